@@ -0,0 +1,177 @@
+using AAXClean.Codecs.FrameFilters.Audio;
+using AAXClean.FrameFilters;
+using Mpeg4Lib.Boxes;
+using System;
+using System.Collections.Generic;
+using System.IO;
+using System.Threading.Tasks;
+
+namespace AAXClean.Codecs.Benchmarks
+{
+	/// <summary>
+	/// The audio every benchmark processes. AAC-LC is a synthetic audiobook generated on first
+	/// use, so the suite runs offline. Other codecs have no encoder in the native library, so
+	/// they are benchmarked only when an environment variable names an unencrypted file with
+	/// that codec, at least <see cref="Duration"/> long.
+	/// </summary>
+	internal static class BenchmarkAudio
+	{
+		/// <summary> Length of audio processed by one benchmark operation. </summary>
+		public static TimeSpan Duration { get; } = TimeSpan.FromMinutes(5);
+
+		public const string AacLc = "aac-lc";
+		private const int DECODE_BATCH_SIZE = 32;
+
+		private static readonly (string codec, string variable)[] CodecFiles =
+		{
+			("usac", "AAXCLEAN_BENCH_USAC"),
+			("e-ac-3", "AAXCLEAN_BENCH_EC3"),
+			("ac-4", "AAXCLEAN_BENCH_AC4"),
+		};
+
+		private static readonly object SyntheticLock = new();
+
+		/// <summary> The codecs with audio available to benchmark. </summary>
+		public static IEnumerable<string> Codecs
+		{
+			get
+			{
+				yield return AacLc;
+				foreach (var (codec, variable) in CodecFiles)
+				{
+					if (File.Exists(Environment.GetEnvironmentVariable(variable)))
+						yield return codec;
+				}
+			}
+		}
+
+		public static string GetPath(string codec)
+		{
+			if (codec == AacLc)
+				return GetSyntheticBook();
+
+			foreach (var (c, variable) in CodecFiles)
+			{
+				if (c == codec)
+					return Environment.GetEnvironmentVariable(variable)!;
+			}
+			throw new ArgumentException($"Unknown codec {codec}", nameof(codec));
+		}
+
+		/// <summary> Path to the synthetic AAC-LC audiobook, creating it if necessary. </summary>
+		public static string GetSyntheticBook()
+		{
+			var path = Path.Combine(Path.GetTempPath(), $"aaxclean-benchmark-{(int)Duration.TotalSeconds}s.m4b");
+			lock (SyntheticLock)
+			{
+				if (!File.Exists(path))
+					SyntheticAudiobook.Create(path, Duration);
+			}
+			return path;
+		}
+
+		/// <summary>
+		/// Speech-like audio: a few harmonics with a syllable-rate envelope and some noise, with
+		/// one second of near-silence every six seconds. Matches the native codec benchmark.
+		/// </summary>
+		public static byte[] GeneratePcm(WaveFormat waveFormat, TimeSpan duration)
+		{
+			int nbSamples = (int)(duration.TotalSeconds * waveFormat.SampleRate);
+			var pcm = new byte[nbSamples * waveFormat.BlockAlign];
+			var samples = System.Runtime.InteropServices.MemoryMarshal.Cast<byte, short>(pcm);
+			uint seed = 12345;
+
+			for (int i = 0; i < nbSamples; i++)
+			{
+				double t = (double)i / waveFormat.SampleRate;
+				double envelope = (long)t % 6 == 5 ? 0.001 : 0.3 * (0.6 + 0.4 * Math.Sin(Math.Tau * 4 * t));
+				double tone = Math.Sin(Math.Tau * 180 * t) + 0.5 * Math.Sin(Math.Tau * 360 * t) + 0.25 * Math.Sin(Math.Tau * 1100 * t);
+
+				for (int c = 0; c < waveFormat.Channels; c++)
+				{
+					seed = seed * 1664525 + 1013904223;
+					double noise = ((int)(seed >> 16) - 32768) / 32768.0 * 0.1;
+					samples[i * waveFormat.Channels + c] = (short)(envelope * (tone + noise) / 1.85 * short.MaxValue);
+				}
+			}
+			return pcm;
+		}
+
+		/// <summary> Read the first <see cref="Duration"/> of compressed audio frames from a file. </summary>
+		public static (AudioSampleEntry sampleEntry, List<FrameEntry> frames) ReadFrames(string codec)
+		{
+			Mp4File mp4File = new(GetPath(codec));
+			try
+			{
+				var sampleRate = FfmpegAacDecoder.GetNativeWaveFormat(mp4File.AudioSampleEntry, WaveFormatEncoding.Pcm).SampleRate;
+				FrameCollector collector = new((long)(Duration.TotalSeconds * sampleRate));
+				FrameTransformBase<FrameEntry, FrameEntry> filter = mp4File.GetAudioFrameFilter();
+				filter.LinkTo(collector);
+
+				mp4File.ProcessAudio(TimeSpan.Zero, TimeSpan.MaxValue, _ => filter.Dispose(), (mp4File.Moov.AudioTrack, filter)).GetAwaiter().GetResult();
+
+				if (!collector.IsFull)
+					throw new InvalidOperationException($"The {codec} benchmark file must be at least {Duration} long.");
+				return (mp4File.AudioSampleEntry, collector.Frames);
+			}
+			finally
+			{
+				mp4File.InputStream.Close();
+			}
+		}
+
+		/// <summary> Decode every frame in batches, the way <see cref="AacToWave"/> does. </summary>
+		/// <param name="consume">Called with each decoded entry before it is released.</param>
+		public static long DecodeAll(FfmpegAacDecoder decoder, List<FrameEntry> frames, Action<WaveEntry>? consume = null)
+		{
+			long nbSamples = 0;
+			Queue<WaveEntry> decoded = new(DECODE_BATCH_SIZE);
+
+			for (int i = 0; i < frames.Count; i += DECODE_BATCH_SIZE)
+			{
+				decoder.DecodeWave(frames.GetRange(i, Math.Min(DECODE_BATCH_SIZE, frames.Count - i)), decoded);
+				while (decoded.TryDequeue(out var wave))
+				{
+					nbSamples += wave.SamplesInFrame;
+					consume?.Invoke(wave);
+					wave.Release();
+				}
+			}
+
+			var flushed = decoder.DecodeFlush();
+			nbSamples += flushed.SamplesInFrame;
+			consume?.Invoke(flushed);
+			flushed.Release();
+			return nbSamples;
+		}
+
+		/// <summary> Copies compressed frames out of the pipeline until it has enough samples. </summary>
+		private sealed class FrameCollector : FrameFinalBase<FrameEntry>
+		{
+			protected override int InputBufferSize => 200;
+			public List<FrameEntry> Frames { get; } = new();
+			public bool IsFull => Samples >= MaxSamples;
+
+			private readonly long MaxSamples;
+			private long Samples;
+
+			public FrameCollector(long maxSamples) => MaxSamples = maxSamples;
+
+			protected override Task PerformFilteringAsync(FrameEntry input)
+			{
+				if (!IsFull)
+				{
+					Frames.Add(new FrameEntry
+					{
+						SamplesInFrame = input.SamplesInFrame,
+						FrameData = input.FrameData.ToArray()
+					});
+					Samples += input.SamplesInFrame;
+				}
+				return Task.CompletedTask;
+			}
+
+			protected override Task FlushAsync() => Task.CompletedTask;
+		}
+	}
+}
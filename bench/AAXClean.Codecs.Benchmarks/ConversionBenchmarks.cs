@@ -0,0 +1,51 @@
+using BenchmarkDotNet.Attributes;
+using System.IO;
+using System.Threading.Tasks;
+
+namespace AAXClean.Codecs.Benchmarks
+{
+	/// <summary> End-to-end conversion of the synthetic audiobook. </summary>
+	public class ConversionBenchmarks
+	{
+		[Params(1, 4)]
+		public int DegreeOfParallelism { get; set; }
+
+		private Mp4File Mp4File = null!;
+		private MemoryStream Output = null!;
+
+		[IterationSetup]
+		public void Open()
+		{
+			Mp4File = new Mp4File(BenchmarkAudio.GetSyntheticBook());
+			Output = new MemoryStream();
+		}
+
+		[IterationCleanup]
+		public void Close()
+		{
+			Mp4File.InputStream.Close();
+			Output.Dispose();
+		}
+
+		[Benchmark]
+		public async Task ConvertToMp3()
+		{
+			var lameConfig = new NAudio.Lame.LameConfig { Preset = NAudio.Lame.LAMEPreset.STANDARD_FAST, Mode = NAudio.Lame.MPEGMode.Mono };
+			await Mp4File.ConvertToMp3Async(Output, lameConfig, degreeOfParallelism: DegreeOfParallelism);
+		}
+
+		[Benchmark]
+		public async Task ConvertToMp4a()
+		{
+			var options = new AacEncodingOptions { BitRate = 64000, Stereo = true };
+			await Mp4File.ConvertToMp4aAsync(Output, options, degreeOfParallelism: DegreeOfParallelism);
+		}
+
+		[Benchmark]
+		public async Task ConvertToMp4aStreamCopy()
+		{
+			var options = new AacEncodingOptions { Stereo = true };
+			await Mp4File.ConvertToMp4aAsync(Output, options, degreeOfParallelism: DegreeOfParallelism);
+		}
+	}
+}
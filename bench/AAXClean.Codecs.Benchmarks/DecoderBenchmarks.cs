@@ -0,0 +1,29 @@
+using AAXClean.Codecs.FrameFilters.Audio;
+using AAXClean.FrameFilters;
+using BenchmarkDotNet.Attributes;
+using Mpeg4Lib.Boxes;
+using System.Collections.Generic;
+
+namespace AAXClean.Codecs.Benchmarks
+{
+	/// <summary> Decoder throughput for each codec, at the codec's native format. </summary>
+	public class DecoderBenchmarks
+	{
+		[ParamsSource(nameof(Codecs))]
+		public string Codec { get; set; } = BenchmarkAudio.AacLc;
+		public static IEnumerable<string> Codecs => BenchmarkAudio.Codecs;
+
+		private AudioSampleEntry SampleEntry = null!;
+		private List<FrameEntry> Frames = null!;
+
+		[GlobalSetup]
+		public void Setup() => (SampleEntry, Frames) = BenchmarkAudio.ReadFrames(Codec);
+
+		[Benchmark]
+		public long Decode()
+		{
+			using FfmpegAacDecoder decoder = new(SampleEntry, WaveFormatEncoding.Pcm);
+			return BenchmarkAudio.DecodeAll(decoder, Frames);
+		}
+	}
+}
@@ -0,0 +1,43 @@
+using AAXClean.Codecs.FrameFilters.Audio;
+using BenchmarkDotNet.Attributes;
+
+namespace AAXClean.Codecs.Benchmarks
+{
+	/// <summary> AAC-LC encoder throughput. </summary>
+	public class EncoderBenchmarks
+	{
+		[Params(1, 2)]
+		public int Channels { get; set; }
+
+		[Params(64000, 128000)]
+		public long BitRate { get; set; }
+
+		private WaveFormat WaveFormat = null!;
+		private byte[] Pcm = null!;
+
+		[GlobalSetup]
+		public void Setup()
+		{
+			WaveFormat = new WaveFormat(SampleRate.Hz_44100, WaveFormatEncoding.Pcm, Channels == 2);
+			Pcm = BenchmarkAudio.GeneratePcm(WaveFormat, BenchmarkAudio.Duration);
+		}
+
+		[Benchmark]
+		public int Encode()
+		{
+			using FfmpegAacEncoder encoder = new(WaveFormat, BitRate, null);
+			WaveEntry input = new()
+			{
+				SamplesInFrame = (uint)(Pcm.Length / WaveFormat.BlockAlign),
+				FrameData = Pcm
+			};
+
+			int nbFrames = 0;
+			foreach (var _ in encoder.EncodeWave(input))
+				nbFrames++;
+			foreach (var _ in encoder.EncodeFlush())
+				nbFrames++;
+			return nbFrames;
+		}
+	}
+}
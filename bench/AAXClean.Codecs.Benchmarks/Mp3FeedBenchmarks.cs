@@ -0,0 +1,43 @@
+using AAXClean.Codecs.FrameFilters.Audio;
+using AAXClean.FrameFilters;
+using BenchmarkDotNet.Attributes;
+using Mpeg4Lib.Boxes;
+using NAudio.Lame;
+using System.Collections.Generic;
+using System.IO;
+
+namespace AAXClean.Codecs.Benchmarks
+{
+	/// <summary>
+	/// AAC-LC to MP3 with LAME fed 16-bit interleaved PCM through its input buffer, relative to
+	/// float-planar audio passed in place.
+	/// </summary>
+	public class Mp3FeedBenchmarks
+	{
+		[Params(false, true)]
+		public bool Stereo { get; set; }
+
+		private AudioSampleEntry SampleEntry = null!;
+		private List<FrameEntry> Frames = null!;
+
+		[GlobalSetup]
+		public void Setup() => (SampleEntry, Frames) = BenchmarkAudio.ReadFrames(BenchmarkAudio.AacLc);
+
+		[Benchmark(Baseline = true)]
+		public long Pcm16Interleaved() => Encode(WaveFormatEncoding.Pcm);
+
+		[Benchmark]
+		public long FloatPlanar() => Encode(WaveFormatEncoding.FloatPlanar);
+
+		private long Encode(WaveFormatEncoding encoding)
+		{
+			using FfmpegAacDecoder decoder = new(SampleEntry, encoding, SampleRate.Hz_44100, Stereo);
+			var lameConfig = new LameConfig { Preset = LAMEPreset.STANDARD_FAST, Mode = Stereo ? MPEGMode.JointStereo : MPEGMode.Mono };
+
+			using var writer = WaveToMp3Filter.CreateWriter(Stream.Null, decoder.WaveFormat, lameConfig);
+			long nbSamples = BenchmarkAudio.DecodeAll(decoder, Frames, wave => WaveToMp3Filter.Write(writer, decoder.WaveFormat, wave));
+			writer.Flush();
+			return nbSamples;
+		}
+	}
+}
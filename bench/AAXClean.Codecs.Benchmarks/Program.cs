@@ -0,0 +1,28 @@
+using BenchmarkDotNet.Configs;
+using BenchmarkDotNet.Diagnosers;
+using BenchmarkDotNet.Exporters.Csv;
+using BenchmarkDotNet.Exporters.Json;
+using BenchmarkDotNet.Running;
+
+namespace AAXClean.Codecs.Benchmarks
+{
+	/// <summary>
+	/// Runs the benchmarks selected on the command line, e.g. <c>--filter *Decoder*</c>.
+	/// Results are written to BenchmarkDotNet.Artifacts/results as JSON and CSV for tracking
+	/// regressions.
+	/// </summary>
+	public static class Program
+	{
+		public static void Main(string[] args)
+		{
+			var config
+				= DefaultConfig.Instance
+				.AddColumn(new RealtimeFactorColumn())
+				.AddDiagnoser(MemoryDiagnoser.Default)
+				.AddExporter(JsonExporter.Full)
+				.AddExporter(CsvMeasurementsExporter.Default);
+
+			BenchmarkSwitcher.FromAssembly(typeof(Program).Assembly).Run(args, config);
+		}
+	}
+}
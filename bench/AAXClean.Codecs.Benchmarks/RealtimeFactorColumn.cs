@@ -0,0 +1,36 @@
+using BenchmarkDotNet.Columns;
+using BenchmarkDotNet.Reports;
+using BenchmarkDotNet.Running;
+
+namespace AAXClean.Codecs.Benchmarks
+{
+	/// <summary>
+	/// Seconds of audio processed per second. Every benchmark operation processes
+	/// <see cref="BenchmarkAudio.Duration"/> of audio.
+	/// </summary>
+	internal sealed class RealtimeFactorColumn : IColumn
+	{
+		public string Id => nameof(RealtimeFactorColumn);
+		public string ColumnName => "Realtime";
+		public bool AlwaysShow => true;
+		public ColumnCategory Category => ColumnCategory.Custom;
+		public int PriorityInCategory => 0;
+		public bool IsNumeric => true;
+		public UnitType UnitType => UnitType.Dimensionless;
+		public string Legend => "Seconds of audio processed per second";
+
+		public string GetValue(Summary summary, BenchmarkCase benchmarkCase)
+		{
+			var statistics = summary[benchmarkCase]?.ResultStatistics;
+			if (statistics is null || statistics.Mean <= 0)
+				return "NA";
+
+			//Mean is in nanoseconds.
+			return (BenchmarkAudio.Duration.TotalSeconds / (statistics.Mean / 1e9)).ToString("F1");
+		}
+
+		public string GetValue(Summary summary, BenchmarkCase benchmarkCase, SummaryStyle style) => GetValue(summary, benchmarkCase);
+		public bool IsDefault(Summary summary, BenchmarkCase benchmarkCase) => false;
+		public bool IsAvailable(Summary summary) => true;
+	}
+}
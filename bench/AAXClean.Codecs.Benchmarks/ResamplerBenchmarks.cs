@@ -0,0 +1,49 @@
+using AAXClean.Codecs.FrameFilters.Audio;
+using AAXClean.FrameFilters;
+using BenchmarkDotNet.Attributes;
+using Mpeg4Lib.Boxes;
+using System.Collections.Generic;
+
+namespace AAXClean.Codecs.Benchmarks
+{
+	/// <summary>
+	/// Cost of converting decoded AAC-LC to each output format, relative to decoding at the
+	/// native format, which bypasses the resampler. The native library's codec_benchmark also
+	/// covers float and planar output.
+	/// </summary>
+	public class ResamplerBenchmarks
+	{
+		private AudioSampleEntry SampleEntry = null!;
+		private List<FrameEntry> Frames = null!;
+
+		[GlobalSetup]
+		public void Setup() => (SampleEntry, Frames) = BenchmarkAudio.ReadFrames(BenchmarkAudio.AacLc);
+
+		[Benchmark(Baseline = true)]
+		public long Native_44100_Stereo() => Decode(SampleRate.Hz_44100, stereo: true);
+
+		[Benchmark]
+		public long Downmix_44100_Mono() => Decode(SampleRate.Hz_44100, stereo: false);
+
+		[Benchmark]
+		public long Resample_22050_Stereo() => Decode(SampleRate.Hz_22050, stereo: true);
+
+		[Benchmark]
+		public long Resample_22050_Mono() => Decode(SampleRate.Hz_22050, stereo: false);
+
+		[Benchmark]
+		public long Resample_22050_Mono_Fast() => Decode(SampleRate.Hz_22050, stereo: false, ResampleQuality.Fast);
+
+		[Benchmark]
+		public long Resample_22050_Mono_High() => Decode(SampleRate.Hz_22050, stereo: false, ResampleQuality.High);
+
+		[Benchmark]
+		public long Resample_16000_Mono() => Decode(SampleRate.Hz_16000, stereo: false);
+
+		private long Decode(SampleRate sampleRate, bool stereo, ResampleQuality resampleQuality = ResampleQuality.Default)
+		{
+			using FfmpegAacDecoder decoder = new(SampleEntry, WaveFormatEncoding.Pcm, sampleRate, stereo, resampleQuality);
+			return BenchmarkAudio.DecodeAll(decoder, Frames);
+		}
+	}
+}
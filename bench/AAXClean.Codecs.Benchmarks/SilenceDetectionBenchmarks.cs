@@ -0,0 +1,29 @@
+using BenchmarkDotNet.Attributes;
+using System;
+using System.Threading.Tasks;
+
+namespace AAXClean.Codecs.Benchmarks
+{
+	/// <summary> End-to-end silence detection on the synthetic audiobook. </summary>
+	public class SilenceDetectionBenchmarks
+	{
+		private const double Decibels = -30;
+		private static readonly TimeSpan MinDuration = TimeSpan.FromSeconds(0.25);
+
+		private Mp4File Mp4File = null!;
+
+		[IterationSetup]
+		public void Open() => Mp4File = new Mp4File(BenchmarkAudio.GetSyntheticBook());
+
+		[IterationCleanup]
+		public void Close() => Mp4File.InputStream.Close();
+
+		[Benchmark(Baseline = true)]
+		public async Task<int> DetectSilence()
+			=> (await Mp4File.DetectSilenceAsync(Decibels, MinDuration))?.Count ?? 0;
+
+		[Benchmark]
+		public async Task<int> DetectSilenceFast()
+			=> (await Mp4File.DetectSilenceFastAsync(Decibels, MinDuration))?.Count ?? 0;
+	}
+}
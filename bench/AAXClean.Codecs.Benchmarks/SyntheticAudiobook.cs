@@ -0,0 +1,156 @@
+using AAXClean.Codecs.FrameFilters.Audio;
+using System;
+using System.Buffers.Binary;
+using System.Collections.Generic;
+using System.IO;
+using System.Linq;
+using System.Text;
+
+namespace AAXClean.Codecs.Benchmarks
+{
+	/// <summary>
+	/// Writes a minimal AAC-LC m4b of generated audio: ftyp, mdat, then a moov with one
+	/// audio track and a title.
+	/// </summary>
+	internal static class SyntheticAudiobook
+	{
+		private const int FRAMES_PER_CHUNK = 20;
+		private const int AAC_FRAME_SIZE = 1024;
+		private const int BIT_RATE = 64000;
+
+		public static void Create(string path, TimeSpan duration)
+		{
+			WaveFormat waveFormat = new(SampleRate.Hz_44100, WaveFormatEncoding.Pcm, stereo: true);
+			byte[] pcm = BenchmarkAudio.GeneratePcm(waveFormat, duration);
+
+			List<byte[]> frames = new();
+			byte[] asc;
+			using (FfmpegAacEncoder encoder = new(waveFormat, BIT_RATE, null))
+			{
+				WaveEntry input = new()
+				{
+					SamplesInFrame = (uint)(pcm.Length / waveFormat.BlockAlign),
+					FrameData = pcm
+				};
+				//Encoded frames are only valid until the enumeration advances.
+				frames.AddRange(encoder.EncodeWave(input).Select(f => f.FrameData.ToArray()));
+				frames.AddRange(encoder.EncodeFlush().Select(f => f.FrameData.ToArray()));
+				asc = encoder.GetAudioSpecificConfig();
+			}
+
+			var tempPath = path + ".tmp";
+			using (var file = File.Create(tempPath))
+			{
+				byte[] ftyp = Box("ftyp", Str("M4B "), U32(0), Str("M4B "), Str("M4A "), Str("mp42"), Str("isom"));
+				file.Write(ftyp);
+
+				long mdatSize = 8 + frames.Sum(f => (long)f.Length);
+				file.Write(U32((uint)mdatSize));
+				file.Write(Str("mdat"));
+
+				List<uint> chunkOffsets = new();
+				long offset = ftyp.Length + 8;
+				for (int i = 0; i < frames.Count; i++)
+				{
+					if (i % FRAMES_PER_CHUNK == 0)
+						chunkOffsets.Add((uint)offset);
+					file.Write(frames[i]);
+					offset += frames[i].Length;
+				}
+
+				file.Write(Moov(waveFormat, asc, frames, chunkOffsets));
+			}
+			File.Move(tempPath, path, overwrite: true);
+		}
+
+		private static byte[] Moov(WaveFormat waveFormat, byte[] asc, List<byte[]> frames, List<uint> chunkOffsets)
+		{
+			uint timescale = (uint)waveFormat.SampleRate;
+			uint duration = (uint)(frames.Count * AAC_FRAME_SIZE);
+			byte[] matrix = Concat(U32(0x00010000), U32(0), U32(0), U32(0), U32(0x00010000), U32(0), U32(0), U32(0), U32(0x40000000));
+
+			var mvhd = FullBox("mvhd", 0, 0, U32(0), U32(0), U32(timescale), U32(duration), U32(0x00010000), U16(0x0100), Zeros(10), matrix, Zeros(24), U32(2));
+			var tkhd = FullBox("tkhd", 0, 3, U32(0), U32(0), U32(1), U32(0), U32(duration), Zeros(8), U16(0), U16(0), U16(0x0100), U16(0), matrix, U32(0), U32(0));
+			var mdhd = FullBox("mdhd", 0, 0, U32(0), U32(0), U32(timescale), U32(duration), U16(0x55C4), U16(0));
+			var hdlr = FullBox("hdlr", 0, 0, U32(0), Str("soun"), Zeros(12), Str("SoundHandler\0"));
+			var smhd = FullBox("smhd", 0, 0, U16(0), U16(0));
+			var dinf = Box("dinf", FullBox("dref", 0, 0, U32(1), FullBox("url ", 0, 1)));
+
+			int maxFrameSize = frames.Max(f => f.Length);
+			var esds = FullBox("esds", 0, 0,
+				Descriptor(3, U16(1), U8(0),
+					Descriptor(4, U8(0x40), U8(0x15), U24((uint)maxFrameSize), U32((uint)(maxFrameSize * 8 * waveFormat.SampleRate / AAC_FRAME_SIZE)), U32(BIT_RATE),
+						Descriptor(5, asc)),
+					Descriptor(6, U8(2))));
+			var mp4a = Box("mp4a", Zeros(6), U16(1), Zeros(8), U16((ushort)waveFormat.Channels), U16(16), U16(0), U16(0), U32(timescale << 16), esds);
+
+			int fullChunks = frames.Count / FRAMES_PER_CHUNK;
+			int lastChunkFrames = frames.Count % FRAMES_PER_CHUNK;
+			List<byte[]> stscEntries = new();
+			if (fullChunks > 0)
+				stscEntries.Add(Concat(U32(1), U32(FRAMES_PER_CHUNK), U32(1)));
+			if (lastChunkFrames > 0)
+				stscEntries.Add(Concat(U32((uint)fullChunks + 1), U32((uint)lastChunkFrames), U32(1)));
+
+			var stbl = Box("stbl",
+				FullBox("stsd", 0, 0, U32(1), mp4a),
+				FullBox("stts", 0, 0, U32(1), U32((uint)frames.Count), U32(AAC_FRAME_SIZE)),
+				FullBox("stsc", 0, 0, [U32((uint)stscEntries.Count), .. stscEntries]),
+				FullBox("stsz", 0, 0, [U32(0), U32((uint)frames.Count), .. frames.Select(f => U32((uint)f.Length))]),
+				FullBox("stco", 0, 0, [U32((uint)chunkOffsets.Count), .. chunkOffsets.Select(U32)]));
+
+			var trak = Box("trak", tkhd, Box("mdia", mdhd, hdlr, Box("minf", smhd, dinf, stbl)));
+
+			var ilst = Box("ilst", Box("©nam", FullBox("data", 0, 1, U32(0), Str("Synthetic Benchmark Audio"))));
+			var udta = Box("udta", FullBox("meta", 0, 0, FullBox("hdlr", 0, 0, U32(0), Str("mdir"), Str("appl"), Zeros(8), U8(0)), ilst));
+
+			return Box("moov", mvhd, trak, udta);
+		}
+
+		private static byte[] Box(string type, params byte[][] contents)
+		{
+			var box = new byte[8 + contents.Sum(c => c.Length)];
+			BinaryPrimitives.WriteUInt32BigEndian(box, (uint)box.Length);
+			Encoding.Latin1.GetBytes(type, box.AsSpan(4, 4));
+			int offset = 8;
+			foreach (var c in contents)
+			{
+				c.CopyTo(box, offset);
+				offset += c.Length;
+			}
+			return box;
+		}
+
+		private static byte[] FullBox(string type, byte version, uint flags, params byte[][] contents)
+			=> Box(type, [U32((uint)version << 24 | flags), .. contents]);
+
+		/// <summary> An MPEG-4 descriptor, with its size in the 4-byte form Audible files use. </summary>
+		private static byte[] Descriptor(byte tag, params byte[][] contents)
+		{
+			byte[] body = Concat(contents);
+			int size = body.Length;
+			return Concat([tag, (byte)(0x80 | (size >> 21) & 0x7f), (byte)(0x80 | (size >> 14) & 0x7f), (byte)(0x80 | (size >> 7) & 0x7f), (byte)(size & 0x7f)], body);
+		}
+
+		private static byte[] Concat(params byte[][] parts) => parts.SelectMany(p => p).ToArray();
+		private static byte[] Str(string value) => Encoding.Latin1.GetBytes(value);
+		private static byte[] Zeros(int count) => new byte[count];
+		private static byte[] U8(byte value) => [value];
+
+		private static byte[] U16(ushort value)
+		{
+			var bytes = new byte[2];
+			BinaryPrimitives.WriteUInt16BigEndian(bytes, value);
+			return bytes;
+		}
+
+		private static byte[] U24(uint value) => U32(value)[1..];
+
+		private static byte[] U32(uint value)
+		{
+			var bytes = new byte[4];
+			BinaryPrimitives.WriteUInt32BigEndian(bytes, value);
+			return bytes;
+		}
+	}
+}
@@ -6,5 +6,21 @@
 		public bool? Stereo { get; set; }
 		public double? EncoderQuality { get; set; }
 		public long? BitRate { get; set; }
+		/// <summary> Resampling filter used if <see cref="SampleRate"/> differs from the source's. </summary>
+		public ResampleQuality ResampleQuality { get; set; }
+		/// <summary>
+		/// Gain applied to the decoded audio before it is encoded, e.g. from <see cref="LoudnessInfo.GetNormalizationGain"/>.
+		/// Any gain other than 0 re-encodes the audio.
+		/// </summary>
+		public double GainDecibels { get; set; }
+		/// <summary>
+		/// Copy AAC-LC audio without re-encoding when the source already has the requested sample rate
+		/// and channel count, and no more than the requested <see cref="BitRate"/>. Multipart conversions
+		/// re-encode only the first few frames of each chapter so the splice decodes cleanly, and add an
+		/// edit list so players skip the encoder's priming. Chapter streams that aren't readable and
+		/// seekable can't take the edit list, so they are copied without the splice.
+		/// Off by default. A copy ignores the degree of parallelism and decode cache it is given.
+		/// </summary>
+		public bool AllowStreamCopy { get; set; }
 	}
 }
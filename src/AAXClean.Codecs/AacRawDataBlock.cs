@@ -0,0 +1,167 @@
+using System;
+
+namespace AAXClean.Codecs;
+
+/// <summary>
+/// Reads the first channel's quantiser settings from an AAC-LC raw_data_block
+/// (ISO/IEC 14496-3 4.4.2) without decoding any spectral data.
+/// </summary>
+internal static class AacRawDataBlock
+{
+	private const int ID_SCE = 0;
+	private const int ID_CPE = 1;
+	private const int ID_LFE = 3;
+	private const int ID_DSE = 4;
+	private const int ID_FIL = 6;
+	private const int EIGHT_SHORT_SEQUENCE = 2;
+	private const int ZERO_HCB = 0;
+
+	/// <summary>
+	/// Decibels per global_gain step. Each step scales the quantiser by 2^(1/4).
+	/// </summary>
+	public const double DecibelsPerGainStep = 1.5051499783199060;
+
+	/// <summary> True if a raw_data_block from this audio object type starts with AAC-LC elements. </summary>
+	public static bool IsSupported(int audioObjectType)
+		=> audioObjectType is 2 or 5 or 29;
+
+	/// <summary>
+	/// Read the global_gain of the first channel in the frame and whether that channel
+	/// codes any spectral data at all.
+	/// </summary>
+	/// <returns>False if the frame does not start with a single channel, channel pair or LFE element.</returns>
+	public static bool TryReadGlobalGain(ReadOnlySpan<byte> frame, out int globalGain, out bool hasSpectrum)
+	{
+		globalGain = 0;
+		hasSpectrum = true;
+		var reader = new BitReader(frame);
+
+		int id;
+		while ((id = reader.Read(3)) is ID_DSE or ID_FIL)
+		{
+			if (id == ID_DSE)
+			{
+				reader.Skip(4);
+				bool byteAlign = reader.Read(1) == 1;
+				int count = reader.Read(8);
+				if (count == 255) count += reader.Read(8);
+				if (byteAlign) reader.ByteAlign();
+				reader.Skip(count * 8);
+			}
+			else
+			{
+				int count = reader.Read(4);
+				if (count == 15) count += reader.Read(8) - 1;
+				reader.Skip(count * 8);
+			}
+		}
+
+		if (id is not (ID_SCE or ID_CPE or ID_LFE))
+			return false;
+
+		reader.Skip(4); //element_instance_tag
+
+		IcsInfo info = default;
+		bool commonWindow = id == ID_CPE && reader.Read(1) == 1;
+		if (commonWindow)
+		{
+			if (!TryReadIcsInfo(ref reader, out info))
+				return false;
+
+			int msMaskPresent = reader.Read(2);
+			if (msMaskPresent == 1)
+				reader.Skip(info.NumWindowGroups * info.MaxSfb);
+		}
+
+		globalGain = reader.Read(8);
+		if (!commonWindow && !TryReadIcsInfo(ref reader, out info))
+			return false;
+
+		hasSpectrum = false;
+		int sectBits = info.IsShort ? 3 : 5;
+		int sectEsc = (1 << sectBits) - 1;
+		for (int g = 0; g < info.NumWindowGroups && !hasSpectrum; g++)
+		{
+			int k = 0;
+			while (k < info.MaxSfb)
+			{
+				int codebook = reader.Read(4);
+				int length = 0, increment;
+				while ((increment = reader.Read(sectBits)) == sectEsc)
+					length += sectEsc;
+				length += increment;
+
+				if (length == 0 || reader.Overrun)
+					return false;
+				if (codebook != ZERO_HCB)
+				{
+					hasSpectrum = true;
+					break;
+				}
+				k += length;
+			}
+		}
+
+		return !reader.Overrun;
+	}
+
+	private static bool TryReadIcsInfo(ref BitReader reader, out IcsInfo info)
+	{
+		info = default;
+		reader.Skip(1); //ics_reserved_bit
+		int windowSequence = reader.Read(2);
+		reader.Skip(1); //window_shape
+
+		if (windowSequence == EIGHT_SHORT_SEQUENCE)
+		{
+			info.IsShort = true;
+			info.MaxSfb = reader.Read(4);
+			int grouping = reader.Read(7);
+			info.NumWindowGroups = 1;
+			for (int i = 0; i < 7; i++)
+			{
+				if ((grouping & (1 << i)) == 0)
+					info.NumWindowGroups++;
+			}
+		}
+		else
+		{
+			info.MaxSfb = reader.Read(6);
+			info.NumWindowGroups = 1;
+			//Prediction is only used by AAC Main and LTP.
+			if (reader.Read(1) == 1)
+				return false;
+		}
+		return !reader.Overrun;
+	}
+
+	private struct IcsInfo
+	{
+		public bool IsShort;
+		public int MaxSfb;
+		public int NumWindowGroups;
+	}
+
+	private ref struct BitReader
+	{
+		private readonly ReadOnlySpan<byte> Data;
+		private int Position;
+		public readonly bool Overrun => Position > Data.Length * 8;
+
+		public BitReader(ReadOnlySpan<byte> data) => Data = data;
+
+		public int Read(int numBits)
+		{
+			int value = 0;
+			for (int i = 0; i < numBits; i++, Position++)
+			{
+				int bit = Position < Data.Length * 8 ? (Data[Position >> 3] >> (7 - (Position & 7))) & 1 : 0;
+				value = (value << 1) | bit;
+			}
+			return value;
+		}
+
+		public void Skip(int numBits) => Position += numBits;
+		public void ByteAlign() => Position = (Position + 7) & ~7;
+	}
+}
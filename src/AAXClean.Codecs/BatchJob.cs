@@ -0,0 +1,89 @@
+﻿using Mpeg4Lib;
+using NAudio.Lame;
+using System;
+using System.Collections.Generic;
+using System.IO;
+using System.Threading;
+using System.Threading.Tasks;
+
+namespace AAXClean.Codecs
+{
+	/// <summary> A conversion or analysis of one <see cref="AAXClean.Mp4File"/>, run by <see cref="BatchProcessor"/>. </summary>
+	public class BatchJob
+	{
+		public Mp4File Mp4File { get; }
+		/// <summary> Name to identify the job in its <see cref="BatchJobResult"/>. </summary>
+		public string? Name { get; set; }
+		/// <summary> Length of the audio the job processes. Longer jobs are started first. </summary>
+		public TimeSpan AudioDuration { get; }
+		/// <summary> Most cores the job can use. A job is given its cores from those free when it starts and keeps them until it completes. </summary>
+		public int MaxDegreeOfParallelism { get; }
+
+		private readonly Func<int, CancellationToken, Task> Run;
+
+		private BatchJob(Mp4File mp4File, TimeSpan audioDuration, int maxDegreeOfParallelism, Func<int, CancellationToken, Task> run)
+		{
+			ArgumentNullException.ThrowIfNull(mp4File, nameof(mp4File));
+			if (maxDegreeOfParallelism < 1) throw new ArgumentOutOfRangeException(nameof(maxDegreeOfParallelism), "must be at least 1");
+
+			Mp4File = mp4File;
+			AudioDuration = audioDuration;
+			MaxDegreeOfParallelism = maxDegreeOfParallelism;
+			Run = run;
+		}
+
+		/// <summary> Run the job, cancelling its operation if <paramref name="cancellationToken"/> is cancelled. </summary>
+		internal Task RunAsync(int degreeOfParallelism, CancellationToken cancellationToken) => Run(degreeOfParallelism, cancellationToken);
+
+		/// <summary> Convert to a single MP3 file with <see cref="Mp4FileExtensions.ConvertToMp3Async"/>. </summary>
+		/// <param name="maxDegreeOfParallelism">Segments the job may encode concurrently. Above 1, the MP3 may be encoded without the bit reservoir.</param>
+		public static BatchJob ConvertToMp3(Mp4File mp4File, Stream outputStream, LameConfig? lameConfig = null, ChapterInfo? userChapters = null, int maxDegreeOfParallelism = 1)
+			=> new(mp4File, GetDuration(mp4File, userChapters), maxDegreeOfParallelism,
+				(dop, ct) => RunOperationAsync(mp4File.ConvertToMp3Async(outputStream, lameConfig, userChapters, dop), ct));
+
+		/// <summary> Convert to a single M4B file with <see cref="Mp4FileExtensions.ConvertToMp4aAsync"/>. </summary>
+		/// <param name="maxDegreeOfParallelism">Segments the job may encode concurrently. At 1, the audio may be transcoded without a separate decoder.</param>
+		public static BatchJob ConvertToMp4a(Mp4File mp4File, Stream outputStream, AacEncodingOptions options, ChapterInfo? userChapters = null, int maxDegreeOfParallelism = int.MaxValue)
+			=> new(mp4File, GetDuration(mp4File, userChapters), maxDegreeOfParallelism,
+				(dop, ct) => RunOperationAsync(mp4File.ConvertToMp4aAsync(outputStream, options, userChapters, dop), ct));
+
+		/// <summary> Split into one MP3 file per chapter with <see cref="Mp4FileExtensions.ConvertToMultiMp3Async"/>. </summary>
+		public static BatchJob ConvertToMultiMp3(Mp4File mp4File, ChapterInfo userChapters, Action<NewMP3SplitCallback> newFileCallback, LameConfig? lameConfig = null, int maxDegreeOfParallelism = int.MaxValue)
+			=> new(mp4File, GetDuration(mp4File, userChapters), maxDegreeOfParallelism,
+				(dop, ct) => RunOperationAsync(mp4File.ConvertToMultiMp3Async(userChapters, newFileCallback, lameConfig, dop), ct));
+
+		/// <summary> Split into one M4B file per chapter with <see cref="Mp4FileExtensions.ConvertToMultiMp4aAsync"/>. </summary>
+		public static BatchJob ConvertToMultiMp4a(Mp4File mp4File, ChapterInfo userChapters, Action<NewAacSplitCallback> newFileCallback, AacEncodingOptions options, int maxDegreeOfParallelism = int.MaxValue)
+			=> new(mp4File, GetDuration(mp4File, userChapters), maxDegreeOfParallelism,
+				(dop, ct) => RunOperationAsync(mp4File.ConvertToMultiMp4aAsync(userChapters, newFileCallback, options, dop), ct));
+
+		/// <summary> Detect silence with <see cref="Mp4FileExtensions.DetectSilenceAsync(Mp4File, double, TimeSpan, Action{SilenceDetectCallback}?, DecodeCache?)"/>. </summary>
+		/// <param name="silencesFound">Receives the silences once the job completes.</param>
+		public static BatchJob DetectSilence(Mp4File mp4File, double decibels, TimeSpan minDuration, Action<List<SilenceEntry>> silencesFound)
+		{
+			ArgumentNullException.ThrowIfNull(silencesFound, nameof(silencesFound));
+			return new(mp4File, mp4File.Duration, 1, async (_, ct) =>
+			{
+				var operation = mp4File.DetectSilenceAsync(decibels, minDuration);
+				List<SilenceEntry>? silences;
+				using (ct.Register(() => operation.CancelAsync()))
+					silences = await operation;
+
+				ct.ThrowIfCancellationRequested();
+				if (silences is not null)
+					silencesFound(silences);
+			});
+		}
+
+		private static async Task RunOperationAsync(Mp4Operation operation, CancellationToken cancellationToken)
+		{
+			using (cancellationToken.Register(() => operation.CancelAsync()))
+				await operation;
+
+			cancellationToken.ThrowIfCancellationRequested();
+		}
+
+		private static TimeSpan GetDuration(Mp4File mp4File, ChapterInfo? userChapters)
+			=> userChapters is null ? mp4File.Duration : userChapters.EndOffset - userChapters.StartOffset;
+	}
+}
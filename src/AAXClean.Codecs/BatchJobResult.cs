@@ -0,0 +1,31 @@
+﻿using System;
+
+namespace AAXClean.Codecs
+{
+	/// <summary> Outcome and speed of one <see cref="BatchJob"/>. </summary>
+	public class BatchJobResult
+	{
+		public BatchJob Job { get; }
+		/// <summary> Cores the job was given, passed to its conversion as the degree of parallelism. </summary>
+		public int Cores { get; }
+		/// <summary> Time from the job starting to it completing. </summary>
+		public TimeSpan Elapsed { get; }
+		/// <summary> The exception the job failed with, or null if it succeeded. </summary>
+		public Exception? Error { get; }
+		/// <summary> Audio processed per unit of wall-clock time. </summary>
+		public double RealtimeFactor => Elapsed > TimeSpan.Zero ? Job.AudioDuration / Elapsed : 0;
+
+		internal BatchJobResult(BatchJob job, int cores, TimeSpan elapsed, Exception? error)
+		{
+			Job = job;
+			Cores = cores;
+			Elapsed = elapsed;
+			Error = error;
+		}
+
+		public override string ToString()
+		{
+			return $"[{Job.Name ?? "Job"}: {Job.AudioDuration} in {Elapsed} on {Cores} cores, {RealtimeFactor:F1}x realtime{(Error is null ? "" : ", failed")}]";
+		}
+	}
+}
@@ -0,0 +1,102 @@
+﻿using System;
+using System.Collections.Generic;
+using System.Diagnostics;
+using System.Linq;
+using System.Threading;
+using System.Threading.Tasks;
+
+namespace AAXClean.Codecs
+{
+	/// <summary>
+	/// Runs many <see cref="BatchJob"/>s at once within a shared budget of cores and decoded-audio
+	/// memory, so that a library's worth of conversions doesn't oversubscribe the machine.
+	/// </summary>
+	/// <remarks>
+	/// Jobs are started longest first, so the batch doesn't end waiting on a long job started last.
+	/// Every running job is given at least one core, and the cores given to running jobs never
+	/// exceed <see cref="MaxCores"/>. A job's cores are its conversion's degree of parallelism,
+	/// whose segment and chapter encoders run on the shared thread pool. While jobs are waiting,
+	/// free cores are shared among the jobs that can start, so the short jobs at the end of a batch
+	/// use the cores the long jobs leave idle. Each running job may hold up to
+	/// <see cref="PcmMemory.PipelineLimit"/> of decoded audio, so at most <see cref="MemoryLimit"/>
+	/// divided by that many jobs run at once.
+	/// </remarks>
+	public class BatchProcessor
+	{
+		public int MaxCores { get; }
+		public long MemoryLimit { get; }
+
+		/// <param name="maxCores">Most cores running jobs may use together. Defaults to the processor count.</param>
+		/// <param name="memoryLimit">Most decoded audio, in bytes, running jobs may hold together. Defaults to <see cref="PcmMemory.ProcessLimit"/>.</param>
+		public BatchProcessor(int maxCores = 0, long memoryLimit = 0)
+		{
+			ArgumentOutOfRangeException.ThrowIfNegative(maxCores, nameof(maxCores));
+			ArgumentOutOfRangeException.ThrowIfNegative(memoryLimit, nameof(memoryLimit));
+
+			MaxCores = maxCores == 0 ? Environment.ProcessorCount : maxCores;
+			MemoryLimit = memoryLimit == 0 ? PcmMemory.ProcessLimit : memoryLimit;
+		}
+
+		/// <summary>
+		/// Run every job. A job that fails doesn't stop the others; its exception is in its <see cref="BatchJobResult"/>.
+		/// </summary>
+		/// <param name="jobCompleted">Called with each job's result as it completes.</param>
+		/// <param name="cancellationToken">Cancels the running jobs and starts no more.</param>
+		public async Task<BatchResult> RunAsync(IEnumerable<BatchJob> jobs, Action<BatchJobResult>? jobCompleted = null, CancellationToken cancellationToken = default)
+		{
+			ArgumentNullException.ThrowIfNull(jobs, nameof(jobs));
+
+			Queue<BatchJob> waiting = new(jobs.OrderByDescending(j => j.AudioDuration));
+			int maxRunning = (int)Math.Clamp(MemoryLimit / PcmMemory.PipelineLimit, 1, MaxCores);
+			Dictionary<Task<BatchJobResult>, int> running = new();
+			List<BatchJobResult> results = new();
+			int freeCores = MaxCores;
+			long batchStart = Stopwatch.GetTimestamp();
+
+			try
+			{
+				while (running.Count > 0 || (waiting.Count > 0 && !cancellationToken.IsCancellationRequested))
+				{
+					while (waiting.Count > 0 && running.Count < maxRunning && freeCores > 0 && !cancellationToken.IsCancellationRequested)
+					{
+						var job = waiting.Dequeue();
+						int jobsAlongside = Math.Min(waiting.Count, maxRunning - running.Count - 1);
+						int cores = Math.Clamp(freeCores / (jobsAlongside + 1), 1, job.MaxDegreeOfParallelism);
+						freeCores -= cores;
+						running.Add(RunJobAsync(job, cores, cancellationToken), cores);
+					}
+
+					var completed = await Task.WhenAny(running.Keys);
+					freeCores += running[completed];
+					running.Remove(completed);
+
+					var result = await completed;
+					results.Add(result);
+					jobCompleted?.Invoke(result);
+				}
+			}
+			finally
+			{
+				await Task.WhenAll(running.Keys);
+			}
+
+			cancellationToken.ThrowIfCancellationRequested();
+			return new BatchResult(results, Stopwatch.GetElapsedTime(batchStart));
+		}
+
+		private static async Task<BatchJobResult> RunJobAsync(BatchJob job, int cores, CancellationToken cancellationToken)
+		{
+			long start = Stopwatch.GetTimestamp();
+			try
+			{
+				//Start the job's filters off the scheduling loop.
+				await Task.Run(() => job.RunAsync(cores, cancellationToken), CancellationToken.None);
+				return new BatchJobResult(job, cores, Stopwatch.GetElapsedTime(start), null);
+			}
+			catch (Exception ex)
+			{
+				return new BatchJobResult(job, cores, Stopwatch.GetElapsedTime(start), ex);
+			}
+		}
+	}
+}
@@ -0,0 +1,32 @@
+﻿using System;
+using System.Collections.Generic;
+using System.Linq;
+
+namespace AAXClean.Codecs
+{
+	/// <summary> Outcome and aggregate speed of a <see cref="BatchProcessor"/> run. </summary>
+	public class BatchResult
+	{
+		/// <summary> Results of every job that ran, in the order they completed. </summary>
+		public IReadOnlyList<BatchJobResult> Jobs { get; }
+		/// <summary> Time from the first job starting to the last completing. </summary>
+		public TimeSpan Elapsed { get; }
+		/// <summary> Audio processed by all jobs that succeeded. </summary>
+		public TimeSpan AudioDuration { get; }
+		/// <summary> Audio processed by all jobs that succeeded, per unit of wall-clock time. </summary>
+		public double RealtimeFactor => Elapsed > TimeSpan.Zero ? AudioDuration / Elapsed : 0;
+		public int FailedCount => Jobs.Count(j => j.Error is not null);
+
+		internal BatchResult(IReadOnlyList<BatchJobResult> jobs, TimeSpan elapsed)
+		{
+			Jobs = jobs;
+			Elapsed = elapsed;
+			AudioDuration = jobs.Where(j => j.Error is null).Aggregate(TimeSpan.Zero, (sum, j) => sum + j.Job.AudioDuration);
+		}
+
+		public override string ToString()
+		{
+			return $"[{Jobs.Count} jobs ({FailedCount} failed): {AudioDuration} in {Elapsed}, {RealtimeFactor:F1}x realtime]";
+		}
+	}
+}
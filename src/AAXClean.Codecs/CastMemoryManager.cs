@@ -0,0 +1,27 @@
+﻿using System;
+using System.Buffers;
+using System.Runtime.CompilerServices;
+using System.Runtime.InteropServices;
+
+namespace AAXClean.Codecs
+{
+	/// <summary> Views decoded bytes as samples of another type without copying them. </summary>
+	internal sealed class CastMemoryManager<T> : MemoryManager<T> where T : unmanaged
+	{
+		private readonly Memory<byte> Bytes;
+
+		public CastMemoryManager(Memory<byte> bytes)
+		{
+			Bytes = bytes;
+		}
+
+		public override Span<T> GetSpan() => MemoryMarshal.Cast<byte, T>(Bytes.Span);
+
+		public override MemoryHandle Pin(int elementIndex = 0)
+			=> Bytes.Slice(elementIndex * Unsafe.SizeOf<T>()).Pin();
+
+		public override void Unpin() { }
+
+		protected override void Dispose(bool disposing) { }
+	}
+}
@@ -0,0 +1,105 @@
+﻿using AAXClean.Codecs.Interop;
+using System.Collections.Generic;
+using System.Diagnostics;
+using System.Diagnostics.Metrics;
+
+namespace AAXClean.Codecs
+{
+	/// <summary>
+	/// Instruments published through <see cref="System.Diagnostics.Metrics"/>. Collect them with
+	/// dotnet-counters, OpenTelemetry or a <see cref="MeterListener"/> subscribed to <see cref="MeterName"/>.
+	/// </summary>
+	/// <remarks>
+	/// Codec instruments are tagged with <c>aaxclean.operation</c> ("decode" or "encode") and, for counts,
+	/// <c>aaxclean.direction</c> ("in" or "out"). Codec time is tagged with <c>aaxclean.stage</c>: "send"
+	/// and "receive" are time inside FFmpeg's codec, "convert" is resampling and sample format conversion.
+	/// Filter instruments are tagged with <c>aaxclean.filter</c>, the filter's class name.
+	/// </remarks>
+	public static class CodecMetrics
+	{
+		public const string MeterName = "AAXClean.Codecs";
+
+		private static readonly Meter Meter = new(MeterName, typeof(CodecMetrics).Assembly.GetName().Version?.ToString());
+
+		private static readonly Counter<long> Frames = Meter.CreateCounter<long>("aaxclean.codec.frames", "{frame}", "Compressed frames sent to or received from a codec.");
+		private static readonly Counter<long> Samples = Meter.CreateCounter<long>("aaxclean.codec.samples", "{sample}", "Audio samples per channel into and out of a codec.");
+		private static readonly Counter<long> Bytes = Meter.CreateCounter<long>("aaxclean.codec.bytes", "By", "Compressed and PCM bytes into and out of a codec.");
+		private static readonly Counter<double> CodecTime = Meter.CreateCounter<double>("aaxclean.codec.time", "s", "Time spent in the native codec.");
+		private static readonly Counter<long> Errors = Meter.CreateCounter<long>("aaxclean.codec.errors", "{error}", "Native codec calls that failed, including skipped invalid frames.");
+		private static readonly Counter<long> ResampledFrames = Meter.CreateCounter<long>("aaxclean.codec.resampled", "{frame}", "Decoded frames converted by the resampler rather than copied or converted directly.");
+		private static readonly Counter<double> FilterTime = Meter.CreateCounter<double>("aaxclean.filter.time", "s", "Time a filter spent processing its input.");
+		private static readonly UpDownCounter<long> QueueDepth = Meter.CreateUpDownCounter<long>("aaxclean.filter.queue_depth", "{item}", "Frames or segments held inside a filter awaiting processing.");
+		private static readonly Counter<double> StallTime = Meter.CreateCounter<double>("aaxclean.filter.stall", "s", "Time a filter waited for downstream filters to accept or release its output.");
+		private static readonly Counter<double> IoWaitTime = Meter.CreateCounter<double>("aaxclean.filter.io_wait", "s", "Time a filter waited for its encoded output to be written.");
+		private static readonly UpDownCounter<long> PcmBytes = Meter.CreateUpDownCounter<long>("aaxclean.pcm.bytes", "By", "Decoded audio held between filters, counted against PcmMemory's limits.");
+
+		private static readonly KeyValuePair<string, object?> In = new("aaxclean.direction", "in");
+		private static readonly KeyValuePair<string, object?> Out = new("aaxclean.direction", "out");
+		private static readonly KeyValuePair<string, object?> Send = new("aaxclean.stage", "send");
+		private static readonly KeyValuePair<string, object?> Receive = new("aaxclean.stage", "receive");
+		private static readonly KeyValuePair<string, object?> Convert = new("aaxclean.stage", "convert");
+		internal static readonly KeyValuePair<string, object?> Decode = new("aaxclean.operation", "decode");
+		internal static readonly KeyValuePair<string, object?> Encode = new("aaxclean.operation", "encode");
+
+		internal static bool CodecEnabled => Frames.Enabled;
+
+		internal static KeyValuePair<string, object?> FilterTag(string filterName) => new("aaxclean.filter", filterName);
+
+		/// <summary> Publish the growth of a native handle's totals since they were last published. </summary>
+		internal static void RecordCodecStats(KeyValuePair<string, object?> operation, in CodecStats current, ref CodecStats published)
+		{
+			Frames.Add(current.frames_in - published.frames_in, operation, In);
+			Frames.Add(current.frames_out - published.frames_out, operation, Out);
+			Samples.Add(current.samples_in - published.samples_in, operation, In);
+			Samples.Add(current.samples_out - published.samples_out, operation, Out);
+			Bytes.Add(current.bytes_in - published.bytes_in, operation, In);
+			Bytes.Add(current.bytes_out - published.bytes_out, operation, Out);
+			CodecTime.Add((current.send_ns - published.send_ns) / 1e9, operation, Send);
+			CodecTime.Add((current.receive_ns - published.receive_ns) / 1e9, operation, Receive);
+			if (current.convert_ns != published.convert_ns)
+				CodecTime.Add((current.convert_ns - published.convert_ns) / 1e9, operation, Convert);
+			if (current.errors != published.errors)
+				Errors.Add(current.errors - published.errors, operation);
+			if (current.resampled_frames != published.resampled_frames)
+				ResampledFrames.Add(current.resampled_frames - published.resampled_frames, operation);
+			published = current;
+		}
+
+		/// <summary> Record the time since <paramref name="startTimestamp"/>, a <see cref="Stopwatch.GetTimestamp"/> value. </summary>
+		internal static void RecordFilterTime(KeyValuePair<string, object?> filter, long startTimestamp)
+		{
+			if (FilterTime.Enabled)
+				FilterTime.Add(Stopwatch.GetElapsedTime(startTimestamp).TotalSeconds, filter);
+		}
+
+		/// <summary> Record the time a filter has waited since <paramref name="startTimestamp"/>. </summary>
+		internal static void RecordStallTime(KeyValuePair<string, object?> filter, long startTimestamp)
+		{
+			if (StallTime.Enabled)
+				StallTime.Add(Stopwatch.GetElapsedTime(startTimestamp).TotalSeconds, filter);
+		}
+
+		/// <summary> Record the time a filter has waited on output I/O since <paramref name="startTimestamp"/>. </summary>
+		internal static void RecordIoWaitTime(KeyValuePair<string, object?> filter, long startTimestamp)
+		{
+			if (IoWaitTime.Enabled)
+				IoWaitTime.Add(Stopwatch.GetElapsedTime(startTimestamp).TotalSeconds, filter);
+		}
+
+		internal static void RecordPcmBytes(long change)
+		{
+			if (PcmBytes.Enabled)
+				PcmBytes.Add(change);
+		}
+
+		/// <summary> Publish a filter's new queue depth as the change from <paramref name="publishedDepth"/>. </summary>
+		internal static void RecordQueueDepth(KeyValuePair<string, object?> filter, int depth, ref int publishedDepth)
+		{
+			if (depth != publishedDepth)
+			{
+				QueueDepth.Add(depth - publishedDepth, filter);
+				publishedDepth = depth;
+			}
+		}
+	}
+}
@@ -0,0 +1,112 @@
+﻿using AAXClean.Codecs.FrameFilters.Audio;
+using Mpeg4Lib.Boxes;
+using System;
+using System.Collections.Concurrent;
+
+namespace AAXClean.Codecs;
+
+/// <summary>
+/// Keeps opened codec instances after use so later chapters, segments and conversions
+/// with the same parameters can skip opening the native codec. Returned instances are
+/// reset before they are pooled.
+/// </summary>
+internal static class CodecPool
+{
+	/// <summary> Idle instances kept per set of parameters. Extra returns are disposed. </summary>
+	private static readonly int MaxIdlePerKey = Environment.ProcessorCount;
+
+	private static readonly ConcurrentDictionary<EncoderKey, ConcurrentBag<FfmpegAacEncoder>> Encoders = new();
+	private static readonly ConcurrentDictionary<DecoderKey, ConcurrentBag<FfmpegAacDecoder>> Decoders = new();
+
+	private readonly record struct EncoderKey(int SampleRate, int Channels, long BitRate, double Quality);
+	private readonly record struct DecoderKey(string AudioSpecificConfig, int SampleRate, bool Stereo, WaveFormatEncoding Encoding, ResampleQuality ResampleQuality);
+
+	public static FfmpegAacEncoder RentEncoder(WaveFormat waveFormat, long? bitRate, double? quality)
+	{
+		var key = new EncoderKey(waveFormat.SampleRate, waveFormat.Channels, bitRate ?? 0, quality ?? 0);
+
+		if (!Encoders.TryGetValue(key, out var idle) || !idle.TryTake(out var encoder))
+			encoder = new FfmpegAacEncoder(waveFormat, bitRate, quality);
+
+		encoder.PoolKey = key;
+		return encoder;
+	}
+
+	public static void Return(FfmpegAacEncoder encoder)
+	{
+		if (encoder.PoolKey is not EncoderKey key || !TryReset(encoder.Reset))
+		{
+			encoder.Dispose();
+			return;
+		}
+		AddIdle(Encoders.GetOrAdd(key, _ => new()), encoder);
+	}
+
+	/// <summary>
+	/// Rent a decoder with the native sample rate and channel count. Only AAC decoders are
+	/// pooled, because E-AC-3 and AC-4 decoders configure themselves from the first frames.
+	/// </summary>
+	public static FfmpegAacDecoder RentDecoder(AudioSampleEntry audioSampleEntry, WaveFormatEncoding waveFormatEncoding)
+	{
+		var native = FfmpegAacDecoder.GetNativeWaveFormat(audioSampleEntry, waveFormatEncoding);
+		return RentDecoder(audioSampleEntry, waveFormatEncoding, native.SampleRateEnum, native.Channels == 2, ResampleQuality.Default);
+	}
+
+	public static FfmpegAacDecoder RentDecoder(AudioSampleEntry audioSampleEntry, WaveFormatEncoding waveFormatEncoding, SampleRate sampleRate, bool stereo, ResampleQuality resampleQuality)
+	{
+		if (audioSampleEntry.Esds is not EsdsBox esds)
+			return new FfmpegAacDecoder(audioSampleEntry, waveFormatEncoding, sampleRate, stereo, resampleQuality);
+
+		var asc = Convert.ToHexString(esds.ES_Descriptor.DecoderConfig.AudioSpecificConfig.AscBlob);
+		var key = new DecoderKey(asc, (int)sampleRate, stereo, waveFormatEncoding, resampleQuality);
+
+		if (!Decoders.TryGetValue(key, out var idle) || !idle.TryTake(out var decoder))
+			decoder = new FfmpegAacDecoder(audioSampleEntry, waveFormatEncoding, sampleRate, stereo, resampleQuality);
+
+		decoder.PoolKey = key;
+		return decoder;
+	}
+
+	public static void Return(FfmpegAacDecoder decoder)
+	{
+		if (decoder.PoolKey is not DecoderKey key || !TryReset(decoder.Reset))
+		{
+			decoder.Dispose();
+			return;
+		}
+		AddIdle(Decoders.GetOrAdd(key, _ => new()), decoder);
+	}
+
+	/// <summary> Dispose all idle instances. </summary>
+	public static void Clear()
+	{
+		foreach (var idle in Encoders.Values)
+			while (idle.TryTake(out var encoder))
+				encoder.Dispose();
+		foreach (var idle in Decoders.Values)
+			while (idle.TryTake(out var decoder))
+				decoder.Dispose();
+	}
+
+	private static bool TryReset(Action reset)
+	{
+		try
+		{
+			reset();
+			return true;
+		}
+		catch
+		{
+			//A codec that can't be reset is closed instead of pooled.
+			return false;
+		}
+	}
+
+	private static void AddIdle<T>(ConcurrentBag<T> idle, T codec) where T : IDisposable
+	{
+		if (idle.Count < MaxIdlePerKey)
+			idle.Add(codec);
+		else
+			codec.Dispose();
+	}
+}
@@ -0,0 +1,181 @@
+﻿using AAXClean.Codecs.FrameFilters.Audio;
+using Mpeg4Lib.Boxes;
+using System;
+using System.Buffers.Binary;
+using System.IO;
+using System.Linq;
+using System.Security.Cryptography;
+
+namespace AAXClean.Codecs
+{
+	/// <summary>
+	/// An on-disk cache of decoded audio, so a file that is processed again doesn't need to be
+	/// decoded again. Each entry holds a per-frame loudness envelope and, optionally, the decoded
+	/// PCM. Entries are keyed by the audio sample entry, duration, frame sizes and output format,
+	/// and every frame is checked against the cached frame's size and checksum as it is read.
+	/// </summary>
+	public sealed class DecodeCache
+	{
+		/// <summary> Directory holding the cache entries. </summary>
+		public string CacheDirectory { get; }
+		/// <summary> Total size of all entries, in bytes. Least recently used entries are evicted beyond this. </summary>
+		public long MaxSize { get; }
+		/// <summary> Whether entries store decoded PCM in addition to the loudness envelope. </summary>
+		public bool CachePcm { get; }
+
+		internal const string EXTENSION = ".aaxcache";
+
+		public DecodeCache(string cacheDirectory, long maxSize, bool cachePcm = true)
+		{
+			ArgumentNullException.ThrowIfNull(cacheDirectory, nameof(cacheDirectory));
+			if (maxSize <= 0) throw new ArgumentOutOfRangeException(nameof(maxSize), "must be greater than 0");
+
+			CacheDirectory = cacheDirectory;
+			MaxSize = maxSize;
+			CachePcm = cachePcm;
+			Directory.CreateDirectory(cacheDirectory);
+		}
+
+		/// <summary> Delete every entry in the cache. </summary>
+		public void Clear()
+		{
+			foreach (var file in Directory.EnumerateFiles(CacheDirectory, "*" + EXTENSION))
+				TryDelete(file);
+		}
+
+		internal string GetKey(Mp4File mp4File, WaveFormat waveFormat, ResampleQuality resampleQuality = ResampleQuality.Default)
+		{
+			using var hash = IncrementalHash.CreateHash(HashAlgorithmName.SHA256);
+			void append(long value) => AppendInt64(hash, value);
+
+			var sampleEntry = mp4File.AudioSampleEntry;
+			if (sampleEntry.Esds is EsdsBox esds)
+				hash.AppendData(esds.ES_Descriptor.DecoderConfig.AudioSpecificConfig.AscBlob);
+			else if (sampleEntry.Dec3 is Dec3Box dec3)
+			{
+				append(dec3.SampleRate);
+				foreach (var sub in dec3.IndependentSubstream)
+					append(sub.acmod << 1 | (sub.lfeon ? 1 : 0));
+			}
+			else if (sampleEntry.Dac4 is Dac4Box dac4)
+				append(dac4.SampleRate ?? 0);
+
+			append(sampleEntry.ChannelCount);
+			append(sampleEntry.SampleRate);
+			append(mp4File.Duration.Ticks);
+			append(mp4File.AverageBitrate);
+			AppendSampleSizes(hash, mp4File.Moov.AudioTrack.Mdia.Minf.Stbl.Stsz);
+			append(waveFormat.SampleRate);
+			append(waveFormat.Channels);
+			append((int)waveFormat.Encoding);
+			append((int)resampleQuality);
+
+			return Convert.ToHexString(hash.GetHashAndReset());
+		}
+
+		/// <summary>
+		/// Two encodes of the same title can share every other key field, but their frame size
+		/// tables all but never match. The table is already in memory, so hashing it is cheap.
+		/// </summary>
+		private static void AppendSampleSizes(IncrementalHash hash, StszBox stsz)
+		{
+			Span<byte> scratch = stackalloc byte[1024];
+			int length = 0;
+			foreach (var size in stsz.SampleSizes)
+			{
+				if (length == scratch.Length)
+				{
+					hash.AppendData(scratch);
+					length = 0;
+				}
+				BinaryPrimitives.WriteInt32LittleEndian(scratch[length..], size);
+				length += sizeof(int);
+			}
+			hash.AppendData(scratch[..length]);
+			AppendInt64(hash, stsz.SampleCount);
+		}
+
+		private static void AppendInt64(IncrementalHash hash, long value)
+		{
+			Span<byte> scratch = stackalloc byte[sizeof(long)];
+			BinaryPrimitives.WriteInt64LittleEndian(scratch, value);
+			hash.AppendData(scratch);
+		}
+
+		private string GetPath(string key) => Path.Combine(CacheDirectory, key + EXTENSION);
+
+		/// <summary>
+		/// Open an entry for reading. A corrupt entry is deleted so that it is rebuilt.
+		/// </summary>
+		internal DecodeCacheEntry? TryOpen(string key)
+		{
+			var path = GetPath(key);
+			if (!File.Exists(path))
+				return null;
+
+			try
+			{
+				var entry = DecodeCacheEntry.Open(path);
+				if (entry is null)
+					TryDelete(path);
+				else
+					File.SetLastAccessTimeUtc(path, DateTime.UtcNow);
+				return entry;
+			}
+			catch (IOException)
+			{
+				//Being written or deleted by another process.
+				return null;
+			}
+		}
+
+		internal DecodeCacheWriter Create(string key, WaveFormat waveFormat)
+			=> new(this, GetPath(key), waveFormat, CachePcm);
+
+		/// <summary>
+		/// Move a finished entry into place and evict entries until the cache fits. If the
+		/// existing entry can't be replaced, the finished entry is discarded and the existing one kept.
+		/// </summary>
+		internal void Commit(string tempPath, string path)
+		{
+			try
+			{
+				File.Move(tempPath, path, overwrite: true);
+			}
+			catch (Exception ex) when (ex is IOException or UnauthorizedAccessException)
+			{
+				//The existing entry is still mapped by a reader.
+				TryDelete(tempPath);
+				return;
+			}
+			File.SetLastAccessTimeUtc(path, DateTime.UtcNow);
+
+			var entries
+				= new DirectoryInfo(CacheDirectory)
+				.EnumerateFiles("*" + EXTENSION)
+				.OrderByDescending(f => f.LastAccessTimeUtc)
+				.ToList();
+
+			long totalSize = 0;
+			foreach (var entry in entries)
+			{
+				totalSize += entry.Length;
+				if (totalSize > MaxSize)
+					TryDelete(entry.FullName);
+			}
+		}
+
+		internal static void TryDelete(string path)
+		{
+			try
+			{
+				File.Delete(path);
+			}
+			catch (IOException)
+			{
+				//Still mapped by a reader. It will be evicted next time.
+			}
+			catch (UnauthorizedAccessException) { }
+		}
+	}
+}
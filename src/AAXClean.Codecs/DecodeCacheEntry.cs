@@ -0,0 +1,295 @@
+using AAXClean.Codecs.FrameFilters.Audio;
+using Microsoft.Win32.SafeHandles;
+using System;
+using System.Buffers.Binary;
+using System.Collections.Generic;
+using System.IO;
+using System.IO.MemoryMappedFiles;
+using System.Numerics;
+using System.Runtime.InteropServices;
+using System.Security.Cryptography;
+
+namespace AAXClean.Codecs
+{
+	/*
+	 * Entry layout, little endian:
+	 *
+	 * Header (64 bytes)
+	 *   0  magic        uint32  "AXDC"
+	 *   4  version      uint16
+	 *   6  flags        uint16  ENTRY_HAS_PCM
+	 *   8  sampleRate   int32
+	 *   12 channels     int16
+	 *   14 encoding     int16
+	 *   16 frameCount   int64   including the decoder flush record
+	 *   24 tableOffset  int64
+	 *   32 checksum     SHA-256 of header bytes [0, 32) and the frame table
+	 * PCM                       only if ENTRY_HAS_PCM, frames back to back
+	 * Frame table               frameCount FrameRecords
+	 */
+
+	/// <summary> One decoded frame's entry in the frame table. </summary>
+	[StructLayout(LayoutKind.Sequential, Pack = 4)]
+	internal struct FrameRecord
+	{
+		/// <summary> Size of the compressed frame, or -1 for the samples flushed from the decoder. </summary>
+		public int CompressedSize;
+		public uint CompressedCrc;
+		public int Samples;
+		public uint PcmCrc;
+		/// <summary> Peak magnitude of each quarter of the frame, over all channels. </summary>
+		public short Peak0, Peak1, Peak2, Peak3;
+
+		public const int ENVELOPE_BLOCKS = 4;
+		public const int FLUSH_RECORD = -1;
+
+		public readonly short MinPeak => Math.Min(Math.Min(Peak0, Peak1), Math.Min(Peak2, Peak3));
+
+		public static uint Crc(ReadOnlySpan<byte> data)
+		{
+			uint crc = 0;
+			var longs = MemoryMarshal.Cast<byte, ulong>(data);
+			foreach (var value in longs)
+				crc = BitOperations.Crc32C(crc, value);
+			foreach (var value in data[(longs.Length * sizeof(ulong))..])
+				crc = BitOperations.Crc32C(crc, value);
+			return crc;
+		}
+
+		public void SetEnvelope(ReadOnlySpan<short> samples)
+		{
+			Span<short> peaks = stackalloc short[ENVELOPE_BLOCKS];
+			int blockSize = (samples.Length + ENVELOPE_BLOCKS - 1) / ENVELOPE_BLOCKS;
+			for (int b = 0; b < ENVELOPE_BLOCKS; b++)
+			{
+				int start = Math.Min(b * blockSize, samples.Length);
+				int peak = 0;
+				foreach (var sample in samples.Slice(start, Math.Min(blockSize, samples.Length - start)))
+					peak = Math.Max(peak, Math.Abs((int)sample));
+				peaks[b] = (short)Math.Min(peak, short.MaxValue);
+			}
+			(Peak0, Peak1, Peak2, Peak3) = (peaks[0], peaks[1], peaks[2], peaks[3]);
+		}
+	}
+
+	/// <summary> A memory-mapped cache entry, read one frame at a time from the start. </summary>
+	internal sealed unsafe class DecodeCacheEntry : IDisposable
+	{
+		internal const uint MAGIC = 0x43445841;
+		internal const ushort VERSION = 1;
+		internal const ushort ENTRY_HAS_PCM = 1;
+		internal const int HEADER_SIZE = 64;
+		internal const int CHECKSUM_OFFSET = 32;
+
+		public string Path { get; }
+		public bool HasPcm { get; }
+		public int SampleRate { get; }
+		public int Channels { get; }
+		/// <summary> Number of records, including the decoder flush record. </summary>
+		public long FrameCount { get; }
+
+		private readonly MemoryMappedFile MappedFile;
+		private readonly MemoryMappedViewAccessor View;
+		private readonly byte* BasePointer;
+		private readonly FrameRecord* Records;
+		private long NextPcmFrame;
+		private long NextPcmOffset = HEADER_SIZE;
+		private bool Invalid;
+
+		private DecodeCacheEntry(string path, MemoryMappedFile mappedFile, MemoryMappedViewAccessor view, byte* basePointer)
+		{
+			Path = path;
+			MappedFile = mappedFile;
+			View = view;
+			BasePointer = basePointer;
+
+			var header = new ReadOnlySpan<byte>(basePointer, HEADER_SIZE);
+			HasPcm = (BinaryPrimitives.ReadUInt16LittleEndian(header[6..]) & ENTRY_HAS_PCM) != 0;
+			SampleRate = BinaryPrimitives.ReadInt32LittleEndian(header[8..]);
+			Channels = BinaryPrimitives.ReadInt16LittleEndian(header[12..]);
+			FrameCount = BinaryPrimitives.ReadInt64LittleEndian(header[16..]);
+			Records = (FrameRecord*)(basePointer + BinaryPrimitives.ReadInt64LittleEndian(header[24..]));
+		}
+
+		/// <returns>The entry, or null if the header or frame table fails its checksum.</returns>
+		public static DecodeCacheEntry? Open(string path)
+		{
+			var length = new FileInfo(path).Length;
+			if (length < HEADER_SIZE)
+				return null;
+
+			var mappedFile = MemoryMappedFile.CreateFromFile(path, FileMode.Open, null, 0, MemoryMappedFileAccess.Read);
+			var view = mappedFile.CreateViewAccessor(0, 0, MemoryMappedFileAccess.Read);
+			byte* basePointer = null;
+			view.SafeMemoryMappedViewHandle.AcquirePointer(ref basePointer);
+			basePointer += view.PointerOffset;
+
+			if (!IsValid(basePointer, length))
+			{
+				view.SafeMemoryMappedViewHandle.ReleasePointer();
+				view.Dispose();
+				mappedFile.Dispose();
+				return null;
+			}
+
+			return new DecodeCacheEntry(path, mappedFile, view, basePointer);
+		}
+
+		private static bool IsValid(byte* basePointer, long length)
+		{
+			var header = new ReadOnlySpan<byte>(basePointer, HEADER_SIZE);
+			if (BinaryPrimitives.ReadUInt32LittleEndian(header) != MAGIC ||
+				BinaryPrimitives.ReadUInt16LittleEndian(header[4..]) != VERSION)
+				return false;
+
+			long frameCount = BinaryPrimitives.ReadInt64LittleEndian(header[16..]);
+			long tableOffset = BinaryPrimitives.ReadInt64LittleEndian(header[24..]);
+			if (frameCount < 1 || tableOffset < HEADER_SIZE || tableOffset + frameCount * sizeof(FrameRecord) != length)
+				return false;
+
+			using var hash = IncrementalHash.CreateHash(HashAlgorithmName.SHA256);
+			hash.AppendData(header[..CHECKSUM_OFFSET]);
+			for (long offset = tableOffset; offset < length; offset += int.MaxValue)
+				hash.AppendData(new ReadOnlySpan<byte>(basePointer + offset, (int)Math.Min(int.MaxValue, length - offset)));
+
+			Span<byte> checksum = stackalloc byte[32];
+			hash.GetHashAndReset(checksum);
+			return checksum.SequenceEqual(header.Slice(CHECKSUM_OFFSET, 32));
+		}
+
+		public ref readonly FrameRecord this[long index] => ref Records[index];
+
+		/// <summary> True if frame <paramref name="index"/> was decoded from exactly this compressed frame. </summary>
+		public bool Matches(long index, ReadOnlySpan<byte> compressedFrame)
+			=> index < FrameCount
+			&& Records[index].CompressedSize == compressedFrame.Length
+			&& Records[index].CompressedCrc == FrameRecord.Crc(compressedFrame);
+
+		/// <summary>
+		/// Get the next frame's decoded PCM. Frames must be read in order.
+		/// </summary>
+		/// <returns>False if the cached PCM fails its checksum.</returns>
+		public bool TryReadPcm(long index, out ReadOnlySpan<byte> pcm)
+		{
+			pcm = default;
+			if (!HasPcm || index != NextPcmFrame)
+				return false;
+
+			ref readonly FrameRecord record = ref Records[index];
+			pcm = new ReadOnlySpan<byte>(BasePointer + NextPcmOffset, record.Samples * Channels * sizeof(short));
+			if (FrameRecord.Crc(pcm) != record.PcmCrc)
+				return false;
+
+			NextPcmFrame++;
+			NextPcmOffset += pcm.Length;
+			return true;
+		}
+
+		/// <summary> Delete the entry when it is disposed so that it is rebuilt. </summary>
+		public void Invalidate() => Invalid = true;
+
+		public void Dispose()
+		{
+			View.SafeMemoryMappedViewHandle.ReleasePointer();
+			View.Dispose();
+			MappedFile.Dispose();
+			if (Invalid)
+				DecodeCache.TryDelete(Path);
+		}
+	}
+
+	/// <summary>
+	/// Builds a cache entry in a temporary file. The entry only replaces the cached one if
+	/// every frame was written and <see cref="Commit"/> is called.
+	/// </summary>
+	internal sealed class DecodeCacheWriter : IDisposable
+	{
+		private readonly DecodeCache Cache;
+		private readonly string FinalPath;
+		private readonly string TempPath;
+		private readonly WaveFormat WaveFormat;
+		private readonly bool WritePcm;
+		private readonly List<FrameRecord> Records = new();
+		private FileStream? Output;
+
+		public DecodeCacheWriter(DecodeCache cache, string path, WaveFormat waveFormat, bool writePcm)
+		{
+			Cache = cache;
+			FinalPath = path;
+			TempPath = path + "." + Guid.NewGuid().ToString("N") + ".tmp";
+			WaveFormat = waveFormat;
+			WritePcm = writePcm;
+			Output = new FileStream(TempPath, FileMode.CreateNew, FileAccess.Write, FileShare.None, 1024 * 1024);
+			Output.Write(new byte[DecodeCacheEntry.HEADER_SIZE]);
+		}
+
+		/// <param name="compressedFrame">The compressed frame, or empty for the decoder's flushed samples.</param>
+		public void Add(ReadOnlySpan<byte> compressedFrame, bool isFlush, WaveEntry decoded)
+		{
+			if (Output is null) return;
+
+			var pcm = decoded.FrameData.Span;
+			var record = new FrameRecord
+			{
+				CompressedSize = isFlush ? FrameRecord.FLUSH_RECORD : compressedFrame.Length,
+				CompressedCrc = FrameRecord.Crc(compressedFrame),
+				Samples = (int)decoded.SamplesInFrame,
+				PcmCrc = FrameRecord.Crc(pcm),
+			};
+			record.SetEnvelope(MemoryMarshal.Cast<byte, short>(pcm));
+			Records.Add(record);
+
+			if (WritePcm)
+				Output.Write(pcm);
+
+			//Give up rather than write an entry that would evict everything else.
+			if (Output.Position + (long)Records.Count * Marshal.SizeOf<FrameRecord>() > Cache.MaxSize)
+				Abandon();
+		}
+
+		public void Commit()
+		{
+			if (Output is null) return;
+
+			long tableOffset = Output.Position;
+			var table = MemoryMarshal.AsBytes(CollectionsMarshal.AsSpan(Records));
+			Output.Write(table);
+
+			Span<byte> header = stackalloc byte[DecodeCacheEntry.HEADER_SIZE];
+			header.Clear();
+			BinaryPrimitives.WriteUInt32LittleEndian(header, DecodeCacheEntry.MAGIC);
+			BinaryPrimitives.WriteUInt16LittleEndian(header[4..], DecodeCacheEntry.VERSION);
+			BinaryPrimitives.WriteUInt16LittleEndian(header[6..], WritePcm ? DecodeCacheEntry.ENTRY_HAS_PCM : (ushort)0);
+			BinaryPrimitives.WriteInt32LittleEndian(header[8..], WaveFormat.SampleRate);
+			BinaryPrimitives.WriteInt16LittleEndian(header[12..], (short)WaveFormat.Channels);
+			BinaryPrimitives.WriteInt16LittleEndian(header[14..], (short)WaveFormat.Encoding);
+			BinaryPrimitives.WriteInt64LittleEndian(header[16..], Records.Count);
+			BinaryPrimitives.WriteInt64LittleEndian(header[24..], tableOffset);
+
+			using (var hash = IncrementalHash.CreateHash(HashAlgorithmName.SHA256))
+			{
+				hash.AppendData(header[..DecodeCacheEntry.CHECKSUM_OFFSET]);
+				hash.AppendData(table);
+				hash.GetHashAndReset(header.Slice(DecodeCacheEntry.CHECKSUM_OFFSET, 32));
+			}
+
+			Output.Position = 0;
+			Output.Write(header);
+			Output.Dispose();
+			Output = null;
+
+			Cache.Commit(TempPath, FinalPath);
+		}
+
+		public void Abandon()
+		{
+			if (Output is null) return;
+			Output.Dispose();
+			Output = null;
+			DecodeCache.TryDelete(TempPath);
+			Records.Clear();
+		}
+
+		public void Dispose() => Abandon();
+	}
+}
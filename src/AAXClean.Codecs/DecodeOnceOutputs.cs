@@ -0,0 +1,27 @@
+﻿using NAudio.Lame;
+using System;
+using System.Collections.Generic;
+using System.IO;
+
+namespace AAXClean.Codecs
+{
+	/// <summary>
+	/// Outputs produced from a single decode of the audio. Any combination may be set, but at least one is required.
+	/// </summary>
+	public class DecodeOnceOutputs
+	{
+		/// <summary> MP3 output stream. LAME resamples and downmixes the shared audio to <see cref="LameConfig"/>'s format. </summary>
+		public Stream? Mp3Output { get; set; }
+		public LameConfig? LameConfig { get; set; }
+		/// <summary> AAC output stream. The audio is decoded at <see cref="AacOptions"/>' sample rate and channel count, which every output then shares. </summary>
+		public Stream? Mp4aOutput { get; set; }
+		public AacEncodingOptions? AacOptions { get; set; }
+		/// <summary> (threshold, minimum duration) profiles to detect silence with. </summary>
+		public IReadOnlyList<(double decibels, TimeSpan minDuration)>? SilenceProfiles { get; set; }
+		public Action<SilenceDetectCallback>? SilenceDetectionCallback { get; set; }
+		/// <summary> Measure the loudness of the shared audio and pass it to this callback once decoding completes. </summary>
+		public Action<LoudnessInfo>? LoudnessCallback { get; set; }
+		/// <summary> Seekable stream for waveform peaks of the shared audio, written with the <see cref="WaveformPeaks"/> defaults. </summary>
+		public Stream? WaveformOutput { get; set; }
+	}
+}
@@ -3,6 +3,8 @@ using AAXClean.Codecs.Interop;
 using AAXClean.FrameFilters;
 using Mpeg4Lib.Boxes;
 using System;
+using System.Buffers;
+using System.Collections.Generic;
 
 namespace AAXClean.Codecs;
 
@@ -13,45 +15,67 @@ internal unsafe sealed class FfmpegAacDecoder : IDisposable
 
 	private readonly NativeDecode AudioDecoder;
 
+	private const int AVERROR_INVALIDDATA = -1313558101;
+	private const int AAC_FRAME_SIZE = 1024;
+	private const int MAX_RESAMPLER_DELAY = 256;
+	private const int PREROLL_FRAMES = 2;
+	private const int RANGE_BATCH_SIZE = 32;
+	private bool IsPlanarStereo => WaveFormat.Encoding is NAudio.Wave.WaveFormatEncoding.Dts && WaveFormat.Channels == 2;
+
+	private PcmBufferPool? BufferPool;
+	/// <summary> Budget charged for decoded audio until downstream filters release it. </summary>
+	internal PcmBudget? Budget { get; set; }
+	private CodecStats PublishedStats;
+	/// <summary> Set by <see cref="CodecPool"/> on instances it may take back. </summary>
+	internal object? PoolKey { get; set; }
 	private int NumberOfSamplesSkipped = 0;
 	private int MaxSamplesToSkip { get; }
 	private static TimeSpan MaxTimeToSkip { get; } = TimeSpan.FromSeconds(1);
 
 	public FfmpegAacDecoder(AudioSampleEntry audioSampleEntry, WaveFormatEncoding waveFormatEncoding)
 	{
+		WaveFormat = GetNativeWaveFormat(audioSampleEntry, waveFormatEncoding);
 		if (audioSampleEntry.Esds is EsdsBox esds)
 		{
-			var asc = esds.ES_Descriptor.DecoderConfig.AudioSpecificConfig;
 			MaxSamplesToSkip = GetMaxNumberOfSamplesToSkip(esds);
-			WaveFormat = new WaveFormat((SampleRate)asc.SamplingFrequency, waveFormatEncoding, asc.ChannelConfiguration == 2);
-			AudioDecoder = new NativeAacDecode(esds, WaveFormat);
+			AudioDecoder = new NativeAacDecode(esds, WaveFormat, ResampleQuality.Default);
 		}
 		else if (audioSampleEntry.Dec3 is Dec3Box dec3)
-		{
-			WaveFormat = new WaveFormat((SampleRate)dec3.SampleRate, waveFormatEncoding, stereo: true);
-			AudioDecoder = new NativeEc3Decode(dec3, WaveFormat);
-		}
+			AudioDecoder = new NativeEc3Decode(dec3, WaveFormat, ResampleQuality.Default);
 		else if (audioSampleEntry.Dac4 is Dac4Box dac4)
+			AudioDecoder = new NativeAc4Decode(dac4, WaveFormat, ResampleQuality.Default);
+		else
+			throw new Exception($"AudioSampleEntry does not contain {nameof(EsdsBox)} or {nameof(Dec3Box)}");
+	}
+
+	/// <summary> The format the decoder outputs when no sample rate or channel count is requested. </summary>
+	public static WaveFormat GetNativeWaveFormat(AudioSampleEntry audioSampleEntry, WaveFormatEncoding waveFormatEncoding)
+	{
+		if (audioSampleEntry.Esds is EsdsBox esds)
 		{
-			WaveFormat = new WaveFormat((SampleRate?)dac4.SampleRate ?? SampleRate.Hz_44100, waveFormatEncoding, stereo: true);
-			AudioDecoder = new NativeAc4Decode(dac4, WaveFormat);
+			var asc = esds.ES_Descriptor.DecoderConfig.AudioSpecificConfig;
+			return new WaveFormat((SampleRate)asc.SamplingFrequency, waveFormatEncoding, asc.ChannelConfiguration == 2);
 		}
+		else if (audioSampleEntry.Dec3 is Dec3Box dec3)
+			return new WaveFormat((SampleRate)dec3.SampleRate, waveFormatEncoding, stereo: true);
+		else if (audioSampleEntry.Dac4 is Dac4Box dac4)
+			return new WaveFormat((SampleRate?)dac4.SampleRate ?? SampleRate.Hz_44100, waveFormatEncoding, stereo: true);
 		else
 			throw new Exception($"AudioSampleEntry does not contain {nameof(EsdsBox)} or {nameof(Dec3Box)}");
 	}
 
-	public FfmpegAacDecoder(AudioSampleEntry audioSampleEntry, WaveFormatEncoding waveFormatEncoding, SampleRate sampleRate, bool stereo)
+	public FfmpegAacDecoder(AudioSampleEntry audioSampleEntry, WaveFormatEncoding waveFormatEncoding, SampleRate sampleRate, bool stereo, ResampleQuality resampleQuality = ResampleQuality.Default)
 	{
 		WaveFormat = new WaveFormat(sampleRate, waveFormatEncoding, stereo);
 		if (audioSampleEntry.Esds is EsdsBox esds)
 		{
 			MaxSamplesToSkip = GetMaxNumberOfSamplesToSkip(esds);
-			AudioDecoder = new NativeAacDecode(esds, WaveFormat);
+			AudioDecoder = new NativeAacDecode(esds, WaveFormat, resampleQuality);
 		}
 		else if (audioSampleEntry.Dec3 is Dec3Box dec3)
-			AudioDecoder = new NativeEc3Decode(dec3, WaveFormat);
+			AudioDecoder = new NativeEc3Decode(dec3, WaveFormat, resampleQuality);
 		else if (audioSampleEntry.Dac4 is Dac4Box dac4)
-			AudioDecoder = new NativeAc4Decode(dac4, WaveFormat);
+			AudioDecoder = new NativeAc4Decode(dac4, WaveFormat, resampleQuality);
 		else
 			throw new Exception($"AudioSampleEntry does not contain {nameof(EsdsBox)} or {nameof(Dec3Box)}");
 
@@ -63,29 +87,92 @@ internal unsafe sealed class FfmpegAacDecoder : IDisposable
 		? (int)(esds.ES_Descriptor.DecoderConfig.AudioSpecificConfig.SamplingFrequency * MaxTimeToSkip.TotalSeconds)
 		: 0;
 
-	public WaveEntry DecodeWave(FrameEntry input)
+	/// <summary>
+	/// Decode a batch of frames with a single call into the native decoder and
+	/// enqueue one <see cref="WaveEntry"/> per input frame, in order.
+	/// </summary>
+	public void DecodeWave(IReadOnlyList<FrameEntry> inputs, Queue<WaveEntry> outputs)
 	{
-		if (!SendSamples(input.FrameData))
+		int nbFrames = inputs.Count;
+		var frameHandles = new MemoryHandle[nbFrames];
+		byte** ppFrames = stackalloc byte*[nbFrames];
+		int* pFrameSizes = stackalloc int[nbFrames];
+		int* pFrameResults = stackalloc int[nbFrames];
+
+		try
 		{
-			if (NumberOfSamplesSkipped + (int)input.SamplesInFrame < MaxSamplesToSkip)
+			for (int i = 0; i < nbFrames; i++)
 			{
-				NumberOfSamplesSkipped += (int)input.SamplesInFrame;
+				frameHandles[i] = inputs[i].FrameData.Pin();
+				ppFrames[i] = (byte*)frameHandles[i].Pointer;
+				pFrameSizes[i] = inputs[i].FrameData.Length;
+			}
+
+			//Size the pool so one buffer holds a full batch of the largest frames the decoder produces.
+			BufferPool ??= new PcmBufferPool(nbFrames * EstimateMaxOutputSamples(inputs[0]) * WaveFormat.BlockAlign);
+
+			int framesDecoded = 0;
+			int minCapacity = 0;
+			while (framesDecoded < nbFrames)
+			{
+				PcmBuffer buffer
+					= minCapacity == 0 ? BufferPool.Rent(Budget)
+					: PcmBuffer.Unpooled(minCapacity * WaveFormat.BlockAlign);
+
+				int capacity = buffer.Data.Length / WaveFormat.BlockAlign;
+				int consumed;
+				fixed (byte* decodeBuff = buffer.Data)
+				{
+					consumed = AudioDecoder.DecodeBatch(
+						ppFrames + framesDecoded,
+						pFrameSizes + framesDecoded,
+						nbFrames - framesDecoded,
+						decodeBuff,
+						IsPlanarStereo ? decodeBuff + capacity * WaveFormat.BlockAlign / 2 : null,
+						capacity,
+						pFrameResults + framesDecoded);
+				}
+
+				int samplesOffset = 0;
+				for (int i = framesDecoded; i < framesDecoded + consumed; i++)
+				{
+					outputs.Enqueue(GetDecodedEntry(inputs[i], pFrameResults[i], buffer, capacity, ref samplesOffset));
+				}
+
+				//Drop the decoder's reference. The buffer returns to the pool once every
+				//entry sliced from it has been released downstream.
+				buffer.Release();
+
+				//The buffer was too small for even one frame. Try again with a bigger one.
+				minCapacity = consumed == 0 ? Math.Max(capacity, AAC_FRAME_SIZE) * 2 : 0;
+				framesDecoded += consumed;
 			}
+		}
+		finally
+		{
+			foreach (var handle in frameHandles)
+				handle.Dispose();
+		}
+		PublishStats();
+	}
+
+	private WaveEntry GetDecodedEntry(FrameEntry input, int frameResult, PcmBuffer buffer, int capacity, ref int samplesOffset)
+	{
+		if (frameResult < 0)
+		{
+			if (frameResult != AVERROR_INVALIDDATA)
+				throw new Exception($"Error decoding AAC frame. Code {NativeDecode.GetFFmpegErrorString(frameResult)}");
+			else if (NumberOfSamplesSkipped + (int)input.SamplesInFrame < MaxSamplesToSkip)
+				NumberOfSamplesSkipped += (int)input.SamplesInFrame;
 			else
 				throw new Exception($"Error decoding AAC frame even after skipping {NumberOfSamplesSkipped} samples");
 
 			//Failed to decode the frame. May need to skip to seed the decoder
 			//for some number of frames before trying to receive decoded data.
-			return new WaveEntry
-			{
-				Chunk = input.Chunk,
-				SamplesInFrame = 0,
-				FrameData = Memory<byte>.Empty,
-			};
+			frameResult = 0;
 		}
 
-		int requiredSamples = GetMaxAvailableDecodeSize();
-		if (requiredSamples == 0)
+		if (frameResult == 0)
 		{
 			return new WaveEntry
 			{
@@ -95,60 +182,72 @@ internal unsafe sealed class FfmpegAacDecoder : IDisposable
 			};
 		}
 
-		Memory<byte> decoded = new byte[requiredSamples * WaveFormat.BlockAlign];
+		Memory<byte> decoded = buffer.Data;
+		buffer.AddReference();
 
-		if (WaveFormat.Encoding is NAudio.Wave.WaveFormatEncoding.Dts && WaveFormat.Channels == 2)
+		WaveEntry entry;
+		if (IsPlanarStereo)
 		{
-			int receivedSamples;
-			fixed (byte* decodeBuff = decoded.Span)
-			{
-				receivedSamples = AudioDecoder.ReceiveDecodedFrame(decodeBuff, decodeBuff + decoded.Length / 2, requiredSamples);
-			}
-
-			return new WaveEntry
+			int planeStart = capacity * WaveFormat.BlockAlign / 2;
+			int offset = samplesOffset * WaveFormat.BlockAlign / 2;
+			int length = frameResult * WaveFormat.BlockAlign / 2;
+			entry = new WaveEntry
 			{
 				Chunk = input.Chunk,
-				SamplesInFrame = (uint)receivedSamples,
-				FrameData = decoded.Slice(0, receivedSamples * WaveFormat.BlockAlign / 2),
-				FrameData2 = decoded.Slice(requiredSamples * WaveFormat.BlockAlign / 2, receivedSamples * WaveFormat.BlockAlign / 2),
+				SamplesInFrame = (uint)frameResult,
+				FrameData = decoded.Slice(offset, length),
+				FrameData2 = decoded.Slice(planeStart + offset, length),
+				Buffer = buffer,
 			};
 		}
 		else
 		{
-			int receivedSamples;
-			fixed (byte* decodeBuff = decoded.Span)
-			{
-				receivedSamples = AudioDecoder.ReceiveDecodedFrame(decodeBuff, null, requiredSamples);
-			}
-
-			return new WaveEntry
+			entry = new WaveEntry
 			{
 				Chunk = input.Chunk,
-				SamplesInFrame = (uint)receivedSamples,
-				FrameData = decoded.Slice(0, receivedSamples * WaveFormat.BlockAlign)
+				SamplesInFrame = (uint)frameResult,
+				FrameData = decoded.Slice(samplesOffset * WaveFormat.BlockAlign, frameResult * WaveFormat.BlockAlign),
+				Buffer = buffer,
 			};
 		}
+		samplesOffset += frameResult;
+		return entry;
 	}
 
+	/// <summary>
+	/// Upper bound on the number of output samples a single frame can produce. Allows for
+	/// SBR doubling the frame length plus any samples buffered inside the resampler.
+	/// </summary>
+	private static int EstimateMaxOutputSamples(FrameEntry input)
+		=> (int)Math.Max(input.SamplesInFrame, AAC_FRAME_SIZE) * 2 + MAX_RESAMPLER_DELAY;
+
 	public WaveEntry DecodeFlush()
 	{
 		int requiredSamples = GetMaxAvailableDecodeSize();
+		int requiredBytes = requiredSamples * WaveFormat.BlockAlign;
 
-		Memory<byte> decoded = new byte[requiredSamples * WaveFormat.BlockAlign];
+		//The entry takes over the rented buffer's reference.
+		PcmBuffer buffer
+			= BufferPool is not null && requiredBytes <= BufferPool.BufferSize ? BufferPool.Rent(Budget)
+			: PcmBuffer.Unpooled(requiredBytes);
 
-		if (WaveFormat.Encoding is NAudio.Wave.WaveFormatEncoding.Dts && WaveFormat.Channels == 2)
+		Memory<byte> decoded = buffer.Data.AsMemory(0, requiredBytes);
+
+		if (IsPlanarStereo)
 		{
 			int receivedSamples;
 			fixed (byte* decodeBuff = decoded.Span)
 			{
 				receivedSamples = AudioDecoder.DecodeFlush(decodeBuff, decodeBuff + decoded.Length / 2, requiredSamples);
 			}
+			PublishStats();
 
 			return new WaveEntry
 			{
 				SamplesInFrame = (uint)receivedSamples,
 				FrameData = decoded.Slice(0, receivedSamples * WaveFormat.BlockAlign / 2),
 				FrameData2 = decoded.Slice(requiredSamples * WaveFormat.BlockAlign / 2, receivedSamples * WaveFormat.BlockAlign / 2),
+				Buffer = buffer,
 			};
 		}
 		else
@@ -158,38 +257,181 @@ internal unsafe sealed class FfmpegAacDecoder : IDisposable
 			{
 				receivedSamples = AudioDecoder.DecodeFlush(decodeBuff, null, requiredSamples);
 			}
+			PublishStats();
 
 			return new WaveEntry
 			{
 				SamplesInFrame = (uint)receivedSamples,
 				FrameData = decoded.Slice(0, receivedSamples * WaveFormat.BlockAlign),
+				Buffer = buffer,
 			};
 		}
 	}
 
-	private bool SendSamples(ReadOnlyMemory<byte> frameData)
+	/// <summary>
+	/// Audio to decode and discard before the first sample wanted from a range, so the decoder's
+	/// overlap and SBR state are settled. USAC and AC-4 can only start decoding at an independent
+	/// frame, so they get as much pre-roll as the decoder may skip while looking for one.
+	/// </summary>
+	public static TimeSpan GetPreRoll(AudioSampleEntry audioSampleEntry)
 	{
-		int ret;
+		var native = GetNativeWaveFormat(audioSampleEntry, WaveFormatEncoding.Pcm);
+		bool needsIndependentFrame
+			= audioSampleEntry.Dac4 is not null
+			|| audioSampleEntry.Esds?.ES_Descriptor.DecoderConfig.AudioSpecificConfig.AudioObjectType == 42;
+
+		return needsIndependentFrame ? MaxTimeToSkip
+			: TimeSpan.FromSeconds((double)PREROLL_FRAMES * AAC_FRAME_SIZE * 2 / native.SampleRate);
+	}
 
-		fixed (byte* inBuff = frameData.Span)
+	/// <summary>
+	/// Decode <paramref name="frames"/>, the first of which starts at <paramref name="framesStart"/>,
+	/// and pass on only the audio from <paramref name="start"/> to <paramref name="end"/>, trimmed to
+	/// the sample. Everything decoded before <paramref name="start"/> is pre-roll. Trimming is exact
+	/// when decoding at the source's sample rate, and off by the resampler's delay otherwise.
+	/// </summary>
+	/// <param name="trackSampleRate">Time scale of the frames' <see cref="FrameEntry.SamplesInFrame"/>.</param>
+	/// <param name="consume">Receives each trimmed entry and must release it.</param>
+	public void DecodeRange(IReadOnlyList<FrameEntry> frames, SampleRate trackSampleRate, TimeSpan framesStart, TimeSpan start, TimeSpan end, Action<WaveEntry> consume)
+	{
+		long position = ToSamples(framesStart);
+		long startSample = ToSamples(start);
+		long endSample = ToSamples(end);
+
+		List<FrameEntry> batch = new(RANGE_BATCH_SIZE);
+		Queue<WaveEntry> decoded = new(RANGE_BATCH_SIZE);
+		try
 		{
-			ret = AudioDecoder.DecodeFrame(inBuff, frameData.Length);
+			for (int i = 0; i < frames.Count && position < endSample; i += batch.Count)
+			{
+				batch.Clear();
+				for (int j = i; j < frames.Count && batch.Count < RANGE_BATCH_SIZE; j++)
+					batch.Add(frames[j]);
+
+				DecodeWave(batch, decoded);
+
+				foreach (var frame in batch)
+				{
+					var wave = decoded.Dequeue();
+					//Frames skipped while the decoder seeds itself output nothing but still take up their time.
+					long length = wave.SamplesInFrame > 0 ? wave.SamplesInFrame
+						: (long)frame.SamplesInFrame * WaveFormat.SampleRate / (int)trackSampleRate;
+					Trim(wave, position, startSample, endSample, consume);
+					position += length;
+				}
+			}
+
+			if (position < endSample)
+				Trim(DecodeFlush(), position, startSample, endSample, consume);
+		}
+		finally
+		{
+			while (decoded.TryDequeue(out var wave))
+				wave.Release();
 		}
+	}
+
+	private long ToSamples(TimeSpan time) => (long)Math.Round(time.TotalSeconds * WaveFormat.SampleRate);
 
-		if (ret >= 0)
+	/// <summary> Pass on the part of <paramref name="wave"/>, which starts at <paramref name="position"/>, inside [start, end). </summary>
+	private void Trim(WaveEntry wave, long position, long startSample, long endSample, Action<WaveEntry> consume)
+	{
+		long first = Math.Max(startSample - position, 0);
+		long last = Math.Min(endSample - position, wave.SamplesInFrame);
+
+		if (last <= first)
+			wave.Release();
+		else if (first == 0 && last == wave.SamplesInFrame)
+			consume(wave);
+		else
 		{
-			return true;
+			int bytesPerSample = IsPlanarStereo ? WaveFormat.BlockAlign / 2 : WaveFormat.BlockAlign;
+			int offset = (int)first * bytesPerSample;
+			int length = (int)(last - first) * bytesPerSample;
+
+			//The trimmed entry takes over the original's reference.
+			consume(new WaveEntry
+			{
+				Chunk = wave.Chunk,
+				SamplesInFrame = (uint)(last - first),
+				FrameData = wave.FrameData.Slice(offset, length),
+				FrameData2 = wave.FrameData2.IsEmpty ? Memory<byte>.Empty : wave.FrameData2.Slice(offset, length),
+				Buffer = wave.Buffer,
+			});
 		}
-		else if (ret == -1313558101)
+	}
+
+	/// <summary>
+	/// Join decoded entries into one, releasing them. The audio is copied into a buffer from this
+	/// decoder's pool, charged to its budget, unless it is larger than the pool's buffers.
+	/// </summary>
+	public WaveEntry Concatenate(Queue<WaveEntry> entries)
+	{
+		var first = entries.Peek();
+		uint samplesInFrame = 0;
+		int length1 = 0, length2 = 0;
+		foreach (var entry in entries)
+		{
+			samplesInFrame += entry.SamplesInFrame;
+			length1 += entry.FrameData.Length;
+			length2 += entry.FrameData2.Length;
+		}
+
+		//The entry takes over the rented buffer's reference.
+		int requiredBytes = length1 + length2;
+		PcmBuffer buffer
+			= BufferPool is not null && requiredBytes <= BufferPool.BufferSize ? BufferPool.Rent(Budget)
+			: PcmBuffer.Unpooled(requiredBytes);
+
+		Memory<byte> frameData = buffer.Data.AsMemory(0, length1);
+		Memory<byte> frameData2 = buffer.Data.AsMemory(length1, length2);
+		int position1 = 0, position2 = 0;
+
+		while (entries.TryDequeue(out var entry))
 		{
-			return false;
+			entry.FrameData.CopyTo(frameData.Slice(position1));
+			entry.FrameData2.CopyTo(frameData2.Slice(position2));
+			position1 += entry.FrameData.Length;
+			position2 += entry.FrameData2.Length;
+			entry.Release();
 		}
 
-		throw new Exception($"Error decoding AAC frame. Code {NativeDecode.GetFFmpegErrorString(ret)}");
+		return new WaveEntry
+		{
+			Chunk = first.Chunk,
+			SamplesInFrame = samplesInFrame,
+			FrameData = frameData,
+			FrameData2 = frameData2,
+			Buffer = buffer,
+		};
 	}
 
 	private int GetMaxAvailableDecodeSize() => AudioDecoder.ReceiveDecodedFrame(null, null, 0);
 
+	/// <summary>
+	/// Discard all buffered frames and resampler samples so decoding can restart
+	/// from any frame of the same stream.
+	/// </summary>
+	public void Reset()
+	{
+		AudioDecoder.Reset();
+		NumberOfSamplesSkipped = 0;
+	}
+
+	/// <summary>
+	/// Scale the decoded audio while it is converted to <see cref="WaveFormat"/>. Set before decoding.
+	/// <see cref="Reset"/> restores unity gain.
+	/// </summary>
+	public void SetGain(double gainDecibels) => AudioDecoder.SetGain(DecibelsToGain(gainDecibels));
+
+	internal static float DecibelsToGain(double decibels) => (float)Math.Pow(10, decibels / 20);
+
+	private void PublishStats()
+	{
+		if (CodecMetrics.CodecEnabled)
+			CodecMetrics.RecordCodecStats(CodecMetrics.Decode, AudioDecoder.GetStats(), ref PublishedStats);
+	}
+
 	public void Dispose()
 	{
 		AudioDecoder.Dispose();
@@ -12,8 +12,23 @@ internal unsafe sealed class FfmpegAacEncoder : IDisposable
 	public WaveFormat WaveFormat { get; }
 	private readonly NativeAacEncode AacEncoder;
 	private const int AAC_SAMPLES_PER_FRAME = 1024;
+	//6144 bits per channel per frame
+	private const int AAC_MAX_PACKET_SIZE_PER_CHANNEL = 768;
+	private const int DEFAULT_PACKETS_PER_BATCH = 20;
 	public byte[] GetAudioSpecificConfig() => AacEncoder.GetAudioSpecificConfig();
 
+	/// <summary>
+	/// Encoded packets from the most recent batch, back-to-back. Frames yielded by
+	/// <see cref="EncodeWave(WaveEntry)"/> and <see cref="EncodeFlush"/> slice this
+	/// buffer and are only valid until the enumeration advances past the batch.
+	/// </summary>
+	private byte[] PacketBuffer;
+	private int[] PacketSizes;
+	private readonly int MaxPacketSize;
+	private CodecStats PublishedStats;
+	/// <summary> Set by <see cref="CodecPool"/> on instances it may take back. </summary>
+	internal object? PoolKey { get; set; }
+
 	public FfmpegAacEncoder(WaveFormat inputWaveFormat, long? bitRate, double? quality)
 	{
 		if (inputWaveFormat.Channels > 2)
@@ -23,38 +38,32 @@ internal unsafe sealed class FfmpegAacEncoder : IDisposable
 
 		WaveFormat = inputWaveFormat;
 		AacEncoder = new NativeAacEncode(WaveFormat, bitRate ?? 0, quality ?? 0);
+		MaxPacketSize = AAC_MAX_PACKET_SIZE_PER_CHANNEL * WaveFormat.Channels;
+		PacketSizes = new int[DEFAULT_PACKETS_PER_BATCH];
+		PacketBuffer = new byte[DEFAULT_PACKETS_PER_BATCH * MaxPacketSize];
 	}
 
 	public IEnumerable<FrameEntry> EncodeWave(WaveEntry input)
 	{
-		int startIndex = 0;
+		int samplesSent = 0;
 		var frameSize = (int)input.SamplesInFrame;
+		EnsureBatchCapacity(frameSize / AAC_SAMPLES_PER_FRAME + 2);
 
-		//It's possible that a frame may be larger than AAC_SAMPLES_PER_FRAME
-		//Send a maximum of AAC_SAMPLES_PER_FRAME at a time to the encoder.
-		while (frameSize > 0)
+		//Each batch encodes as many samples as will fit in the packet buffer.
+		while (samplesSent < frameSize)
 		{
-			int toSend = Math.Min(frameSize, AAC_SAMPLES_PER_FRAME);
-
-			int samplesNeeded = SendSamples(input.FrameData.Slice(startIndex, toSend).Span, toSend);
-			startIndex += toSend;
-			frameSize -= toSend;
+			samplesSent += EncodeBatch(input, samplesSent, frameSize - samplesSent, out int nbPackets);
 
-			if (samplesNeeded == 0)
+			int offset = 0;
+			for (int i = 0; i < nbPackets; i++)
 			{
-				int encodedSize;
-				while ((encodedSize = GetAvailableFrameSize()) > 0)
+				yield return new FrameEntry
 				{
-					Memory<byte> encAud = GetEncodedFrame(encodedSize);
-					yield return new FrameEntry
-					{
-						Chunk = input.Chunk,
-						SamplesInFrame = AAC_SAMPLES_PER_FRAME,
-						FrameData = encAud
-					};
-				}
-				if (encodedSize < 0)
-					throw new Exception("Failed to retrieve encoded samples.");
+					Chunk = input.Chunk,
+					SamplesInFrame = AAC_SAMPLES_PER_FRAME,
+					FrameData = PacketBuffer.AsMemory(offset, PacketSizes[i])
+				};
+				offset += PacketSizes[i];
 			}
 		}
 	}
@@ -68,65 +77,58 @@ internal unsafe sealed class FfmpegAacEncoder : IDisposable
 
 		do
 		{
-			int encodedSize = GetAvailableFrameSize();
+			EncodeBatch(null, 0, 0, out int nbPackets);
 
-			if (encodedSize < 0)
-				throw new Exception("Failed to retrieve encoded samples.");
-			else if (encodedSize == 0) yield break;
+			if (nbPackets == 0) yield break;
 
-			Memory<byte> encAud = GetEncodedFrame(encodedSize);
-			yield return new FrameEntry
+			int offset = 0;
+			for (int i = 0; i < nbPackets; i++)
 			{
-				SamplesInFrame = AAC_SAMPLES_PER_FRAME,
-				FrameData = encAud
-			};
+				yield return new FrameEntry
+				{
+					SamplesInFrame = AAC_SAMPLES_PER_FRAME,
+					FrameData = PacketBuffer.AsMemory(offset, PacketSizes[i])
+				};
+				offset += PacketSizes[i];
+			}
 		} while (true);
 	}
 
-	private int SendSamples(Span<byte> frameData, int numSamples)
+	private int EncodeBatch(WaveEntry? input, int startSample, int numSamples, out int nbPackets)
 	{
 		int ret;
-		fixed (byte* buffer1 = frameData)
+		int packetCount;
+
+		fixed (byte* buffer1 = input is null ? default : input.FrameData.Span.Slice(startSample * WaveFormat.BlockAlign))
+		fixed (byte* pPackets = PacketBuffer)
+		fixed (int* pPacketSizes = PacketSizes)
 		{
-			ret = AacEncoder.EncodeFrame(buffer1, null, numSamples);
+			ret = AacEncoder.EncodeBatch(buffer1, null, numSamples, pPackets, PacketBuffer.Length, pPacketSizes, PacketSizes.Length, &packetCount);
 		}
 
 		if (ret < 0)
 			throw new Exception("Failed to encode samples.");
 
+		if (CodecMetrics.CodecEnabled)
+			CodecMetrics.RecordCodecStats(CodecMetrics.Encode, AacEncoder.GetStats(), ref PublishedStats);
+
+		nbPackets = packetCount;
 		return ret;
 	}
 
-	private int SendSamplesPlanarStereo(Span<byte> frameData1, Span<byte> frameData2, int numSamples)
+	private void EnsureBatchCapacity(int maxPackets)
 	{
-		int ret;
-		fixed (byte* buffer1 = frameData1)
-		{
-			fixed (byte* buffer2 = frameData2)
-			{
-				ret = AacEncoder.EncodeFrame(buffer1, buffer2, numSamples);
-			}
-		}
+		if (PacketSizes.Length >= maxPackets) return;
 
-		if (ret < 0)
-			throw new Exception("Failed to encode samples.");
-
-		return ret;
+		PacketSizes = new int[maxPackets];
+		PacketBuffer = new byte[maxPackets * MaxPacketSize];
 	}
 
-	private int GetAvailableFrameSize() => AacEncoder.ReceiveEncodedFrame(null, 0);
-
-	private Memory<byte> GetEncodedFrame(int encodedSize)
-	{
-		Memory<byte> encAud = new byte[encodedSize];
-		fixed (byte* pEncAud = encAud.Span)
-		{
-			encodedSize = AacEncoder.ReceiveEncodedFrame(pEncAud, encodedSize);
-		}
-		if (encodedSize != 0)
-			throw new Exception("Failed to retrieve encoded samples.");
-		return encAud;
-	}
+	/// <summary>
+	/// Discard all buffered samples and packets so the encoder can start a new stream
+	/// with the same options. Any frames from a previous enumeration are invalidated.
+	/// </summary>
+	public void Reset() => AacEncoder.Reset();
 
 	public void Dispose()
 	{
@@ -0,0 +1,147 @@
+﻿using AAXClean.Codecs.FrameFilters.Audio;
+using AAXClean.Codecs.Interop;
+using AAXClean.FrameFilters;
+using Mpeg4Lib.Boxes;
+using System;
+using System.Buffers;
+using System.Collections.Generic;
+
+namespace AAXClean.Codecs;
+
+/// <summary>
+/// Decodes, resamples and re-encodes AAC in one native call per batch. Decoded audio is
+/// written straight into the encoder's input buffer, so PCM never crosses into managed memory.
+/// </summary>
+internal unsafe sealed class FfmpegAacTranscoder : IDisposable
+{
+	public WaveFormat WaveFormat { get; }
+	private readonly NativeTranscode Transcoder;
+	private const int AAC_SAMPLES_PER_FRAME = 1024;
+	//6144 bits per channel per frame
+	private const int AAC_MAX_PACKET_SIZE_PER_CHANNEL = 768;
+	private const int PACKETS_PER_BATCH = 64;
+	public byte[] GetAudioSpecificConfig() => Transcoder.GetAudioSpecificConfig();
+	/// <summary> Scale the decoded audio before it is encoded. Set before transcoding. </summary>
+	public void SetGain(double gainDecibels) => Transcoder.SetGain(FfmpegAacDecoder.DecibelsToGain(gainDecibels));
+
+	/// <summary>
+	/// Encoded packets from the most recent batch, back-to-back. Frames yielded by
+	/// <see cref="Transcode(IReadOnlyList{FrameEntry})"/> and <see cref="TranscodeFlush"/>
+	/// slice this buffer and are only valid until the enumeration advances past the batch.
+	/// </summary>
+	private readonly byte[] PacketBuffer;
+	private readonly int[] PacketSizes;
+	private CodecStats PublishedDecodeStats;
+	private CodecStats PublishedEncodeStats;
+
+	public FfmpegAacTranscoder(AudioSampleEntry audioSampleEntry, SampleRate sampleRate, bool stereo, long? bitRate, double? quality, ResampleQuality resampleQuality = ResampleQuality.Default)
+	{
+		if (!CanTranscode(audioSampleEntry))
+			throw new ArgumentException("Only AAC audio can be transcoded natively.", nameof(audioSampleEntry));
+
+		WaveFormat = new WaveFormat(sampleRate, WaveFormatEncoding.Pcm, stereo);
+		Transcoder = new NativeTranscode(audioSampleEntry.Esds!, WaveFormat, bitRate ?? 0, quality ?? 0, resampleQuality);
+		PacketSizes = new int[PACKETS_PER_BATCH];
+		PacketBuffer = new byte[PACKETS_PER_BATCH * AAC_MAX_PACKET_SIZE_PER_CHANNEL * WaveFormat.Channels];
+	}
+
+	/// <summary>
+	/// USAC streams can contain frames the decoder rejects until it is seeded, which the
+	/// managed decoder skips. Those are left to the separate decode and encode filters.
+	/// </summary>
+	public static bool CanTranscode(AudioSampleEntry audioSampleEntry)
+		=> audioSampleEntry.Esds is EsdsBox esds
+		&& esds.ES_Descriptor.DecoderConfig.AudioSpecificConfig.AudioObjectType != 42;
+
+	public IEnumerable<FrameEntry> Transcode(IReadOnlyList<FrameEntry> inputs)
+	{
+		int framesConsumed = 0;
+
+		//Each batch stops early once the packet buffer is full.
+		do
+		{
+			framesConsumed += TranscodeBatch(inputs, framesConsumed, out int nbPackets);
+
+			int offset = 0;
+			for (int i = 0; i < nbPackets; i++)
+			{
+				yield return new FrameEntry
+				{
+					Chunk = inputs[0].Chunk,
+					SamplesInFrame = AAC_SAMPLES_PER_FRAME,
+					FrameData = PacketBuffer.AsMemory(offset, PacketSizes[i])
+				};
+				offset += PacketSizes[i];
+			}
+		} while (framesConsumed < inputs.Count);
+	}
+
+	public IEnumerable<FrameEntry> TranscodeFlush()
+	{
+		Transcoder.Flush();
+
+		do
+		{
+			TranscodeBatch([], 0, out int nbPackets);
+
+			if (nbPackets == 0) yield break;
+
+			int offset = 0;
+			for (int i = 0; i < nbPackets; i++)
+			{
+				yield return new FrameEntry
+				{
+					SamplesInFrame = AAC_SAMPLES_PER_FRAME,
+					FrameData = PacketBuffer.AsMemory(offset, PacketSizes[i])
+				};
+				offset += PacketSizes[i];
+			}
+		} while (true);
+	}
+
+	private int TranscodeBatch(IReadOnlyList<FrameEntry> inputs, int startFrame, out int nbPackets)
+	{
+		int consumed;
+		int packetCount;
+		int nbFrames = inputs.Count - startFrame;
+		var frameHandles = new MemoryHandle[nbFrames];
+		byte** ppFrames = stackalloc byte*[nbFrames];
+		int* pFrameSizes = stackalloc int[nbFrames];
+
+		try
+		{
+			for (int i = 0; i < nbFrames; i++)
+			{
+				frameHandles[i] = inputs[startFrame + i].FrameData.Pin();
+				ppFrames[i] = (byte*)frameHandles[i].Pointer;
+				pFrameSizes[i] = inputs[startFrame + i].FrameData.Length;
+			}
+
+			fixed (byte* pPackets = PacketBuffer)
+			fixed (int* pPacketSizes = PacketSizes)
+			{
+				consumed = Transcoder.TranscodeBatch(ppFrames, pFrameSizes, nbFrames, pPackets, PacketBuffer.Length, pPacketSizes, PacketSizes.Length, &packetCount);
+			}
+		}
+		finally
+		{
+			foreach (var handle in frameHandles)
+				handle.Dispose();
+		}
+
+		if (CodecMetrics.CodecEnabled)
+		{
+			var (decodeStats, encodeStats) = Transcoder.GetStats();
+			CodecMetrics.RecordCodecStats(CodecMetrics.Decode, decodeStats, ref PublishedDecodeStats);
+			CodecMetrics.RecordCodecStats(CodecMetrics.Encode, encodeStats, ref PublishedEncodeStats);
+		}
+
+		nbPackets = packetCount;
+		return consumed;
+	}
+
+	public void Dispose()
+	{
+		Transcoder.Dispose();
+	}
+}
@@ -0,0 +1,394 @@
+﻿using AAXClean.FrameFilters.Audio;
+using Mpeg4Lib;
+using Mpeg4Lib.Boxes;
+using System;
+using System.Buffers.Binary;
+using System.Collections.Generic;
+using System.IO;
+
+namespace AAXClean.Codecs.FrameFilters.Audio
+{
+	/// <summary>
+	/// Splits AAC-LC audio into chapter files by copying frames. A copied frame only decodes
+	/// correctly after the frame before it, so the first frames of each chapter are decoded
+	/// with that frame as pre-roll and re-encoded. The re-encoded frames start with the encoder's
+	/// priming frame, which an edit list tells players to skip, so a chapter file can only be
+	/// spliced if its stream can be read back and seeked. Other chapters are copied as they are.
+	/// </summary>
+	internal class AacPassthroughMultipartFilter : MultipartFilterBase<FrameEntry, NewAacSplitCallback>
+	{
+		private Action<NewAacSplitCallback> NewFileCallback { get; }
+		protected override int InputBufferSize => 100;
+
+		/// <summary> Frames at the start of each chapter replaced with re-encoded frames. </summary>
+		private const int SPLICE_FRAMES = 2;
+		/// <summary>
+		/// Frames encoded past the splice and discarded. The last re-encoded frame overlaps the
+		/// first copied frame, so the encoder must see the audio that follows it.
+		/// </summary>
+		private const int LOOKAHEAD_FRAMES = 2;
+		private const int AAC_SAMPLES_PER_FRAME = 1024;
+		private const int FRAMES_PER_CHUNK = 20;
+
+		private AacEncodingOptions encodingOptions;
+		private readonly AudioSampleEntry audioSampleEntry;
+		private readonly byte[] audioSpecificConfig;
+		private readonly long sourceBitRate;
+		private readonly FtypBox ftyp;
+		private readonly MoovBox moov;
+
+		private Mp4aWriter? mp4writer;
+		private int framesInCurrentChunk;
+		/// <summary> Samples at the start of the current chapter file that players should skip. </summary>
+		private long primingSamples;
+		private FrameEntry? previousFrame;
+		private List<FrameEntry>? spliceFrames;
+		private FfmpegAacDecoder? spliceDecoder;
+		private FfmpegAacEncoder? spliceEncoder;
+
+		public AacPassthroughMultipartFilter(ChapterInfo splitChapters, Mp4File mp4File, AacEncodingOptions encoderOptions, Action<NewAacSplitCallback> newFileCallback)
+			: base(splitChapters, mp4File.SampleRate, mp4File.AudioChannels == 2)
+		{
+			ftyp = mp4File.Ftyp;
+			moov = mp4File.Moov;
+			audioSampleEntry = mp4File.AudioSampleEntry;
+			audioSpecificConfig = audioSampleEntry.Esds!.ES_Descriptor.DecoderConfig.AudioSpecificConfig.AscBlob;
+			sourceBitRate = mp4File.AverageBitrate;
+			encodingOptions = encoderOptions;
+			NewFileCallback = newFileCallback;
+		}
+
+		protected override void CloseCurrentWriter()
+		{
+			if (mp4writer is null) return;
+
+			try
+			{
+				//Chapter ended before the splice filled up. Copy what there is.
+				if (spliceFrames is not null)
+				{
+					foreach (var frame in spliceFrames)
+						AddFrame(frame.FrameData.Span, frame.SamplesInFrame);
+					spliceFrames = null;
+				}
+				mp4writer.Close();
+				if (primingSamples > 0)
+					EditList.TrySkipSamples(mp4writer.OutputFile, primingSamples);
+				mp4writer.OutputFile.Close();
+			}
+			finally
+			{
+				mp4writer.Dispose();
+				mp4writer = null;
+			}
+		}
+
+		protected override void WriteFrameToFile(FrameEntry audioFrame, bool _)
+		{
+			if (mp4writer is not null)
+			{
+				if (spliceFrames is null)
+					AddFrame(audioFrame.FrameData.Span, audioFrame.SamplesInFrame);
+				else
+				{
+					spliceFrames.Add(audioFrame);
+					if (spliceFrames.Count == SPLICE_FRAMES + LOOKAHEAD_FRAMES)
+						WriteSplice();
+				}
+			}
+			previousFrame = audioFrame;
+		}
+
+		protected override void CreateNewWriter(NewAacSplitCallback callback)
+		{
+			callback.EncodingOptions = encodingOptions;
+			NewFileCallback(callback);
+			if (callback.OutputFile is not Stream outFile)
+				throw new InvalidOperationException("Output file stream null");
+
+			encodingOptions = callback.EncodingOptions ?? encodingOptions;
+			mp4writer = new Mp4aWriter(outFile, ftyp, moov, audioSpecificConfig);
+			mp4writer.RemoveTextTrack();
+			framesInCurrentChunk = 0;
+			primingSamples = 0;
+
+			if (mp4writer.Moov.ILst is not null)
+			{
+				var tags = new MetadataItems(mp4writer.Moov.ILst);
+				if (callback.TrackNumber.HasValue && callback.TrackCount.HasValue)
+					tags.TrackNumber = (callback.TrackNumber.Value, callback.TrackCount.Value);
+				tags.Title = callback.TrackTitle ?? tags.Title;
+			}
+
+			//The first frame of the stream has no frame before it, so it needs no splice.
+			bool canSplice = previousFrame is not null && outFile.CanRead && outFile.CanSeek;
+			spliceFrames = canSplice ? new(SPLICE_FRAMES + LOOKAHEAD_FRAMES) : null;
+		}
+
+		private void AddFrame(Span<byte> frame, uint samplesInFrame)
+		{
+			mp4writer!.AddFrame(frame, framesInCurrentChunk++ == 0, samplesInFrame);
+			framesInCurrentChunk %= FRAMES_PER_CHUNK;
+		}
+
+		private void WriteSplice()
+		{
+			var frames = spliceFrames!;
+			spliceFrames = null;
+
+			if (TryEncodeSplice(frames, out var packets, out int primingFrames))
+			{
+				primingSamples = primingFrames * AAC_SAMPLES_PER_FRAME;
+				foreach (var packet in packets)
+					AddFrame(packet, AAC_SAMPLES_PER_FRAME);
+				for (int i = SPLICE_FRAMES; i < frames.Count; i++)
+					AddFrame(frames[i].FrameData.Span, frames[i].SamplesInFrame);
+			}
+			else
+			{
+				foreach (var frame in frames)
+					AddFrame(frame.FrameData.Span, frame.SamplesInFrame);
+			}
+		}
+
+		/// <summary>
+		/// Decode the splice frames after the frame that precedes them and re-encode them.
+		/// Returns the encoder's priming packets followed by one packet per splice frame.
+		/// </summary>
+		private bool TryEncodeSplice(List<FrameEntry> frames, out List<byte[]> packets, out int primingFrames)
+		{
+			packets = new();
+			primingFrames = 0;
+			spliceDecoder ??= CodecPool.RentDecoder(audioSampleEntry, WaveFormatEncoding.Pcm);
+			spliceEncoder ??= CodecPool.RentEncoder(spliceDecoder.WaveFormat, encodingOptions.BitRate ?? sourceBitRate, encodingOptions.EncoderQuality);
+
+			Queue<WaveEntry> decoded = new(frames.Count + 1);
+			List<byte[]> encoded = new();
+			try
+			{
+				spliceDecoder.DecodeWave([previousFrame!, .. frames], decoded);
+
+				//Only the pre-roll frame's overlap is needed, not its output.
+				decoded.Dequeue().Release();
+
+				while (decoded.TryDequeue(out var wave))
+				{
+					if (wave.SamplesInFrame != AAC_SAMPLES_PER_FRAME)
+					{
+						wave.Release();
+						return false;
+					}
+					foreach (var packet in spliceEncoder.EncodeWave(wave))
+						encoded.Add(packet.FrameData.ToArray());
+					wave.Release();
+				}
+				foreach (var packet in spliceEncoder.EncodeFlush())
+					encoded.Add(packet.FrameData.ToArray());
+			}
+			finally
+			{
+				while (decoded.TryDequeue(out var wave))
+					wave.Release();
+				spliceDecoder.Reset();
+				spliceEncoder.Reset();
+			}
+
+			//A flushed encoder outputs one packet per frame plus its priming packets.
+			primingFrames = encoded.Count - frames.Count;
+			if (primingFrames < 1)
+				return false;
+
+			packets = encoded.GetRange(0, primingFrames + SPLICE_FRAMES);
+			return true;
+		}
+
+		protected override void Dispose(bool disposing)
+		{
+			if (disposing && !Disposed)
+			{
+				CloseCurrentWriter();
+				if (spliceDecoder is not null)
+					CodecPool.Return(spliceDecoder);
+				if (spliceEncoder is not null)
+					CodecPool.Return(spliceEncoder);
+			}
+			base.Dispose(disposing);
+		}
+
+		/// <summary>
+		/// Adds an edit list to a finished file's audio track so that players skip its first
+		/// samples (ISO/IEC 14496-12, 8.6.6). Only moov is rewritten, so it must be the last box.
+		/// </summary>
+		private static class EditList
+		{
+			private const int HEADER_SIZE = 8;
+
+			/// <returns>False, leaving the file unchanged, if the file isn't laid out as expected.</returns>
+			public static bool TrySkipSamples(Stream file, long samples)
+			{
+				if (!TryReadLastBox(file, "moov"u8, out long moovOffset, out byte[] moov))
+					return false;
+
+				int mvhd = FindChild(moov, 0, "mvhd"u8);
+				if (mvhd < 0) return false;
+
+				int audioTrak = -1;
+				long otherTracksDuration = 0;
+				for (int trak = FindChild(moov, 0, "trak"u8); trak >= 0; trak = FindNext(moov, 0, trak, "trak"u8))
+				{
+					int hdlr = FindChild(moov, FindChild(moov, trak, "mdia"u8), "hdlr"u8);
+					if (hdlr >= 0 && GetSize(moov, hdlr) >= 20 && moov.AsSpan(hdlr + 16, 4).SequenceEqual("soun"u8))
+						audioTrak = trak;
+					else if (FindChild(moov, trak, "tkhd"u8) is int otherTkhd and >= 0)
+						otherTracksDuration = Math.Max(otherTracksDuration, ReadTime(moov, otherTkhd, 28, 36));
+				}
+				if (audioTrak < 0) return false;
+
+				int tkhd = FindChild(moov, audioTrak, "tkhd"u8);
+				int mdhd = FindChild(moov, FindChild(moov, audioTrak, "mdia"u8), "mdhd"u8);
+				if (tkhd < 0 || mdhd < 0) return false;
+
+				long movieTimescale = ReadTimescale(moov, mvhd);
+				long mediaTimescale = ReadTimescale(moov, mdhd);
+				long mediaDuration = ReadTime(moov, mdhd, 24, 32);
+				if (movieTimescale <= 0 || mediaTimescale <= 0 || samples >= mediaDuration)
+					return false;
+
+				//Durations are in the movie's timescale and the start time in the track's.
+				long editDuration = (mediaDuration - samples) * movieTimescale / mediaTimescale;
+				byte[] edts = CreateEdts(editDuration, samples);
+
+				//Replace any edit list copied from the source.
+				int oldEdts = FindChild(moov, audioTrak, "edts"u8);
+				int insertAt = oldEdts >= 0 ? oldEdts : tkhd + GetSize(moov, tkhd);
+				int removed = oldEdts >= 0 ? GetSize(moov, oldEdts) : 0;
+				int change = edts.Length - removed;
+
+				byte[] newMoov = [.. moov.AsSpan(0, insertAt), .. edts, .. moov.AsSpan(insertAt + removed)];
+				SetSize(newMoov, 0, moov.Length + change);
+				SetSize(newMoov, audioTrak, GetSize(moov, audioTrak) + change);
+				if (mvhd > insertAt)
+					mvhd += change;
+				if (tkhd > insertAt)
+					tkhd += change;
+
+				WriteTime(newMoov, tkhd, 28, 36, editDuration);
+				WriteTime(newMoov, mvhd, 24, 32, Math.Max(otherTracksDuration, editDuration));
+
+				file.Position = moovOffset;
+				file.Write(newMoov);
+				if (change < 0)
+					file.SetLength(moovOffset + newMoov.Length);
+				return true;
+			}
+
+			private static byte[] CreateEdts(long editDuration, long mediaTime)
+			{
+				bool version1 = editDuration > uint.MaxValue;
+				int entrySize = version1 ? 20 : 12;
+				byte[] edts = new byte[2 * HEADER_SIZE + 8 + entrySize];
+
+				SetHeader(edts, 0, edts.Length, "edts"u8);
+				SetHeader(edts, HEADER_SIZE, edts.Length - HEADER_SIZE, "elst"u8);
+				edts[2 * HEADER_SIZE] = (byte)(version1 ? 1 : 0);
+				BinaryPrimitives.WriteUInt32BigEndian(edts.AsSpan(2 * HEADER_SIZE + 4), 1);
+
+				var entry = edts.AsSpan(2 * HEADER_SIZE + 8);
+				if (version1)
+				{
+					BinaryPrimitives.WriteInt64BigEndian(entry, editDuration);
+					BinaryPrimitives.WriteInt64BigEndian(entry[8..], mediaTime);
+				}
+				else
+				{
+					BinaryPrimitives.WriteUInt32BigEndian(entry, (uint)editDuration);
+					BinaryPrimitives.WriteInt32BigEndian(entry[4..], (int)mediaTime);
+				}
+				//Media rate of 1.0
+				BinaryPrimitives.WriteInt16BigEndian(entry[^4..], 1);
+				return edts;
+			}
+
+			private static bool TryReadLastBox(Stream file, ReadOnlySpan<byte> type, out long offset, out byte[] box)
+			{
+				offset = -1;
+				box = [];
+				if (!file.CanRead || !file.CanSeek)
+					return false;
+
+				Span<byte> header = stackalloc byte[16];
+				long size = 0;
+				for (long position = 0; position < file.Length; position += size)
+				{
+					file.Position = position;
+					file.ReadExactly(header[..HEADER_SIZE]);
+					size = BinaryPrimitives.ReadUInt32BigEndian(header);
+					if (size == 1)
+					{
+						file.ReadExactly(header[HEADER_SIZE..]);
+						size = BinaryPrimitives.ReadInt64BigEndian(header[HEADER_SIZE..]);
+					}
+					else if (size == 0)
+						size = file.Length - position;
+
+					if (size < HEADER_SIZE) return false;
+					offset = header[4..HEADER_SIZE].SequenceEqual(type) ? position : -1;
+				}
+
+				if (offset < 0 || size > int.MaxValue) return false;
+
+				box = new byte[size];
+				file.Position = offset;
+				file.ReadExactly(box);
+				return GetSize(box, 0) == box.Length;
+			}
+
+			private static int FindChild(byte[] data, int parent, ReadOnlySpan<byte> type)
+				=> parent < 0 ? -1 : FindNext(data, parent, parent + HEADER_SIZE - 1, type);
+
+			/// <summary> Find the next child of <paramref name="parent"/> after <paramref name="previous"/> with the given type. </summary>
+			private static int FindNext(byte[] data, int parent, int previous, ReadOnlySpan<byte> type)
+			{
+				int end = parent + GetSize(data, parent);
+				int child = previous < parent + HEADER_SIZE ? parent + HEADER_SIZE : previous + GetSize(data, previous);
+				for (; child + HEADER_SIZE <= end; child += GetSize(data, child))
+				{
+					int size = GetSize(data, child);
+					if (size < HEADER_SIZE || child + size > end)
+						return -1;
+					if (data.AsSpan(child + 4, 4).SequenceEqual(type))
+						return child;
+				}
+				return -1;
+			}
+
+			/// <summary> Read the timescale of an mvhd or mdhd box. </summary>
+			private static long ReadTimescale(byte[] data, int box)
+				=> BinaryPrimitives.ReadUInt32BigEndian(data.AsSpan(box + (data[box + HEADER_SIZE] == 1 ? 28 : 20)));
+
+			/// <summary> Read a time field from a full box at the offset for its version. </summary>
+			private static long ReadTime(byte[] data, int box, int version0Offset, int version1Offset)
+				=> data[box + HEADER_SIZE] == 1
+				? BinaryPrimitives.ReadInt64BigEndian(data.AsSpan(box + version1Offset))
+				: BinaryPrimitives.ReadUInt32BigEndian(data.AsSpan(box + version0Offset));
+
+			private static void WriteTime(byte[] data, int box, int version0Offset, int version1Offset, long value)
+			{
+				if (data[box + HEADER_SIZE] == 1)
+					BinaryPrimitives.WriteInt64BigEndian(data.AsSpan(box + version1Offset), value);
+				else
+					BinaryPrimitives.WriteUInt32BigEndian(data.AsSpan(box + version0Offset), (uint)Math.Min(value, uint.MaxValue));
+			}
+
+			private static int GetSize(byte[] data, int box) => (int)Math.Min(BinaryPrimitives.ReadUInt32BigEndian(data.AsSpan(box)), int.MaxValue);
+
+			private static void SetSize(byte[] data, int box, int size) => BinaryPrimitives.WriteUInt32BigEndian(data.AsSpan(box), (uint)size);
+
+			private static void SetHeader(byte[] data, int box, int size, ReadOnlySpan<byte> type)
+			{
+				SetSize(data, box, size);
+				type.CopyTo(data.AsSpan(box + 4));
+			}
+		}
+	}
+}
@@ -1,5 +1,8 @@
 ﻿using AAXClean.FrameFilters;
 using Mpeg4Lib.Boxes;
+using System;
+using System.Collections.Generic;
+using System.Diagnostics;
 
 namespace AAXClean.Codecs.FrameFilters.Audio
 {
@@ -8,23 +11,84 @@ namespace AAXClean.Codecs.FrameFilters.Audio
 		protected override int InputBufferSize => 300;
 		public WaveFormat WaveFormat => AacDecoder.WaveFormat;
 
+		/// <summary>
+		/// Number of frames sent to the native decoder in one call. Output lags input by
+		/// up to one batch, and the audio still queued at the end is emitted as a single entry
+		/// that multipart filters split back into frames.
+		/// </summary>
+		private const int DECODE_BATCH_SIZE = 32;
+		private readonly List<FrameEntry> PendingFrames = new(DECODE_BATCH_SIZE);
+		private readonly Queue<WaveEntry> DecodedFrames = new(DECODE_BATCH_SIZE);
+		private static readonly KeyValuePair<string, object?> MetricsTag = CodecMetrics.FilterTag(nameof(AacToWave));
+		private int PublishedQueueDepth;
+
 		private readonly FfmpegAacDecoder AacDecoder;
-		public AacToWave(AudioSampleEntry audioSampleEntry, WaveFormatEncoding waveFormat, SampleRate sampleRate, bool stereo)
+		private readonly PcmBudget Budget = new(MetricsTag);
+		/// <param name="gainDecibels">Gain applied by the decoder as it converts to <paramref name="waveFormat"/>.</param>
+		public AacToWave(AudioSampleEntry audioSampleEntry, WaveFormatEncoding waveFormat, SampleRate sampleRate, bool stereo, ResampleQuality resampleQuality = ResampleQuality.Default, double gainDecibels = 0)
 		{
-			AacDecoder = new FfmpegAacDecoder(audioSampleEntry, waveFormat, sampleRate, stereo);
+			AacDecoder = CodecPool.RentDecoder(audioSampleEntry, waveFormat, sampleRate, stereo, resampleQuality);
+			AacDecoder.Budget = Budget;
+			if (gainDecibels != 0)
+				AacDecoder.SetGain(gainDecibels);
 		}
 		public AacToWave(AudioSampleEntry audioSampleEntry, WaveFormatEncoding waveFormat)
 		{
-			AacDecoder = new FfmpegAacDecoder(audioSampleEntry, waveFormat);
+			AacDecoder = CodecPool.RentDecoder(audioSampleEntry, waveFormat);
+			AacDecoder.Budget = Budget;
+		}
+
+		protected override WaveEntry PerformFinalFiltering()
+		{
+			long start = Stopwatch.GetTimestamp();
+			DecodePendingFrames();
+			DecodedFrames.Enqueue(AacDecoder.DecodeFlush());
+			var output = DecodedFrames.Count == 1 ? DecodedFrames.Dequeue() : AacDecoder.Concatenate(DecodedFrames);
+			RecordMetrics(start);
+			return output;
 		}
 
-		protected override WaveEntry PerformFinalFiltering() => AacDecoder.DecodeFlush();
-		public override WaveEntry PerformFiltering(FrameEntry input) => AacDecoder.DecodeWave(input);
+		public override WaveEntry PerformFiltering(FrameEntry input)
+		{
+			long start = Stopwatch.GetTimestamp();
+			PendingFrames.Add(input);
+			if (PendingFrames.Count == DECODE_BATCH_SIZE)
+				DecodePendingFrames();
+
+			//While the first batch fills there is no audio to pass on. The input's chunk belongs
+			//to audio that is still undecoded, so the placeholder carries none.
+			var output = DecodedFrames.TryDequeue(out var decoded) ? decoded
+				: new WaveEntry
+				{
+					SamplesInFrame = 0,
+					FrameData = Memory<byte>.Empty,
+				};
+			RecordMetrics(start);
+			return output;
+		}
+
+		private void RecordMetrics(long startTimestamp)
+		{
+			CodecMetrics.RecordFilterTime(MetricsTag, startTimestamp);
+			CodecMetrics.RecordQueueDepth(MetricsTag, PendingFrames.Count + DecodedFrames.Count, ref PublishedQueueDepth);
+		}
+
+		private void DecodePendingFrames()
+		{
+			if (PendingFrames.Count == 0) return;
+			AacDecoder.DecodeWave(PendingFrames, DecodedFrames);
+			PendingFrames.Clear();
+		}
 
 		protected override void Dispose(bool disposing)
 		{
 			if (disposing && !Disposed)
-				AacDecoder.Dispose();
+			{
+				CodecMetrics.RecordQueueDepth(MetricsTag, 0, ref PublishedQueueDepth);
+				AacDecoder.Budget = null;
+				Budget.Dispose();
+				CodecPool.Return(AacDecoder);
+			}
 			base.Dispose(disposing);
 		}
 	}
@@ -0,0 +1,115 @@
+﻿using AAXClean.FrameFilters;
+using AAXClean.FrameFilters.Audio;
+using System.Collections.Generic;
+using System.Diagnostics;
+using System.IO;
+using System.Threading.Tasks;
+
+namespace AAXClean.Codecs.FrameFilters.Audio
+{
+	/// <summary>
+	/// Re-encodes AAC frames to AAC with a single native transcoder, replacing the
+	/// <see cref="AacToWave"/> and <see cref="WaveToAacFilter"/> pair.
+	/// </summary>
+	internal sealed class AacTranscodeFilter : FrameFinalBase<FrameEntry>
+	{
+		private readonly FfmpegAacTranscoder aacTranscoder;
+		private readonly Mp4aWriter Mp4aWriter;
+		private readonly CoalescingWriteStream OutputStream;
+		private readonly ChapterQueue ChapterQueue;
+		protected override int InputBufferSize => 300;
+		private static readonly KeyValuePair<string, object?> MetricsTag = CodecMetrics.FilterTag(nameof(AacTranscodeFilter));
+		private int PublishedQueueDepth;
+
+		/// <summary> Number of frames sent to the native transcoder in one call. </summary>
+		private const int TRANSCODE_BATCH_SIZE = 32;
+		private readonly List<FrameEntry> PendingFrames = new(TRANSCODE_BATCH_SIZE);
+
+		private const int FRAMES_PER_CHUNK = 20;
+		private int FramesInCurrentChunk = 0;
+		public bool Closed { get; private set; }
+
+		public AacTranscodeFilter(Stream mp4Output, Mp4File mp4File, ChapterQueue chapterQueue, SampleRate sampleRate, bool stereo, AacEncodingOptions options)
+		{
+			ChapterQueue = chapterQueue;
+			aacTranscoder = new FfmpegAacTranscoder(mp4File.AudioSampleEntry, sampleRate, stereo, options.BitRate, options.EncoderQuality, options.ResampleQuality);
+			if (options.GainDecibels != 0)
+				aacTranscoder.SetGain(options.GainDecibels);
+			var asc = aacTranscoder.GetAudioSpecificConfig();
+			//The caller closes mp4Output, so only this filter's buffering is disposed.
+			OutputStream = new CoalescingWriteStream(mp4Output, MetricsTag, leaveOpen: true);
+			Mp4aWriter = new Mp4aWriter(OutputStream, mp4File.Ftyp, mp4File.Moov, asc);
+		}
+
+		protected override Task PerformFilteringAsync(FrameEntry input)
+		{
+			long start = Stopwatch.GetTimestamp();
+			PendingFrames.Add(input);
+			if (PendingFrames.Count == TRANSCODE_BATCH_SIZE)
+				TranscodePendingFrames();
+
+			CodecMetrics.RecordFilterTime(MetricsTag, start);
+			CodecMetrics.RecordQueueDepth(MetricsTag, PendingFrames.Count, ref PublishedQueueDepth);
+			return Task.CompletedTask;
+		}
+
+		protected override Task FlushAsync()
+		{
+			long start = Stopwatch.GetTimestamp();
+			TranscodePendingFrames();
+
+			foreach (var flushedFrame in aacTranscoder.TranscodeFlush())
+			{
+				Mp4aWriter.AddFrame(flushedFrame.FrameData.Span, newChunk: false, flushedFrame.SamplesInFrame);
+			}
+
+			//Write any remaining chapters
+			while (ChapterQueue?.TryGetNextChapter(out var chapterEntry) is true)
+				Mp4aWriter.WriteChapter(chapterEntry);
+
+			CloseWriter();
+			CodecMetrics.RecordFilterTime(MetricsTag, start);
+			return Task.CompletedTask;
+		}
+
+		private void TranscodePendingFrames()
+		{
+			if (PendingFrames.Count == 0) return;
+
+			foreach (var encodedAac in aacTranscoder.Transcode(PendingFrames))
+			{
+				bool newChunk = FramesInCurrentChunk++ == 0;
+
+				//Write chapters as soon as they're available.
+				while (ChapterQueue?.TryGetNextChapter(out var chapterEntry) is true)
+				{
+					Mp4aWriter.WriteChapter(chapterEntry);
+					newChunk = true;
+				}
+				Mp4aWriter.AddFrame(encodedAac.FrameData.Span, newChunk, encodedAac.SamplesInFrame);
+				FramesInCurrentChunk %= FRAMES_PER_CHUNK;
+			}
+			PendingFrames.Clear();
+		}
+
+		private void CloseWriter()
+		{
+			if (Closed) return;
+			Mp4aWriter.Close();
+			OutputStream.Dispose();
+			Closed = true;
+		}
+
+		protected override void Dispose(bool disposing)
+		{
+			if (disposing && !Disposed)
+			{
+				CodecMetrics.RecordQueueDepth(MetricsTag, 0, ref PublishedQueueDepth);
+				aacTranscoder?.Dispose();
+				Mp4aWriter?.Dispose();
+				OutputStream?.Dispose();
+			}
+			base.Dispose(disposing);
+		}
+	}
+}
@@ -0,0 +1,190 @@
+﻿using AAXClean.FrameFilters;
+using System;
+using System.Collections.Generic;
+using System.Diagnostics;
+
+namespace AAXClean.Codecs.FrameFilters.Audio
+{
+	/// <summary>
+	/// Decodes a whole file like <see cref="AacToWave"/>, serving frames from a <see cref="DecodeCache"/>
+	/// entry when one matches and building the entry when none does. If a frame doesn't match the
+	/// entry, or its cached PCM is corrupt, the entry is deleted and decoding continues live.
+	/// </summary>
+	internal sealed class CachedAacToWave : FrameTransformBase<FrameEntry, WaveEntry>
+	{
+		protected override int InputBufferSize => 300;
+		public WaveFormat WaveFormat => AacDecoder.WaveFormat;
+
+		private const int DECODE_BATCH_SIZE = 32;
+		/// <summary> Frames decoded and discarded to rebuild the decoder state when leaving the cache. </summary>
+		private const int WARMUP_FRAMES = 2;
+
+		private readonly FfmpegAacDecoder AacDecoder;
+		private readonly List<FrameEntry> PendingFrames = new(DECODE_BATCH_SIZE);
+		private readonly Queue<WaveEntry> DecodedFrames = new(DECODE_BATCH_SIZE);
+		private readonly Queue<FrameEntry> RecentFrames = new(WARMUP_FRAMES);
+		private static readonly KeyValuePair<string, object?> MetricsTag = CodecMetrics.FilterTag(nameof(CachedAacToWave));
+		private int PublishedQueueDepth;
+		private PcmBufferPool? BufferPool;
+		private readonly PcmBudget Budget = new(MetricsTag);
+
+		private DecodeCacheEntry? Reader;
+		private DecodeCacheWriter? Writer;
+		private long FrameIndex;
+
+		public CachedAacToWave(Mp4File mp4File, DecodeCache cache, SampleRate sampleRate, bool stereo, ResampleQuality resampleQuality = ResampleQuality.Default)
+			: this(CodecPool.RentDecoder(mp4File.AudioSampleEntry, WaveFormatEncoding.Pcm, sampleRate, stereo, resampleQuality), mp4File, cache, resampleQuality) { }
+
+		public CachedAacToWave(Mp4File mp4File, DecodeCache cache)
+			: this(CodecPool.RentDecoder(mp4File.AudioSampleEntry, WaveFormatEncoding.Pcm), mp4File, cache, ResampleQuality.Default) { }
+
+		private CachedAacToWave(FfmpegAacDecoder decoder, Mp4File mp4File, DecodeCache cache, ResampleQuality resampleQuality)
+		{
+			AacDecoder = decoder;
+			AacDecoder.Budget = Budget;
+			var key = cache.GetKey(mp4File, decoder.WaveFormat, resampleQuality);
+			Reader = cache.TryOpen(key);
+			if (Reader?.HasPcm is not true)
+			{
+				Reader?.Dispose();
+				Reader = null;
+				Writer = cache.Create(key, decoder.WaveFormat);
+			}
+		}
+
+		public override WaveEntry PerformFiltering(FrameEntry input)
+		{
+			long start = Stopwatch.GetTimestamp();
+			var output = Filter(input);
+			CodecMetrics.RecordFilterTime(MetricsTag, start);
+			CodecMetrics.RecordQueueDepth(MetricsTag, PendingFrames.Count + DecodedFrames.Count, ref PublishedQueueDepth);
+			return output;
+		}
+
+		private WaveEntry Filter(FrameEntry input)
+		{
+			if (Reader is not null)
+			{
+				if (Reader.Matches(FrameIndex, input.FrameData.Span) && Reader.TryReadPcm(FrameIndex, out var pcm))
+				{
+					if (RecentFrames.Count == WARMUP_FRAMES)
+						RecentFrames.Dequeue();
+					RecentFrames.Enqueue(input);
+					FrameIndex++;
+					return ToWaveEntry(input, pcm);
+				}
+				LeaveCache();
+			}
+
+			PendingFrames.Add(input);
+			if (PendingFrames.Count == DECODE_BATCH_SIZE)
+				DecodePendingFrames();
+
+			//The input's chunk belongs to audio that is still undecoded.
+			return DecodedFrames.TryDequeue(out var decoded) ? decoded
+				: new WaveEntry
+				{
+					SamplesInFrame = 0,
+					FrameData = Memory<byte>.Empty,
+				};
+		}
+
+		protected override WaveEntry PerformFinalFiltering()
+		{
+			long start = Stopwatch.GetTimestamp();
+			var output = FinalFilter();
+			CodecMetrics.RecordFilterTime(MetricsTag, start);
+			CodecMetrics.RecordQueueDepth(MetricsTag, 0, ref PublishedQueueDepth);
+			return output;
+		}
+
+		private WaveEntry FinalFilter()
+		{
+			if (Reader is not null)
+			{
+				//Every frame came from the cache. Serve the decoder's flushed samples too.
+				if (FrameIndex == Reader.FrameCount - 1 &&
+					Reader[FrameIndex].CompressedSize == FrameRecord.FLUSH_RECORD &&
+					Reader.TryReadPcm(FrameIndex, out var pcm))
+				{
+					return ToWaveEntry(null, pcm);
+				}
+				LeaveCache();
+			}
+
+			DecodePendingFrames();
+			var flushed = AacDecoder.DecodeFlush();
+			Writer?.Add(ReadOnlySpan<byte>.Empty, isFlush: true, flushed);
+			Writer?.Commit();
+			DecodedFrames.Enqueue(flushed);
+			return DecodedFrames.Count == 1 ? DecodedFrames.Dequeue() : AacDecoder.Concatenate(DecodedFrames);
+		}
+
+		/// <summary>
+		/// Stop reading from the cache entry, delete it, and warm the decoder up on the
+		/// frames just served so that live decoding continues seamlessly.
+		/// </summary>
+		private void LeaveCache()
+		{
+			Reader?.Invalidate();
+			Reader?.Dispose();
+			Reader = null;
+
+			if (RecentFrames.Count > 0)
+			{
+				AacDecoder.DecodeWave(RecentFrames.ToArray(), DecodedFrames);
+				while (DecodedFrames.TryDequeue(out var discarded))
+					discarded.Release();
+				RecentFrames.Clear();
+			}
+		}
+
+		private void DecodePendingFrames()
+		{
+			if (PendingFrames.Count == 0) return;
+			int firstOutput = DecodedFrames.Count;
+			AacDecoder.DecodeWave(PendingFrames, DecodedFrames);
+
+			if (Writer is not null)
+			{
+				int i = 0;
+				foreach (var decoded in DecodedFrames)
+				{
+					if (i >= firstOutput)
+						Writer.Add(PendingFrames[i - firstOutput].FrameData.Span, isFlush: false, decoded);
+					i++;
+				}
+			}
+			PendingFrames.Clear();
+		}
+
+		private WaveEntry ToWaveEntry(FrameEntry? input, ReadOnlySpan<byte> pcm)
+		{
+			BufferPool ??= new PcmBufferPool(Math.Max(pcm.Length, 2048 * WaveFormat.BlockAlign));
+			PcmBuffer buffer = pcm.Length <= BufferPool.BufferSize ? BufferPool.Rent(Budget) : PcmBuffer.Unpooled(pcm.Length);
+			pcm.CopyTo(buffer.Data);
+
+			return new WaveEntry
+			{
+				Chunk = input?.Chunk,
+				SamplesInFrame = (uint)(pcm.Length / WaveFormat.BlockAlign),
+				FrameData = buffer.Data.AsMemory(0, pcm.Length),
+				Buffer = buffer,
+			};
+		}
+
+		protected override void Dispose(bool disposing)
+		{
+			if (disposing && !Disposed)
+			{
+				CodecMetrics.RecordQueueDepth(MetricsTag, 0, ref PublishedQueueDepth);
+				Reader?.Dispose();
+				Writer?.Dispose();
+				AacDecoder.Budget = null;
+				Budget.Dispose();
+				CodecPool.Return(AacDecoder);
+			}
+			base.Dispose(disposing);
+		}
+	}
+}
@@ -0,0 +1,195 @@
+﻿using System;
+using System.Collections.Concurrent;
+using System.Collections.Generic;
+using System.Threading;
+using System.Threading.Tasks;
+
+namespace AAXClean.Codecs.FrameFilters.Audio
+{
+	/// <summary> Encodes and writes a single chapter's output file. </summary>
+	internal interface IChapterEncoder
+	{
+		/// <summary> Encode a frame of audio, then release it. The frame is released even if encoding fails. </summary>
+		void Write(WaveEntry audioFrame);
+		/// <summary> Flush the encoder and close the output file. </summary>
+		void Close();
+		/// <summary> Release the encoder and close the output file without finalizing it. </summary>
+		void Abort();
+	}
+
+	/// <summary>
+	/// Runs each chapter's encoder on its own worker so that chapters can be encoded concurrently
+	/// while the decoder moves on to the next one.
+	/// </summary>
+	/// <remarks>
+	/// At most <see cref="DegreeOfParallelism"/> chapters are encoded at once, and the decoded audio
+	/// queued for all of them never exceeds <see cref="MAX_BUFFERED_BYTES"/>. When either limit is
+	/// reached the caller blocks, which in turn back-pressures the decoder. A degree of parallelism
+	/// of 1 encodes inline on the caller's thread.
+	/// </remarks>
+	internal sealed class ChapterEncoderPool : IDisposable
+	{
+		public const long MAX_BUFFERED_BYTES = 256 * 1024 * 1024;
+
+		public int DegreeOfParallelism { get; }
+		private readonly SemaphoreSlim WorkerSlots;
+		private readonly List<Task> Workers = new();
+		private readonly object BudgetLock = new();
+		private long BufferedBytes;
+		private Exception? WorkerException;
+
+		public ChapterEncoderPool(int degreeOfParallelism)
+		{
+			DegreeOfParallelism = degreeOfParallelism;
+			WorkerSlots = new SemaphoreSlim(degreeOfParallelism);
+		}
+
+		/// <summary>
+		/// Wait for a free worker, then create the chapter's encoder on the calling thread
+		/// so that chapter callbacks are still raised in chapter order.
+		/// </summary>
+		public ChapterJob StartChapter(Func<IChapterEncoder> createEncoder)
+		{
+			if (DegreeOfParallelism == 1)
+				return new ChapterJob(this, createEncoder());
+
+			WorkerSlots.Wait();
+			ChapterJob job;
+			try
+			{
+				ThrowIfFaulted();
+				job = new ChapterJob(this, createEncoder());
+			}
+			catch
+			{
+				WorkerSlots.Release();
+				throw;
+			}
+
+			Workers.RemoveAll(w => w.IsCompleted);
+			Workers.Add(Task.Factory.StartNew(() => RunChapter(job), TaskCreationOptions.LongRunning));
+			return job;
+		}
+
+		/// <summary> Wait for every started chapter to finish encoding. </summary>
+		public async Task WhenAllAsync()
+		{
+			await Task.WhenAll(Workers);
+			ThrowIfFaulted();
+		}
+
+		private void RunChapter(ChapterJob job)
+		{
+			try
+			{
+				foreach (var frame in job.Frames.GetConsumingEnumerable())
+				{
+					int size = frame.FrameData.Length + frame.FrameData2.Length;
+					try
+					{
+						//Keep draining after a failure so the producer is never left waiting on the budget.
+						if (WorkerException is null)
+							job.Encoder.Write(frame);
+						else
+							frame.Release();
+					}
+					catch (Exception ex)
+					{
+						Interlocked.CompareExchange(ref WorkerException, ex, null);
+					}
+					finally
+					{
+						ReleaseBudget(size);
+					}
+				}
+				//A chapter missing audio must not be finalized as though it were complete.
+				if (WorkerException is null)
+					job.Encoder.Close();
+				else
+					job.Encoder.Abort();
+			}
+			catch (Exception ex)
+			{
+				Interlocked.CompareExchange(ref WorkerException, ex, null);
+			}
+			finally
+			{
+				WorkerSlots.Release();
+			}
+		}
+
+		private void ReserveBudget(int bytes)
+		{
+			lock (BudgetLock)
+			{
+				//Always admit a frame when nothing is queued so an oversized frame can't stall.
+				while (BufferedBytes > 0 && BufferedBytes + bytes > MAX_BUFFERED_BYTES)
+				{
+					ThrowIfFaulted();
+					Monitor.Wait(BudgetLock);
+				}
+				BufferedBytes += bytes;
+			}
+		}
+
+		private void ReleaseBudget(int bytes)
+		{
+			lock (BudgetLock)
+			{
+				BufferedBytes -= bytes;
+				Monitor.PulseAll(BudgetLock);
+			}
+		}
+
+		private void ThrowIfFaulted()
+		{
+			if (WorkerException is Exception ex)
+				throw new AggregateException("Chapter encoder failed.", ex);
+		}
+
+		public void Dispose()
+		{
+			try
+			{
+				Task.WaitAll(Workers.ToArray());
+			}
+			catch (AggregateException) { }
+			WorkerSlots.Dispose();
+		}
+
+		public sealed class ChapterJob
+		{
+			internal IChapterEncoder Encoder { get; }
+			internal BlockingCollection<WaveEntry> Frames { get; } = new();
+			private readonly ChapterEncoderPool Pool;
+
+			internal ChapterJob(ChapterEncoderPool pool, IChapterEncoder encoder)
+			{
+				Pool = pool;
+				Encoder = encoder;
+			}
+
+			public void Add(WaveEntry audioFrame)
+			{
+				if (Pool.DegreeOfParallelism == 1)
+				{
+					Encoder.Write(audioFrame);
+					return;
+				}
+
+				Pool.ThrowIfFaulted();
+				Pool.ReserveBudget(audioFrame.FrameData.Length + audioFrame.FrameData2.Length);
+				Frames.Add(audioFrame);
+			}
+
+			/// <summary> Signal that the chapter has no more audio, letting its encoder flush and close. </summary>
+			public void Complete()
+			{
+				if (Pool.DegreeOfParallelism == 1)
+					Encoder.Close();
+				else
+					Frames.CompleteAdding();
+			}
+		}
+	}
+}
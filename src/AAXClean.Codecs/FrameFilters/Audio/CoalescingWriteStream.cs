@@ -0,0 +1,194 @@
+﻿using System;
+using System.Collections.Generic;
+using System.Diagnostics;
+using System.IO;
+using System.Threading;
+using System.Threading.Tasks;
+
+namespace AAXClean.Codecs.FrameFilters.Audio
+{
+	/// <summary>
+	/// Collects an encoder's small writes into large blocks aligned to <see cref="BLOCK_SIZE"/>
+	/// in the destination, and writes each full block on a background task while the next one
+	/// fills. A write only blocks when the previous block is still being written, and that time
+	/// is published as the filter's I/O wait.
+	/// </summary>
+	/// <remarks>
+	/// Seeking, reading and reading the length first write everything buffered, so writers that
+	/// go back to patch headers see the same stream they would without buffering.
+	/// </remarks>
+	internal sealed class CoalescingWriteStream : Stream
+	{
+		public const int BLOCK_SIZE = 1024 * 1024;
+
+		private readonly Stream Destination;
+		private readonly bool LeaveOpen;
+		private readonly KeyValuePair<string, object?> MetricsTag;
+
+		private byte[] Block = new byte[BLOCK_SIZE];
+		private byte[] WritingBlock = new byte[BLOCK_SIZE];
+		private int BlockLength;
+		/// <summary> Bytes that fit in <see cref="Block"/> before the next aligned offset. </summary>
+		private int BlockCapacity;
+		private Task PendingWrite = Task.CompletedTask;
+		private long position;
+		private bool Disposed;
+
+		public CoalescingWriteStream(Stream destination, KeyValuePair<string, object?> metricsTag, bool leaveOpen = false)
+		{
+			ArgumentNullException.ThrowIfNull(destination, nameof(destination));
+			if (destination.CanWrite is false) throw new ArgumentException("stream is not writable", nameof(destination));
+
+			Destination = destination;
+			LeaveOpen = leaveOpen;
+			MetricsTag = metricsTag;
+			position = destination.CanSeek ? destination.Position : 0;
+			BlockCapacity = AlignedCapacity();
+		}
+
+		public override bool CanRead => !Disposed && Destination.CanRead;
+		public override bool CanSeek => !Disposed && Destination.CanSeek;
+		public override bool CanWrite => !Disposed;
+
+		public override long Length
+		{
+			get
+			{
+				Flush();
+				return Destination.Length;
+			}
+		}
+
+		public override long Position
+		{
+			get => position;
+			set => Seek(value, SeekOrigin.Begin);
+		}
+
+		public override void Write(byte[] buffer, int offset, int count)
+			=> Write(buffer.AsSpan(offset, count));
+
+		public override void WriteByte(byte value)
+			=> Write(new ReadOnlySpan<byte>(in value));
+
+		public override void Write(ReadOnlySpan<byte> buffer)
+		{
+			ObjectDisposedException.ThrowIf(Disposed, this);
+
+			while (buffer.Length > 0)
+			{
+				int count = Math.Min(buffer.Length, BlockCapacity - BlockLength);
+				buffer[..count].CopyTo(Block.AsSpan(BlockLength));
+				BlockLength += count;
+				position += count;
+				buffer = buffer[count..];
+
+				if (BlockLength == BlockCapacity)
+					SubmitBlock();
+			}
+		}
+
+		public override Task WriteAsync(byte[] buffer, int offset, int count, CancellationToken cancellationToken)
+		{
+			Write(buffer.AsSpan(offset, count));
+			return Task.CompletedTask;
+		}
+
+		public override ValueTask WriteAsync(ReadOnlyMemory<byte> buffer, CancellationToken cancellationToken = default)
+		{
+			Write(buffer.Span);
+			return ValueTask.CompletedTask;
+		}
+
+		/// <summary> Hand the filled block to a background write and start filling the other one. </summary>
+		private void SubmitBlock()
+		{
+			WaitForPendingWrite();
+			(Block, WritingBlock) = (WritingBlock, Block);
+			var data = WritingBlock.AsMemory(0, BlockLength);
+			PendingWrite = Task.Run(async () => await Destination.WriteAsync(data));
+			BlockLength = 0;
+			BlockCapacity = AlignedCapacity();
+		}
+
+		private void WaitForPendingWrite()
+		{
+			if (PendingWrite.IsCompleted)
+			{
+				PendingWrite.GetAwaiter().GetResult();
+				return;
+			}
+
+			long start = Stopwatch.GetTimestamp();
+			PendingWrite.GetAwaiter().GetResult();
+			CodecMetrics.RecordIoWaitTime(MetricsTag, start);
+		}
+
+		private int AlignedCapacity() => BLOCK_SIZE - (int)(position % BLOCK_SIZE);
+
+		public override void Flush()
+		{
+			ObjectDisposedException.ThrowIf(Disposed, this);
+			if (BlockLength > 0)
+				SubmitBlock();
+			WaitForPendingWrite();
+			Destination.Flush();
+		}
+
+		public override async Task FlushAsync(CancellationToken cancellationToken)
+		{
+			ObjectDisposedException.ThrowIf(Disposed, this);
+			if (BlockLength > 0)
+				SubmitBlock();
+			if (!PendingWrite.IsCompleted)
+			{
+				long start = Stopwatch.GetTimestamp();
+				await PendingWrite;
+				CodecMetrics.RecordIoWaitTime(MetricsTag, start);
+			}
+			await PendingWrite;
+			await Destination.FlushAsync(cancellationToken);
+		}
+
+		public override int Read(byte[] buffer, int offset, int count)
+		{
+			Flush();
+			int read = Destination.Read(buffer, offset, count);
+			position = Destination.Position;
+			BlockCapacity = AlignedCapacity();
+			return read;
+		}
+
+		public override long Seek(long offset, SeekOrigin origin)
+		{
+			Flush();
+			position = Destination.Seek(offset, origin);
+			BlockCapacity = AlignedCapacity();
+			return position;
+		}
+
+		public override void SetLength(long value)
+		{
+			Flush();
+			Destination.SetLength(value);
+		}
+
+		protected override void Dispose(bool disposing)
+		{
+			if (disposing && !Disposed)
+			{
+				try
+				{
+					Flush();
+				}
+				finally
+				{
+					Disposed = true;
+					if (!LeaveOpen)
+						Destination.Dispose();
+				}
+			}
+			base.Dispose(disposing);
+		}
+	}
+}
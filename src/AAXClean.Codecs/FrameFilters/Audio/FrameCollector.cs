@@ -0,0 +1,47 @@
+﻿using AAXClean.FrameFilters;
+using System;
+using System.Collections.Generic;
+using System.Threading.Tasks;
+
+namespace AAXClean.Codecs.FrameFilters.Audio
+{
+	/// <summary> Keeps every frame of a short range so it can be decoded later on another thread. </summary>
+	internal sealed class FrameCollector : FrameFinalBase<FrameEntry>
+	{
+		protected override int InputBufferSize => 100;
+		public List<FrameEntry> Frames { get; } = new();
+
+		protected override Task FlushAsync() => Task.CompletedTask;
+
+		protected override Task PerformFilteringAsync(FrameEntry input)
+		{
+			Frames.Add(input);
+			return Task.CompletedTask;
+		}
+
+		/// <summary>
+		/// Start time of the first collected frame. A range may start partway through a chunk, so
+		/// the first frame's index is counted back from the start of the next chunk when there is one.
+		/// </summary>
+		/// <param name="requestedStart">Start of the range that was read, used if the frames carry no chunk.</param>
+		public TimeSpan GetStartTime(SampleRate trackSampleRate, TimeSpan requestedStart)
+		{
+			if (Frames.Count == 0)
+				return requestedStart;
+
+			long frameDuration = Frames[0].SamplesInFrame;
+			if (Frames[0].Chunk is not ChunkEntry firstChunk)
+			{
+				long frameIndex = (long)(requestedStart.TotalSeconds * (int)trackSampleRate) / frameDuration;
+				return TimeSpan.FromSeconds((double)frameIndex * frameDuration / (int)trackSampleRate);
+			}
+
+			int framesInFirstChunk = Frames.FindIndex(f => f.Chunk?.ChunkIndex != firstChunk.ChunkIndex);
+			long firstIndex = framesInFirstChunk < 0
+				? firstChunk.FirstFrameIndex
+				: firstChunk.FirstFrameIndex + firstChunk.FrameCount - framesInFirstChunk;
+
+			return TimeSpan.FromSeconds((double)firstIndex * frameDuration / (int)trackSampleRate);
+		}
+	}
+}
@@ -0,0 +1,63 @@
+﻿using AAXClean.Codecs.Interop;
+using AAXClean.FrameFilters;
+using System;
+using System.Collections.Generic;
+using System.Diagnostics;
+using System.Threading.Tasks;
+
+namespace AAXClean.Codecs.FrameFilters.Audio
+{
+	/// <summary> Measures the loudness of decoded audio with the native BS.1770 meter. </summary>
+	internal sealed class LoudnessMeterFilter : FrameFinalBase<WaveEntry>
+	{
+		/// <summary> The loudness of all audio received. Set when the filter completes. </summary>
+		public LoudnessInfo? Loudness { get; private set; }
+		protected override int InputBufferSize => 500;
+
+		private readonly WaveFormat WaveFormat;
+		private readonly NativeLoudness Meter;
+		private readonly Action<LoudnessInfo>? LoudnessCallback;
+		private static readonly KeyValuePair<string, object?> MetricsTag = CodecMetrics.FilterTag(nameof(LoudnessMeterFilter));
+
+		public LoudnessMeterFilter(WaveFormat waveFormat, Action<LoudnessInfo>? loudnessCallback = null)
+		{
+			WaveFormat = waveFormat;
+			LoudnessCallback = loudnessCallback;
+			Meter = new NativeLoudness(waveFormat.SampleRate, waveFormat.Channels);
+		}
+
+		protected override Task FlushAsync()
+		{
+			long start = Stopwatch.GetTimestamp();
+			var result = Meter.GetResult();
+			Loudness = new LoudnessInfo(
+				result.integrated,
+				20 * Math.Log10(result.true_peak),
+				20 * Math.Log10(result.sample_peak),
+				TimeSpan.FromSeconds((double)result.samples / WaveFormat.SampleRate));
+			CodecMetrics.RecordFilterTime(MetricsTag, start);
+
+			LoudnessCallback?.Invoke(Loudness);
+			return Task.CompletedTask;
+		}
+
+		protected override unsafe Task PerformFilteringAsync(WaveEntry input)
+		{
+			long start = Stopwatch.GetTimestamp();
+			fixed (byte* pSamples0 = input.FrameData.Span)
+			fixed (byte* pSamples1 = input.FrameData2.Span)
+				Meter.Process(pSamples0, pSamples1, (int)input.SamplesInFrame, WaveFormat.Encoding);
+
+			input.Release();
+			CodecMetrics.RecordFilterTime(MetricsTag, start);
+			return Task.CompletedTask;
+		}
+
+		protected override void Dispose(bool disposing)
+		{
+			if (disposing && !Disposed)
+				Meter.Dispose();
+			base.Dispose(disposing);
+		}
+	}
+}
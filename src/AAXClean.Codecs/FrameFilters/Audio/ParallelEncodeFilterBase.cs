@@ -0,0 +1,203 @@
+﻿using AAXClean.FrameFilters;
+using System;
+using System.Buffers;
+using System.Collections.Generic;
+using System.Diagnostics;
+using System.Threading.Tasks;
+
+namespace AAXClean.Codecs.FrameFilters.Audio
+{
+	/// <summary>
+	/// Splits decoded audio into fixed-length segments, encodes up to <see cref="DegreeOfParallelism"/>
+	/// segments concurrently and writes the encoded frames back out in their original order.
+	/// </summary>
+	/// <remarks>
+	/// Each segment is encoded together with <see cref="ROLL_FRAMES"/> frames of the audio on either
+	/// side of it so the encoder's delay and lookahead are primed with real samples. Frames covering
+	/// that overlap are discarded, so the stitched stream has the same frame count and timing as a
+	/// single sequential encode of the whole input.
+	/// </remarks>
+	internal abstract class ParallelEncodeFilterBase : FrameFinalBase<WaveEntry>
+	{
+		protected override int InputBufferSize => 200;
+
+		/// <summary> Frames of overlap encoded before and after each segment. </summary>
+		protected const int ROLL_FRAMES = 2;
+		private const int SEGMENT_SECONDS = 30;
+
+		public int DegreeOfParallelism { get; }
+		protected WaveFormat WaveFormat { get; }
+		public bool Closed { get; private set; }
+		/// <summary> Number of samples per channel received so far. </summary>
+		protected long SamplesIn { get; private set; }
+
+		private readonly int SegmentFrames;
+		private readonly int DelayFrames;
+		private readonly int RollBytes;
+		private readonly int SegmentBufferSize;
+		private readonly Queue<Task<EncodedSegment>> PendingSegments = new();
+		private readonly KeyValuePair<string, object?> MetricsTag;
+		private int PublishedQueueDepth;
+
+		private byte[] SegmentBuffer;
+		private int BytesInSegment;
+		private int SegmentIndex;
+
+		/// <param name="waveFormat">Interleaved format of the decoded input audio</param>
+		/// <param name="frameSize">Number of samples per encoded frame</param>
+		/// <param name="encoderDelay">Number of samples the encoder delays its output by</param>
+		/// <param name="degreeOfParallelism">Maximum number of segments encoded or awaiting output at once</param>
+		protected ParallelEncodeFilterBase(WaveFormat waveFormat, int frameSize, int encoderDelay, int degreeOfParallelism)
+		{
+			if (waveFormat.Encoding != NAudio.Wave.WaveFormatEncoding.Pcm)
+				throw new ArgumentException("Parallel encoding only supports interleaved PCM wave formats.", nameof(waveFormat));
+
+			WaveFormat = waveFormat;
+			DegreeOfParallelism = degreeOfParallelism;
+			SegmentFrames = Math.Max(1, waveFormat.SampleRate * SEGMENT_SECONDS / frameSize);
+			DelayFrames = encoderDelay / frameSize;
+			RollBytes = ROLL_FRAMES * frameSize * waveFormat.BlockAlign;
+			SegmentBufferSize = (SegmentFrames * frameSize * waveFormat.BlockAlign) + 2 * RollBytes;
+			SegmentBuffer = ArrayPool<byte>.Shared.Rent(SegmentBufferSize);
+			MetricsTag = CodecMetrics.FilterTag(GetType().Name);
+		}
+
+		/// <summary>
+		/// Encode one segment of PCM audio to completion, including flushing the encoder.
+		/// Called concurrently from thread pool threads, so must not touch shared state.
+		/// </summary>
+		/// <param name="index">Zero-based index of the segment</param>
+		/// <param name="pcm">Interleaved audio including any pre-roll and post-roll</param>
+		protected abstract EncodedSegment EncodeSegment(int index, ReadOnlyMemory<byte> pcm);
+
+		/// <summary> Write a segment's kept frames to the output. Called in segment order. </summary>
+		protected abstract void WriteSegment(EncodedSegment segment);
+
+		/// <summary> Called after the last segment has been written. </summary>
+		protected abstract void CloseWriter();
+
+		protected override async Task PerformFilteringAsync(WaveEntry input)
+		{
+			var data = input.FrameData;
+			SamplesIn += data.Length / WaveFormat.BlockAlign;
+
+			while (data.Length > 0)
+			{
+				//The first segment has no pre-roll.
+				int segmentSize = SegmentIndex == 0 ? SegmentBufferSize - RollBytes : SegmentBufferSize;
+				int toCopy = Math.Min(data.Length, segmentSize - BytesInSegment);
+				data.Span[..toCopy].CopyTo(SegmentBuffer.AsSpan(BytesInSegment));
+				BytesInSegment += toCopy;
+				data = data[toCopy..];
+
+				if (BytesInSegment == segmentSize)
+					await DispatchSegmentAsync(isLastSegment: false);
+			}
+
+			input.Release();
+		}
+
+		protected override async Task FlushAsync()
+		{
+			await DispatchSegmentAsync(isLastSegment: true);
+
+			while (PendingSegments.Count > 0)
+				WriteTimedSegment(await PendingSegments.Dequeue());
+
+			CodecMetrics.RecordQueueDepth(MetricsTag, 0, ref PublishedQueueDepth);
+			CloseWriter();
+			Closed = true;
+		}
+
+		private async Task DispatchSegmentAsync(bool isLastSegment)
+		{
+			//Bound memory use by never holding more segments than we have workers.
+			while (PendingSegments.Count >= DegreeOfParallelism)
+				WriteTimedSegment(await PendingSegments.Dequeue());
+
+			var buffer = SegmentBuffer;
+			var length = BytesInSegment;
+			var index = SegmentIndex++;
+
+			if (!isLastSegment)
+			{
+				//The next segment starts with this one's post-roll preceded by its pre-roll.
+				SegmentBuffer = ArrayPool<byte>.Shared.Rent(SegmentBufferSize);
+				buffer.AsSpan(length - 2 * RollBytes, 2 * RollBytes).CopyTo(SegmentBuffer);
+				BytesInSegment = 2 * RollBytes;
+			}
+			else
+			{
+				SegmentBuffer = Array.Empty<byte>();
+				BytesInSegment = 0;
+			}
+
+			PendingSegments.Enqueue(Task.Run(() => EncodeAndTrim(index, buffer, length, isLastSegment)));
+
+			while (PendingSegments.TryPeek(out var next) && next.IsCompleted)
+				WriteTimedSegment(await PendingSegments.Dequeue());
+
+			CodecMetrics.RecordQueueDepth(MetricsTag, PendingSegments.Count, ref PublishedQueueDepth);
+		}
+
+		private void WriteTimedSegment(EncodedSegment segment)
+		{
+			long start = Stopwatch.GetTimestamp();
+			WriteSegment(segment);
+			CodecMetrics.RecordFilterTime(MetricsTag, start);
+		}
+
+		private EncodedSegment EncodeAndTrim(int index, byte[] buffer, int length, bool isLastSegment)
+		{
+			EncodedSegment segment;
+			long start = Stopwatch.GetTimestamp();
+			try
+			{
+				segment = EncodeSegment(index, buffer.AsMemory(0, length));
+			}
+			finally
+			{
+				ArrayPool<byte>.Shared.Return(buffer);
+			}
+			//Counted as the filter's time even though segments encode concurrently.
+			CodecMetrics.RecordFilterTime(MetricsTag, start);
+
+			//The first segment has no pre-roll, so it keeps the encoder's priming
+			//frames. Every other segment drops the frames covering its pre-roll.
+			int firstFrame = index == 0 ? 0 : ROLL_FRAMES + DelayFrames;
+			int frameCount
+				= isLastSegment ? segment.Frames.Count - firstFrame
+				: index == 0 ? SegmentFrames + DelayFrames
+				: SegmentFrames;
+
+			if (firstFrame + frameCount > segment.Frames.Count)
+				throw new InvalidOperationException($"Encoder produced {segment.Frames.Count} frames for segment {index} but {firstFrame + frameCount} were expected.");
+
+			segment.Frames.RemoveRange(firstFrame + frameCount, segment.Frames.Count - firstFrame - frameCount);
+			segment.Frames.RemoveRange(0, firstFrame);
+			return segment;
+		}
+
+		protected override void Dispose(bool disposing)
+		{
+			if (disposing && !Disposed)
+				CodecMetrics.RecordQueueDepth(MetricsTag, 0, ref PublishedQueueDepth);
+			if (disposing && !Disposed && SegmentBuffer.Length > 0)
+			{
+				ArrayPool<byte>.Shared.Return(SegmentBuffer);
+				SegmentBuffer = Array.Empty<byte>();
+			}
+			base.Dispose(disposing);
+		}
+
+		protected sealed class EncodedSegment
+		{
+			public int Index { get; init; }
+			/// <summary> Data preceding the first frame, such as an ID3v2 tag. </summary>
+			public Memory<byte> Header { get; init; }
+			/// <summary> Data following the last frame, such as an ID3v1 tag. </summary>
+			public Memory<byte> Trailer { get; init; }
+			public List<Memory<byte>> Frames { get; } = new();
+		}
+	}
+}
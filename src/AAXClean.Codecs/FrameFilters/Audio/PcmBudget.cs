@@ -0,0 +1,132 @@
+﻿using System;
+using System.Collections.Generic;
+using System.Diagnostics;
+using System.Threading;
+
+namespace AAXClean.Codecs.FrameFilters.Audio
+{
+	/// <summary>
+	/// Decoded audio one decoding filter has passed downstream and not yet had released. Renting
+	/// a buffer waits while the filter holds more than its limit or the process holds more than
+	/// <see cref="PcmMemory.ProcessLimit"/>.
+	/// </summary>
+	/// <remarks>
+	/// The limit is about <see cref="PcmMemory.BufferDuration"/> of the rate at which downstream
+	/// filters release audio, so a filter feeding slow consumers buffers less. A filter holding
+	/// nothing is always admitted. If nothing is released for <see cref="PROGRESS_TIMEOUT"/>, the
+	/// consumers must be holding audio until they receive more, so the filter is admitted and the
+	/// amount it held becomes its minimum limit.
+	/// </remarks>
+	internal sealed class PcmBudget : IDisposable
+	{
+		private static readonly TimeSpan PROGRESS_TIMEOUT = TimeSpan.FromMilliseconds(50);
+		/// <summary> Shortest interval over which the release rate is measured. </summary>
+		private static readonly TimeSpan RATE_WINDOW = TimeSpan.FromMilliseconds(100);
+
+		private readonly KeyValuePair<string, object?> MetricsTag;
+		private long BytesInUse;
+		private long MinimumLimit;
+		private long Releases;
+		private bool Overcommitted;
+		private bool Disposed;
+
+		private long WindowStart;
+		private long WindowBytes;
+		/// <summary> Smoothed rate at which downstream filters release audio, in bytes per second. </summary>
+		private double ReleaseRate;
+
+		public PcmBudget(KeyValuePair<string, object?> metricsTag)
+		{
+			MetricsTag = metricsTag;
+		}
+
+		public void Reserve(int bytes)
+		{
+			long waitStart = 0;
+			lock (PcmMemory.BudgetLock)
+			{
+				long releases = Releases;
+				long lastProgress = 0;
+				while (BytesInUse > 0 && !Overcommitted && IsOverLimit(bytes))
+				{
+					if (waitStart == 0)
+						waitStart = lastProgress = Stopwatch.GetTimestamp();
+
+					Monitor.Wait(PcmMemory.BudgetLock, PROGRESS_TIMEOUT);
+
+					if (Releases != releases)
+					{
+						releases = Releases;
+						lastProgress = Stopwatch.GetTimestamp();
+					}
+					else if (Stopwatch.GetElapsedTime(lastProgress) >= PROGRESS_TIMEOUT)
+					{
+						//Stop waiting until something is released.
+						Overcommitted = true;
+						MinimumLimit = Math.Max(MinimumLimit, BytesInUse + bytes);
+					}
+				}
+				BytesInUse += bytes;
+				PcmMemory.Add(bytes);
+			}
+			if (waitStart != 0)
+				CodecMetrics.RecordStallTime(MetricsTag, waitStart);
+		}
+
+		public void Release(int bytes)
+		{
+			lock (PcmMemory.BudgetLock)
+			{
+				if (Disposed) return;
+				BytesInUse -= bytes;
+				PcmMemory.Add(-bytes);
+				Releases++;
+				Overcommitted = false;
+				UpdateReleaseRate(bytes);
+				Monitor.PulseAll(PcmMemory.BudgetLock);
+			}
+		}
+
+		private bool IsOverLimit(int bytes)
+		{
+			long measured = (long)(ReleaseRate * PcmMemory.BufferDuration.TotalSeconds);
+			long limit = Math.Max(Math.Min(measured, PcmMemory.PipelineLimit), Math.Max(MinimumLimit, 2L * bytes));
+			return BytesInUse + bytes > limit || PcmMemory.BytesInUse + bytes > PcmMemory.ProcessLimit;
+		}
+
+		private void UpdateReleaseRate(int bytes)
+		{
+			long now = Stopwatch.GetTimestamp();
+			if (WindowStart == 0)
+			{
+				WindowStart = now;
+				return;
+			}
+
+			WindowBytes += bytes;
+			var elapsed = Stopwatch.GetElapsedTime(WindowStart, now);
+			if (elapsed < RATE_WINDOW) return;
+
+			double rate = WindowBytes / elapsed.TotalSeconds;
+			ReleaseRate = ReleaseRate == 0 ? rate : (ReleaseRate + rate) / 2;
+			WindowStart = now;
+			WindowBytes = 0;
+		}
+
+		/// <summary>
+		/// Stop charging this budget. Audio still held downstream, such as entries abandoned in
+		/// a cancelled conversion's queues, no longer counts against the process limit.
+		/// </summary>
+		public void Dispose()
+		{
+			lock (PcmMemory.BudgetLock)
+			{
+				if (Disposed) return;
+				Disposed = true;
+				PcmMemory.Add(-BytesInUse);
+				BytesInUse = 0;
+				Monitor.PulseAll(PcmMemory.BudgetLock);
+			}
+		}
+	}
+}
@@ -0,0 +1,93 @@
+﻿using System;
+using System.Collections.Concurrent;
+using System.Threading;
+
+namespace AAXClean.Codecs.FrameFilters.Audio
+{
+	/// <summary>
+	/// A pool of fixed-size decode buffers. Buffers are rented by the decoder and
+	/// returned by the last downstream consumer of the frames sliced from them.
+	/// </summary>
+	/// <remarks>
+	/// Pools live as long as their decoder, which <see cref="CodecPool"/> may keep between
+	/// conversions, so only up to <see cref="MAX_RETAINED_BYTES"/> of free buffers are kept.
+	/// Buffers returned beyond that are left to the GC.
+	/// </remarks>
+	internal sealed class PcmBufferPool
+	{
+		private const int MAX_RETAINED_BYTES = 8 * 1024 * 1024;
+		private const int MIN_RETAINED_BUFFERS = 4;
+
+		public int BufferSize { get; }
+		/// <summary> Most free buffers the pool keeps. </summary>
+		public int MaxRetained { get; }
+		private readonly ConcurrentQueue<PcmBuffer> FreeBuffers = new();
+		private int RetainedCount;
+
+		public PcmBufferPool(int bufferSize)
+		{
+			BufferSize = bufferSize;
+			MaxRetained = Math.Max(MIN_RETAINED_BUFFERS, MAX_RETAINED_BYTES / bufferSize);
+		}
+
+		/// <summary>
+		/// Rent a buffer holding one reference on behalf of the caller. With a <paramref name="budget"/>,
+		/// waits until the budget has room and charges the buffer to it until the buffer is returned.
+		/// </summary>
+		public PcmBuffer Rent(PcmBudget? budget = null)
+		{
+			budget?.Reserve(BufferSize);
+			if (FreeBuffers.TryDequeue(out var buffer))
+				Interlocked.Decrement(ref RetainedCount);
+			else
+				buffer = new PcmBuffer(new byte[BufferSize], this);
+			buffer.Budget = budget;
+			buffer.AddReference();
+			return buffer;
+		}
+
+		internal void Return(PcmBuffer buffer)
+		{
+			if (Interlocked.Increment(ref RetainedCount) <= MaxRetained)
+				FreeBuffers.Enqueue(buffer);
+			else
+				Interlocked.Decrement(ref RetainedCount);
+		}
+	}
+
+	internal sealed class PcmBuffer
+	{
+		public byte[] Data { get; }
+		private readonly PcmBufferPool? Pool;
+		private int referenceCount;
+		/// <summary> Budget charged for this buffer while it is rented. </summary>
+		internal PcmBudget? Budget { get; set; }
+
+		internal PcmBuffer(byte[] data, PcmBufferPool? pool)
+		{
+			Data = data;
+			Pool = pool;
+		}
+
+		/// <summary> Create a buffer which is left to the GC instead of being returned to a pool. </summary>
+		public static PcmBuffer Unpooled(int size)
+		{
+			var buffer = new PcmBuffer(new byte[size], null);
+			buffer.AddReference();
+			return buffer;
+		}
+
+		public void AddReference() => Interlocked.Increment(ref referenceCount);
+
+		public void Release()
+		{
+			if (Interlocked.Decrement(ref referenceCount) == 0)
+			{
+				var budget = Budget;
+				Budget = null;
+				budget?.Release(Data.Length);
+				Pool?.Return(this);
+			}
+		}
+	}
+}
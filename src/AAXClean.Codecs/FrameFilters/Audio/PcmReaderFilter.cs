@@ -0,0 +1,70 @@
+﻿using AAXClean.FrameFilters;
+using System;
+using System.Collections.Generic;
+using System.Threading;
+using System.Threading.Channels;
+using System.Threading.Tasks;
+
+namespace AAXClean.Codecs.FrameFilters.Audio
+{
+	/// <summary>
+	/// Hands decoded audio to a consumer that pulls it. The filter waits while the consumer is
+	/// <see cref="LENT_ENTRIES"/> entries behind, so its input queue and then the decoder and
+	/// frame reader upstream wait too.
+	/// </summary>
+	internal sealed class PcmReaderFilter : FrameFinalBase<WaveEntry>
+	{
+		private const int LENT_ENTRIES = 4;
+		protected override int InputBufferSize => 100;
+
+		private readonly Channel<WaveEntry> Entries = Channel.CreateBounded<WaveEntry>(new BoundedChannelOptions(LENT_ENTRIES) { SingleReader = true, SingleWriter = true });
+		private readonly CancellationTokenSource AbandonedSource = new();
+
+		public IAsyncEnumerable<WaveEntry> ReadAllAsync(CancellationToken cancellationToken)
+			=> Entries.Reader.ReadAllAsync(cancellationToken);
+
+		/// <summary> End reading once the filter has received all audio, or with the error the conversion failed with. </summary>
+		public void Complete(Exception? error) => Entries.Writer.TryComplete(error);
+
+		/// <summary>
+		/// Stop lending audio because the consumer has stopped reading. Audio the filter
+		/// receives from now on, and audio not yet read, is released.
+		/// </summary>
+		public void Abandon()
+		{
+			AbandonedSource.Cancel();
+			ReleaseUnread();
+		}
+
+		/// <summary> Release audio the consumer didn't read. </summary>
+		public void ReleaseUnread()
+		{
+			while (Entries.Reader.TryRead(out var entry))
+				entry.Release();
+		}
+
+		protected override Task FlushAsync()
+		{
+			Entries.Writer.TryComplete();
+			return Task.CompletedTask;
+		}
+
+		protected override async Task PerformFilteringAsync(WaveEntry input)
+		{
+			if (input.SamplesInFrame == 0 || AbandonedSource.IsCancellationRequested)
+			{
+				input.Release();
+				return;
+			}
+
+			try
+			{
+				await Entries.Writer.WriteAsync(input, AbandonedSource.Token);
+			}
+			catch (OperationCanceledException)
+			{
+				input.Release();
+			}
+		}
+	}
+}
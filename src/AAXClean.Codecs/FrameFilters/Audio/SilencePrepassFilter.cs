@@ -0,0 +1,205 @@
+using AAXClean.FrameFilters;
+using Mpeg4Lib.Boxes;
+using System;
+using System.Collections.Generic;
+using System.Runtime.InteropServices;
+using System.Threading.Tasks;
+
+namespace AAXClean.Codecs.FrameFilters.Audio
+{
+	/// <summary>
+	/// Detects silence by decoding only the frames that might be quiet. Each frame's level is
+	/// estimated from its global_gain, or read from a cached loudness envelope, and frames
+	/// estimated louder than the threshold plus a tolerance are skipped. Skipped frames can't
+	/// contain silence, so the runs found in the decoded regions are the same runs a full
+	/// decode finds.
+	/// </summary>
+	internal sealed class SilencePrepassFilter : FrameFinalBase<FrameEntry>
+	{
+		public List<SilenceEntry> Silences => Scanner.Silences;
+		public WaveFormat WaveFormat => AacDecoder.WaveFormat;
+		protected override int InputBufferSize => 500;
+
+		/// <summary>
+		/// Frames always decoded at the start of the stream to learn how far above the
+		/// quantiser step this encoder puts the signal.
+		/// </summary>
+		private const int CALIBRATION_FRAMES = 512;
+		/// <summary> Skipped frames kept so a region can be decoded from before its first quiet frame. </summary>
+		private const int HISTORY_FRAMES = 16;
+		/// <summary> Frames decoded and discarded to rebuild the decoder's overlap and SBR state after a gap. </summary>
+		private const int WARMUP_FRAMES = 4;
+		/// <summary> The longest frame any supported decoder produces, in samples per channel. </summary>
+		private const int MAX_FRAME_SAMPLES = 2048;
+
+		private readonly FfmpegAacDecoder AacDecoder;
+		private readonly SilenceScanner Scanner;
+		private readonly bool CanEstimate;
+		private readonly double Threshold;
+		private readonly double Tolerance;
+		private readonly int CalibrationFrames;
+		private readonly short EnvelopeThreshold;
+		private DecodeCacheEntry? Envelope;
+
+		private readonly Queue<(FrameEntry frame, long position)> History = new(HISTORY_FRAMES);
+		private readonly List<FrameEntry> DecodeBatch = new(HISTORY_FRAMES + 1);
+		private readonly Queue<WaveEntry> DecodedFrames = new(HISTORY_FRAMES + 1);
+
+		/// <summary> Sample position of the next input frame. </summary>
+		private long Position;
+		private long FramesReceived;
+		private int FramesSkipped;
+		private bool Decoding = true;
+		private double OutputSamplesPerInputSample = 1;
+		/// <summary> Smallest difference seen between a frame's peak level and its global_gain, in dB. </summary>
+		private double MinPeakToGain = double.PositiveInfinity;
+		private int MaxQuietGain = int.MaxValue;
+
+		/// <param name="envelope">A cache entry for this file, decoded at its native format. The filter takes ownership of it.</param>
+		public SilencePrepassFilter(AudioSampleEntry audioSampleEntry, double db, TimeSpan minDuration, double toleranceDb, Action<SilenceDetectCallback>? detectionCallback, DecodeCacheEntry? envelope = null)
+		{
+			AacDecoder = CodecPool.RentDecoder(audioSampleEntry, WaveFormatEncoding.Pcm);
+			Scanner = new SilenceScanner(db, minDuration, AacDecoder.WaveFormat, detectionCallback);
+			CanEstimate = audioSampleEntry.Esds is EsdsBox esds && AacRawDataBlock.IsSupported(esds.ES_Descriptor.DecoderConfig.AudioSpecificConfig.AudioObjectType);
+			Threshold = db;
+			Tolerance = toleranceDb;
+			Envelope = envelope;
+			CalibrationFrames = envelope is null ? CALIBRATION_FRAMES : 0;
+			EnvelopeThreshold = (short)Math.Round(Math.Pow(10, db / 20) * short.MaxValue);
+		}
+
+		/// <summary>
+		/// A frame whose every envelope block holds a loud sample can only hide a silence shorter
+		/// than two blocks, so the envelope can only find silences at least that long.
+		/// </summary>
+		public static bool CanUseEnvelope(TimeSpan minDuration, WaveFormat waveFormat)
+			=> minDuration.TotalSeconds * waveFormat.SampleRate >= 2 * MAX_FRAME_SAMPLES / FrameRecord.ENVELOPE_BLOCKS;
+
+		protected override Task PerformFilteringAsync(FrameEntry input)
+		{
+			bool hasGain = AacRawDataBlock.TryReadGlobalGain(input.FrameData.Span, out int globalGain, out bool hasSpectrum);
+			bool mayBeQuiet = !CanEstimate || !hasGain || !hasSpectrum || globalGain <= MaxQuietGain;
+			long position = Position;
+
+			if (Envelope?.Matches(FramesReceived, input.FrameData.Span) is true)
+				mayBeQuiet = Envelope[FramesReceived].MinPeak <= EnvelopeThreshold;
+			else if (Envelope is not null)
+			{
+				//The entry is for different audio. Fall back to decoding every frame that might be quiet.
+				Envelope.Invalidate();
+				Envelope.Dispose();
+				Envelope = null;
+			}
+
+			if (Decoding || FramesReceived < CalibrationFrames)
+			{
+				DecodeBatch.Add(input);
+				Decode(DecodeBatch, 0, hasGain && hasSpectrum ? globalGain : -1);
+
+				//Stop once the decoded audio is loud and the estimate says the next frames will be too.
+				Decoding = mayBeQuiet || Scanner.InSilence || FramesReceived < CalibrationFrames;
+				FramesSkipped = 0;
+			}
+			else if (mayBeQuiet)
+			{
+				//Resume decoding from the oldest skipped frame still held. If none were dropped
+				//the decoder state is still continuous and nothing needs to be discarded.
+				int warmup = FramesSkipped > History.Count ? Math.Min(WARMUP_FRAMES, History.Count) : 0;
+				int index = 0;
+				while (History.TryDequeue(out var skipped))
+				{
+					if (index++ == warmup)
+						Scanner.Seek(skipped.position);
+					DecodeBatch.Add(skipped.frame);
+				}
+				if (warmup == index)
+					Scanner.Seek(position);
+
+				DecodeBatch.Add(input);
+				Decode(DecodeBatch, warmup, hasGain && hasSpectrum ? globalGain : -1);
+				Decoding = true;
+				FramesSkipped = 0;
+			}
+			else
+			{
+				if (History.Count == HISTORY_FRAMES)
+					History.Dequeue();
+				History.Enqueue((input, position));
+				FramesSkipped++;
+				Position += (long)Math.Round(input.SamplesInFrame * OutputSamplesPerInputSample);
+			}
+
+			FramesReceived++;
+			return Task.CompletedTask;
+		}
+
+		protected override Task FlushAsync()
+		{
+			if (Decoding)
+			{
+				WaveEntry flushed = AacDecoder.DecodeFlush();
+				Scanner.Scan(flushed);
+				flushed.Release();
+			}
+			Scanner.Finish();
+			return Task.CompletedTask;
+		}
+
+		/// <summary>
+		/// Decode a batch of consecutive frames, discarding the first <paramref name="discard"/>
+		/// outputs, and scan the rest. The last frame in the batch is the current input.
+		/// </summary>
+		private void Decode(List<FrameEntry> frames, int discard, int lastFrameGain)
+		{
+			AacDecoder.DecodeWave(frames, DecodedFrames);
+
+			for (int i = 0; DecodedFrames.TryDequeue(out var decoded); i++)
+			{
+				if (decoded.SamplesInFrame > 0 && frames[i].SamplesInFrame > 0)
+					OutputSamplesPerInputSample = (double)decoded.SamplesInFrame / frames[i].SamplesInFrame;
+
+				if (i >= discard)
+					Scanner.Scan(decoded);
+
+				if (i == frames.Count - 1)
+				{
+					Position += decoded.SamplesInFrame;
+					if (lastFrameGain >= 0)
+						Calibrate(decoded, lastFrameGain);
+				}
+
+				decoded.Release();
+			}
+			frames.Clear();
+		}
+
+		/// <summary>
+		/// Lower the peak-to-gain bound with a decoded frame and derive the largest global_gain
+		/// a frame can have and still peak below the threshold plus the tolerance.
+		/// </summary>
+		private void Calibrate(WaveEntry decoded, int globalGain)
+		{
+			int peak = 0;
+			foreach (short sample in MemoryMarshal.Cast<byte, short>(decoded.FrameData.Span))
+				peak = Math.Max(peak, Math.Abs((int)sample));
+
+			if (peak == 0) return;
+
+			double peakToGain = 20 * Math.Log10(peak / 32768d) - globalGain * AacRawDataBlock.DecibelsPerGainStep;
+			if (peakToGain >= MinPeakToGain) return;
+
+			MinPeakToGain = peakToGain;
+			MaxQuietGain = (int)Math.Floor((Threshold + Tolerance - MinPeakToGain) / AacRawDataBlock.DecibelsPerGainStep);
+		}
+
+		protected override void Dispose(bool disposing)
+		{
+			if (disposing && !Disposed)
+			{
+				Envelope?.Dispose();
+				CodecPool.Return(AacDecoder);
+			}
+			base.Dispose(disposing);
+		}
+	}
+}
@@ -0,0 +1,136 @@
+using AAXClean.Codecs.Interop;
+using System;
+using System.Collections.Generic;
+using System.Linq;
+
+namespace AAXClean.Codecs.FrameFilters.Audio
+{
+	/// <summary>
+	/// Finds runs of silence in a stream of decoded frames for one or more (threshold, minimum
+	/// duration) profiles. Positions are counted from the start of the stream and may jump
+	/// forward when frames are not scanned.
+	/// </summary>
+	internal unsafe sealed class SilenceScanner
+	{
+		/// <summary> Silences found for the first profile. </summary>
+		public List<SilenceEntry> Silences => ProfileSilences[0];
+		/// <summary> Silences found for each profile, in the order the profiles were given. </summary>
+		public List<SilenceEntry>[] ProfileSilences { get; }
+		/// <summary> True if the last scanned sample was silent for any profile. </summary>
+		public bool InSilence
+		{
+			get
+			{
+				foreach (var state in ScanStates)
+				{
+					if (state.run_length > 0)
+						return true;
+				}
+				return false;
+			}
+		}
+
+		private readonly WaveFormat WaveFormat;
+		private readonly Action<SilenceDetectCallback>? DetectionCallback;
+
+		//Profiles sorted by ascending threshold, as the native scanner requires.
+		private readonly int[] ProfileIndices;
+		private readonly double[] Decibels;
+		private readonly TimeSpan[] MinimumDurations;
+		private readonly double[] MaxAmplitudes;
+		private readonly long[] MinConsecutiveSamples;
+
+		private readonly NativeSilence.SilenceScanState[] ScanStates;
+		private int[] RunProfiles = Array.Empty<int>();
+		private long[] RunStarts = Array.Empty<long>();
+		private long[] RunLengths = Array.Empty<long>();
+
+		public SilenceScanner(double db, TimeSpan minDuration, WaveFormat waveFormat, Action<SilenceDetectCallback>? detectionCallback)
+			: this(new[] { (db, minDuration) }, waveFormat, detectionCallback) { }
+
+		public SilenceScanner(IReadOnlyList<(double decibels, TimeSpan minDuration)> profiles, WaveFormat waveFormat, Action<SilenceDetectCallback>? detectionCallback)
+		{
+			WaveFormat = waveFormat;
+			DetectionCallback = detectionCallback;
+
+			ProfileIndices = Enumerable.Range(0, profiles.Count).OrderBy(i => profiles[i].decibels).ToArray();
+			Decibels = ProfileIndices.Select(i => profiles[i].decibels).ToArray();
+			MinimumDurations = ProfileIndices.Select(i => profiles[i].minDuration).ToArray();
+			MaxAmplitudes = Decibels.Select(db => Math.Pow(10, db / 20)).ToArray();
+			MinConsecutiveSamples = MinimumDurations.Select(d => (long)Math.Round(waveFormat.SampleRate * d.TotalSeconds * waveFormat.Channels)).ToArray();
+
+			ScanStates = new NativeSilence.SilenceScanState[profiles.Count];
+			ProfileSilences = new List<SilenceEntry>[profiles.Count];
+			for (int i = 0; i < ProfileSilences.Length; i++)
+				ProfileSilences[i] = new List<SilenceEntry>();
+		}
+
+		/// <summary>
+		/// Continue scanning at <paramref name="samplePosition"/>. Runs in progress are
+		/// closed at the last scanned sample.
+		/// </summary>
+		public void Seek(long samplePosition)
+		{
+			Finish();
+			for (int p = 0; p < ScanStates.Length; p++)
+				ScanStates[p] = new NativeSilence.SilenceScanState { position = samplePosition * WaveFormat.Channels };
+		}
+
+		/// <summary> Report the runs in progress that are long enough. </summary>
+		public void Finish()
+		{
+			for (int p = 0; p < ScanStates.Length; p++)
+			{
+				if (ScanStates[p].run_length > MinConsecutiveSamples[p])
+					AddSilence(p, ScanStates[p].run_start, ScanStates[p].run_length);
+				ScanStates[p].run_length = 0;
+			}
+		}
+
+		public void Scan(WaveEntry input)
+		{
+			int nbSamples = (int)input.SamplesInFrame;
+
+			//Every reported run is longer than its profile's minimum and ends at a loud sample.
+			int maxRuns = 0;
+			foreach (long minSamples in MinConsecutiveSamples)
+				maxRuns += (int)(nbSamples * WaveFormat.Channels / (minSamples + 1)) + 1;
+
+			if (RunStarts.Length < maxRuns)
+			{
+				RunProfiles = new int[maxRuns];
+				RunStarts = new long[maxRuns];
+				RunLengths = new long[maxRuns];
+			}
+
+			int nbRuns;
+			fixed (byte* pSamples0 = input.FrameData.Span)
+			fixed (byte* pSamples1 = input.FrameData2.Span)
+			fixed (int* pRunProfiles = RunProfiles)
+			fixed (long* pRunStarts = RunStarts)
+			fixed (long* pRunLengths = RunLengths)
+			{
+				if (ScanStates.Length == 1)
+				{
+					nbRuns = NativeSilence.Scan(ref ScanStates[0], pSamples0, pSamples1, nbSamples, WaveFormat.Channels, WaveFormat.Encoding, MaxAmplitudes[0], MinConsecutiveSamples[0], pRunStarts, pRunLengths, RunStarts.Length);
+					new Span<int>(pRunProfiles, nbRuns).Clear();
+				}
+				else
+					nbRuns = NativeSilence.ScanProfiles(ScanStates, MaxAmplitudes, MinConsecutiveSamples, pSamples0, pSamples1, nbSamples, WaveFormat.Channels, WaveFormat.Encoding, pRunProfiles, pRunStarts, pRunLengths, RunStarts.Length);
+			}
+
+			for (int i = 0; i < nbRuns; i++)
+				AddSilence(RunProfiles[i], RunStarts[i], RunLengths[i]);
+		}
+
+		private void AddSilence(int profile, long silenceStart, long numConsecutiveSilences)
+		{
+			TimeSpan start = TimeSpan.FromSeconds((double)silenceStart / WaveFormat.Channels / WaveFormat.SampleRate);
+			TimeSpan end = TimeSpan.FromSeconds((double)(silenceStart + numConsecutiveSilences) / WaveFormat.Channels / WaveFormat.SampleRate);
+
+			SilenceEntry silence = new(start, end);
+			ProfileSilences[ProfileIndices[profile]].Add(silence);
+			DetectionCallback?.Invoke(new SilenceDetectCallback(Decibels[profile], MinimumDurations[profile], silence));
+		}
+	}
+}
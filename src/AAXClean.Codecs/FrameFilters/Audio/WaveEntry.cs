@@ -8,5 +8,48 @@ namespace AAXClean.Codecs.FrameFilters.Audio
 		public WaveFormatEncoding Encoding { get; init; }
 		/// <summary> Frame data for second channel of 2-channel Planar Audio. </summary>
 		public Memory<byte> FrameData2 { get; init; }
+		/// <summary> Pooled buffer backing the frame data, if any. </summary>
+		internal PcmBuffer? Buffer { get; init; }
+
+		/// <summary>
+		/// Release this entry's hold on its pooled buffer. The frame data must not be
+		/// used after calling this.
+		/// </summary>
+		internal void Release() => Buffer?.Release();
+
+		/// <summary> Take another hold on the pooled buffer for a consumer that will <see cref="Release"/> it. </summary>
+		internal void AddReference() => Buffer?.AddReference();
+
+		/// <summary>
+		/// Split this entry into consecutive entries of at most <paramref name="samplesPerEntry"/> samples.
+		/// The entries share this entry's buffer and each holds its own reference, the first taking over this one's.
+		/// </summary>
+		internal WaveEntry[] Split(int samplesPerEntry)
+		{
+			if (SamplesInFrame <= samplesPerEntry)
+				return [this];
+
+			int bytesPerSample = FrameData.Length / (int)SamplesInFrame;
+			var entries = new WaveEntry[(SamplesInFrame + samplesPerEntry - 1) / samplesPerEntry];
+			for (int i = 0; i < entries.Length; i++)
+			{
+				int offset = i * samplesPerEntry * bytesPerSample;
+				int samples = (int)Math.Min(samplesPerEntry, SamplesInFrame - i * samplesPerEntry);
+				int length = samples * bytesPerSample;
+				if (i > 0)
+					AddReference();
+
+				entries[i] = new WaveEntry
+				{
+					Chunk = Chunk,
+					SamplesInFrame = (uint)samples,
+					Encoding = Encoding,
+					FrameData = FrameData.Slice(offset, length),
+					FrameData2 = FrameData2.IsEmpty ? Memory<byte>.Empty : FrameData2.Slice(offset, length),
+					Buffer = Buffer,
+				};
+			}
+			return entries;
+		}
 	}
 }
@@ -1,8 +1,14 @@
 ﻿namespace AAXClean.Codecs.FrameFilters.Audio
 {
+	/// <summary> Decoded sample formats. Values are the matching FFmpeg sample formats. </summary>
 	public enum WaveFormatEncoding : int
 	{
+		/// <summary> 16-bit signed integer, channels interleaved. </summary>
 		Pcm = 1,
+		/// <summary> 32-bit float, channels interleaved. </summary>
+		Float = 3,
+		/// <summary> 32-bit float, one plane per channel. </summary>
+		FloatPlanar = 8,
 	}
 
 	public class WaveFormat : NAudio.Wave.WaveFormat
@@ -18,5 +24,7 @@
 			averageBytesPerSecond = blockAlign * this.sampleRate;
 			waveFormatTag = (NAudio.Wave.WaveFormatEncoding)format;
 		}
+
+		internal bool IsFloatPlanar => waveFormatTag == (NAudio.Wave.WaveFormatEncoding)WaveFormatEncoding.FloatPlanar;
 	}
 }
@@ -0,0 +1,53 @@
+﻿using AAXClean.FrameFilters;
+using System;
+using System.Collections.Generic;
+using System.Diagnostics;
+using System.Linq;
+using System.Threading.Tasks;
+
+namespace AAXClean.Codecs.FrameFilters.Audio
+{
+	/// <summary>
+	/// Sends each decoded entry to several filters. Every filter runs on its own thread with its
+	/// own input buffer, so a slow consumer only stalls decoding once its buffer is full. The
+	/// consumers share the entry's pooled buffer, which is returned after the last one releases it.
+	/// </summary>
+	internal sealed class WaveTeeFilter : FrameFinalBase<WaveEntry>
+	{
+		protected override int InputBufferSize => 100;
+		private readonly FrameFilterBase<WaveEntry>[] Targets;
+		private static readonly KeyValuePair<string, object?> MetricsTag = CodecMetrics.FilterTag(nameof(WaveTeeFilter));
+
+		public WaveTeeFilter(params FrameFilterBase<WaveEntry>[] targets)
+		{
+			ArgumentNullException.ThrowIfNull(targets, nameof(targets));
+			if (targets.Length < 1) throw new ArgumentException("At least one target is required.", nameof(targets));
+			Targets = targets;
+		}
+
+		protected override async Task PerformFilteringAsync(WaveEntry input)
+		{
+			//Each target releases the entry once.
+			for (int i = 1; i < Targets.Length; i++)
+				input.AddReference();
+
+			long start = Stopwatch.GetTimestamp();
+			foreach (var target in Targets)
+				await target.AddInputAsync(input);
+			CodecMetrics.RecordStallTime(MetricsTag, start);
+		}
+
+		protected override Task FlushAsync()
+			=> Task.WhenAll(Targets.Select(t => t.CompleteAsync()));
+
+		protected override void Dispose(bool disposing)
+		{
+			if (disposing && !Disposed)
+			{
+				foreach (var target in Targets)
+					target.Dispose();
+			}
+			base.Dispose(disposing);
+		}
+	}
+}
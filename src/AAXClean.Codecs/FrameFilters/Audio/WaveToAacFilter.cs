@@ -1,5 +1,7 @@
 ﻿using AAXClean.FrameFilters;
 using AAXClean.FrameFilters.Audio;
+using System.Collections.Generic;
+using System.Diagnostics;
 using System.IO;
 using System.Threading.Tasks;
 
@@ -9,8 +11,10 @@ namespace AAXClean.Codecs.FrameFilters.Audio
 	{
 		private readonly FfmpegAacEncoder aacEncoder;
 		private readonly Mp4aWriter Mp4aWriter;
+		private readonly CoalescingWriteStream OutputStream;
 		private readonly ChapterQueue ChapterQueue;
 		protected override int InputBufferSize => 200;
+		private static readonly KeyValuePair<string, object?> MetricsTag = CodecMetrics.FilterTag(nameof(WaveToAacFilter));
 
 		private const int FRAMES_PER_CHUNK = 20;
 		private int FramesInCurrentChunk = 0;
@@ -19,13 +23,19 @@ namespace AAXClean.Codecs.FrameFilters.Audio
 		internal WaveToAacFilter(Stream mp4Output, Mp4File mp4File, ChapterQueue chapterQueue, WaveFormat waveFormat, long? bitrate, double? quality)
 		{
 			ChapterQueue = chapterQueue;
-			aacEncoder = new FfmpegAacEncoder(waveFormat, bitrate, quality);
+			aacEncoder = CodecPool.RentEncoder(waveFormat, bitrate, quality);
 			var asc = aacEncoder.GetAudioSpecificConfig();
-			Mp4aWriter = new Mp4aWriter(mp4Output, mp4File.Ftyp, mp4File.Moov, asc);
+			//The caller closes mp4Output, so only this filter's buffering is disposed.
+			OutputStream = new CoalescingWriteStream(mp4Output, MetricsTag, leaveOpen: true);
+			Mp4aWriter = new Mp4aWriter(OutputStream, mp4File.Ftyp, mp4File.Moov, asc);
 		}
 
 		protected override Task PerformFilteringAsync(WaveEntry input)
 		{
+			long start = Stopwatch.GetTimestamp();
+			//Mp4aWriter records every packet's size and duration, so packets are added one at a time.
+			//They are sliced from the encoder's contiguous batch buffer and land back-to-back in
+			//OutputStream's block, so adding them as one chunk would save neither a copy nor a write.
 			foreach (var encodedAac in aacEncoder.EncodeWave(input))
 			{
 				bool newChunk = FramesInCurrentChunk++ == 0;
@@ -40,11 +50,14 @@ namespace AAXClean.Codecs.FrameFilters.Audio
 				FramesInCurrentChunk %= FRAMES_PER_CHUNK;
 			}
 
+			input.Release();
+			CodecMetrics.RecordFilterTime(MetricsTag, start);
 			return Task.CompletedTask;
 		}
 
 		protected override Task FlushAsync()
 		{
+			long start = Stopwatch.GetTimestamp();
 			foreach (var flushedFrame in aacEncoder.EncodeFlush())
 			{
 				Mp4aWriter.AddFrame(flushedFrame.FrameData.Span, newChunk: false, flushedFrame.SamplesInFrame);
@@ -55,6 +68,7 @@ namespace AAXClean.Codecs.FrameFilters.Audio
 				Mp4aWriter.WriteChapter(chapterEntry);
 
 			CloseWriter();
+			CodecMetrics.RecordFilterTime(MetricsTag, start);
 			return Task.CompletedTask;
 		}
 
@@ -62,6 +76,7 @@ namespace AAXClean.Codecs.FrameFilters.Audio
 		{
 			if (Closed) return;
 			Mp4aWriter.Close();
+			OutputStream.Dispose();
 			Closed = true;
 		}
 
@@ -69,8 +84,10 @@ namespace AAXClean.Codecs.FrameFilters.Audio
 		{
 			if (disposing && !Disposed)
 			{
-				aacEncoder?.Dispose();
+				if (aacEncoder is not null)
+					CodecPool.Return(aacEncoder);
 				Mp4aWriter?.Dispose();
+				OutputStream?.Dispose();
 			}
 			base.Dispose(disposing);
 		}
@@ -2,6 +2,8 @@
 using Mpeg4Lib;
 using Mpeg4Lib.Boxes;
 using System;
+using System.IO;
+using System.Threading.Tasks;
 
 namespace AAXClean.Codecs.FrameFilters.Audio
 {
@@ -10,18 +12,17 @@ namespace AAXClean.Codecs.FrameFilters.Audio
 		private Action<NewAacSplitCallback> NewFileCallback { get; }
 		protected override int InputBufferSize => 100;
 
-		private bool currentWriterOpen;
 		private AacEncodingOptions encodingOptions;
-		private Mp4aWriter? mp4writer;
-		private FfmpegAacEncoder? aacEncoder;
-		private int framesInCurrentChunk = 0;
+		private readonly ChapterEncoderPool encoderPool;
+		private ChapterEncoderPool.ChapterJob? currentJob;
 
 		private readonly WaveFormat waveFormat;
 		private readonly FtypBox ftyp;
 		private readonly MoovBox moov;
 		private const int FRAMES_PER_CHUNK = 20;
+		private const int SAMPLES_PER_FRAME = 1024;
 
-		public WaveToAacMultipartFilter(ChapterInfo splitChapters, FtypBox ftyp, MoovBox moov, WaveFormat waveFormat, AacEncodingOptions encoderOptions, Action<NewAacSplitCallback> newFileCallback)
+		public WaveToAacMultipartFilter(ChapterInfo splitChapters, FtypBox ftyp, MoovBox moov, WaveFormat waveFormat, AacEncodingOptions encoderOptions, Action<NewAacSplitCallback> newFileCallback, int degreeOfParallelism = 1)
 			: base(splitChapters, waveFormat.SampleRateEnum, waveFormat.Channels == 2)
 		{
 			this.ftyp = ftyp;
@@ -29,65 +30,138 @@ namespace AAXClean.Codecs.FrameFilters.Audio
 			this.waveFormat = waveFormat;
 			encodingOptions = encoderOptions;
 			NewFileCallback = newFileCallback;
+			encoderPool = new ChapterEncoderPool(degreeOfParallelism);
 		}
 
 		protected override void CloseCurrentWriter()
 		{
-			if (!currentWriterOpen || aacEncoder is null) return;
-
-			foreach (var flushedFrame in aacEncoder.EncodeFlush())
-			{
-				mp4writer?.AddFrame(flushedFrame.FrameData.Span, newChunk: false, flushedFrame.SamplesInFrame);
-			}
-			mp4writer?.Close();
-			mp4writer?.OutputFile.Close();
-			mp4writer?.Dispose();
-			currentWriterOpen = false;
+			currentJob?.Complete();
+			currentJob = null;
 		}
 
 		protected override void WriteFrameToFile(WaveEntry audioFrame, bool _)
 		{
-			if (aacEncoder is null) return;
-
-			foreach (var encodedAac in aacEncoder.EncodeWave(audioFrame))
-			{
-				mp4writer?.AddFrame(encodedAac.FrameData.Span, framesInCurrentChunk++ == 0, encodedAac.SamplesInFrame);
-				framesInCurrentChunk %= FRAMES_PER_CHUNK;
-			}
+			if (currentJob is null)
+				audioFrame.Release();
+			else
+				currentJob.Add(audioFrame);
 		}
 
 		protected override void CreateNewWriter(NewAacSplitCallback callback)
 		{
-			callback.EncodingOptions = encodingOptions;
-			NewFileCallback(callback);
-			if (callback.OutputFile is not System.IO.Stream outFile)
-				throw new InvalidOperationException("Output file stream null");
-
-			encodingOptions = callback.EncodingOptions;
-			aacEncoder = new FfmpegAacEncoder(waveFormat, encodingOptions?.BitRate, encodingOptions?.EncoderQuality);
-			var ascBytes = aacEncoder.GetAudioSpecificConfig();
-			mp4writer = new Mp4aWriter(outFile, ftyp, moov, ascBytes);
-			currentWriterOpen = true;
-			framesInCurrentChunk = 0;
-			mp4writer.RemoveTextTrack();
-
-			if (mp4writer.Moov.ILst is not null)
+			currentJob = encoderPool.StartChapter(() =>
 			{
-				var tags = new MetadataItems(mp4writer.Moov.ILst);
-				if (callback.TrackNumber.HasValue && callback.TrackCount.HasValue)
-					tags.TrackNumber = (callback.TrackNumber.Value, callback.TrackCount.Value);
-				tags.Title = callback.TrackTitle ?? tags.Title;
-			}
+				callback.EncodingOptions = encodingOptions;
+				NewFileCallback(callback);
+				if (callback.OutputFile is not Stream outFile)
+					throw new InvalidOperationException("Output file stream null");
+
+				encodingOptions = callback.EncodingOptions;
+				var chapterWriter = new ChapterWriter(outFile, ftyp, moov, waveFormat, encodingOptions);
+
+				if (chapterWriter.Mp4writer.Moov.ILst is not null)
+				{
+					var tags = new MetadataItems(chapterWriter.Mp4writer.Moov.ILst);
+					if (callback.TrackNumber.HasValue && callback.TrackCount.HasValue)
+						tags.TrackNumber = (callback.TrackNumber.Value, callback.TrackCount.Value);
+					tags.Title = callback.TrackTitle ?? tags.Title;
+				}
+				return chapterWriter;
+			});
+		}
+
+		protected override async Task PerformFilteringAsync(WaveEntry input)
+		{
+			//The decoder's last entry joins all the audio it had queued, so pass it on a frame
+			//at a time for chapter boundaries inside it to land on the right frame.
+			foreach (var frame in input.Split(SAMPLES_PER_FRAME))
+				await base.PerformFilteringAsync(frame);
+		}
+
+		protected override async Task FlushAsync()
+		{
+			await base.FlushAsync();
+			await encoderPool.WhenAllAsync();
 		}
 
 		protected override void Dispose(bool disposing)
 		{
 			if (disposing && !Disposed)
 			{
-				aacEncoder?.Dispose();
-				mp4writer?.Dispose();
+				CloseCurrentWriter();
+				encoderPool.Dispose();
 			}
 			base.Dispose(disposing);
 		}
+
+		private sealed class ChapterWriter : IChapterEncoder
+		{
+			public Mp4aWriter Mp4writer { get; }
+			private readonly FfmpegAacEncoder aacEncoder;
+			private int framesInCurrentChunk = 0;
+			private bool closed;
+
+			public ChapterWriter(Stream outFile, FtypBox ftyp, MoovBox moov, WaveFormat waveFormat, AacEncodingOptions? encodingOptions)
+			{
+				aacEncoder = CodecPool.RentEncoder(waveFormat, encodingOptions?.BitRate, encodingOptions?.EncoderQuality);
+				var ascBytes = aacEncoder.GetAudioSpecificConfig();
+				Mp4writer = new Mp4aWriter(outFile, ftyp, moov, ascBytes);
+				Mp4writer.RemoveTextTrack();
+			}
+
+			public void Write(WaveEntry audioFrame)
+			{
+				try
+				{
+					foreach (var encodedAac in aacEncoder.EncodeWave(audioFrame))
+					{
+						Mp4writer.AddFrame(encodedAac.FrameData.Span, framesInCurrentChunk++ == 0, encodedAac.SamplesInFrame);
+						framesInCurrentChunk %= FRAMES_PER_CHUNK;
+					}
+				}
+				finally
+				{
+					audioFrame.Release();
+				}
+			}
+
+			public void Close()
+			{
+				if (closed) return;
+				closed = true;
+
+				try
+				{
+					foreach (var flushedFrame in aacEncoder.EncodeFlush())
+					{
+						Mp4writer.AddFrame(flushedFrame.FrameData.Span, newChunk: false, flushedFrame.SamplesInFrame);
+					}
+					Mp4writer.Close();
+					Mp4writer.OutputFile.Close();
+				}
+				finally
+				{
+					Mp4writer.Dispose();
+					CodecPool.Return(aacEncoder);
+				}
+			}
+
+			public void Abort()
+			{
+				if (closed) return;
+				closed = true;
+
+				//Closing the file without Mp4writer.Close leaves it without a moov box.
+				try
+				{
+					Mp4writer.OutputFile.Close();
+				}
+				finally
+				{
+					Mp4writer.Dispose();
+					CodecPool.Return(aacEncoder);
+				}
+			}
+		}
 	}
 }
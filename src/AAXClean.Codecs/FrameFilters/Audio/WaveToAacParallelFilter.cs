@@ -0,0 +1,117 @@
+﻿using AAXClean.FrameFilters;
+using AAXClean.FrameFilters.Audio;
+using System;
+using System.Collections.Generic;
+using System.IO;
+using System.Runtime.InteropServices;
+
+namespace AAXClean.Codecs.FrameFilters.Audio
+{
+	/// <summary>
+	/// Encodes to a single AAC-LC mp4 file, spreading the encoding of consecutive segments across threads.
+	/// </summary>
+	internal class WaveToAacParallelFilter : ParallelEncodeFilterBase
+	{
+		private const int AAC_SAMPLES_PER_FRAME = 1024;
+		//The encoder primes its output with one frame of silence.
+		private const int AAC_ENCODER_DELAY = AAC_SAMPLES_PER_FRAME;
+
+		private readonly Mp4aWriter Mp4aWriter;
+		private readonly ChapterQueue ChapterQueue;
+		private readonly long? BitRate;
+		private readonly double? Quality;
+
+		private const int FRAMES_PER_CHUNK = 20;
+		private int FramesInCurrentChunk = 0;
+
+		internal WaveToAacParallelFilter(Stream mp4Output, Mp4File mp4File, ChapterQueue chapterQueue, WaveFormat waveFormat, long? bitrate, double? quality, int degreeOfParallelism)
+			: base(waveFormat, AAC_SAMPLES_PER_FRAME, AAC_ENCODER_DELAY, degreeOfParallelism)
+		{
+			ChapterQueue = chapterQueue;
+			BitRate = bitrate;
+			Quality = quality;
+
+			var aacEncoder = CodecPool.RentEncoder(waveFormat, bitrate, quality);
+			byte[] asc = aacEncoder.GetAudioSpecificConfig();
+			CodecPool.Return(aacEncoder);
+
+			Mp4aWriter = new Mp4aWriter(mp4Output, mp4File.Ftyp, mp4File.Moov, asc);
+		}
+
+		protected override EncodedSegment EncodeSegment(int index, ReadOnlyMemory<byte> pcm)
+		{
+			var aacEncoder = CodecPool.RentEncoder(WaveFormat, BitRate, Quality);
+
+			var input = new WaveEntry
+			{
+				SamplesInFrame = (uint)(pcm.Length / WaveFormat.BlockAlign),
+				FrameData = MemoryMarshal.AsMemory(pcm)
+			};
+
+			//Packets only live until the encoder's next batch, so gather them into one buffer.
+			using var packets = new MemoryStream();
+			var packetSizes = new List<int>();
+
+			try
+			{
+				foreach (var packet in aacEncoder.EncodeWave(input))
+				{
+					packets.Write(packet.FrameData.Span);
+					packetSizes.Add(packet.FrameData.Length);
+				}
+				foreach (var packet in aacEncoder.EncodeFlush())
+				{
+					packets.Write(packet.FrameData.Span);
+					packetSizes.Add(packet.FrameData.Length);
+				}
+			}
+			finally
+			{
+				CodecPool.Return(aacEncoder);
+			}
+
+			var segment = new EncodedSegment { Index = index };
+			var data = packets.GetBuffer().AsMemory(0, (int)packets.Length);
+
+			foreach (var size in packetSizes)
+			{
+				segment.Frames.Add(data[..size]);
+				data = data[size..];
+			}
+			return segment;
+		}
+
+		protected override void WriteSegment(EncodedSegment segment)
+		{
+			foreach (var frame in segment.Frames)
+			{
+				bool newChunk = FramesInCurrentChunk++ == 0;
+
+				//Write chapters as soon as they're available.
+				while (ChapterQueue?.TryGetNextChapter(out var chapterEntry) is true)
+				{
+					Mp4aWriter.WriteChapter(chapterEntry);
+					newChunk = true;
+				}
+				Mp4aWriter.AddFrame(frame.Span, newChunk, AAC_SAMPLES_PER_FRAME);
+				FramesInCurrentChunk %= FRAMES_PER_CHUNK;
+			}
+		}
+
+		protected override void CloseWriter()
+		{
+			//Write any remaining chapters
+			while (ChapterQueue?.TryGetNextChapter(out var chapterEntry) is true)
+				Mp4aWriter.WriteChapter(chapterEntry);
+
+			Mp4aWriter.Close();
+		}
+
+		protected override void Dispose(bool disposing)
+		{
+			if (disposing && !Disposed)
+				Mp4aWriter?.Dispose();
+			base.Dispose(disposing);
+		}
+	}
+}
@@ -1,6 +1,9 @@
 ﻿using AAXClean.FrameFilters;
 using NAudio.Lame;
+using System.Collections.Generic;
+using System.Diagnostics;
 using System.IO;
+using System.Runtime.InteropServices;
 using System.Threading.Tasks;
 
 namespace AAXClean.Codecs.FrameFilters.Audio
@@ -11,25 +14,48 @@ namespace AAXClean.Codecs.FrameFilters.Audio
 		protected override int InputBufferSize => 100;
 
 		private readonly LameMP3FileWriter lameMp3Encoder;
+		private readonly WaveFormat WaveFormat;
 		private readonly Stream OutputStream;
+		private static readonly KeyValuePair<string, object?> MetricsTag = CodecMetrics.FilterTag(nameof(WaveToMp3Filter));
 
 		public WaveToMp3Filter(Stream mp3Output, WaveFormat waveFormat, LameConfig lameConfig)
 		{
-			OutputStream = mp3Output;
-			lameMp3Encoder = new LameMP3FileWriter(OutputStream, waveFormat, lameConfig);
+			OutputStream = new CoalescingWriteStream(mp3Output, MetricsTag);
+			WaveFormat = waveFormat;
+			lameMp3Encoder = CreateWriter(OutputStream, waveFormat, lameConfig);
+		}
+
+		/// <summary> LAME takes float-planar audio as 32-bit float input, one plane per channel. </summary>
+		internal static LameMP3FileWriter CreateWriter(Stream mp3Output, WaveFormat waveFormat, LameConfig lameConfig)
+			=> new(mp3Output,
+				waveFormat.IsFloatPlanar ? NAudio.Wave.WaveFormat.CreateIeeeFloatWaveFormat(waveFormat.SampleRate, waveFormat.Channels) : waveFormat,
+				lameConfig);
+
+		/// <summary> Float-planar audio is passed to LAME in place instead of through its input buffer. </summary>
+		internal static void Write(LameMP3FileWriter writer, WaveFormat waveFormat, WaveEntry input)
+		{
+			if (waveFormat.IsFloatPlanar)
+				writer.WritePlanar(MemoryMarshal.Cast<byte, float>(input.FrameData.Span), MemoryMarshal.Cast<byte, float>(input.FrameData2.Span));
+			else
+				writer.Write(input.FrameData.Span);
 		}
 
 		protected override async Task FlushAsync()
 		{
+			long start = Stopwatch.GetTimestamp();
 			await lameMp3Encoder.FlushAsync();
 			lameMp3Encoder.Close();
 			OutputStream.Close();
 			Closed = true;
+			CodecMetrics.RecordFilterTime(MetricsTag, start);
 		}
 
 		protected override Task PerformFilteringAsync(WaveEntry input)
 		{
-			lameMp3Encoder.Write(input.FrameData.Span);
+			long start = Stopwatch.GetTimestamp();
+			Write(lameMp3Encoder, WaveFormat, input);
+			input.Release();
+			CodecMetrics.RecordFilterTime(MetricsTag, start);
 			return Task.CompletedTask;
 		}
 
@@ -37,8 +63,20 @@ namespace AAXClean.Codecs.FrameFilters.Audio
 		{
 			if (disposing && !Disposed)
 			{
-				lameMp3Encoder?.Close();
-				lameMp3Encoder?.Dispose();
+				try
+				{
+					lameMp3Encoder?.Close();
+					lameMp3Encoder?.Dispose();
+				}
+				finally
+				{
+					//Wait for the background write so it can't race the caller closing mp3Output.
+					try { OutputStream.Dispose(); }
+					catch
+					{
+						//The output of an abandoned conversion is incomplete anyway.
+					}
+				}
 			}
 			base.Dispose(disposing);
 		}
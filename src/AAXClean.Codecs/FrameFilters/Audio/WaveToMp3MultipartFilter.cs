@@ -2,67 +2,136 @@
 using NAudio.Lame;
 using System;
 using System.IO;
+using System.Threading.Tasks;
 
 namespace AAXClean.Codecs.FrameFilters.Audio
 {
 	internal sealed class WaveToMp3MultipartFilter : MultipartFilterBase<WaveEntry, NewMP3SplitCallback>
 	{
 		protected override int InputBufferSize => 100;
+		private const int SAMPLES_PER_FRAME = 1024;
 
 		private readonly Action<NewMP3SplitCallback> newFileCallback;
-		private bool CurrentWriterOpen;
 		private readonly WaveFormat WaveFormat;
-		private LameMP3FileWriter? Writer;
+		private readonly ChapterEncoderPool EncoderPool;
+		private ChapterEncoderPool.ChapterJob? CurrentJob;
 		private LameConfig LameConfig;
-		private Stream? OutputStream;
 
-		public WaveToMp3MultipartFilter(Mpeg4Lib.ChapterInfo splitChapters, WaveFormat waveFormat, LameConfig lameConfig, Action<NewMP3SplitCallback> newFileCallback)
+		public WaveToMp3MultipartFilter(Mpeg4Lib.ChapterInfo splitChapters, WaveFormat waveFormat, LameConfig lameConfig, Action<NewMP3SplitCallback> newFileCallback, int degreeOfParallelism = 1)
 			: base(splitChapters, waveFormat.SampleRateEnum, waveFormat.Channels == 2)
 		{
 			WaveFormat = waveFormat;
 			LameConfig = lameConfig;
 			this.newFileCallback = newFileCallback;
+			EncoderPool = new ChapterEncoderPool(degreeOfParallelism);
 		}
 
 		protected override void CloseCurrentWriter()
 		{
-			if (!CurrentWriterOpen) return;
-
-			Writer?.Flush();
-			Writer?.Close();
-			Writer?.Dispose();
-			OutputStream?.Close();
-			OutputStream?.Dispose();
-			CurrentWriterOpen = false;
+			CurrentJob?.Complete();
+			CurrentJob = null;
 		}
 
 		protected override void WriteFrameToFile(WaveEntry audioFrame, bool newChunk)
-			=> Writer?.Write(audioFrame.FrameData.Span);
+		{
+			if (CurrentJob is null)
+				audioFrame.Release();
+			else
+				CurrentJob.Add(audioFrame);
+		}
 
 		protected override void CreateNewWriter(NewMP3SplitCallback callback)
 		{
-			callback.LameConfig = LameConfig;
-			newFileCallback(callback);
+			CurrentJob = EncoderPool.StartChapter(() =>
+			{
+				callback.LameConfig = LameConfig;
+				newFileCallback(callback);
 
-			if (callback.OutputFile is not Stream outFile)
-				throw new InvalidOperationException("Output file stream null");
+				if (callback.OutputFile is not Stream outFile)
+					throw new InvalidOperationException("Output file stream null");
 
-			LameConfig = callback.LameConfig;
-			CurrentWriterOpen = true;
-			if (LameConfig.ID3 is ID3TagData tagData)
-			{
-				tagData.Track = $"{callback.TrackNumber}/{callback.TrackCount}";
-				tagData.Title = callback.TrackTitle ?? tagData.Title;
-			}
-			OutputStream = outFile;
-			Writer = new LameMP3FileWriter(outFile, WaveFormat, LameConfig);
+				LameConfig = callback.LameConfig;
+				if (LameConfig.ID3 is ID3TagData tagData)
+				{
+					tagData.Track = $"{callback.TrackNumber}/{callback.TrackCount}";
+					tagData.Title = callback.TrackTitle ?? tagData.Title;
+				}
+				//The config and tags are consumed here, so the next chapter is free to change them.
+				return new ChapterWriter(outFile, WaveToMp3Filter.CreateWriter(outFile, WaveFormat, LameConfig), WaveFormat);
+			});
+		}
+
+		protected override async Task PerformFilteringAsync(WaveEntry input)
+		{
+			//The decoder's last entry joins all the audio it had queued, so pass it on a frame
+			//at a time for chapter boundaries inside it to land on the right frame.
+			foreach (var frame in input.Split(SAMPLES_PER_FRAME))
+				await base.PerformFilteringAsync(frame);
+		}
+
+		protected override async Task FlushAsync()
+		{
+			await base.FlushAsync();
+			await EncoderPool.WhenAllAsync();
 		}
 
 		protected override void Dispose(bool disposing)
 		{
-			if (disposing && !Disposed && CurrentWriterOpen)
+			if (disposing && !Disposed)
+			{
 				CloseCurrentWriter();
+				EncoderPool.Dispose();
+			}
 			base.Dispose(disposing);
 		}
+
+		private sealed class ChapterWriter : IChapterEncoder
+		{
+			private readonly Stream OutputStream;
+			private readonly LameMP3FileWriter Writer;
+			private readonly WaveFormat WaveFormat;
+			private bool Closed;
+
+			public ChapterWriter(Stream outputStream, LameMP3FileWriter writer, WaveFormat waveFormat)
+			{
+				OutputStream = outputStream;
+				Writer = writer;
+				WaveFormat = waveFormat;
+			}
+
+			public void Write(WaveEntry audioFrame)
+			{
+				try
+				{
+					WaveToMp3Filter.Write(Writer, WaveFormat, audioFrame);
+				}
+				finally
+				{
+					audioFrame.Release();
+				}
+			}
+
+			public void Close()
+			{
+				if (Closed) return;
+				Closed = true;
+
+				Writer.Flush();
+				Writer.Close();
+				Writer.Dispose();
+				OutputStream.Close();
+				OutputStream.Dispose();
+			}
+
+			public void Abort()
+			{
+				if (Closed) return;
+				Closed = true;
+
+				//The writer only flushes LAME and writes its tag to a writable stream.
+				OutputStream.Close();
+				Writer.Dispose();
+			}
+		}
 	}
 }
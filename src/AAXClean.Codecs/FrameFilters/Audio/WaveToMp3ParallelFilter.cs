@@ -0,0 +1,308 @@
+﻿using NAudio.Lame;
+using System;
+using System.Buffers.Binary;
+using System.Collections.Generic;
+using System.IO;
+
+namespace AAXClean.Codecs.FrameFilters.Audio
+{
+	/// <summary>
+	/// Encodes to a single mp3 file, spreading the encoding of consecutive segments across threads.
+	/// </summary>
+	/// <remarks>
+	/// Segments are encoded with the bit reservoir disabled so that their frames can be stitched
+	/// together. No single encoder sees the whole stream, so the Xing/LAME tag written by the first
+	/// segment's encoder is rewritten from the stitched totals once the last segment is written.
+	/// </remarks>
+	internal class WaveToMp3ParallelFilter : ParallelEncodeFilterBase
+	{
+		//LAME delays its output by ENCDELAY samples (see lame's encoder.h).
+		private const int LAME_ENCODER_DELAY = 576;
+
+		private readonly LameConfig FirstSegmentConfig;
+		private readonly LameConfig SegmentConfig;
+		private readonly Stream OutputStream;
+		private readonly int SamplesPerFrame;
+		private Memory<byte> Trailer;
+
+		//Xing/LAME tag frame of the first segment and the totals needed to rewrite it.
+		private const int MAX_SEEK_POINTS = 1024;
+		private readonly List<long> SeekPoints = new();
+		private byte[]? TagFrame;
+		private long TagPosition;
+		private int SeekStride = 1;
+		private int FrameCount;
+		private long AudioBytes;
+		private ushort MusicCrc;
+
+		public WaveToMp3ParallelFilter(Stream mp3Output, WaveFormat waveFormat, LameConfig lameConfig, int degreeOfParallelism)
+			: base(waveFormat, GetSamplesPerFrame(waveFormat.SampleRate), LAME_ENCODER_DELAY, degreeOfParallelism)
+		{
+			OutputStream = mp3Output;
+			SamplesPerFrame = GetSamplesPerFrame(waveFormat.SampleRate);
+
+			//Every segment must share the input sample rate so that frames line up with segments.
+			FirstSegmentConfig = lameConfig.Clone();
+			FirstSegmentConfig.OutputSampleRate = waveFormat.SampleRate;
+			FirstSegmentConfig.DisableReservoir = true;
+			//The tag can only be rewritten in place, as LameMP3FileWriter does for a sequential encode.
+			FirstSegmentConfig.WriteVBRTag = lameConfig.WriteVBRTag is not false && mp3Output.CanSeek;
+
+			//Only the first segment carries the ID3 and Xing/LAME tags.
+			SegmentConfig = FirstSegmentConfig.Clone();
+			SegmentConfig.ID3 = null;
+			SegmentConfig.WriteVBRTag = false;
+		}
+
+		private static int GetSamplesPerFrame(int sampleRate) => sampleRate >= 32000 ? 1152 : 576;
+
+		protected override EncodedSegment EncodeSegment(int index, ReadOnlyMemory<byte> pcm)
+		{
+			var mp3Stream = new MemoryStream();
+			using (var lameMp3Encoder = new LameMP3FileWriter(mp3Stream, WaveFormat, index == 0 ? FirstSegmentConfig : SegmentConfig))
+			{
+				lameMp3Encoder.Write(pcm.Span);
+				lameMp3Encoder.Flush();
+			}
+			return Mp3FrameReader.SplitFrames(index, mp3Stream.GetBuffer().AsMemory(0, (int)mp3Stream.Length));
+		}
+
+		protected override void WriteSegment(EncodedSegment segment)
+		{
+			if (segment.Index == 0)
+			{
+				int id3Length = Mp3FrameReader.GetId3v2Length(segment.Header.Span);
+				if (segment.Header.Length > id3Length)
+				{
+					TagPosition = OutputStream.Position + id3Length;
+					TagFrame = segment.Header[id3Length..].ToArray();
+				}
+				OutputStream.Write(segment.Header.Span);
+				Trailer = segment.Trailer;
+			}
+
+			foreach (var frame in segment.Frames)
+			{
+				if (TagFrame is not null)
+					AddToTagTotals(frame.Span);
+				OutputStream.Write(frame.Span);
+			}
+		}
+
+		protected override void CloseWriter()
+		{
+			OutputStream.Write(Trailer.Span);
+
+			if (TagFrame is not null)
+			{
+				LameTag.Update(TagFrame, FrameCount, AudioBytes, GetSeekTable(), SamplesPerFrame, SamplesIn, MusicCrc);
+				long end = OutputStream.Position;
+				OutputStream.Position = TagPosition;
+				OutputStream.Write(TagFrame);
+				OutputStream.Position = end;
+			}
+			OutputStream.Close();
+		}
+
+		private void AddToTagTotals(ReadOnlySpan<byte> frame)
+		{
+			//Keep a bounded number of seek points by halving their density whenever the list fills.
+			if (FrameCount % SeekStride == 0)
+			{
+				SeekPoints.Add(AudioBytes);
+				if (SeekPoints.Count == MAX_SEEK_POINTS)
+				{
+					for (int i = 1; i < MAX_SEEK_POINTS / 2; i++)
+						SeekPoints[i] = SeekPoints[2 * i];
+					SeekPoints.RemoveRange(MAX_SEEK_POINTS / 2, MAX_SEEK_POINTS / 2);
+					SeekStride *= 2;
+				}
+			}
+			FrameCount++;
+			AudioBytes += frame.Length;
+			MusicCrc = LameTag.Crc16(MusicCrc, frame);
+		}
+
+		/// <summary> Byte offset of the frame at each percent of the duration, scaled to 256ths of the stream. </summary>
+		private byte[] GetSeekTable()
+		{
+			var toc = new byte[100];
+			long streamBytes = TagFrame!.Length + AudioBytes;
+			for (int i = 0; i < toc.Length && SeekPoints.Count > 0; i++)
+			{
+				long frame = (long)i * FrameCount / toc.Length;
+				long offset = TagFrame.Length + SeekPoints[(int)Math.Min(frame / SeekStride, SeekPoints.Count - 1)];
+				toc[i] = (byte)Math.Min(255, 256 * offset / streamBytes);
+			}
+			return toc;
+		}
+
+		/// <summary> Rewrites the totals in a Xing/LAME tag frame (see lame's VbrTag.c). </summary>
+		private static class LameTag
+		{
+			private const int FRAMES_FLAG = 1;
+			private const int BYTES_FLAG = 2;
+			private const int TOC_FLAG = 4;
+			private const int QUALITY_FLAG = 8;
+			private const int LAME_EXTENSION_SIZE = 36;
+			private static readonly ushort[] CrcTable = CreateCrcTable();
+
+			/// <returns>Offset of the "Xing" or "Info" identifier, or -1 if the frame is not a tag frame.</returns>
+			public static int FindTag(ReadOnlySpan<byte> frame)
+			{
+				if (frame.Length < 4) return -1;
+
+				//The tag follows the side information, which is all zero in a tag frame.
+				bool mpeg1 = ((frame[1] >> 3) & 3) == 3;
+				bool mono = frame[3] >> 6 == 3;
+				int offset = 4 + (mpeg1 ? (mono ? 17 : 32) : (mono ? 9 : 17));
+				if ((frame[1] & 1) == 0)
+					offset += 2;
+
+				return frame.Length >= offset + 8 && (frame.Slice(offset, 4).SequenceEqual("Xing"u8) || frame.Slice(offset, 4).SequenceEqual("Info"u8))
+					? offset
+					: -1;
+			}
+
+			public static void Update(Span<byte> frame, int frameCount, long audioBytes, byte[] seekTable, int samplesPerFrame, long samples, ushort musicCrc)
+			{
+				int position = FindTag(frame);
+				if (position < 0) return;
+
+				uint streamBytes = (uint)Math.Min(uint.MaxValue, frame.Length + audioBytes);
+				int flags = (int)BinaryPrimitives.ReadUInt32BigEndian(frame[(position + 4)..]);
+				position += 8;
+
+				if ((flags & FRAMES_FLAG) != 0)
+				{
+					BinaryPrimitives.WriteUInt32BigEndian(frame[position..], (uint)frameCount);
+					position += 4;
+				}
+				if ((flags & BYTES_FLAG) != 0)
+				{
+					BinaryPrimitives.WriteUInt32BigEndian(frame[position..], streamBytes);
+					position += 4;
+				}
+				if ((flags & TOC_FLAG) != 0)
+				{
+					seekTable.CopyTo(frame[position..]);
+					position += seekTable.Length;
+				}
+				if ((flags & QUALITY_FLAG) != 0)
+					position += 4;
+
+				if (frame.Length < position + LAME_EXTENSION_SIZE) return;
+
+				//Encoder delay and padding are packed as two 12-bit values. The delay is the
+				//first segment's, which is the stitched stream's too.
+				int delay = frame[position + 21] << 4 | frame[position + 22] >> 4;
+				int padding = (int)Math.Clamp((long)frameCount * samplesPerFrame - delay - samples, 0, 0xfff);
+				frame[position + 22] = (byte)((delay & 0xf) << 4 | padding >> 8);
+				frame[position + 23] = (byte)padding;
+
+				BinaryPrimitives.WriteUInt32BigEndian(frame[(position + 28)..], streamBytes);
+				BinaryPrimitives.WriteUInt16BigEndian(frame[(position + 32)..], musicCrc);
+				BinaryPrimitives.WriteUInt16BigEndian(frame[(position + 34)..], Crc16(0, frame[..(position + 34)]));
+			}
+
+			public static ushort Crc16(ushort crc, ReadOnlySpan<byte> data)
+			{
+				foreach (var b in data)
+					crc = (ushort)((crc >> 8) ^ CrcTable[(crc ^ b) & 0xff]);
+				return crc;
+			}
+
+			//CRC-16 with the reflected polynomial 0x8005, as lame's crc16_lookup.
+			private static ushort[] CreateCrcTable()
+			{
+				var table = new ushort[256];
+				for (int i = 0; i < table.Length; i++)
+				{
+					int crc = i;
+					for (int bit = 0; bit < 8; bit++)
+						crc = (crc & 1) != 0 ? (crc >> 1) ^ 0xa001 : crc >> 1;
+					table[i] = (ushort)crc;
+				}
+				return table;
+			}
+		}
+
+		/// <summary> Splits a LAME-encoded MPEG audio layer III stream into its frames. </summary>
+		private static class Mp3FrameReader
+		{
+			private static readonly int[] Mpeg1Bitrates = [0, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320];
+			private static readonly int[] Mpeg2Bitrates = [0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160];
+			private static readonly int[] Mpeg1SampleRates = [44100, 48000, 32000];
+
+			public static EncodedSegment SplitFrames(int index, Memory<byte> mp3)
+			{
+				var span = mp3.Span;
+				int position = GetId3v2Length(span);
+
+				//The first segment's Xing/LAME tag frame is not audio, so it is kept with the header.
+				if (index == 0 && position < span.Length)
+				{
+					int tagLength = GetFrameLength(span[position..]);
+					if (LameTag.FindTag(span.Slice(position, tagLength)) >= 0)
+						position += tagLength;
+				}
+
+				var segment = new EncodedSegment
+				{
+					Index = index,
+					Header = mp3[..position],
+					//Only the first segment is tagged, and a frame could end with "TAG".
+					Trailer = index == 0 ? FindId3v1Tag(mp3[position..]) : Memory<byte>.Empty
+				};
+
+				int end = mp3.Length - segment.Trailer.Length;
+				while (position < end)
+				{
+					int frameLength = GetFrameLength(span[position..end]);
+					segment.Frames.Add(mp3.Slice(position, frameLength));
+					position += frameLength;
+				}
+				return segment;
+			}
+
+			public static int GetId3v2Length(ReadOnlySpan<byte> span)
+			{
+				if (span.Length < 10 || span[0] != 'I' || span[1] != 'D' || span[2] != '3')
+					return 0;
+
+				//ID3v2 tag size is a 28-bit synchsafe integer excluding the 10-byte header.
+				return 10 + ((span[6] & 0x7f) << 21 | (span[7] & 0x7f) << 14 | (span[8] & 0x7f) << 7 | span[9] & 0x7f);
+			}
+
+			private static Memory<byte> FindId3v1Tag(Memory<byte> mp3)
+			{
+				const int ID3V1_SIZE = 128;
+				var span = mp3.Span;
+				return span.Length >= ID3V1_SIZE && span[^ID3V1_SIZE] == 'T' && span[^(ID3V1_SIZE - 1)] == 'A' && span[^(ID3V1_SIZE - 2)] == 'G'
+					? mp3[^ID3V1_SIZE..]
+					: Memory<byte>.Empty;
+			}
+
+			private static int GetFrameLength(ReadOnlySpan<byte> header)
+			{
+				if (header.Length < 4 || header[0] != 0xff || (header[1] & 0xe0) != 0xe0)
+					throw new InvalidDataException("Lost MP3 frame sync while splitting encoded segment.");
+
+				int version = (header[1] >> 3) & 3;
+				int layer = (header[1] >> 1) & 3;
+				int bitrateIndex = header[2] >> 4;
+				int sampleRateIndex = (header[2] >> 2) & 3;
+				int padding = (header[2] >> 1) & 1;
+
+				if (version == 1 || layer != 1 || bitrateIndex is 0 or 15 || sampleRateIndex == 3)
+					throw new InvalidDataException("Unsupported MP3 frame header. Free format bitrates cannot be encoded in parallel.");
+
+				//version 3 is MPEG-1, 2 is MPEG-2 and 0 is MPEG-2.5
+				int sampleRate = Mpeg1SampleRates[sampleRateIndex] >> (version == 3 ? 0 : version == 2 ? 1 : 2);
+				return version == 3
+					? 144000 * Mpeg1Bitrates[bitrateIndex] / sampleRate + padding
+					: 72000 * Mpeg2Bitrates[bitrateIndex] / sampleRate + padding;
+			}
+		}
+	}
+}
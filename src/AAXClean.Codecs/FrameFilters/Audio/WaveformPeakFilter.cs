@@ -0,0 +1,74 @@
+﻿using AAXClean.Codecs.Interop;
+using AAXClean.FrameFilters;
+using System;
+using System.Collections.Generic;
+using System.Diagnostics;
+using System.IO;
+using System.Threading.Tasks;
+
+namespace AAXClean.Codecs.FrameFilters.Audio
+{
+	/// <summary> Builds waveform peaks at several zoom levels from decoded audio and writes them to a <see cref="WaveformPeaks"/> file. </summary>
+	internal sealed class WaveformPeakFilter : FrameFinalBase<WaveEntry>
+	{
+		protected override int InputBufferSize => 500;
+
+		private readonly WaveFormat WaveFormat;
+		private readonly int SamplesPerPeak;
+		private readonly CoalescingWriteStream OutputStream;
+		private readonly WaveformPeakWriter Writer;
+		private NativePeaks.PeakScanState ScanState;
+		private NativePeaks.WavePeak[] Peaks = new NativePeaks.WavePeak[16];
+		private static readonly KeyValuePair<string, object?> MetricsTag = CodecMetrics.FilterTag(nameof(WaveformPeakFilter));
+
+		public WaveformPeakFilter(Stream output, WaveFormat waveFormat, int samplesPerPeak, int levelCount, int levelScale)
+		{
+			WaveFormat = waveFormat;
+			SamplesPerPeak = samplesPerPeak;
+			OutputStream = new CoalescingWriteStream(output, MetricsTag, leaveOpen: true);
+			Writer = new WaveformPeakWriter(OutputStream, waveFormat.SampleRate, waveFormat.Channels, samplesPerPeak, levelCount, levelScale);
+		}
+
+		protected override Task FlushAsync()
+		{
+			long start = Stopwatch.GetTimestamp();
+			if (ScanState.window_position > 0)
+			{
+				double rms = Math.Sqrt(ScanState.sum_squares / (ScanState.window_position * WaveFormat.Channels));
+				Writer.AddPeak(ScanState.min, ScanState.max, (float)rms, ScanState.window_position);
+			}
+			Writer.Complete();
+			OutputStream.Dispose();
+			CodecMetrics.RecordFilterTime(MetricsTag, start);
+			return Task.CompletedTask;
+		}
+
+		protected override unsafe Task PerformFilteringAsync(WaveEntry input)
+		{
+			long start = Stopwatch.GetTimestamp();
+
+			int maxPeaks = (int)((ScanState.window_position + input.SamplesInFrame) / SamplesPerPeak);
+			if (maxPeaks > Peaks.Length)
+				Peaks = new NativePeaks.WavePeak[maxPeaks];
+
+			int nbPeaks;
+			fixed (byte* pSamples0 = input.FrameData.Span)
+			fixed (byte* pSamples1 = input.FrameData2.Span)
+				nbPeaks = NativePeaks.Scan(ref ScanState, pSamples0, pSamples1, (int)input.SamplesInFrame, WaveFormat.Channels, WaveFormat.Encoding, SamplesPerPeak, Peaks);
+
+			input.Release();
+			for (int i = 0; i < nbPeaks; i++)
+				Writer.AddPeak(Peaks[i].min, Peaks[i].max, Peaks[i].rms, SamplesPerPeak);
+
+			CodecMetrics.RecordFilterTime(MetricsTag, start);
+			return Task.CompletedTask;
+		}
+
+		protected override void Dispose(bool disposing)
+		{
+			if (disposing && !Disposed)
+				OutputStream.Dispose();
+			base.Dispose(disposing);
+		}
+	}
+}
@@ -0,0 +1,20 @@
+﻿using System.Runtime.InteropServices;
+
+namespace AAXClean.Codecs.Interop;
+
+/// <summary> Running totals kept by a native decoder or encoder handle. </summary>
+[StructLayout(LayoutKind.Sequential)]
+internal struct CodecStats
+{
+	public long frames_in;
+	public long frames_out;
+	public long samples_in;
+	public long samples_out;
+	public long bytes_in;
+	public long bytes_out;
+	public long send_ns;
+	public long receive_ns;
+	public long convert_ns;
+	public long errors;
+	public long resampled_frames;
+}
@@ -9,7 +9,7 @@ internal class NativeAacDecode : NativeDecode
 {
 	protected override DecoderHandle Handle { get; }
 
-	public unsafe NativeAacDecode(EsdsBox esed, WaveFormat waveFormat)
+	public unsafe NativeAacDecode(EsdsBox esed, WaveFormat waveFormat, ResampleQuality resampleQuality)
 	{
 		ArgumentNullException.ThrowIfNull(esed, nameof(esed));
 		ArgumentNullException.ThrowIfNull(waveFormat, nameof(waveFormat));
@@ -19,7 +19,7 @@ internal class NativeAacDecode : NativeDecode
 		{
 			AacDecoderOptions options = new()
 			{
-				output_options = GetOutputOptions(waveFormat),
+				output_options = GetOutputOptions(waveFormat, resampleQuality),
 				asc_size = asc.Length,
 				ASC = pAsc
 			};
@@ -38,7 +38,7 @@ internal class NativeAacDecode : NativeDecode
 	private static extern DecoderHandle Decoder_OpenAac(ref AacDecoderOptions decoder_options);
 
 	[StructLayout(LayoutKind.Sequential)]
-	private unsafe struct AacDecoderOptions
+	internal unsafe struct AacDecoderOptions
 	{
 		public OutputOptions output_options;
 		public int asc_size;
@@ -20,22 +20,24 @@ internal unsafe class NativeAacEncode : IDisposable
 	[DllImport(libname, CallingConvention = CallingConvention.StdCall)]
 	private static extern int AacEncoder_ReceiveEncodedFrame(EncoderHandle self, byte* pEncodedAudio, int size);
 
+	[DllImport(libname, CallingConvention = CallingConvention.StdCall)]
+	private static extern int AacEncoder_EncodeBatch(EncoderHandle self, byte* pWaveAudio1, byte* pWaveAudio2, int nbSamples, byte* pEncodedAudio, int cbEncodedAudio, int* pPacketSizes, int maxPackets, int* pNbPackets);
+
 	[DllImport(libname, CallingConvention = CallingConvention.StdCall)]
 	private static extern int AacEncoder_EncodeFlush(EncoderHandle self);
 
 	[DllImport(libname, CallingConvention = CallingConvention.StdCall)]
 	private static extern int AacEncoder_GetExtraData(EncoderHandle self, byte* ascBuffer, int* pSize);
 
+	[DllImport(libname, CallingConvention = CallingConvention.StdCall)]
+	private static extern int AacEncoder_GetStats(EncoderHandle self, out CodecStats pStats);
+
+	[DllImport(libname, CallingConvention = CallingConvention.StdCall)]
+	private static extern int AacEncoder_Reset(EncoderHandle self);
+
 	public NativeAacEncode(WaveFormat waveFormat, long bitRate, double quality)
 	{
-		AacEncoderOptions options = new()
-		{
-			bit_rate = bitRate,
-			global_quality = (int)(FF_QP2LAMBDA * quality),
-			sample_rate = waveFormat.SampleRate,
-			channels = waveFormat.Channels,
-			sample_fmt = (int)waveFormat.Encoding
-		};
+		AacEncoderOptions options = GetEncoderOptions(waveFormat, bitRate, quality);
 		Handle = AacEncoder_Open(ref options);
 
 		long err = Handle.DangerousGetHandle();
@@ -50,9 +52,25 @@ internal unsafe class NativeAacEncode : IDisposable
 		=> AacEncoder_EncodeFrame(Handle, pWaveAudio1, pWaveAudio2, nbSamples);
 	public int ReceiveEncodedFrame(byte* pEncodedAudio, int size)
 		=> AacEncoder_ReceiveEncodedFrame(Handle, pEncodedAudio, size);
+	public int EncodeBatch(byte* pWaveAudio1, byte* pWaveAudio2, int nbSamples, byte* pEncodedAudio, int cbEncodedAudio, int* pPacketSizes, int maxPackets, int* pNbPackets)
+		=> AacEncoder_EncodeBatch(Handle, pWaveAudio1, pWaveAudio2, nbSamples, pEncodedAudio, cbEncodedAudio, pPacketSizes, maxPackets, pNbPackets);
 	public int EncodeFlush()
 		=> AacEncoder_EncodeFlush(Handle);
 
+	public CodecStats GetStats()
+	{
+		int ret = AacEncoder_GetStats(Handle, out var stats);
+		return ret == 0 ? stats
+			: throw new Exception($"Error getting encoder stats. Code {ret}");
+	}
+
+	public void Reset()
+	{
+		int ret = AacEncoder_Reset(Handle);
+		if (ret < 0)
+			throw new Exception($"Error resetting AAC encoder. Code {ret}");
+	}
+
 	public byte[] GetAudioSpecificConfig()
 	{
 		var ascSize = AacEncoder_GetExtraData(Handle, null, null);
@@ -86,8 +104,18 @@ internal unsafe class NativeAacEncode : IDisposable
 		protected override bool ReleaseHandle() => AacEncoder_Close(handle) == 0;
 	}
 
+	internal static AacEncoderOptions GetEncoderOptions(WaveFormat waveFormat, long bitRate, double quality)
+		=> new()
+		{
+			bit_rate = bitRate,
+			global_quality = (int)(FF_QP2LAMBDA * quality),
+			sample_rate = waveFormat.SampleRate,
+			channels = waveFormat.Channels,
+			sample_fmt = (int)waveFormat.Encoding
+		};
+
 	[StructLayout(LayoutKind.Sequential)]
-	private struct AacEncoderOptions
+	internal struct AacEncoderOptions
 	{
 		public long bit_rate;
 		public int global_quality;
@@ -9,12 +9,12 @@ internal unsafe class NativeAc4Decode : NativeDecode
 {
 	protected override DecoderHandle Handle { get; }
 
-	public NativeAc4Decode(Dac4Box dec3, WaveFormat waveFormat)
+	public NativeAc4Decode(Dac4Box dec3, WaveFormat waveFormat, ResampleQuality resampleQuality)
 	{
 		ArgumentNullException.ThrowIfNull(dec3, nameof(dec3));
 		ArgumentNullException.ThrowIfNull(waveFormat, nameof(waveFormat));
 
-		OutputOptions options = GetOutputOptions(waveFormat);
+		OutputOptions options = GetOutputOptions(waveFormat, resampleQuality);
 		Handle = Decoder_OpenAC4(ref options);
 	}
 
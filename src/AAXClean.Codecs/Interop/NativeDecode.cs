@@ -15,9 +15,21 @@ internal unsafe abstract class NativeDecode : IDisposable
 	[DllImport(libname, CallingConvention = CallingConvention.StdCall)]
 	private static extern int Decoder_ReceiveDecodedFrame(DecoderHandle self, byte* pDecodedAudio1, byte* pDecodedAudio2, int cbInBufferSize);
 
+	[DllImport(libname, CallingConvention = CallingConvention.StdCall)]
+	private static extern int Decoder_DecodeBatch(DecoderHandle self, byte** ppCompressedAudio, int* pcbInBufferSizes, int nbFrames, byte* pDecodedAudio1, byte* pDecodedAudio2, int numSamples, int* pFrameResults);
+
 	[DllImport(libname, CallingConvention = CallingConvention.StdCall)]
 	private static extern int Decoder_DecodeFlush(DecoderHandle self, byte* pDecodedAudio1, byte* pDecodedAudio2, int cbInBufferSize);
 
+	[DllImport(libname, CallingConvention = CallingConvention.StdCall)]
+	private static extern int Decoder_GetStats(DecoderHandle self, out CodecStats pStats);
+
+	[DllImport(libname, CallingConvention = CallingConvention.StdCall)]
+	private static extern int Decoder_Reset(DecoderHandle self);
+
+	[DllImport(libname, CallingConvention = CallingConvention.StdCall)]
+	private static extern int Decoder_SetGain(DecoderHandle self, float gain);
+
 	public int DecodeFrame(byte* pCompressedAudio, int cbInputSize)
 		=> Decoder_DecodeFrame(Handle, pCompressedAudio, cbInputSize);
 	public int ReceiveDecodedFrame(byte* pDecodedAudio1, byte* pDecodedAudio2, int cbInputSize)
@@ -27,6 +39,12 @@ internal unsafe abstract class NativeDecode : IDisposable
 		return receivedSamples >= 0 ? receivedSamples
 			: throw new Exception($"Error receiving decoded frame. Code {GetFFmpegErrorString(receivedSamples)}");
 	}
+	public int DecodeBatch(byte** ppCompressedAudio, int* pcbInBufferSizes, int nbFrames, byte* pDecodedAudio1, byte* pDecodedAudio2, int numSamples, int* pFrameResults)
+	{
+		int framesConsumed = Decoder_DecodeBatch(Handle, ppCompressedAudio, pcbInBufferSizes, nbFrames, pDecodedAudio1, pDecodedAudio2, numSamples, pFrameResults);
+		return framesConsumed >= 0 ? framesConsumed
+			: throw new Exception($"Error decoding AAC frame batch. Code {GetFFmpegErrorString(framesConsumed)}");
+	}
 	public int DecodeFlush(byte* pDecodedAudio1, byte* pDecodedAudio2, int cbInputSize)
 	{
 		int receivedSamples = Decoder_DecodeFlush(Handle, pDecodedAudio1, pDecodedAudio2, cbInputSize);
@@ -34,6 +52,24 @@ internal unsafe abstract class NativeDecode : IDisposable
 		return receivedSamples >= 0 ? receivedSamples
 			: throw new Exception($"Error receiving decoded frame. Code {GetFFmpegErrorString(receivedSamples)}");
 	}
+	public CodecStats GetStats()
+	{
+		int ret = Decoder_GetStats(Handle, out var stats);
+		return ret == 0 ? stats
+			: throw new Exception($"Error getting decoder stats. Code {ret}");
+	}
+	public void Reset()
+	{
+		int ret = Decoder_Reset(Handle);
+		if (ret < 0)
+			throw new Exception($"Error resetting decoder. Code {ret}");
+	}
+	public void SetGain(float gain)
+	{
+		int ret = Decoder_SetGain(Handle, gain);
+		if (ret < 0)
+			throw new Exception($"Error setting decoder gain. Code {ret}");
+	}
 	public static string GetFFmpegErrorString(int errorCode)
 		=> System.Text.Encoding.UTF8.GetString(BitConverter.GetBytes(-errorCode));
 
@@ -50,14 +86,15 @@ internal unsafe abstract class NativeDecode : IDisposable
 	}
 
 	[StructLayout(LayoutKind.Sequential)]
-	protected struct OutputOptions
+	internal struct OutputOptions
 	{
 		public int out_sample_rate;
 		public int out_sample_fmt;
 		public int out_channels;
+		public int resample_quality;
 	}
 
-	protected static OutputOptions GetOutputOptions(WaveFormat waveFormat)
+	internal static OutputOptions GetOutputOptions(WaveFormat waveFormat, ResampleQuality resampleQuality)
 	{
 		if (waveFormat.Channels is not 1 and not 2)
 			throw new ArgumentException("Output wave format must be either mono or stereo.");
@@ -67,6 +104,7 @@ internal unsafe abstract class NativeDecode : IDisposable
 			out_sample_rate = waveFormat.SampleRate,
 			out_sample_fmt = (int)waveFormat.Encoding,
 			out_channels = waveFormat.Channels,
+			resample_quality = (int)resampleQuality,
 		};
 	}
 
@@ -9,7 +9,7 @@ internal unsafe class NativeEc3Decode : NativeDecode
 {
 	protected override DecoderHandle Handle { get; }
 
-	public NativeEc3Decode(Dec3Box dec3, WaveFormat waveFormat)
+	public NativeEc3Decode(Dec3Box dec3, WaveFormat waveFormat, ResampleQuality resampleQuality)
 	{
 		ArgumentNullException.ThrowIfNull(dec3, nameof(dec3));
 		ArgumentNullException.ThrowIfNull(waveFormat, nameof(waveFormat));
@@ -17,7 +17,7 @@ internal unsafe class NativeEc3Decode : NativeDecode
 
 		Ec3DecoderOptions options = new()
 		{
-			output_options = GetOutputOptions(waveFormat),
+			output_options = GetOutputOptions(waveFormat, resampleQuality),
 			in_sample_rate = dec3.SampleRate,
 			in_subwoofer = (byte)(firstIndSubstream.lfeon ? 1 : 0),
 			in_audio_coding_mode = (byte)firstIndSubstream.acmod,
@@ -1,5 +1,7 @@
+using System;
 using System.Runtime.InteropServices;
 using System.Text;
+using System.Threading;
 
 namespace AAXClean.Codecs.Interop;
 
@@ -17,35 +19,102 @@ public enum LogLevel
 }
 
 public delegate void LogEventHandler(LogLevel level, string message);
+
+/// <summary>
+/// FFmpeg log messages are buffered natively and raised in batches from a background
+/// timer, never on the codec thread that logged them. Consecutive identical messages are
+/// coalesced and floods are rate limited natively; both are reported as summary messages.
+/// </summary>
 public static unsafe class NativeLogging
 {
+	private const int DRAIN_INTERVAL_MS = 100;
+	private const int DRAIN_BATCH_SIZE = 64;
+	private const int LOG_MESSAGE_SIZE = 244;
+	private static readonly object SubscriptionLock = new();
+	private static readonly object DrainLock = new();
+	private static Timer? DrainTimer;
 	private static LogEventHandler? _messageLogged;
+
 	public static event LogEventHandler? MessageLogged
 	{
 		add
 		{
-			_messageLogged += value;
-			SetLogCallback(&MessageLogger);
+			lock (SubscriptionLock)
+			{
+				_messageLogged += value;
+				if (_messageLogged is not null && DrainTimer is null)
+				{
+					Log_SetEnabled(1);
+					DrainTimer = new Timer(OnDrainTimer, null, DRAIN_INTERVAL_MS, DRAIN_INTERVAL_MS);
+				}
+			}
 		}
 		remove
 		{
-			_messageLogged -= value;
-			if (_messageLogged == null)
-				SetLogCallback(null);
+			lock (SubscriptionLock)
+			{
+				_messageLogged -= value;
+				if (_messageLogged is null && DrainTimer is not null)
+				{
+					Log_SetEnabled(0);
+					DrainTimer.Dispose();
+					DrainTimer = null;
+				}
+			}
 		}
 	}
 
-	[UnmanagedCallersOnly]
-	private static void MessageLogger(int code, byte* pMessage, int messageSize)
+	/// <summary>
+	/// Raise <see cref="MessageLogged"/> on the calling thread for every buffered message,
+	/// e.g. after a conversion completes, instead of waiting for the next background drain.
+	/// </summary>
+	public static void Flush()
+	{
+		lock (DrainLock)
+			Drain();
+	}
+
+	private static void OnDrainTimer(object? state)
 	{
-		if (_messageLogged is not null)
+		//Skip this tick if a slow handler is still working through the previous batch.
+		if (!Monitor.TryEnter(DrainLock)) return;
+		try { Drain(); }
+		catch
 		{
-			var message = Encoding.UTF8.GetString(pMessage, messageSize - 1);
-			_messageLogged((LogLevel)code, message);
+			//An exception escaping a timer callback terminates the process. Drain failures
+			//and handler exceptions are only surfaced to callers of Flush.
 		}
+		finally { Monitor.Exit(DrainLock); }
+	}
+
+	private static void Drain()
+	{
+		LogRecord* records = stackalloc LogRecord[DRAIN_BATCH_SIZE];
+		int count;
+		do
+		{
+			count = Log_Drain(records, DRAIN_BATCH_SIZE);
+			if (count < 0)
+				throw new Exception($"Failed to drain native log messages. Code {count}");
+
+			var handler = _messageLogged;
+			for (int i = 0; i < count && handler is not null; i++)
+				handler((LogLevel)records[i].level, Encoding.UTF8.GetString(records[i].message, records[i].message_size));
+		} while (count == DRAIN_BATCH_SIZE);
+	}
+
+	[StructLayout(LayoutKind.Sequential)]
+	private struct LogRecord
+	{
+		public int level;
+		public int repeat_count;
+		public int message_size;
+		public fixed byte message[LOG_MESSAGE_SIZE];
 	}
 
 	private const string libname = "aaxcleannative";
 	[DllImport(libname, CallingConvention = CallingConvention.StdCall)]
-	private static extern void SetLogCallback(delegate* unmanaged<int, byte*, int, void> messageDelegate);
-}
\ No newline at end of file
+	private static extern void Log_SetEnabled(int enabled);
+	[DllImport(libname, CallingConvention = CallingConvention.StdCall)]
+	private static extern int Log_Drain(LogRecord* records, int maxRecords);
+}
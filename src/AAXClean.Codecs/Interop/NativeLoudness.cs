@@ -0,0 +1,71 @@
+﻿using System;
+using System.Runtime.InteropServices;
+
+namespace AAXClean.Codecs.Interop;
+
+/// <summary> ITU-R BS.1770 loudness meter. The true-peak interpolator uses <see cref="NativeSilence.Isa"/>. </summary>
+internal unsafe sealed class NativeLoudness : IDisposable
+{
+	private const string libname = "aaxcleannative";
+	private readonly LoudnessHandle Handle;
+
+	[StructLayout(LayoutKind.Sequential)]
+	public struct LoudnessResult
+	{
+		public double integrated;
+		public double true_peak;
+		public double sample_peak;
+		public long samples;
+	}
+
+	[DllImport(libname, CallingConvention = CallingConvention.StdCall)]
+	private static extern LoudnessHandle Loudness_Open(int sampleRate, int channels);
+
+	[DllImport(libname, CallingConvention = CallingConvention.StdCall)]
+	private static extern int Loudness_Process(LoudnessHandle self, byte* pSamples0, byte* pSamples1, int nbSamples, int sampleFormat);
+
+	[DllImport(libname, CallingConvention = CallingConvention.StdCall)]
+	private static extern int Loudness_GetResult(LoudnessHandle self, out LoudnessResult pResult);
+
+	public NativeLoudness(int sampleRate, int channels)
+	{
+		Handle = Loudness_Open(sampleRate, channels);
+
+		long err = Handle.DangerousGetHandle();
+
+		if (err < 0)
+		{
+			throw new Exception($"Error opening loudness meter. Code {err}");
+		}
+	}
+
+	public void Process(byte* pSamples0, byte* pSamples1, int nbSamples, NAudio.Wave.WaveFormatEncoding encoding)
+	{
+		int ret = Loudness_Process(Handle, pSamples0, pSamples1, nbSamples, (int)encoding);
+		if (ret < 0)
+			throw new Exception($"Error measuring loudness. Code {ret}");
+	}
+
+	public LoudnessResult GetResult()
+	{
+		int ret = Loudness_GetResult(Handle, out var result);
+		return ret == 0 ? result
+			: throw new Exception($"Error getting loudness. Code {ret}");
+	}
+
+	public void Dispose()
+	{
+		if (!Handle.IsClosed)
+			Handle.Close();
+	}
+
+	private class LoudnessHandle : SafeHandle
+	{
+		[DllImport(libname, CallingConvention = CallingConvention.StdCall)]
+		private static extern int Loudness_Close(IntPtr self);
+		private LoudnessHandle() : base(IntPtr.Zero, true) { }
+		//Loudness_Open returns a negative error code in place of a handle.
+		public override bool IsInvalid => IsClosed || handle.ToInt64() <= 0;
+		protected override bool ReleaseHandle() => Loudness_Close(handle) == 0;
+	}
+}
@@ -0,0 +1,41 @@
+﻿using System;
+using System.Runtime.InteropServices;
+
+namespace AAXClean.Codecs.Interop;
+
+/// <summary> Reduces audio to waveform peaks. Uses <see cref="NativeSilence.Isa"/>. </summary>
+internal static unsafe class NativePeaks
+{
+	private const string libname = "aaxcleannative";
+
+	[StructLayout(LayoutKind.Sequential)]
+	public struct PeakScanState
+	{
+		public long window_position;
+		public float min;
+		public float max;
+		public double sum_squares;
+	}
+
+	[StructLayout(LayoutKind.Sequential)]
+	public struct WavePeak
+	{
+		public float min;
+		public float max;
+		public float rms;
+	}
+
+	[DllImport(libname, CallingConvention = CallingConvention.StdCall)]
+	private static extern int Peaks_Scan(PeakScanState* state, byte* pSamples0, byte* pSamples1, int nbSamples, int channels, int sampleFormat, int samplesPerPeak, WavePeak* pPeaks, int maxPeaks);
+
+	public static int Scan(ref PeakScanState state, byte* pSamples0, byte* pSamples1, int nbSamples, int channels, NAudio.Wave.WaveFormatEncoding encoding, int samplesPerPeak, WavePeak[] peaks)
+	{
+		int nbPeaks;
+		fixed (PeakScanState* pState = &state)
+		fixed (WavePeak* pPeaks = peaks)
+			nbPeaks = Peaks_Scan(pState, pSamples0, pSamples1, nbSamples, channels, (int)encoding, samplesPerPeak, pPeaks, peaks.Length);
+
+		return nbPeaks >= 0 ? nbPeaks
+			: throw new Exception($"Error scanning waveform peaks. Code {nbPeaks}");
+	}
+}
@@ -0,0 +1,76 @@
+﻿using System;
+using System.Runtime.InteropServices;
+
+namespace AAXClean.Codecs.Interop;
+
+internal enum SilenceIsa
+{
+	Scalar = 0,
+	Avx2 = 1,
+	Avx512 = 2,
+	Neon = 3
+}
+
+internal static unsafe class NativeSilence
+{
+	private const string libname = "aaxcleannative";
+	private const int ERR_ISA_UNSUPPORTED = -13;
+	/// <summary> The most profiles <see cref="ScanProfiles"/> accepts. </summary>
+	public const int MaxProfiles = 32;
+
+	[StructLayout(LayoutKind.Sequential)]
+	public struct SilenceScanState
+	{
+		public long position;
+		public long run_start;
+		public long run_length;
+	}
+
+	[DllImport(libname, CallingConvention = CallingConvention.StdCall)]
+	private static extern int Silence_Scan(SilenceScanState* state, byte* pSamples0, byte* pSamples1, int nbSamples, int channels, int sampleFormat, double threshold, long minRunLength, long* pRunStarts, long* pRunLengths, int maxRuns);
+
+	[DllImport(libname, CallingConvention = CallingConvention.StdCall)]
+	private static extern int Silence_ScanProfiles(SilenceScanState* states, int nbProfiles, double* thresholds, long* minRunLengths, byte* pSamples0, byte* pSamples1, int nbSamples, int channels, int sampleFormat, int* pRunProfiles, long* pRunStarts, long* pRunLengths, int maxRuns);
+
+	[DllImport(libname, CallingConvention = CallingConvention.StdCall)]
+	private static extern int Silence_GetIsa();
+
+	[DllImport(libname, CallingConvention = CallingConvention.StdCall)]
+	private static extern int Silence_SetIsa(int isa);
+
+	/// <summary> The instruction set used to scan for silence. Setting an unsupported instruction set throws. </summary>
+	public static SilenceIsa Isa
+	{
+		get => (SilenceIsa)Silence_GetIsa();
+		set
+		{
+			if (Silence_SetIsa((int)value) == ERR_ISA_UNSUPPORTED)
+				throw new PlatformNotSupportedException($"{value} is not supported on this CPU.");
+		}
+	}
+
+	public static int Scan(ref SilenceScanState state, byte* pSamples0, byte* pSamples1, int nbSamples, int channels, NAudio.Wave.WaveFormatEncoding encoding, double threshold, long minRunLength, long* pRunStarts, long* pRunLengths, int maxRuns)
+	{
+		int nbRuns;
+		fixed (SilenceScanState* pState = &state)
+			nbRuns = Silence_Scan(pState, pSamples0, pSamples1, nbSamples, channels, (int)encoding, threshold, minRunLength, pRunStarts, pRunLengths, maxRuns);
+
+		return nbRuns >= 0 ? nbRuns
+			: throw new Exception($"Error scanning for silence. Code {nbRuns}");
+	}
+
+	/// <summary>
+	/// Scan for silence at several thresholds in one pass. Thresholds must be in ascending order.
+	/// </summary>
+	public static int ScanProfiles(SilenceScanState[] states, double[] thresholds, long[] minRunLengths, byte* pSamples0, byte* pSamples1, int nbSamples, int channels, NAudio.Wave.WaveFormatEncoding encoding, int* pRunProfiles, long* pRunStarts, long* pRunLengths, int maxRuns)
+	{
+		int nbRuns;
+		fixed (SilenceScanState* pStates = states)
+		fixed (double* pThresholds = thresholds)
+		fixed (long* pMinRunLengths = minRunLengths)
+			nbRuns = Silence_ScanProfiles(pStates, states.Length, pThresholds, pMinRunLengths, pSamples0, pSamples1, nbSamples, channels, (int)encoding, pRunProfiles, pRunStarts, pRunLengths, maxRuns);
+
+		return nbRuns >= 0 ? nbRuns
+			: throw new Exception($"Error scanning for silence. Code {nbRuns}");
+	}
+}
@@ -0,0 +1,117 @@
+﻿using AAXClean.Codecs.FrameFilters.Audio;
+using Mpeg4Lib.Boxes;
+using System;
+using System.Runtime.InteropServices;
+
+namespace AAXClean.Codecs.Interop;
+
+internal unsafe class NativeTranscode : IDisposable
+{
+	protected const string libname = "aaxcleannative";
+	private TranscoderHandle Handle { get; }
+
+	[DllImport(libname, CallingConvention = CallingConvention.StdCall)]
+	private static extern TranscoderHandle Transcoder_Open(ref NativeAacDecode.AacDecoderOptions decoder_options, ref NativeAacEncode.AacEncoderOptions encoder_options);
+
+	[DllImport(libname, CallingConvention = CallingConvention.StdCall)]
+	private static extern int Transcoder_TranscodeBatch(TranscoderHandle self, byte** ppCompressedAudio, int* pcbInBufferSizes, int nbFrames, byte* pEncodedAudio, int cbEncodedAudio, int* pPacketSizes, int maxPackets, int* pNbPackets);
+
+	[DllImport(libname, CallingConvention = CallingConvention.StdCall)]
+	private static extern int Transcoder_Flush(TranscoderHandle self);
+
+	[DllImport(libname, CallingConvention = CallingConvention.StdCall)]
+	private static extern int Transcoder_GetExtraData(TranscoderHandle self, byte* ascBuffer, int* pSize);
+
+	[DllImport(libname, CallingConvention = CallingConvention.StdCall)]
+	private static extern int Transcoder_GetStats(TranscoderHandle self, out CodecStats pDecodeStats, out CodecStats pEncodeStats);
+
+	[DllImport(libname, CallingConvention = CallingConvention.StdCall)]
+	private static extern int Transcoder_SetGain(TranscoderHandle self, float gain);
+
+	public NativeTranscode(EsdsBox esds, WaveFormat waveFormat, long bitRate, double quality, ResampleQuality resampleQuality)
+	{
+		ArgumentNullException.ThrowIfNull(esds, nameof(esds));
+		ArgumentNullException.ThrowIfNull(waveFormat, nameof(waveFormat));
+
+		var asc = esds.ES_Descriptor.DecoderConfig.AudioSpecificConfig.AscBlob;
+		var encoderOptions = NativeAacEncode.GetEncoderOptions(waveFormat, bitRate, quality);
+		fixed (byte* pAsc = asc)
+		{
+			NativeAacDecode.AacDecoderOptions decoderOptions = new()
+			{
+				output_options = NativeDecode.GetOutputOptions(waveFormat, resampleQuality),
+				asc_size = asc.Length,
+				ASC = pAsc
+			};
+			Handle = Transcoder_Open(ref decoderOptions, ref encoderOptions);
+		}
+
+		long err = Handle.DangerousGetHandle();
+
+		if (err < 0)
+		{
+			throw new Exception($"Error opening AAC Transcoder. Code {err}");
+		}
+	}
+
+	public int TranscodeBatch(byte** ppCompressedAudio, int* pcbInBufferSizes, int nbFrames, byte* pEncodedAudio, int cbEncodedAudio, int* pPacketSizes, int maxPackets, int* pNbPackets)
+	{
+		int framesConsumed = Transcoder_TranscodeBatch(Handle, ppCompressedAudio, pcbInBufferSizes, nbFrames, pEncodedAudio, cbEncodedAudio, pPacketSizes, maxPackets, pNbPackets);
+		return framesConsumed >= 0 ? framesConsumed
+			: throw new Exception($"Error transcoding AAC frame batch. Code {NativeDecode.GetFFmpegErrorString(framesConsumed)}");
+	}
+
+	public void Flush()
+	{
+		int ret = Transcoder_Flush(Handle);
+		if (ret < 0)
+			throw new Exception($"Error flushing AAC transcoder. Code {ret}");
+	}
+
+	public (CodecStats decode, CodecStats encode) GetStats()
+	{
+		int ret = Transcoder_GetStats(Handle, out var decodeStats, out var encodeStats);
+		return ret == 0 ? (decodeStats, encodeStats)
+			: throw new Exception($"Error getting transcoder stats. Code {ret}");
+	}
+
+	public void SetGain(float gain)
+	{
+		int ret = Transcoder_SetGain(Handle, gain);
+		if (ret < 0)
+			throw new Exception($"Error setting transcoder gain. Code {ret}");
+	}
+
+	public byte[] GetAudioSpecificConfig()
+	{
+		var ascSize = Transcoder_GetExtraData(Handle, null, null);
+		var ascBuffer = new byte[ascSize];
+		fixed (byte* pAscBuffer = ascBuffer)
+		{
+			if (Transcoder_GetExtraData(Handle, pAscBuffer, &ascSize) != 0)
+				throw new Exception("Failed to retrieve Audio Specific Config.");
+		}
+		return ascBuffer;
+	}
+
+	public void Dispose()
+	{
+		Dispose(true);
+		GC.SuppressFinalize(this);
+	}
+
+	protected virtual void Dispose(bool disposing)
+	{
+		if (disposing && !Handle.IsClosed)
+			Handle.Close();
+	}
+
+	private class TranscoderHandle : SafeHandle
+	{
+		[DllImport(libname, CallingConvention = CallingConvention.StdCall)]
+		private static extern int Transcoder_Close(IntPtr self);
+		private TranscoderHandle() : base(IntPtr.Zero, true) { }
+		public override bool IsInvalid => IsClosed || handle == IntPtr.Zero;
+		protected override bool ReleaseHandle() => Transcoder_Close(handle) == 0;
+	}
+}
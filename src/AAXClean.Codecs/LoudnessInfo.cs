@@ -0,0 +1,47 @@
+﻿using System;
+
+namespace AAXClean.Codecs
+{
+	/// <summary> ITU-R BS.1770 / EBU R128 loudness of decoded audio. </summary>
+	public class LoudnessInfo
+	{
+		/// <summary> Gated loudness of the whole audio in LUFS, or <see cref="double.NegativeInfinity"/> if it is silent. </summary>
+		public double IntegratedLoudness { get; }
+		/// <summary> Largest magnitude of the audio oversampled 4 times, in dBTP. </summary>
+		public double TruePeak { get; }
+		/// <summary> Largest sample magnitude, in dBFS. </summary>
+		public double SamplePeak { get; }
+		public TimeSpan Duration { get; }
+
+		internal LoudnessInfo(double integratedLoudness, double truePeak, double samplePeak, TimeSpan duration)
+		{
+			IntegratedLoudness = integratedLoudness;
+			TruePeak = truePeak;
+			SamplePeak = samplePeak;
+			Duration = duration;
+		}
+
+		/// <summary>
+		/// Gain, in dB, that brings <see cref="IntegratedLoudness"/> to <paramref name="targetLoudness"/>
+		/// without raising <see cref="TruePeak"/> above <paramref name="maxTruePeak"/>. Silent audio gets no gain.
+		/// </summary>
+		/// <param name="targetLoudness">Loudness to normalise to, in LUFS.</param>
+		/// <param name="maxTruePeak">Highest true peak allowed after the gain, in dBTP.</param>
+		public double GetNormalizationGain(double targetLoudness, double maxTruePeak = -1)
+		{
+			if (!double.IsFinite(targetLoudness)) throw new ArgumentOutOfRangeException(nameof(targetLoudness), "must be finite");
+			if (!double.IsFinite(maxTruePeak)) throw new ArgumentOutOfRangeException(nameof(maxTruePeak), "must be finite");
+
+			if (!double.IsFinite(IntegratedLoudness))
+				return 0;
+
+			double gain = targetLoudness - IntegratedLoudness;
+			return double.IsFinite(TruePeak) ? Math.Min(gain, maxTruePeak - TruePeak) : gain;
+		}
+
+		public override string ToString()
+		{
+			return $"[Integrated = {IntegratedLoudness:F1} LUFS, True Peak = {TruePeak:F1} dBTP, Sample Peak = {SamplePeak:F1} dBFS]";
+		}
+	}
+}
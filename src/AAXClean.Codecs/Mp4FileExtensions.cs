@@ -1,29 +1,69 @@
 ﻿using AAXClean.Codecs.FrameFilters.Audio;
+using AAXClean.Codecs.Interop;
 using AAXClean.FrameFilters;
 using AAXClean.FrameFilters.Text;
 using Mpeg4Lib;
 using Mpeg4Lib.Boxes;
 using System;
 using System.Collections.Generic;
+using System.ComponentModel;
 using System.IO;
+using System.Linq;
+using System.Runtime.CompilerServices;
+using System.Threading;
 using System.Threading.Tasks;
 
 namespace AAXClean.Codecs
 {
 	public static class Mp4FileExtensions
 	{
-		public static Mp4Operation<List<SilenceEntry>?> DetectSilenceAsync(this Mp4File mp4File, double decibels, TimeSpan minDuration, Action<SilenceDetectCallback>? detectionCallback = null)
+		/// <param name="decodeCache">Optional cache of decoded audio. Decoded PCM is read from the cache instead of decoding, and a cached loudness envelope limits decoding to the frames that might be quiet.</param>
+		public static Mp4Operation<List<SilenceEntry>?> DetectSilenceAsync(this Mp4File mp4File, double decibels, TimeSpan minDuration, Action<SilenceDetectCallback>? detectionCallback = null, DecodeCache? decodeCache = null)
 		{
 			ArgumentNullException.ThrowIfNull(mp4File, nameof(mp4File));
 			if (decibels >= 0 || decibels < -90) throw new ArgumentOutOfRangeException(nameof(decibels), "must fall in [-90,0)");
 			if (minDuration.TotalSeconds * (int)mp4File.SampleRate < 2) throw new ArgumentOutOfRangeException(nameof(minDuration), "must be no shorter than 2 audio samples.");
 
 			FrameTransformBase<FrameEntry, FrameEntry> filter1 = mp4File.GetAudioFrameFilter();
-			AacToWave filter2 = new(mp4File.AudioSampleEntry, WaveFormatEncoding.Pcm);
+
+			if (decodeCache is not null)
+			{
+				var nativeFormat = FfmpegAacDecoder.GetNativeWaveFormat(mp4File.AudioSampleEntry, WaveFormatEncoding.Pcm);
+				var entry = decodeCache.TryOpen(decodeCache.GetKey(mp4File, nativeFormat));
+
+				if (entry is not null && !entry.HasPcm && SilencePrepassFilter.CanUseEnvelope(minDuration, nativeFormat))
+				{
+					SilencePrepassFilter prepass = new(mp4File.AudioSampleEntry, decibels, minDuration, 0, detectionCallback, entry);
+					filter1.LinkTo(prepass);
+
+					List<SilenceEntry>? envelopeCompletion(Task t)
+					{
+						filter1.Dispose();
+						return t.IsFaulted ? null : prepass.Silences;
+					}
+
+					return mp4File.ProcessAudio(TimeSpan.Zero, TimeSpan.MaxValue, envelopeCompletion, (mp4File.Moov.AudioTrack, filter1));
+				}
+				entry?.Dispose();
+			}
+
+			FrameTransformBase<FrameEntry, WaveEntry> filter2;
+			WaveFormat waveFormat;
+			if (decodeCache is null)
+			{
+				AacToWave aacToWave = new(mp4File.AudioSampleEntry, WaveFormatEncoding.Pcm);
+				(filter2, waveFormat) = (aacToWave, aacToWave.WaveFormat);
+			}
+			else
+			{
+				CachedAacToWave aacToWave = new(mp4File, decodeCache);
+				(filter2, waveFormat) = (aacToWave, aacToWave.WaveFormat);
+			}
+
 			SilenceDetectFilter f3 = new(
 				decibels,
 				minDuration,
-				filter2.WaveFormat,
+				waveFormat,
 				detectionCallback);
 
 			filter1.LinkTo(filter2);
@@ -38,11 +78,240 @@ namespace AAXClean.Codecs
 			return mp4File.ProcessAudio(TimeSpan.Zero, TimeSpan.MaxValue, completion, (mp4File.Moov.AudioTrack, filter1));
 		}
 
-		public static Mp4Operation ConvertToMp3Async(this Mp4File mp4File, Stream outputStream, NAudio.Lame.LameConfig? lameConfig = null, ChapterInfo? userChapters = null)
+		/// <summary>
+		/// Detect silence for several (threshold, minimum duration) profiles while decoding the file once.
+		/// </summary>
+		/// <returns>The silences found for each profile, in the order the profiles were given.</returns>
+		public static Mp4Operation<List<SilenceEntry>[]?> DetectSilenceAsync(this Mp4File mp4File, IReadOnlyList<(double decibels, TimeSpan minDuration)> profiles, Action<SilenceDetectCallback>? detectionCallback = null)
+		{
+			ArgumentNullException.ThrowIfNull(mp4File, nameof(mp4File));
+			ArgumentNullException.ThrowIfNull(profiles, nameof(profiles));
+			ValidateSilenceProfiles(mp4File, profiles, nameof(profiles));
+
+			FrameTransformBase<FrameEntry, FrameEntry> filter1 = mp4File.GetAudioFrameFilter();
+			AacToWave filter2 = new(mp4File.AudioSampleEntry, WaveFormatEncoding.Pcm);
+			SilenceDetectFilter f3 = new(
+				profiles,
+				filter2.WaveFormat,
+				detectionCallback);
+
+			filter1.LinkTo(filter2);
+			filter2.LinkTo(f3);
+
+			List<SilenceEntry>[]? completion(Task t)
+			{
+				filter1.Dispose();
+				return t.IsFaulted ? null : f3.ProfileSilences;
+			}
+
+			return mp4File.ProcessAudio(TimeSpan.Zero, TimeSpan.MaxValue, completion, (mp4File.Moov.AudioTrack, filter1));
+		}
+
+		/// <summary>
+		/// Detect silence without decoding the whole file. Each frame's level is estimated from the
+		/// compressed bitstream and only frames that may be quiet are decoded and scanned.
+		/// </summary>
+		/// <param name="toleranceDecibels">How far above <paramref name="decibels"/> a frame's estimated level may be and still be decoded. Larger tolerances decode more of the file and match <see cref="DetectSilenceAsync"/> more closely.</param>
+		public static Mp4Operation<List<SilenceEntry>?> DetectSilenceFastAsync(this Mp4File mp4File, double decibels, TimeSpan minDuration, double toleranceDecibels = 6, Action<SilenceDetectCallback>? detectionCallback = null)
+		{
+			ArgumentNullException.ThrowIfNull(mp4File, nameof(mp4File));
+			if (decibels >= 0 || decibels < -90) throw new ArgumentOutOfRangeException(nameof(decibels), "must fall in [-90,0)");
+			if (minDuration.TotalSeconds * (int)mp4File.SampleRate < 2) throw new ArgumentOutOfRangeException(nameof(minDuration), "must be no shorter than 2 audio samples.");
+			if (toleranceDecibels < 0) throw new ArgumentOutOfRangeException(nameof(toleranceDecibels), "must not be negative");
+
+			FrameTransformBase<FrameEntry, FrameEntry> filter1 = mp4File.GetAudioFrameFilter();
+			SilencePrepassFilter f2 = new(
+				mp4File.AudioSampleEntry,
+				decibels,
+				minDuration,
+				toleranceDecibels,
+				detectionCallback);
+
+			filter1.LinkTo(f2);
+
+			List<SilenceEntry>? completion(Task t)
+			{
+				filter1.Dispose();
+				return t.IsFaulted ? null : f2.Silences;
+			}
+
+			return mp4File.ProcessAudio(TimeSpan.Zero, TimeSpan.MaxValue, completion, (mp4File.Moov.AudioTrack, filter1));
+		}
+
+		/// <summary>
+		/// Measure the loudness of the audio without encoding it. The audio is decoded at its own
+		/// sample rate and measured in place. Pass <see cref="LoudnessInfo.GetNormalizationGain"/>
+		/// to a conversion to normalise the audio as it is decoded.
+		/// </summary>
+		/// <param name="stereo">Channel layout to measure. Downmixing changes loudness, so measure the layout you will convert to. Defaults to the source's.</param>
+		public static Mp4Operation<LoudnessInfo?> MeasureLoudnessAsync(this Mp4File mp4File, bool? stereo = null)
+		{
+			ArgumentNullException.ThrowIfNull(mp4File, nameof(mp4File));
+
+			var nativeFormat = FfmpegAacDecoder.GetNativeWaveFormat(mp4File.AudioSampleEntry, WaveFormatEncoding.FloatPlanar);
+
+			FrameTransformBase<FrameEntry, FrameEntry> filter1 = mp4File.GetAudioFrameFilter();
+			AacToWave filter2 = new(mp4File.AudioSampleEntry, WaveFormatEncoding.FloatPlanar, nativeFormat.SampleRateEnum, stereo ?? nativeFormat.Channels == 2);
+			LoudnessMeterFilter filter3 = new(filter2.WaveFormat);
+
+			filter1.LinkTo(filter2);
+			filter2.LinkTo(filter3);
+
+			LoudnessInfo? completion(Task t)
+			{
+				filter1.Dispose();
+				return t.IsFaulted ? null : filter3.Loudness;
+			}
+
+			return mp4File.ProcessAudio(TimeSpan.Zero, TimeSpan.MaxValue, completion, (mp4File.Moov.AudioTrack, filter1));
+		}
+
+		/// <summary>
+		/// Write waveform peaks of the audio at several zoom levels, in one pass, for <see cref="WaveformPeaks.Open"/>
+		/// to map. The audio is decoded at its own sample rate and channel count.
+		/// </summary>
+		/// <param name="outputStream">Seekable stream for the peaks file. Closed when the operation completes.</param>
+		/// <param name="samplesPerPeak">Samples per channel in each peak of the finest level.</param>
+		/// <param name="levelCount">Number of zoom levels.</param>
+		/// <param name="levelScale">Peaks of each level combined into one peak of the next.</param>
+		public static Mp4Operation GenerateWaveformAsync(this Mp4File mp4File, Stream outputStream, int samplesPerPeak = WaveformPeaks.DefaultSamplesPerPeak, int levelCount = WaveformPeaks.DefaultLevelCount, int levelScale = WaveformPeaks.DefaultLevelScale)
+		{
+			ArgumentNullException.ThrowIfNull(mp4File, nameof(mp4File));
+			ArgumentNullException.ThrowIfNull(outputStream, nameof(outputStream));
+			if (!outputStream.CanWrite || !outputStream.CanSeek) throw new ArgumentException("stream must be writable and seekable", nameof(outputStream));
+			ValidateWaveformLevels(samplesPerPeak, levelCount, levelScale);
+
+			FrameTransformBase<FrameEntry, FrameEntry> filter1 = mp4File.GetAudioFrameFilter();
+			AacToWave filter2 = new(mp4File.AudioSampleEntry, WaveFormatEncoding.FloatPlanar);
+			WaveformPeakFilter filter3 = new(outputStream, filter2.WaveFormat, samplesPerPeak, levelCount, levelScale);
+
+			filter1.LinkTo(filter2);
+			filter2.LinkTo(filter3);
+
+			void completion(Task t)
+			{
+				filter1.Dispose();
+				outputStream.Close();
+			}
+
+			return mp4File.ProcessAudio(TimeSpan.Zero, TimeSpan.MaxValue, completion, (mp4File.Moov.AudioTrack, filter1));
+		}
+
+		/// <summary>
+		/// Decode the audio as the caller reads it, with channels interleaved. Each block is lent
+		/// without copying until the caller moves to the next one, when it is recycled, so copy
+		/// any audio that must be kept. While the caller is behind, decoding and reading the file wait.
+		/// </summary>
+		/// <typeparam name="T"><see cref="short"/> for 16-bit PCM or <see cref="float"/> for 32-bit float.</typeparam>
+		/// <param name="sampleRate">Output sample rate, no higher than the source's. Defaults to the source's.</param>
+		/// <param name="stereo">Output channel layout. Defaults to the source's.</param>
+		/// <param name="resampleQuality">Resampling filter used if the output sample rate differs from the source's.</param>
+		/// <param name="cancellationToken">Stops decoding. Stopping reading early does the same.</param>
+		public static IAsyncEnumerable<ReadOnlyMemory<T>> ReadPcmAsync<T>(this Mp4File mp4File, SampleRate? sampleRate = null, bool? stereo = null, ResampleQuality resampleQuality = ResampleQuality.Default, CancellationToken cancellationToken = default) where T : unmanaged
+		{
+			ArgumentNullException.ThrowIfNull(mp4File, nameof(mp4File));
+			var encoding
+				= typeof(T) == typeof(short) ? WaveFormatEncoding.Pcm
+				: typeof(T) == typeof(float) ? WaveFormatEncoding.Float
+				: throw new NotSupportedException($"{typeof(T).Name} samples are not supported. Use {nameof(Int16)} or {nameof(Single)}.");
+
+			return ReadInterleavedWaveAsync<T>(mp4File, encoding, sampleRate, stereo, resampleQuality, cancellationToken);
+		}
+
+		/// <summary>
+		/// Decode the audio as the caller reads it, as 32-bit float with one plane per channel.
+		/// Blocks are lent the same way as by <see cref="ReadPcmAsync{T}"/>.
+		/// </summary>
+		/// <param name="sampleRate">Output sample rate, no higher than the source's. Defaults to the source's.</param>
+		/// <param name="stereo">Output channel layout. Defaults to the source's.</param>
+		/// <param name="resampleQuality">Resampling filter used if the output sample rate differs from the source's.</param>
+		/// <param name="cancellationToken">Stops decoding. Stopping reading early does the same.</param>
+		public static IAsyncEnumerable<PlanarPcm> ReadPlanarPcmAsync(this Mp4File mp4File, SampleRate? sampleRate = null, bool? stereo = null, ResampleQuality resampleQuality = ResampleQuality.Default, CancellationToken cancellationToken = default)
+		{
+			ArgumentNullException.ThrowIfNull(mp4File, nameof(mp4File));
+			return ReadPlanarWaveAsync(mp4File, sampleRate, stereo, resampleQuality, cancellationToken);
+		}
+
+		private static async IAsyncEnumerable<ReadOnlyMemory<T>> ReadInterleavedWaveAsync<T>(Mp4File mp4File, WaveFormatEncoding encoding, SampleRate? sampleRate, bool? stereo, ResampleQuality resampleQuality, [EnumeratorCancellation] CancellationToken cancellationToken) where T : unmanaged
+		{
+			await foreach (var entry in ReadWaveAsync(mp4File, encoding, sampleRate, stereo, resampleQuality, cancellationToken))
+				yield return new CastMemoryManager<T>(entry.FrameData).Memory;
+		}
+
+		private static async IAsyncEnumerable<PlanarPcm> ReadPlanarWaveAsync(Mp4File mp4File, SampleRate? sampleRate, bool? stereo, ResampleQuality resampleQuality, [EnumeratorCancellation] CancellationToken cancellationToken)
+		{
+			await foreach (var entry in ReadWaveAsync(mp4File, WaveFormatEncoding.FloatPlanar, sampleRate, stereo, resampleQuality, cancellationToken))
+			{
+				yield return new PlanarPcm(
+					(int)entry.SamplesInFrame,
+					new CastMemoryManager<float>(entry.FrameData).Memory,
+					entry.FrameData2.IsEmpty ? ReadOnlyMemory<float>.Empty : new CastMemoryManager<float>(entry.FrameData2).Memory);
+			}
+		}
+
+		/// <summary>
+		/// Lend each decoded entry until the caller moves to the next. When reading ends early, the
+		/// conversion is cancelled and audio already decoded is released.
+		/// </summary>
+		private static async IAsyncEnumerable<WaveEntry> ReadWaveAsync(Mp4File mp4File, WaveFormatEncoding encoding, SampleRate? sampleRate, bool? stereo, ResampleQuality resampleQuality, [EnumeratorCancellation] CancellationToken cancellationToken)
+		{
+			var nativeFormat = FfmpegAacDecoder.GetNativeWaveFormat(mp4File.AudioSampleEntry, encoding);
+
+			FrameTransformBase<FrameEntry, FrameEntry> filter1 = mp4File.GetAudioFrameFilter();
+			AacToWave filter2 = new(
+				mp4File.AudioSampleEntry,
+				encoding,
+				sampleRate is null ? nativeFormat.SampleRateEnum : mp4File.GetMaxSampleRate(sampleRate),
+				stereo ?? nativeFormat.Channels == 2,
+				resampleQuality);
+			PcmReaderFilter filter3 = new();
+
+			filter1.LinkTo(filter2);
+			filter2.LinkTo(filter3);
+
+			void completion(Task t)
+			{
+				filter1.Dispose();
+				filter3.Complete(t.Exception?.InnerException);
+			}
+
+			var operation = mp4File.ProcessAudio(TimeSpan.Zero, TimeSpan.MaxValue, completion, (mp4File.Moov.AudioTrack, filter1));
+			WaveEntry? lent = null;
+			try
+			{
+				await foreach (var entry in filter3.ReadAllAsync(cancellationToken))
+				{
+					lent = entry;
+					yield return entry;
+					lent = null;
+					entry.Release();
+				}
+			}
+			finally
+			{
+				lent?.Release();
+				if (!operation.IsCompleted)
+				{
+					filter3.Abandon();
+					await operation.CancelAsync();
+				}
+				//Errors were passed to the reader. After an early stop they no longer matter.
+				await Task.WhenAny(operation);
+				filter3.ReleaseUnread();
+			}
+		}
+
+		/// <param name="degreeOfParallelism">Number of segments to encode concurrently. Values greater than 1 encode without the bit reservoir.</param>
+		/// <param name="decodeCache">Optional cache of decoded audio, used when converting the whole file.</param>
+		/// <param name="resampleQuality">Resampling filter used if the MP3 sample rate differs from the source's.</param>
+		/// <param name="gainDecibels">Gain applied as the audio is decoded, e.g. from <see cref="LoudnessInfo.GetNormalizationGain"/>. The decode cache is not used with a gain.</param>
+		public static Mp4Operation ConvertToMp3Async(this Mp4File mp4File, Stream outputStream, NAudio.Lame.LameConfig? lameConfig = null, ChapterInfo? userChapters = null, int degreeOfParallelism = 1, DecodeCache? decodeCache = null, ResampleQuality resampleQuality = ResampleQuality.Default, double gainDecibels = 0)
 		{
 			ArgumentNullException.ThrowIfNull(mp4File, nameof(mp4File));
 			ArgumentNullException.ThrowIfNull(outputStream, nameof(outputStream));
 			if (outputStream.CanWrite is false) throw new ArgumentException("output stream is not writable", nameof(outputStream));
+			if (degreeOfParallelism < 1) throw new ArgumentOutOfRangeException(nameof(degreeOfParallelism), "must be at least 1");
+			if (!double.IsFinite(gainDecibels)) throw new ArgumentOutOfRangeException(nameof(gainDecibels), "must be finite");
 
 			lameConfig ??= mp4File.GetDefaultLameConfig();
 			lameConfig.ID3 ??= mp4File.MetadataItems?.ToIDTags() ?? new(nameof(AAXClean));
@@ -58,16 +327,17 @@ namespace AAXClean.Codecs
 
 			FrameTransformBase<FrameEntry, FrameEntry> filter1 = mp4File.GetAudioFrameFilter();
 
-			AacToWave filter2 = new(
-				mp4File.AudioSampleEntry,
-				WaveFormatEncoding.Pcm,
-				sampleRate,
-				stereo);
+			//LAME reads float-planar audio in place. Parallel encoding and the decode cache use 16-bit PCM.
+			//The cache holds audio without gain, so a gain is applied by decoding.
+			var useDecodeCache = userChapters is null && decodeCache is not null && gainDecibels == 0;
+			var encoding = degreeOfParallelism == 1 && !useDecodeCache ? WaveFormatEncoding.FloatPlanar : WaveFormatEncoding.Pcm;
 
-			WaveToMp3Filter filter3 = new(
-				outputStream,
-				filter2.WaveFormat,
-				lameConfig);
+			var (filter2, waveFormat) = CreateDecodeFilter(mp4File, sampleRate, stereo, resampleQuality, useDecodeCache ? decodeCache : null, encoding, gainDecibels);
+
+			FrameFinalBase<WaveEntry> filter3
+				= degreeOfParallelism > 1
+				? new WaveToMp3ParallelFilter(outputStream, waveFormat, lameConfig, degreeOfParallelism)
+				: new WaveToMp3Filter(outputStream, waveFormat, lameConfig);
 
 			filter1.LinkTo(filter2);
 			filter2.LinkTo(filter3);
@@ -84,12 +354,20 @@ namespace AAXClean.Codecs
 			return mp4File.ProcessAudio(start, end, completion, (mp4File.Moov.AudioTrack, filter1));
 		}
 
-		public static Mp4Operation ConvertToMp4aAsync(this Mp4File mp4File, Stream outputStream, AacEncodingOptions options, ChapterInfo? userChapters = null)
+		/// <summary>
+		/// Re-encode the audio to AAC-LC. With <see cref="AacEncodingOptions.AllowStreamCopy"/>, audio
+		/// already in the requested format is copied instead.
+		/// </summary>
+		/// <param name="degreeOfParallelism">Number of segments to encode concurrently. Ignored when the audio is copied.</param>
+		/// <param name="decodeCache">Optional cache of decoded audio, used when converting the whole file. Ignored when the audio is copied.</param>
+		public static Mp4Operation ConvertToMp4aAsync(this Mp4File mp4File, Stream outputStream, AacEncodingOptions options, ChapterInfo? userChapters = null, int degreeOfParallelism = 1, DecodeCache? decodeCache = null)
 		{
 			ArgumentNullException.ThrowIfNull(mp4File, nameof(mp4File));
 			ArgumentNullException.ThrowIfNull(outputStream, nameof(outputStream));
 			ArgumentNullException.ThrowIfNull(options, nameof(options));
 			if (outputStream.CanWrite is false) throw new ArgumentException("output stream is not writable", nameof(outputStream));
+			if (degreeOfParallelism < 1) throw new ArgumentOutOfRangeException(nameof(degreeOfParallelism), "must be at least 1");
+			if (!double.IsFinite(options.GainDecibels)) throw new ArgumentOutOfRangeException(nameof(options), "GainDecibels must be finite");
 
 			var start = userChapters?.StartOffset ?? TimeSpan.Zero;
 			var end = userChapters?.EndOffset ?? TimeSpan.MaxValue;
@@ -97,6 +375,10 @@ namespace AAXClean.Codecs
 			var stereo = mp4File.AudioChannels > 1 && options.Stereo is true;
 			var sampleRate = mp4File.GetMaxSampleRate(options.SampleRate);
 
+			//Re-encoding to the source's own format only loses quality.
+			if (CanStreamCopy(mp4File, options, sampleRate, stereo))
+				return mp4File.ConvertToMp4aAsync(outputStream, userChapters);
+
 			ChapterQueue chapterQueue = new(mp4File.SampleRate, sampleRate);
 			if (userChapters is not null)
 			{
@@ -107,22 +389,25 @@ namespace AAXClean.Codecs
 
 			FrameTransformBase<FrameEntry, FrameEntry> filter1 = mp4File.GetAudioFrameFilter();
 
-			AacToWave filter2 = new(
-				mp4File.AudioSampleEntry,
-				WaveFormatEncoding.Pcm,
-				sampleRate,
-				stereo);
+			var useDecodeCache = userChapters is null && decodeCache is not null && options.GainDecibels == 0;
 
-			WaveToAacFilter filter3 = new(
-				outputStream,
-				mp4File,
-				chapterQueue,
-				filter2.WaveFormat,
-				options.BitRate,
-				options.EncoderQuality);
+			//Serial AAC to AAC conversions decode and re-encode inside the native transcoder.
+			if (degreeOfParallelism == 1 && !useDecodeCache && FfmpegAacTranscoder.CanTranscode(mp4File.AudioSampleEntry))
+			{
+				filter1.LinkTo(new AacTranscodeFilter(outputStream, mp4File, chapterQueue, sampleRate, stereo, options));
+			}
+			else
+			{
+				var (filter2, waveFormat) = CreateDecodeFilter(mp4File, sampleRate, stereo, options.ResampleQuality, useDecodeCache ? decodeCache : null, gainDecibels: options.GainDecibels);
 
-			filter1.LinkTo(filter2);
-			filter2.LinkTo(filter3);
+				FrameFinalBase<WaveEntry> filter3
+					= degreeOfParallelism > 1
+					? new WaveToAacParallelFilter(outputStream, mp4File, chapterQueue, waveFormat, options.BitRate, options.EncoderQuality, degreeOfParallelism)
+					: new WaveToAacFilter(outputStream, mp4File, chapterQueue, waveFormat, options.BitRate, options.EncoderQuality);
+
+				filter1.LinkTo(filter2);
+				filter2.LinkTo(filter3);
+			}
 
 			if (mp4File.Moov.TextTrack is null || userChapters is not null)
 			{
@@ -151,42 +436,138 @@ namespace AAXClean.Codecs
 			}
 		}
 
-		public static Mp4Operation ConvertToMultiMp4aAsync(this Mp4File mp4File, ChapterInfo userChapters, Action<NewAacSplitCallback> newFileCallback, AacEncodingOptions options)
+		/// <summary>
+		/// Decrypt and decode the audio once and send it to every output in <paramref name="outputs"/>.
+		/// Each output is encoded or scanned on its own thread.
+		/// </summary>
+		/// <returns>The silences found for each of <see cref="DecodeOnceOutputs.SilenceProfiles"/>, in the order the profiles were given.</returns>
+		public static Mp4Operation<List<SilenceEntry>[]?> DecodeOnceAsync(this Mp4File mp4File, DecodeOnceOutputs outputs)
+		{
+			ArgumentNullException.ThrowIfNull(mp4File, nameof(mp4File));
+			ArgumentNullException.ThrowIfNull(outputs, nameof(outputs));
+			if (outputs.Mp3Output is null && outputs.Mp4aOutput is null && outputs.SilenceProfiles is null && outputs.LoudnessCallback is null && outputs.WaveformOutput is null) throw new ArgumentException("no outputs were given", nameof(outputs));
+			if (outputs.Mp3Output?.CanWrite is false) throw new ArgumentException("MP3 output stream is not writable", nameof(outputs));
+			if (outputs.Mp4aOutput?.CanWrite is false) throw new ArgumentException("AAC output stream is not writable", nameof(outputs));
+			if (outputs.WaveformOutput is not null && (!outputs.WaveformOutput.CanWrite || !outputs.WaveformOutput.CanSeek)) throw new ArgumentException("waveform output stream must be writable and seekable", nameof(outputs));
+			if (outputs.Mp4aOutput is not null && outputs.AacOptions is null) throw new ArgumentException("AAC output requires AAC encoding options", nameof(outputs));
+			if (outputs.AacOptions?.GainDecibels is not null and not 0) throw new ArgumentException("a gain would change every output's audio, so it is not supported", nameof(outputs));
+			if (outputs.SilenceProfiles is not null)
+				ValidateSilenceProfiles(mp4File, outputs.SilenceProfiles, nameof(outputs));
+
+			FrameTransformBase<FrameEntry, FrameEntry> filter1 = mp4File.GetAudioFrameFilter();
+
+			//The AAC encoder needs 16-bit PCM in its output format. Without it, decode the
+			//source's format as float-planar, which LAME and the silence scanner read in place.
+			var aacOptions = outputs.Mp4aOutput is null ? null : outputs.AacOptions;
+			AacToWave filter2 = aacOptions is null
+				? new(mp4File.AudioSampleEntry, WaveFormatEncoding.FloatPlanar)
+				: new(mp4File.AudioSampleEntry, WaveFormatEncoding.Pcm, mp4File.GetMaxSampleRate(aacOptions.SampleRate), mp4File.AudioChannels > 1 && aacOptions.Stereo is true, aacOptions.ResampleQuality);
+			var waveFormat = filter2.WaveFormat;
+
+			List<FrameFilterBase<WaveEntry>> targets = new();
+			if (outputs.Mp3Output is not null)
+			{
+				var lameConfig = outputs.LameConfig ?? mp4File.GetDefaultLameConfig();
+				lameConfig.ID3 ??= mp4File.MetadataItems?.ToIDTags() ?? new(nameof(AAXClean));
+				targets.Add(new WaveToMp3Filter(outputs.Mp3Output, waveFormat, lameConfig));
+			}
+
+			ChapterFilter? chapterFilter = null;
+			if (aacOptions is not null)
+			{
+				ChapterQueue chapterQueue = new(mp4File.SampleRate, waveFormat.SampleRateEnum);
+				if (mp4File.Moov.TextTrack is not null)
+				{
+					chapterFilter = new();
+					chapterFilter.ChapterRead += (_, e) => chapterQueue.Add(e);
+				}
+				targets.Add(new WaveToAacFilter(outputs.Mp4aOutput!, mp4File, chapterQueue, waveFormat, aacOptions.BitRate, aacOptions.EncoderQuality));
+			}
+
+			SilenceDetectFilter? silenceFilter = null;
+			if (outputs.SilenceProfiles is not null)
+			{
+				silenceFilter = new(outputs.SilenceProfiles, waveFormat, outputs.SilenceDetectionCallback);
+				targets.Add(silenceFilter);
+			}
+
+			if (outputs.LoudnessCallback is not null)
+				targets.Add(new LoudnessMeterFilter(waveFormat, outputs.LoudnessCallback));
+
+			if (outputs.WaveformOutput is not null)
+				targets.Add(new WaveformPeakFilter(outputs.WaveformOutput, waveFormat, WaveformPeaks.DefaultSamplesPerPeak, WaveformPeaks.DefaultLevelCount, WaveformPeaks.DefaultLevelScale));
+
+			filter1.LinkTo(filter2);
+			filter2.LinkTo(new WaveTeeFilter([.. targets]));
+
+			List<SilenceEntry>[]? completion(Task t)
+			{
+				filter1.Dispose();
+				chapterFilter?.Dispose();
+				outputs.Mp3Output?.Close();
+				outputs.Mp4aOutput?.Close();
+				outputs.WaveformOutput?.Close();
+				return t.IsFaulted ? null : silenceFilter?.ProfileSilences ?? [];
+			}
+
+			return chapterFilter is null
+				? mp4File.ProcessAudio(TimeSpan.Zero, TimeSpan.MaxValue, completion, (mp4File.Moov.AudioTrack, filter1))
+				: mp4File.ProcessAudio(TimeSpan.Zero, TimeSpan.MaxValue, completion, (mp4File.Moov.AudioTrack, filter1), (mp4File.Moov.TextTrack!, chapterFilter));
+		}
+
+		/// <summary>
+		/// Re-encode each chapter to its own AAC-LC file. With <see cref="AacEncodingOptions.AllowStreamCopy"/>,
+		/// audio already in the requested format is copied instead.
+		/// </summary>
+		/// <param name="degreeOfParallelism">Number of chapter files to encode concurrently. Callbacks are still raised in chapter order. Ignored when the audio is copied.</param>
+		public static Mp4Operation ConvertToMultiMp4aAsync(this Mp4File mp4File, ChapterInfo userChapters, Action<NewAacSplitCallback> newFileCallback, AacEncodingOptions options, int degreeOfParallelism = 1)
 		{
 			ArgumentNullException.ThrowIfNull(mp4File, nameof(mp4File));
 			ArgumentNullException.ThrowIfNull(userChapters, nameof(userChapters));
 			ArgumentNullException.ThrowIfNull(newFileCallback, nameof(newFileCallback));
+			if (degreeOfParallelism < 1) throw new ArgumentOutOfRangeException(nameof(degreeOfParallelism), "must be at least 1");
 
 			var stereo = mp4File.AudioChannels > 1 && options.Stereo is true;
 			var sampleRate = mp4File.GetMaxSampleRate(options.SampleRate);
 
 			FrameTransformBase<FrameEntry, FrameEntry> filter1 = mp4File.GetAudioFrameFilter();
+			void completion(Task t) => filter1.Dispose();
+
+			if (CanStreamCopy(mp4File, options, sampleRate, stereo))
+			{
+				filter1.LinkTo(new AacPassthroughMultipartFilter(userChapters, mp4File, options, newFileCallback));
+				return mp4File.ProcessAudio(userChapters.StartOffset, userChapters.EndOffset, completion, (mp4File.Moov.AudioTrack, filter1));
+			}
 
 			AacToWave filter2 = new(
 				mp4File.AudioSampleEntry,
 				WaveFormatEncoding.Pcm,
 				sampleRate,
-				stereo);
+				stereo,
+				options.ResampleQuality,
+				options.GainDecibels);
 
 			WaveToAacMultipartFilter filter3 = new(
 				userChapters, mp4File.Ftyp, mp4File.Moov,
 				filter2.WaveFormat,
 				options,
-				newFileCallback);
+				newFileCallback,
+				degreeOfParallelism);
 
 			filter1.LinkTo(filter2);
 			filter2.LinkTo(filter3);
 
-			void completion(Task t) => filter1.Dispose();
-
 			return mp4File.ProcessAudio(userChapters.StartOffset, userChapters.EndOffset, completion, (mp4File.Moov.AudioTrack, filter1));
 		}
 
-		public static Mp4Operation ConvertToMultiMp3Async(this Mp4File mp4File, ChapterInfo userChapters, Action<NewMP3SplitCallback> newFileCallback, NAudio.Lame.LameConfig? lameConfig = null)
+		/// <param name="degreeOfParallelism">Number of chapter files to encode concurrently. Callbacks are still raised in chapter order.</param>
+		/// <param name="resampleQuality">Resampling filter used if the MP3 sample rate differs from the source's.</param>
+		public static Mp4Operation ConvertToMultiMp3Async(this Mp4File mp4File, ChapterInfo userChapters, Action<NewMP3SplitCallback> newFileCallback, NAudio.Lame.LameConfig? lameConfig = null, int degreeOfParallelism = 1, ResampleQuality resampleQuality = ResampleQuality.Default)
 		{
 			ArgumentNullException.ThrowIfNull(mp4File, nameof(mp4File));
 			ArgumentNullException.ThrowIfNull(userChapters, nameof(userChapters));
 			ArgumentNullException.ThrowIfNull(newFileCallback, nameof(newFileCallback));
+			if (degreeOfParallelism < 1) throw new ArgumentOutOfRangeException(nameof(degreeOfParallelism), "must be at least 1");
 
 			lameConfig ??= mp4File.GetDefaultLameConfig();
 			lameConfig.ID3 ??= mp4File.MetadataItems?.ToIDTags() ?? new(nameof(AAXClean));
@@ -198,15 +579,17 @@ namespace AAXClean.Codecs
 
 			AacToWave filter2 = new(
 				mp4File.AudioSampleEntry,
-				WaveFormatEncoding.Pcm,
+				WaveFormatEncoding.FloatPlanar,
 				sampleRate,
-				stereo);
+				stereo,
+				resampleQuality);
 
 			WaveToMp3MultipartFilter filter3 = new(
 				userChapters,
 				filter2.WaveFormat,
 				lameConfig,
-				newFileCallback);
+				newFileCallback,
+				degreeOfParallelism);
 
 			filter1.LinkTo(filter2);
 			filter2.LinkTo(filter3);
@@ -216,6 +599,166 @@ namespace AAXClean.Codecs
 			return mp4File.ProcessAudio(userChapters.StartOffset, userChapters.EndOffset, completion, (mp4File.Moov.AudioTrack, filter1));
 		}
 
+		/// <summary>
+		/// Encode short clips of the audio to MP3, each trimmed to the sample. Clips are read one at
+		/// a time, since they share the input stream, and decoded and encoded concurrently with
+		/// decoders reused across clips.
+		/// </summary>
+		/// <param name="clips">Start and end of each clip.</param>
+		/// <param name="createOutput">Returns the stream for the clip at the given index in <paramref name="clips"/>. The stream is closed once the clip is written.</param>
+		/// <param name="degreeOfParallelism">Number of clips to decode and encode at once.</param>
+		public static async Task ExtractClipsAsync(this Mp4File mp4File, IReadOnlyList<(TimeSpan start, TimeSpan end)> clips, Func<int, Stream> createOutput, NAudio.Lame.LameConfig? lameConfig = null, int degreeOfParallelism = 4, CancellationToken cancellationToken = default)
+		{
+			ArgumentNullException.ThrowIfNull(mp4File, nameof(mp4File));
+			ArgumentNullException.ThrowIfNull(clips, nameof(clips));
+			ArgumentNullException.ThrowIfNull(createOutput, nameof(createOutput));
+			if (degreeOfParallelism < 1) throw new ArgumentOutOfRangeException(nameof(degreeOfParallelism), "must be at least 1");
+			foreach (var (start, end) in clips)
+			{
+				if (start < TimeSpan.Zero || end <= start) throw new ArgumentOutOfRangeException(nameof(clips), "each clip must start at or after zero and end after it starts");
+			}
+
+			lameConfig ??= mp4File.GetDefaultLameConfig();
+			lameConfig.ID3 ??= mp4File.MetadataItems?.ToIDTags() ?? new(nameof(AAXClean));
+
+			var preRoll = FfmpegAacDecoder.GetPreRoll(mp4File.AudioSampleEntry);
+			using SemaphoreSlim workerSlots = new(degreeOfParallelism);
+			List<Task> workers = new();
+
+			try
+			{
+				//Read in file order so the input is never read backwards.
+				foreach (int index in Enumerable.Range(0, clips.Count).OrderBy(i => clips[i].start))
+				{
+					var (start, end) = clips[index];
+					var readStart = start > preRoll ? start - preRoll : TimeSpan.Zero;
+
+					//Past the end, read a little more in case the last frame the range ends in isn't included.
+					FrameCollector collector = await ReadFramesAsync(mp4File, readStart, end + preRoll, cancellationToken);
+					var framesStart = collector.GetStartTime(mp4File.SampleRate, readStart);
+
+					await workerSlots.WaitAsync(cancellationToken);
+					if (workers.Find(w => w.IsFaulted) is Task faulted)
+					{
+						workerSlots.Release();
+						await faulted;
+					}
+					workers.Add(Task.Run(() =>
+					{
+						try
+						{
+							EncodeClip(mp4File, collector.Frames, framesStart, start, end, createOutput(index), lameConfig);
+						}
+						finally
+						{
+							workerSlots.Release();
+						}
+					}, CancellationToken.None));
+				}
+			}
+			finally
+			{
+				await Task.WhenAll(workers);
+			}
+		}
+
+		private static async Task<FrameCollector> ReadFramesAsync(Mp4File mp4File, TimeSpan start, TimeSpan end, CancellationToken cancellationToken)
+		{
+			FrameTransformBase<FrameEntry, FrameEntry> filter1 = mp4File.GetAudioFrameFilter();
+			FrameCollector collector = new();
+			filter1.LinkTo(collector);
+
+			void completion(Task t) => filter1.Dispose();
+
+			var operation = mp4File.ProcessAudio(start, end, completion, (mp4File.Moov.AudioTrack, filter1));
+			using (cancellationToken.Register(() => operation.CancelAsync()))
+				await operation;
+
+			cancellationToken.ThrowIfCancellationRequested();
+			return collector;
+		}
+
+		private static void EncodeClip(Mp4File mp4File, List<FrameEntry> frames, TimeSpan framesStart, TimeSpan start, TimeSpan end, Stream output, NAudio.Lame.LameConfig lameConfig)
+		{
+			var decoder = CodecPool.RentDecoder(mp4File.AudioSampleEntry, WaveFormatEncoding.FloatPlanar);
+			try
+			{
+				using var writer = WaveToMp3Filter.CreateWriter(output, decoder.WaveFormat, lameConfig);
+				decoder.DecodeRange(frames, mp4File.SampleRate, framesStart, start, end, wave =>
+				{
+					try
+					{
+						WaveToMp3Filter.Write(writer, decoder.WaveFormat, wave);
+					}
+					finally
+					{
+						wave.Release();
+					}
+				});
+				writer.Flush();
+			}
+			finally
+			{
+				CodecPool.Return(decoder);
+				output.Close();
+			}
+		}
+
+		private static void ValidateSilenceProfiles(Mp4File mp4File, IReadOnlyList<(double decibels, TimeSpan minDuration)> profiles, string paramName)
+		{
+			if (profiles.Count < 1 || profiles.Count > NativeSilence.MaxProfiles) throw new ArgumentOutOfRangeException(paramName, $"must contain between 1 and {NativeSilence.MaxProfiles} profiles");
+			foreach (var (decibels, minDuration) in profiles)
+			{
+				if (decibels >= 0 || decibels < -90) throw new ArgumentOutOfRangeException(paramName, "decibels must fall in [-90,0)");
+				if (minDuration.TotalSeconds * (int)mp4File.SampleRate < 2) throw new ArgumentOutOfRangeException(paramName, "minDuration must be no shorter than 2 audio samples.");
+			}
+		}
+
+		private static void ValidateWaveformLevels(int samplesPerPeak, int levelCount, int levelScale)
+		{
+			ArgumentOutOfRangeException.ThrowIfNegativeOrZero(samplesPerPeak, nameof(samplesPerPeak));
+			ArgumentOutOfRangeException.ThrowIfNegativeOrZero(levelCount, nameof(levelCount));
+			ArgumentOutOfRangeException.ThrowIfLessThan(levelScale, 2, nameof(levelScale));
+			if (samplesPerPeak * Math.Pow(levelScale, levelCount - 1) > int.MaxValue)
+				throw new ArgumentOutOfRangeException(nameof(levelCount), "the coarsest level's peaks would be too long");
+		}
+
+		/// <summary>
+		/// AAC-LC sources can be copied when the output would have the same sample rate and
+		/// channel count, and the requested bitrate is no lower than the source's. A quality
+		/// target can't be compared to the source, so it always re-encodes.
+		/// </summary>
+		private static bool CanStreamCopy(Mp4File mp4File, AacEncodingOptions options, SampleRate sampleRate, bool stereo)
+		{
+			if (!options.AllowStreamCopy || options.GainDecibels != 0 || mp4File.AudioSampleEntry.Esds is not EsdsBox esds)
+				return false;
+
+			var asc = esds.ES_Descriptor.DecoderConfig.AudioSpecificConfig;
+			return asc.AudioObjectType == 2
+				&& asc.SamplingFrequency == (int)sampleRate
+				&& asc.ChannelConfiguration == (stereo ? 2 : 1)
+				&& (options.BitRate is long bitRate ? bitRate >= mp4File.AverageBitrate : options.EncoderQuality is null);
+		}
+
+		/// <summary>
+		/// Create the filter that decodes the whole file, reading from and filling <paramref name="decodeCache"/> if there is one.
+		/// </summary>
+		/// <param name="encoding">Decoder output format. The decode cache only holds 16-bit PCM.</param>
+		/// <param name="gainDecibels">Gain applied by the decoder. Must be 0 with a decode cache.</param>
+		private static (FrameTransformBase<FrameEntry, WaveEntry> filter, WaveFormat waveFormat) CreateDecodeFilter(Mp4File mp4File, SampleRate sampleRate, bool stereo, ResampleQuality resampleQuality, DecodeCache? decodeCache, WaveFormatEncoding encoding = WaveFormatEncoding.Pcm, double gainDecibels = 0)
+		{
+			if (decodeCache is null)
+			{
+				AacToWave aacToWave = new(mp4File.AudioSampleEntry, encoding, sampleRate, stereo, resampleQuality, gainDecibels);
+				return (aacToWave, aacToWave.WaveFormat);
+			}
+			else
+			{
+				CachedAacToWave aacToWave = new(mp4File, decodeCache, sampleRate, stereo, resampleQuality);
+				return (aacToWave, aacToWave.WaveFormat);
+			}
+		}
+
 		public static NAudio.Lame.LameConfig GetDefaultLameConfig(this Mp4File mp4File)
 		{
 			ArgumentNullException.ThrowIfNull(mp4File, nameof(mp4File));
@@ -284,6 +827,28 @@ namespace AAXClean.Codecs
 
 			return tags;
 		}
+
+		//Signatures from before optional parameters were appended, kept so that callers
+		//compiled against them still bind. New code binds to the overloads above.
+		[EditorBrowsable(EditorBrowsableState.Never)]
+		public static Mp4Operation<List<SilenceEntry>?> DetectSilenceAsync(this Mp4File mp4File, double decibels, TimeSpan minDuration, Action<SilenceDetectCallback>? detectionCallback)
+			=> DetectSilenceAsync(mp4File, decibels, minDuration, detectionCallback, decodeCache: null);
+
+		[EditorBrowsable(EditorBrowsableState.Never)]
+		public static Mp4Operation ConvertToMp3Async(this Mp4File mp4File, Stream outputStream, NAudio.Lame.LameConfig? lameConfig, ChapterInfo? userChapters)
+			=> ConvertToMp3Async(mp4File, outputStream, lameConfig, userChapters, degreeOfParallelism: 1);
+
+		[EditorBrowsable(EditorBrowsableState.Never)]
+		public static Mp4Operation ConvertToMp4aAsync(this Mp4File mp4File, Stream outputStream, AacEncodingOptions options, ChapterInfo? userChapters)
+			=> ConvertToMp4aAsync(mp4File, outputStream, options, userChapters, degreeOfParallelism: 1);
+
+		[EditorBrowsable(EditorBrowsableState.Never)]
+		public static Mp4Operation ConvertToMultiMp4aAsync(this Mp4File mp4File, ChapterInfo userChapters, Action<NewAacSplitCallback> newFileCallback, AacEncodingOptions options)
+			=> ConvertToMultiMp4aAsync(mp4File, userChapters, newFileCallback, options, degreeOfParallelism: 1);
+
+		[EditorBrowsable(EditorBrowsableState.Never)]
+		public static Mp4Operation ConvertToMultiMp3Async(this Mp4File mp4File, ChapterInfo userChapters, Action<NewMP3SplitCallback> newFileCallback, NAudio.Lame.LameConfig? lameConfig)
+			=> ConvertToMultiMp3Async(mp4File, userChapters, newFileCallback, lameConfig, degreeOfParallelism: 1);
 	}
 }
 
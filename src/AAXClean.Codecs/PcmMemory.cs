@@ -0,0 +1,52 @@
+﻿using System;
+using System.Threading;
+
+namespace AAXClean.Codecs
+{
+	/// <summary>
+	/// Limits on decoded audio waiting between filters. Once a limit is reached, decoders wait for
+	/// downstream filters to release audio before decoding more. Time spent waiting is published
+	/// through <see cref="CodecMetrics"/> as <c>aaxclean.filter.stall</c>.
+	/// </summary>
+	public static class PcmMemory
+	{
+		internal static readonly object BudgetLock = new();
+		private static long bytesInUse;
+		private static long processLimit = 512L * 1024 * 1024;
+		private static long pipelineLimit = 64L * 1024 * 1024;
+		private static TimeSpan bufferDuration = TimeSpan.FromSeconds(1);
+
+		/// <summary> Most decoded audio, in bytes, that all conversions in the process may hold between filters. </summary>
+		public static long ProcessLimit
+		{
+			get => Interlocked.Read(ref processLimit);
+			set => Interlocked.Exchange(ref processLimit, value > 0 ? value : throw new ArgumentOutOfRangeException(nameof(ProcessLimit), "must be positive"));
+		}
+
+		/// <summary> Most decoded audio, in bytes, that one decoder may hold between filters. </summary>
+		public static long PipelineLimit
+		{
+			get => Interlocked.Read(ref pipelineLimit);
+			set => Interlocked.Exchange(ref pipelineLimit, value > 0 ? value : throw new ArgumentOutOfRangeException(nameof(PipelineLimit), "must be positive"));
+		}
+
+		/// <summary>
+		/// Decoded audio a decoder keeps ahead of the filters it feeds, measured in the time
+		/// those filters take to process it. Up to <see cref="PipelineLimit"/>.
+		/// </summary>
+		public static TimeSpan BufferDuration
+		{
+			get => bufferDuration;
+			set => bufferDuration = value > TimeSpan.Zero ? value : throw new ArgumentOutOfRangeException(nameof(BufferDuration), "must be positive");
+		}
+
+		/// <summary> Decoded audio, in bytes, currently held between filters in the process. </summary>
+		public static long BytesInUse => Interlocked.Read(ref bytesInUse);
+
+		internal static void Add(long bytes)
+		{
+			Interlocked.Add(ref bytesInUse, bytes);
+			CodecMetrics.RecordPcmBytes(bytes);
+		}
+	}
+}
@@ -0,0 +1,20 @@
+﻿using System;
+
+namespace AAXClean.Codecs
+{
+	/// <summary> A block of decoded 32-bit float audio with one plane per channel. </summary>
+	public readonly struct PlanarPcm
+	{
+		public int SampleCount { get; }
+		public ReadOnlyMemory<float> Channel0 { get; }
+		/// <summary> The second channel of stereo audio. Empty for mono. </summary>
+		public ReadOnlyMemory<float> Channel1 { get; }
+
+		internal PlanarPcm(int sampleCount, ReadOnlyMemory<float> channel0, ReadOnlyMemory<float> channel1)
+		{
+			SampleCount = sampleCount;
+			Channel0 = channel0;
+			Channel1 = channel1;
+		}
+	}
+}
@@ -0,0 +1,16 @@
+﻿namespace AAXClean.Codecs
+{
+	/// <summary>
+	/// Filter used when decoded audio must be resampled to a different sample rate. Has
+	/// no effect when the output sample rate matches the source's.
+	/// </summary>
+	public enum ResampleQuality
+	{
+		/// <summary> FFmpeg's default windowed-sinc filter. </summary>
+		Default = 0,
+		/// <summary> A short filter with an earlier roll-off. Several times faster, and transparent for speech. </summary>
+		Fast = 1,
+		/// <summary> A long filter with a steep roll-off, for music downsampled to a low rate. </summary>
+		High = 2,
+	}
+}
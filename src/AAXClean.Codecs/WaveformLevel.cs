@@ -0,0 +1,27 @@
+﻿using System;
+
+namespace AAXClean.Codecs
+{
+	/// <summary> One zoom level of a <see cref="WaveformPeaks"/> file. </summary>
+	public class WaveformLevel
+	{
+		public int SamplesPerPeak { get; }
+		public long PeakCount { get; }
+		public TimeSpan PeakDuration { get; }
+		/// <summary> Offset of the level's first peak from the start of the file. </summary>
+		internal long Offset { get; }
+
+		internal WaveformLevel(int samplesPerPeak, long peakCount, long offset, int sampleRate)
+		{
+			SamplesPerPeak = samplesPerPeak;
+			PeakCount = peakCount;
+			Offset = offset;
+			PeakDuration = TimeSpan.FromSeconds((double)samplesPerPeak / sampleRate);
+		}
+
+		public override string ToString()
+		{
+			return $"[{SamplesPerPeak} samples per peak, {PeakCount} peaks]";
+		}
+	}
+}
@@ -0,0 +1,19 @@
+﻿using System;
+using System.Runtime.InteropServices;
+
+namespace AAXClean.Codecs
+{
+	/// <summary>
+	/// Minimum, maximum and RMS of the samples a peak covers, over all channels, scaled so that
+	/// full scale is <see cref="short.MaxValue"/>.
+	/// </summary>
+	[StructLayout(LayoutKind.Sequential, Pack = 2)]
+	public readonly record struct WaveformPeak(short Min, short Max, short Rms)
+	{
+		internal static WaveformPeak FromFractions(float min, float max, float rms)
+			=> new(Quantize(min), Quantize(max), Quantize(rms));
+
+		private static short Quantize(float value)
+			=> (short)Math.Clamp(MathF.Round(value * short.MaxValue), -short.MaxValue, short.MaxValue);
+	}
+}
@@ -0,0 +1,148 @@
+﻿using System;
+using System.Buffers.Binary;
+using System.Collections.Generic;
+using System.IO;
+
+namespace AAXClean.Codecs
+{
+	/// <summary>
+	/// Writes a <see cref="WaveformPeaks"/> file from the finest level's peaks, building each
+	/// coarser level from the one below as peaks arrive. The finest level is written as it is
+	/// built and the coarser levels, together a third of its size at the default scale, are
+	/// written after it when the writer completes.
+	/// </summary>
+	internal sealed class WaveformPeakWriter
+	{
+		private readonly Stream Output;
+		private readonly long Origin;
+		private readonly int SampleRate;
+		private readonly int Channels;
+		private readonly int LevelScale;
+		private readonly LevelBuilder[] Levels;
+		private readonly byte[] PeakBuffer = new byte[WaveformPeaks.PEAK_SIZE];
+		private long SampleCount;
+
+		private sealed class LevelBuilder
+		{
+			public required int SamplesPerPeak { get; init; }
+			public List<WaveformPeak> Peaks { get; } = new();
+			public long PeakCount;
+			public float Min = float.PositiveInfinity;
+			public float Max = float.NegativeInfinity;
+			public double SumSquares;
+			public long Samples;
+			public int Children;
+		}
+
+		private int HeaderSize => WaveformPeaks.HEADER_SIZE + Levels.Length * WaveformPeaks.LEVEL_ENTRY_SIZE;
+
+		public WaveformPeakWriter(Stream output, int sampleRate, int channels, int samplesPerPeak, int levelCount, int levelScale)
+		{
+			Output = output;
+			Origin = output.Position;
+			SampleRate = sampleRate;
+			Channels = channels;
+			LevelScale = levelScale;
+
+			Levels = new LevelBuilder[levelCount];
+			long levelSamples = samplesPerPeak;
+			for (int i = 0; i < levelCount; i++, levelSamples *= levelScale)
+				Levels[i] = new LevelBuilder { SamplesPerPeak = (int)levelSamples };
+
+			//Peak counts and offsets are filled in by Complete.
+			Output.Write(new byte[HeaderSize]);
+		}
+
+		/// <summary> Add the next peak of the finest level. </summary>
+		/// <param name="samples">Samples per channel the peak covers. Less than a full peak only for the last.</param>
+		public void AddPeak(float min, float max, float rms, long samples)
+		{
+			WritePeak(WaveformPeak.FromFractions(min, max, rms));
+			Levels[0].PeakCount++;
+			SampleCount += samples;
+			AddChild(1, min, max, (double)rms * rms * samples, samples);
+		}
+
+		private void AddChild(int level, float min, float max, double sumSquares, long samples)
+		{
+			if (level >= Levels.Length) return;
+
+			var builder = Levels[level];
+			builder.Min = Math.Min(builder.Min, min);
+			builder.Max = Math.Max(builder.Max, max);
+			builder.SumSquares += sumSquares;
+			builder.Samples += samples;
+
+			if (++builder.Children == LevelScale)
+				EndPeak(level);
+		}
+
+		private void EndPeak(int level)
+		{
+			var builder = Levels[level];
+			float rms = (float)Math.Sqrt(builder.SumSquares / builder.Samples);
+			builder.Peaks.Add(WaveformPeak.FromFractions(builder.Min, builder.Max, rms));
+			builder.PeakCount++;
+
+			AddChild(level + 1, builder.Min, builder.Max, builder.SumSquares, builder.Samples);
+
+			builder.Min = float.PositiveInfinity;
+			builder.Max = float.NegativeInfinity;
+			builder.SumSquares = 0;
+			builder.Samples = 0;
+			builder.Children = 0;
+		}
+
+		/// <summary> End the partial peak of every level, write the coarser levels and fill in the header. </summary>
+		public void Complete()
+		{
+			for (int level = 1; level < Levels.Length; level++)
+			{
+				if (Levels[level].Children > 0)
+					EndPeak(level);
+			}
+
+			Span<long> offsets = stackalloc long[Levels.Length];
+			offsets[0] = HeaderSize;
+			for (int level = 1; level < Levels.Length; level++)
+			{
+				long position = Output.Position - Origin;
+				long aligned = (position + 7) & ~7L;
+				Output.Write(new byte[aligned - position]);
+				offsets[level] = aligned;
+
+				foreach (var peak in Levels[level].Peaks)
+					WritePeak(peak);
+			}
+
+			byte[] header = new byte[HeaderSize];
+			BinaryPrimitives.WriteUInt32LittleEndian(header.AsSpan(0), WaveformPeaks.MAGIC);
+			BinaryPrimitives.WriteUInt16LittleEndian(header.AsSpan(4), WaveformPeaks.VERSION);
+			BinaryPrimitives.WriteUInt16LittleEndian(header.AsSpan(6), (ushort)Channels);
+			BinaryPrimitives.WriteInt32LittleEndian(header.AsSpan(8), SampleRate);
+			BinaryPrimitives.WriteInt32LittleEndian(header.AsSpan(12), Levels.Length);
+			BinaryPrimitives.WriteInt64LittleEndian(header.AsSpan(16), SampleCount);
+
+			for (int level = 0; level < Levels.Length; level++)
+			{
+				var entry = header.AsSpan(WaveformPeaks.HEADER_SIZE + level * WaveformPeaks.LEVEL_ENTRY_SIZE);
+				BinaryPrimitives.WriteInt32LittleEndian(entry, Levels[level].SamplesPerPeak);
+				BinaryPrimitives.WriteInt64LittleEndian(entry[8..], Levels[level].PeakCount);
+				BinaryPrimitives.WriteInt64LittleEndian(entry[16..], offsets[level]);
+			}
+
+			long end = Output.Position;
+			Output.Position = Origin;
+			Output.Write(header);
+			Output.Position = end;
+		}
+
+		private void WritePeak(WaveformPeak peak)
+		{
+			BinaryPrimitives.WriteInt16LittleEndian(PeakBuffer.AsSpan(0), peak.Min);
+			BinaryPrimitives.WriteInt16LittleEndian(PeakBuffer.AsSpan(2), peak.Max);
+			BinaryPrimitives.WriteInt16LittleEndian(PeakBuffer.AsSpan(4), peak.Rms);
+			Output.Write(PeakBuffer);
+		}
+	}
+}
@@ -0,0 +1,163 @@
+﻿using System;
+using System.Collections.Generic;
+using System.IO;
+using System.IO.MemoryMappedFiles;
+
+namespace AAXClean.Codecs
+{
+	/// <summary>
+	/// Waveform peaks at several zoom levels, read from a memory-mapped file so any time range
+	/// can be sliced without reading the rest of the file.
+	/// </summary>
+	/// <remarks>
+	/// The file is little-endian. A 24-byte header holds the magic "AXWF", a 16-bit version and
+	/// channel count, then the 32-bit sample rate and level count and the 64-bit number of
+	/// samples per channel. A 24-byte entry follows for each level, finest first: 32-bit
+	/// samples per peak, 32 reserved bits, then the 64-bit peak count and the offset of the
+	/// level's peaks from the start of the file. Each level is an array of 6-byte
+	/// <see cref="WaveformPeak"/>s starting on an 8-byte boundary. Each level's peaks combine a
+	/// fixed number of peaks from the level below, and the last peak of a level may cover fewer samples.
+	/// </remarks>
+	public sealed class WaveformPeaks : IDisposable
+	{
+		public const int DefaultSamplesPerPeak = 512;
+		public const int DefaultLevelCount = 6;
+		public const int DefaultLevelScale = 4;
+
+		internal const uint MAGIC = 0x46575841; //"AXWF"
+		internal const ushort VERSION = 1;
+		internal const int HEADER_SIZE = 24;
+		internal const int LEVEL_ENTRY_SIZE = 24;
+		internal const int PEAK_SIZE = 6;
+
+		public int SampleRate { get; }
+		public int Channels { get; }
+		/// <summary> Samples per channel the peaks were built from. </summary>
+		public long SampleCount { get; }
+		public TimeSpan Duration => TimeSpan.FromSeconds((double)SampleCount / SampleRate);
+		/// <summary> Zoom levels, finest first. </summary>
+		public IReadOnlyList<WaveformLevel> Levels { get; }
+
+		private readonly MemoryMappedFile File;
+		private readonly MemoryMappedViewAccessor View;
+
+		private WaveformPeaks(MemoryMappedFile file, MemoryMappedViewAccessor view)
+		{
+			File = file;
+			View = view;
+
+			if (view.Capacity < HEADER_SIZE || view.ReadUInt32(0) != MAGIC)
+				throw new InvalidDataException("Not a waveform peaks file.");
+			if (view.ReadUInt16(4) != VERSION)
+				throw new InvalidDataException($"Unsupported waveform peaks version {view.ReadUInt16(4)}.");
+
+			Channels = view.ReadUInt16(6);
+			SampleRate = view.ReadInt32(8);
+			int levelCount = view.ReadInt32(12);
+			SampleCount = view.ReadInt64(16);
+
+			if (SampleRate <= 0 || levelCount <= 0 || HEADER_SIZE + (long)levelCount * LEVEL_ENTRY_SIZE > view.Capacity)
+				throw new InvalidDataException("Waveform peaks header is corrupt.");
+
+			var levels = new WaveformLevel[levelCount];
+			for (int i = 0; i < levelCount; i++)
+			{
+				long entry = HEADER_SIZE + (long)i * LEVEL_ENTRY_SIZE;
+				int samplesPerPeak = view.ReadInt32(entry);
+				long peakCount = view.ReadInt64(entry + 8);
+				long offset = view.ReadInt64(entry + 16);
+
+				if (samplesPerPeak <= 0 || peakCount < 0 || offset < 0 || offset + peakCount * PEAK_SIZE > view.Capacity)
+					throw new InvalidDataException($"Waveform peaks level {i} is corrupt.");
+
+				levels[i] = new WaveformLevel(samplesPerPeak, peakCount, offset, SampleRate);
+			}
+			Levels = levels;
+		}
+
+		/// <summary> Map a file written by <see cref="Mp4FileExtensions.GenerateWaveformAsync"/>. </summary>
+		public static WaveformPeaks Open(string path)
+		{
+			ArgumentException.ThrowIfNullOrEmpty(path, nameof(path));
+
+			var file = MemoryMappedFile.CreateFromFile(path, FileMode.Open, null, 0, MemoryMappedFileAccess.Read);
+			MemoryMappedViewAccessor? view = null;
+			try
+			{
+				view = file.CreateViewAccessor(0, 0, MemoryMappedFileAccess.Read);
+				return new WaveformPeaks(file, view);
+			}
+			catch
+			{
+				view?.Dispose();
+				file.Dispose();
+				throw;
+			}
+		}
+
+		/// <summary> The peaks of one level that overlap the range from <paramref name="start"/> to <paramref name="end"/>. </summary>
+		/// <param name="level">Index into <see cref="Levels"/>.</param>
+		public WaveformPeak[] GetPeaks(int level, TimeSpan start, TimeSpan end)
+		{
+			ObjectDisposedException.ThrowIf(Disposed, this);
+			ArgumentOutOfRangeException.ThrowIfNegative(level, nameof(level));
+			ArgumentOutOfRangeException.ThrowIfGreaterThanOrEqual(level, Levels.Count, nameof(level));
+			if (end < start) throw new ArgumentException("end must not be before start", nameof(end));
+
+			var l = Levels[level];
+			(long first, long count) = PeaksInRange(l, start, end);
+			var peaks = new WaveformPeak[count];
+			if (count == 0) return peaks;
+
+			unsafe
+			{
+				byte* pView = null;
+				View.SafeMemoryMappedViewHandle.AcquirePointer(ref pView);
+				try
+				{
+					new ReadOnlySpan<WaveformPeak>(pView + View.PointerOffset + l.Offset + first * PEAK_SIZE, (int)count).CopyTo(peaks);
+				}
+				finally
+				{
+					View.SafeMemoryMappedViewHandle.ReleasePointer();
+				}
+			}
+			return peaks;
+		}
+
+		/// <summary>
+		/// The peaks of the finest level that draws the range from <paramref name="start"/> to
+		/// <paramref name="end"/> in at most <paramref name="maxPeaks"/> peaks, or of the coarsest level if none does.
+		/// </summary>
+		/// <param name="maxPeaks">Most peaks wanted, e.g. the width in pixels the range is drawn in.</param>
+		public WaveformPeak[] GetPeaks(TimeSpan start, TimeSpan end, int maxPeaks)
+		{
+			ArgumentOutOfRangeException.ThrowIfNegativeOrZero(maxPeaks, nameof(maxPeaks));
+			if (end < start) throw new ArgumentException("end must not be before start", nameof(end));
+
+			int level = 0;
+			while (level < Levels.Count - 1 && PeaksInRange(Levels[level], start, end).count > maxPeaks)
+				level++;
+			return GetPeaks(level, start, end);
+		}
+
+		private (long first, long count) PeaksInRange(WaveformLevel level, TimeSpan start, TimeSpan end)
+		{
+			long startSample = (long)Math.Max(0, Math.Floor(start.TotalSeconds * SampleRate));
+			long endSample = (long)Math.Min(SampleCount, Math.Ceiling(end.TotalSeconds * SampleRate));
+
+			long first = Math.Min(startSample / level.SamplesPerPeak, level.PeakCount);
+			long last = Math.Min((endSample + level.SamplesPerPeak - 1) / level.SamplesPerPeak, level.PeakCount);
+			return (first, Math.Max(0, last - first));
+		}
+
+		private bool Disposed;
+		public void Dispose()
+		{
+			if (Disposed) return;
+			Disposed = true;
+			View.Dispose();
+			File.Dispose();
+		}
+	}
+}
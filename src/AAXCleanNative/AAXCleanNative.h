@@ -4,10 +4,13 @@
 #include <stdint.h>
 
 #include <libavutil/frame.h>
+#include <libavutil/time.h>
 #include <libavcodec/avcodec.h>
 #include <libswresample/swresample.h>
 
 #define AAC_FRAME_SIZE 1024
+//6144 bits per channel per frame
+#define AAC_MAX_PACKET_SIZE(channels) (768 * (channels))
 
 typedef void* PVOID;
 
@@ -31,19 +34,72 @@ typedef void* PVOID;
 #pragma warning Unknown dynamic link import/export semantics.
 #endif
 
+#define RESAMPLE_QUALITY_DEFAULT 0
+#define RESAMPLE_QUALITY_FAST 1
+#define RESAMPLE_QUALITY_HIGH 2
+
 typedef struct OutputOptions
 {
 	int32_t out_sample_rate;
 	int32_t out_sample_fmt;
 	int32_t out_channels;
+	//One of the RESAMPLE_QUALITY_ values. Only used if out_sample_rate differs from the stream's.
+	int32_t resample_quality;
 } OutputOptions, * POutputOptions;
 
+/*
+* Running totals kept by each decoder and encoder handle. Times are in nanoseconds,
+* measured with FFmpeg's monotonic clock, which has microsecond resolution.
+*/
+typedef struct CodecStats {
+    //Packets sent to a decoder, or frames sent to an encoder.
+    int64_t frames_in;
+    //Frames received from a decoder, or packets received from an encoder.
+    int64_t frames_out;
+    //Samples per channel the decoder produced, or the encoder was given.
+    int64_t samples_in;
+    //Samples per channel written to the decoder's output buffers, or encoded into packets.
+    int64_t samples_out;
+    //Compressed bytes sent to a decoder, or PCM bytes given to an encoder.
+    int64_t bytes_in;
+    //PCM bytes written by a decoder, or compressed bytes received from an encoder.
+    int64_t bytes_out;
+    //Time in avcodec_send_packet or avcodec_send_frame.
+    int64_t send_ns;
+    //Time in avcodec_receive_frame or avcodec_receive_packet.
+    int64_t receive_ns;
+    //Time converting decoded frames to the output format. Always 0 for encoders.
+    int64_t convert_ns;
+    //Calls that failed, including packets the decoder rejected as invalid.
+    int64_t errors;
+    //Decoded frames converted by swresample rather than copied or converted directly. Always 0 for encoders.
+    int64_t resampled_frames;
+} CodecStats, * PCodecStats;
+
+static inline int64_t stats_now_ns(void) {
+    return av_gettime_relative() * 1000;
+}
+
+//How decoded frames are converted to the output format. Chosen when the first frame is decoded.
+#define CONVERSION_UNKNOWN 0
+#define CONVERSION_SWR 1
+#define CONVERSION_COPY 2
+#define CONVERSION_FLTP_TO_S16 3
+#define CONVERSION_FLTP_TO_FLT 4
+
 typedef struct AacDecoder {
     AVCodecContext* context;
     SwrContext* swr_ctx;
     AVPacket* packet;
     AVFrame* frame;
 	OutputOptions output_options;
+    int32_t max_frame_samples;
+    //Set when Decoder_DecodeBatch decoded a frame but had no room to convert it.
+    int32_t frame_pending;
+    int32_t conversion;
+    //Linear gain applied while converting decoded frames. 1 unless set with Decoder_SetGain.
+    float gain;
+    CodecStats stats;
 }AacDecoder, * PAacDecoder;
 
 typedef struct AacDecoderOptions {
@@ -52,24 +108,124 @@ typedef struct AacDecoderOptions {
     uint8_t* ASC;
 }AacDecoderOptions, * PAacDecoderOptions;
 
+typedef struct AacEncoderOptions {
+    int64_t bit_rate;
+    int32_t global_quality;
+    int32_t sample_rate;
+    int32_t channels;
+    int32_t sample_fmt;
+}AacEncoderOptions, * PAacEncoderOptions;
+
 typedef struct AacEncoder {
     AVCodecContext* context;
     AVPacket* packet;
     AVFrame* frame;
     int32_t current_frame_nb_samples;
     int32_t sample_size;
+    //Kept to reopen encoders that can't be flushed.
+    AacEncoderOptions options;
+    CodecStats stats;
 }AacEncoder, * PAacEncoder;
 
-typedef struct AacEncoderOptions {
-    int64_t bit_rate;
-    int32_t global_quality;
-    int32_t sample_rate;
+typedef struct Transcoder {
+    PAacDecoder decoder;
+    PAacEncoder encoder;
+    //Decoded samples in the encoder's input format. The decoder writes at write_pos and
+    //the encoder reads full frames in place from read_pos.
+    AVFrame* staging;
+    //Reference to a slice of staging that is sent to the encoder.
+    AVFrame* view;
+    int32_t capacity;
+    int32_t read_pos;
+    int32_t write_pos;
+    int32_t flushing;
+    int32_t eof_sent;
+}Transcoder, * PTranscoder;
+
+typedef struct SilenceScanState {
+    int64_t position;
+    int64_t run_start;
+    int64_t run_length;
+}SilenceScanState, * PSilenceScanState;
+
+#define SILENCE_ISA_SCALAR 0
+#define SILENCE_ISA_AVX2 1
+#define SILENCE_ISA_AVX512 2
+#define SILENCE_ISA_NEON 3
+#define SILENCE_MAX_PROFILES 32
+
+//Oversampling of the true-peak interpolator and the taps in each of its phases.
+#define LOUDNESS_TP_PHASES 4
+#define LOUDNESS_TP_TAPS 12
+//Samples per channel measured at a time.
+#define LOUDNESS_CHUNK 1024
+//Gated block loudness is counted in 0.01 LU bins from the absolute gate up to +10 LUFS.
+#define LOUDNESS_ABSOLUTE_GATE (-70.0)
+#define LOUDNESS_BIN_WIDTH 0.01
+#define LOUDNESS_BINS 8000
+
+typedef struct LoudnessMeter {
     int32_t channels;
-    int32_t sample_fmt;
-}AacEncoderOptions, * PAacEncoderOptions;
-
-typedef void (*LogCallbackType)(int32_t code, const char* message, size_t messageSize);
-static LogCallbackType LogCallback;
+    //Samples per channel in each 100 ms step of the 400 ms gating block.
+    int32_t step_length;
+    //K-weighting pre-filter and RLB high-pass as b0, b1, b2, a1, a2.
+    double shelf[5];
+    double highpass[5];
+    //Transposed direct form II state of both filters, per channel.
+    double filter_state[2][4];
+    //Sum of the channels' squared K-weighted samples in the current step.
+    double step_energy;
+    int32_t step_position;
+    //Mean square of the last four steps, indexed by step count.
+    double step_power[4];
+    int64_t steps;
+    int64_t bin_blocks[LOUDNESS_BINS];
+    double bin_power[LOUDNESS_BINS];
+    //Each channel's samples, preceded by the last LOUDNESS_TP_TAPS - 1 samples of the
+    //previous chunk for the true-peak interpolator.
+    float history[2][LOUDNESS_TP_TAPS - 1 + LOUDNESS_CHUNK];
+    float true_peak;
+    float sample_peak;
+    int64_t samples;
+}LoudnessMeter, * PLoudnessMeter;
+
+typedef struct PeakScanState {
+    //Samples per channel in the current peak so far.
+    int64_t window_position;
+    float min;
+    float max;
+    double sum_squares;
+}PeakScanState, * PPeakScanState;
+
+typedef struct WavePeak {
+    float min;
+    float max;
+    float rms;
+}WavePeak, * PWavePeak;
+
+typedef struct LoudnessResult {
+    //Gated loudness in LUFS, or -INFINITY if no block is louder than the absolute gate.
+    double integrated;
+    //Largest magnitude of the audio oversampled LOUDNESS_TP_PHASES times, as a fraction of full scale.
+    double true_peak;
+    //Largest sample magnitude as a fraction of full scale.
+    double sample_peak;
+    //Samples per channel measured.
+    int64_t samples;
+}LoudnessResult, * PLoudnessResult;
+
+#define LOG_MESSAGE_SIZE 244
+#define LOG_RATE_LIMIT 20
+
+typedef struct LogRecord {
+    int32_t level;
+    /* Number of messages this record stands for. Greater than one for repeat and
+    suppression summaries. */
+    int32_t repeat_count;
+    /* Length of message in bytes, excluding the null terminator. */
+    int32_t message_size;
+    char message[LOG_MESSAGE_SIZE];
+}LogRecord, * PLogRecord;
 
 #define ERR_SUCCESS 0
 #define ERR_INVALID_HANDLE (-1)
@@ -84,6 +240,30 @@ static LogCallbackType LogCallback;
 #define ERR_AAC_DECODE_FAIL (-10)
 #define ERR_SWR_OUTPUT_CHANNELS_UNSUPPORTED (-11)
 #define ERR_SWR_OUTPUT_FORMAT_UNSUPPORTED (-12)
+#define ERR_ISA_UNSUPPORTED (-13)
+#define ERR_SILENCE_PROFILES_INVALID (-14)
+#define ERR_RESAMPLE_QUALITY_UNSUPPORTED (-15)
+#define ERR_GAIN_INVALID (-16)
+#define ERR_SAMPLE_RATE_UNSUPPORTED (-17)
+#define ERR_PEAK_SIZE_INVALID (-18)
+
+/*
+* Sample format conversions used when the decoder's output needs no resampling or
+* remixing. Rounding and clipping match swresample's. Samples are multiplied by gain
+* as they are converted.
+*/
+void Convert_FltpToS16(const float* pSamples0, const float* pSamples1, int16_t* pOutput, int32_t nbSamples, float gain);
+void Convert_FltpToFlt(const float* pSamples0, const float* pSamples1, float* pOutput, int32_t nbSamples, float gain);
+
+/*
+* Packet-level decoder and encoder steps shared with the transcoder. They behave like
+the static helpers they were split from and do not validate their arguments.
+*/
+int32_t decoder_decode_packet(PAacDecoder config, uint8_t* pCompressedAudio, uint32_t cbInBufferSize);
+int32_t decoder_get_out_samples(PAacDecoder config);
+int32_t decoder_convert_frame(PAacDecoder config, uint8_t* outBuff0, uint8_t* outBuff1, int32_t numSamples);
+int32_t encoder_send_frame(PAacEncoder config, AVFrame* frame);
+int32_t encoder_drain_packets(PAacEncoder config, uint8_t* outBuff, int32_t cbOutBuff, int32_t* pPacketSizes, int32_t maxPackets, int32_t* pBytesWritten, int32_t* pNbPackets);
 
 /**
 * Open an AAC-LC audio encoder instance. Only supports AV_SAMPLE_FMT_FLTP
@@ -146,6 +326,36 @@ otherwise 0 if success or a negative error code.
 * 
 */
 EXPORT int32_t AacEncoder_ReceiveEncodedFrame(PAacEncoder config, uint8_t* outBuff, int32_t cbOutBuff);
+/**
+* Encode any number of audio samples and receive all resulting AAC packets in a
+single call. Complete frames are sent to the encoder and the encoded packets are
+written back-to-back into outBuff. A trailing partial frame is held until more
+samples are sent or the encoder is flushed. Call with nbSamples 0 after
+AacEncoder_EncodeFlush to drain the encoder.
+*
+* @param config encoder handle
+*
+* @param pDecodedAudio0 a pointer to the audio (channel 0 if planar). May be NULL if nbSamples is 0.
+*
+* @param pDecodedAudio1 if planar stereo, a pointer to channel 1 of the audio.
+*
+* @param nbSamples the number of audio samples being sent to the encoder.
+*
+* @param outBuff the buffer to receive the encoded packets.
+*
+* @param cbOutBuff The size, in bytes, of outBuff.
+*
+* @param pPacketSizes array to receive the size of each packet written to outBuff.
+*
+* @param maxPackets the number of elements in pPacketSizes.
+*
+* @param pNbPackets receives the number of packets written to outBuff.
+*
+* @return the number of input samples consumed, which is less than nbSamples if
+outBuff or pPacketSizes filled up, otherwise a negative error code.
+*/
+EXPORT int32_t AacEncoder_EncodeBatch(PAacEncoder config, uint8_t* pDecodedAudio0, uint8_t* pDecodedAudio1, int32_t nbSamples, uint8_t* outBuff, int32_t cbOutBuff, int32_t* pPacketSizes, int32_t maxPackets, int32_t* pNbPackets);
+
 /**
 * Flush all data in the encoder buffer and signal the end of encoding.
 * 
@@ -155,6 +365,30 @@ EXPORT int32_t AacEncoder_ReceiveEncodedFrame(PAacEncoder config, uint8_t* outBu
 */
 EXPORT int32_t AacEncoder_EncodeFlush(PAacEncoder config);
 
+/**
+* Get the encoder's running totals since it was opened.
+*
+* @param config encoder handle
+*
+* @param pStats receives the totals.
+*
+* @return 0 if success, otherwise a negative error code.
+*/
+EXPORT int32_t AacEncoder_GetStats(PAacEncoder config, PCodecStats pStats);
+
+/**
+* Return the encoder to the state it was opened in so it can encode another stream
+with the same options. Buffered samples and packets are discarded. The packet, frame
+and sample buffers are kept. Encoders without AV_CODEC_CAP_ENCODER_FLUSH, including
+FFmpeg's native AAC encoder, also get a freshly opened codec context.
+*
+* @param config encoder handle
+*
+* @return 0 if success, otherwise a negative error code. The handle must be closed
+if reset fails.
+*/
+EXPORT int32_t AacEncoder_Reset(PAacEncoder config);
+
 /**
 * Open an AAC-LC audio decoder instance.
 *
@@ -222,6 +456,37 @@ decoded if positive, or a negative error code.
 */
 EXPORT int32_t Decoder_ReceiveDecodedFrame(PAacDecoder config, uint8_t* outBuff0, uint8_t* outBuff1, int32_t numSamples);
 /**
+* Decode and resample a batch of audio frames in a single call. Decoded audio is
+written back-to-back into the caller-owned output buffers.
+*
+* @param config decoder handle
+*
+* @param ppCompressedAudio array of nbFrames pointers to the encoded audio frames.
+*
+* @param pcbInBufferSizes array of nbFrames sizes, in bytes, of the encoded audio frames.
+*
+* @param nbFrames the number of frames in the batch.
+*
+* @param outBuff0 pointer to the output arena. For packet audio, this buffer
+receives the full frames (both stereo and mono). For planar audio, this buffer
+receives the channel 0 audio.
+*
+* @param outBuff1 pointer to the arena to receive channel 1 of the decoded planar
+audio. Unused for packet audio.
+*
+* @param numSamples The size of each output arena, in number of audio samples.
+*
+* @param pFrameResults array of nbFrames values to receive the number of samples
+written to the arena for each frame, or AVERROR_INVALIDDATA if that frame could
+not be decoded.
+*
+* @return the number of frames consumed, which is less than nbFrames if the
+arena filled up, otherwise a negative error code. A frame whose decoded audio
+did not fit is not counted as consumed, but is already decoded. Pass it again
+first in the next call, which converts it without decoding it twice.
+*/
+EXPORT int32_t Decoder_DecodeBatch(PAacDecoder config, uint8_t** ppCompressedAudio, uint32_t* pcbInBufferSizes, int32_t nbFrames, uint8_t* outBuff0, uint8_t* outBuff1, int32_t numSamples, int32_t* pFrameResults);
+/**
 * Flush all data in the decoder buffer and signal the end of decoding. Call aacDecoder_ReceiveDecodedFrame()
 with NULL/0 to get the maximum size of the buffer needed to drain the decoder.
 *
@@ -239,29 +504,295 @@ audio. Unused for packet audio.
 EXPORT int32_t Decoder_DecodeFlush(PAacDecoder config, uint8_t* outBuff0, uint8_t* outBuff1, uint32_t cbOutBuff);
 
 /**
-* Set the logging callback
+* Get the decoder's running totals since it was opened.
+*
+* @param config decoder handle
+*
+* @param pStats receives the totals.
+*
+* @return 0 if success, otherwise a negative error code.
+*/
+EXPORT int32_t Decoder_GetStats(PAacDecoder config, PCodecStats pStats);
+
+/**
+* Return the decoder to the state it was opened in so it can decode the same stream
+again from any frame, e.g. after a seek. Buffered frames and resampler samples are
+discarded. The codec context, packet, frame and resampler are kept, as are the stats.
 *
-* @param callback A logging function with a compatible signature.
+* @param config decoder handle
 *
-* @remarks The callback must be thread safe, even if the application does not use
-* threads itself as some codecs are multithreaded.
+* @return 0 if success, otherwise a negative error code.
 */
-EXPORT void SetLogCallback(LogCallbackType callback);
+EXPORT int32_t Decoder_Reset(PAacDecoder config);
 
-static void AvLogCallback(void* data, int32_t code, const char* fmt, va_list args) {
+/**
+* Scale the decoded audio while it is converted to the output format, e.g. to normalise
+its loudness. The gain is folded into the sample format conversion, or into the
+resampler's remix, so it costs no extra pass over the audio. Decoder_Reset restores
+a gain of 1.
+*
+* @param config decoder handle
+*
+* @param gain linear gain, greater than 0. Set it before decoding, since a resampler
+that is already open is reinitialized and loses its buffered samples.
+*
+* @return 0 if success, otherwise a negative error code.
+*/
+EXPORT int32_t Decoder_SetGain(PAacDecoder config, float gain);
 
-    if (!LogCallback || code == AV_LOG_DEBUG)
-        return;
+/**
+* Open an AAC decoder and encoder pair that transcodes without returning PCM to
+the caller. Decoded audio is converted straight into a buffer the encoder reads
+whole frames from.
+*
+* @param decoder_options the source's ASC. Only output_options.resample_quality is
+used; the output rate, format and channels are taken from encoder_options.
+*
+* @param encoder_options options for encoding the audio.
+*
+* @return handle to the transcoder instance, otherwise a negative error code.
+*/
+EXPORT PVOID Transcoder_Open(PAacDecoderOptions decoder_options, PAacEncoderOptions encoder_options);
 
-    va_list argsCopy;
-    va_copy(argsCopy, args);
-    size_t requiredSize = vsnprintf(NULL, 0, fmt, argsCopy);
+EXPORT int32_t Transcoder_Close(PTranscoder config);
 
-    char* messageBuff = malloc(requiredSize);
-    if (!messageBuff)
-        return;
+/**
+* Decode a batch of compressed frames and receive the resulting AAC packets in a
+single call. Packets are written back-to-back into outBuff. Call with nbFrames 0
+after Transcoder_Flush until no more packets are returned.
+*
+* @param config transcoder handle
+*
+* @param ppCompressedAudio array of nbFrames pointers to the compressed frames.
+*
+* @param pcbInBufferSizes array of nbFrames sizes, in bytes, of the compressed frames.
+*
+* @param nbFrames the number of frames in the batch.
+*
+* @param outBuff the buffer to receive the encoded packets.
+*
+* @param cbOutBuff The size, in bytes, of outBuff.
+*
+* @param pPacketSizes array to receive the size of each packet written to outBuff.
+*
+* @param maxPackets the number of elements in pPacketSizes.
+*
+* @param pNbPackets receives the number of packets written to outBuff.
+*
+* @return the number of input frames consumed, which is less than nbFrames if
+outBuff or pPacketSizes filled up, otherwise a negative error code. A frame the
+decoder rejects fails the batch with AVERROR_INVALIDDATA.
+*/
+EXPORT int32_t Transcoder_TranscodeBatch(PTranscoder config, uint8_t** ppCompressedAudio, uint32_t* pcbInBufferSizes, int32_t nbFrames, uint8_t* outBuff, int32_t cbOutBuff, int32_t* pPacketSizes, int32_t maxPackets, int32_t* pNbPackets);
 
-    requiredSize = vsnprintf(messageBuff, requiredSize, fmt, args);
-    LogCallback(code, messageBuff, requiredSize);
-    free(messageBuff);
-}
+/**
+* Drain the resampler and signal the end of the input. The remaining audio is encoded
+by subsequent calls to Transcoder_TranscodeBatch.
+*
+* @param config transcoder handle
+*
+* @return 0 if success, otherwise a negative error code.
+*/
+EXPORT int32_t Transcoder_Flush(PTranscoder config);
+
+/**
+* Get the encoder's audio specific config. See AacEncoder_GetExtraData.
+*/
+EXPORT int32_t Transcoder_GetExtraData(PTranscoder config, uint8_t* ascBuffer, int32_t* pSize);
+
+/**
+* Get the running totals of the transcoder's decoder and encoder.
+*
+* @param config transcoder handle
+*
+* @param pDecodeStats receives the decoder's totals.
+*
+* @param pEncodeStats receives the encoder's totals.
+*
+* @return 0 if success, otherwise a negative error code.
+*/
+EXPORT int32_t Transcoder_GetStats(PTranscoder config, PCodecStats pDecodeStats, PCodecStats pEncodeStats);
+
+/**
+* Scale the decoded audio before it is encoded. See Decoder_SetGain.
+*/
+EXPORT int32_t Transcoder_SetGain(PTranscoder config, float gain);
+
+/**
+* Scan audio for runs of silence. A sample is silent if its magnitude is less
+than threshold. Runs may span calls, so the same state must be passed with each
+consecutive buffer of audio.
+*
+* @param state scan state, zeroed before the first call. position is the number of
+samples (counting every channel) scanned so far. If run_length is non-zero, the
+audio ended in a silent run starting at run_start.
+*
+* @param pSamples0 pointer to the audio. For planar audio, channel 0.
+*
+* @param pSamples1 if planar stereo, a pointer to channel 1 of the audio.
+*
+* @param nbSamples the number of audio samples per channel.
+*
+* @param channels the number of channels, 1 or 2.
+*
+* @param sampleFormat AV_SAMPLE_FMT_S16, AV_SAMPLE_FMT_FLT or AV_SAMPLE_FMT_FLTP.
+*
+* @param threshold the silence threshold as a fraction of full scale.
+*
+* @param minRunLength only runs longer than this many samples are reported.
+*
+* @param pRunStarts array to receive the start sample of each completed run.
+*
+* @param pRunLengths array to receive the length of each completed run.
+*
+* @param maxRuns the number of elements in pRunStarts and pRunLengths. Capacity
+for nbSamples * channels / (minRunLength + 1) + 1 runs is always sufficient.
+*
+* @return the number of completed runs, otherwise a negative error code.
+*/
+EXPORT int32_t Silence_Scan(PSilenceScanState state, uint8_t* pSamples0, uint8_t* pSamples1, int32_t nbSamples, int32_t channels, int32_t sampleFormat, double threshold, int64_t minRunLength, int64_t* pRunStarts, int64_t* pRunLengths, int32_t maxRuns);
+
+/**
+* Scan a block of samples for runs of silence at several thresholds in one pass.
+Each profile's runs match those Silence_Scan finds with that profile's settings.
+*
+* @param states array of nbProfiles scan states, one per profile.
+*
+* @param nbProfiles the number of profiles, 1 to SILENCE_MAX_PROFILES.
+*
+* @param thresholds each profile's silence threshold as a fraction of full scale,
+in ascending order.
+*
+* @param minRunLengths each profile's minimum reported run length in samples.
+*
+* @param pRunProfiles array to receive the profile index of each completed run.
+*
+* @param maxRuns the number of elements in pRunProfiles, pRunStarts and pRunLengths.
+The sum of each profile's Silence_Scan capacity is always sufficient.
+*
+* @return the number of completed runs in order of their ends, otherwise a negative
+error code.
+*/
+EXPORT int32_t Silence_ScanProfiles(PSilenceScanState states, int32_t nbProfiles, const double* thresholds, const int64_t* minRunLengths, uint8_t* pSamples0, uint8_t* pSamples1, int32_t nbSamples, int32_t channels, int32_t sampleFormat, int32_t* pRunProfiles, int64_t* pRunStarts, int64_t* pRunLengths, int32_t maxRuns);
+
+/**
+* Get the instruction set used by Silence_Scan. The best supported instruction
+set is chosen at runtime on first use.
+*
+* @return one of the SILENCE_ISA_ values.
+*/
+EXPORT int32_t Silence_GetIsa(void);
+
+/**
+* Force Silence_Scan to use an instruction set, e.g. for benchmarking.
+*
+* @param isa one of the SILENCE_ISA_ values.
+*
+* @return isa if supported by this CPU, otherwise ERR_ISA_UNSUPPORTED.
+*/
+EXPORT int32_t Silence_SetIsa(int32_t isa);
+
+/**
+* Reduce audio to waveform peaks: the minimum, maximum and RMS of every samplesPerPeak
+samples, over all channels. Peaks may span calls, so the same state must be passed
+with each consecutive buffer of audio. Uses the instruction set chosen with
+Silence_SetIsa.
+*
+* @param state scan state, zeroed before the first call. If window_position is non-zero,
+the audio ended partway through a peak whose values so far are in min, max and
+sum_squares.
+*
+* @param pSamples0 pointer to the audio. For planar audio, channel 0.
+*
+* @param pSamples1 if planar stereo, a pointer to channel 1 of the audio.
+*
+* @param nbSamples the number of audio samples per channel.
+*
+* @param channels the number of channels, 1 or 2.
+*
+* @param sampleFormat AV_SAMPLE_FMT_S16, AV_SAMPLE_FMT_FLT or AV_SAMPLE_FMT_FLTP.
+*
+* @param samplesPerPeak the number of samples per channel in each peak.
+*
+* @param pPeaks array to receive the completed peaks, as fractions of full scale.
+*
+* @param maxPeaks the number of elements in pPeaks. Capacity for
+(window_position + nbSamples) / samplesPerPeak peaks is always sufficient.
+*
+* @return the number of completed peaks, otherwise a negative error code.
+*/
+EXPORT int32_t Peaks_Scan(PPeakScanState state, uint8_t* pSamples0, uint8_t* pSamples1, int32_t nbSamples, int32_t channels, int32_t sampleFormat, int32_t samplesPerPeak, PWavePeak pPeaks, int32_t maxPeaks);
+
+/**
+* Open an ITU-R BS.1770 / EBU R128 loudness meter. The audio is K-weighted, measured
+in 400 ms blocks that overlap by 75% and gated at LOUDNESS_ABSOLUTE_GATE and 10 LU
+below the ungated level. The true-peak interpolator uses the instruction set chosen
+with Silence_SetIsa.
+*
+* @param sampleRate the audio's sample rate, 8000 to 192000 Hz.
+*
+* @param channels the number of channels, 1 or 2. Both channels are weighted equally.
+*
+* @return handle to the meter, otherwise a negative error code.
+*/
+EXPORT PVOID Loudness_Open(int32_t sampleRate, int32_t channels);
+
+EXPORT int32_t Loudness_Close(PLoudnessMeter meter);
+
+/**
+* Measure the next block of audio.
+*
+* @param meter loudness meter handle
+*
+* @param pSamples0 pointer to the audio. For planar audio, channel 0.
+*
+* @param pSamples1 if planar stereo, a pointer to channel 1 of the audio.
+*
+* @param nbSamples the number of audio samples per channel.
+*
+* @param sampleFormat AV_SAMPLE_FMT_S16, AV_SAMPLE_FMT_FLT or AV_SAMPLE_FMT_FLTP.
+*
+* @return 0 if success, otherwise a negative error code.
+*/
+EXPORT int32_t Loudness_Process(PLoudnessMeter meter, uint8_t* pSamples0, uint8_t* pSamples1, int32_t nbSamples, int32_t sampleFormat);
+
+/**
+* Get the loudness of all audio measured so far. The meter can continue measuring
+afterwards. A block that is still incomplete is not counted.
+*
+* @param meter loudness meter handle
+*
+* @param pResult receives the measurement.
+*
+* @return 0 if success, otherwise a negative error code.
+*/
+EXPORT int32_t Loudness_GetResult(PLoudnessMeter meter, PLoudnessResult pResult);
+
+/**
+* Start or stop capturing FFmpeg log messages. Captured messages are formatted into
+a fixed-size lock-free ring buffer on the logging thread and must be collected with
+Log_Drain. Messages above AV_LOG_VERBOSE are ignored.
+*
+* @param enabled non-zero to capture messages, zero to restore FFmpeg's default
+logger.
+*
+* @remarks Consecutive identical messages are coalesced into one "Last message
+repeated N times" record, and each message class (format string) is limited to
+LOG_RATE_LIMIT records per second, with a summary of the suppressed count. If the
+ring is full, new messages are dropped and counted.
+*/
+EXPORT void Log_SetEnabled(int32_t enabled);
+
+/**
+* Remove captured log records from the ring buffer. Must not be called concurrently
+with itself.
+*
+* @param records array to receive the records in the order they were logged.
+*
+* @param maxRecords the number of elements in records.
+*
+* @return the number of records written. Pending repeat, suppression and dropped
+summaries are only written once the ring is empty, so a return value of maxRecords
+means more records may be available.
+*/
+EXPORT int32_t Log_Drain(PLogRecord records, int32_t maxRecords);
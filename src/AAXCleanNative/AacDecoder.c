@@ -1,4 +1,37 @@
 #include "AAXCleanNative.h"
+#include <libavutil/opt.h>
+#include <math.h>
+
+static int32_t set_resample_quality(SwrContext* swr_ctx, int32_t quality) {
+
+    int32_t filter_size, phase_shift;
+    double cutoff;
+
+    switch (quality) {
+    case RESAMPLE_QUALITY_DEFAULT:
+        return 0;
+    case RESAMPLE_QUALITY_FAST:
+        //A quarter of the default filter length. Rolls off earlier, which spoken word doesn't miss.
+        filter_size = 8;
+        phase_shift = 6;
+        cutoff = 0.9;
+        break;
+    case RESAMPLE_QUALITY_HIGH:
+        filter_size = 64;
+        phase_shift = 12;
+        cutoff = 0.98;
+        break;
+    default:
+        return ERR_RESAMPLE_QUALITY_UNSUPPORTED;
+    }
+
+    if (av_opt_set_int(swr_ctx, "filter_size", filter_size, 0) < 0 ||
+        av_opt_set_int(swr_ctx, "phase_shift", phase_shift, 0) < 0 ||
+        av_opt_set_double(swr_ctx, "cutoff", cutoff, 0) < 0)
+        return ERR_SWR_INIT_FAIL;
+
+    return 0;
+}
 
 static int32_t init_swr(PAacDecoder pdec, POutputOptions pOptions, AVChannelLayout* pIn_layout, int32_t in_sample_rate) {
 
@@ -30,6 +63,15 @@ static int32_t init_swr(PAacDecoder pdec, POutputOptions pOptions, AVChannelLayo
         goto failed;
     }
 
+    if ((ret = set_resample_quality(pdec->swr_ctx, pOptions->resample_quality)) < 0)
+        goto failed;
+
+    //A rematrix volume other than 1 makes swresample remix, which applies the gain in the same pass.
+    if (av_opt_set_double(pdec->swr_ctx, "rematrix_volume", pdec->gain, 0) < 0) {
+        ret = ERR_SWR_INIT_FAIL;
+        goto failed;
+    }
+
     if (swr_init(pdec->swr_ctx) < 0) {
         ret = ERR_SWR_INIT_FAIL;
         goto failed;
@@ -45,64 +87,304 @@ failed:
     return ret;
 }
 
+/*
+* Choose how to convert the decoded frame. When the frame already has the output rate
+* and layout, only the sample format may need converting, so swresample is bypassed.
+* Once swresample is in use it stays in use, since it may hold buffered samples.
+*/
+static int32_t update_conversion(PAacDecoder config) {
+
+    AVFrame* frame = config->frame;
+    POutputOptions pOptions = &config->output_options;
+
+    if (config->swr_ctx)
+        return 0;
+
+    AVChannelLayout out_layout
+        = pOptions->out_channels == 2
+        ? (AVChannelLayout)AV_CHANNEL_LAYOUT_STEREO
+        : (AVChannelLayout)AV_CHANNEL_LAYOUT_MONO;
+
+    if (frame->format == AV_SAMPLE_FMT_FLTP &&
+        frame->sample_rate == pOptions->out_sample_rate &&
+        (pOptions->out_channels == 1 || pOptions->out_channels == 2) &&
+        av_channel_layout_compare(&frame->ch_layout, &out_layout) == 0) {
+
+        switch (pOptions->out_sample_fmt) {
+        case AV_SAMPLE_FMT_FLTP:
+            config->conversion = CONVERSION_COPY;
+            return 0;
+        case AV_SAMPLE_FMT_FLT:
+            config->conversion = CONVERSION_FLTP_TO_FLT;
+            return 0;
+        case AV_SAMPLE_FMT_S16:
+            config->conversion = CONVERSION_FLTP_TO_S16;
+            return 0;
+        }
+    }
+
+    config->conversion = CONVERSION_SWR;
+    return init_swr(config, pOptions, &frame->ch_layout, frame->sample_rate);
+}
+
+/* The number of output samples the decoded frame needs. */
+int32_t decoder_get_out_samples(PAacDecoder config) {
+    return config->conversion == CONVERSION_SWR
+        ? swr_get_out_samples(config->swr_ctx, config->frame->nb_samples)
+        : config->frame->nb_samples;
+}
+
+/* Add the time spent converting and the samples written to the decoder's stats. */
+static void add_convert_stats(PAacDecoder config, int64_t start_ns, int32_t nb_samples) {
+
+    config->stats.convert_ns += stats_now_ns() - start_ns;
+
+    if (nb_samples < 0) {
+        config->stats.errors++;
+        return;
+    }
+
+    config->stats.samples_out += nb_samples;
+    config->stats.bytes_out += (int64_t)nb_samples
+        * av_get_bytes_per_sample(config->output_options.out_sample_fmt)
+        * config->output_options.out_channels;
+}
+
+/* Convert the decoded frame into the output buffers. Returns the number of samples written.
+Only swresample can hold back samples that don't fit, so the other conversions need room for the whole frame. */
+int32_t decoder_convert_frame(PAacDecoder config, uint8_t* outBuff0, uint8_t* outBuff1, int32_t numSamples) {
+
+    AVFrame* frame = config->frame;
+    const float* in0 = (const float*)frame->data[0];
+    const float* in1 = frame->ch_layout.nb_channels == 2 ? (const float*)frame->data[1] : NULL;
+    int32_t nb_samples = frame->nb_samples;
+    int64_t start_ns = stats_now_ns();
+
+    if (config->conversion != CONVERSION_SWR && numSamples < nb_samples) {
+        add_convert_stats(config, start_ns, ERR_BUFF_TOO_SMALL);
+        return ERR_BUFF_TOO_SMALL;
+    }
+
+    switch (config->conversion) {
+    case CONVERSION_COPY:
+        //Each plane is copied as mono, which is a memcpy at unity gain.
+        Convert_FltpToFlt(in0, NULL, (float*)outBuff0, nb_samples, config->gain);
+        if (in1)
+            Convert_FltpToFlt(in1, NULL, (float*)outBuff1, nb_samples, config->gain);
+        break;
+    case CONVERSION_FLTP_TO_FLT:
+        Convert_FltpToFlt(in0, in1, (float*)outBuff0, nb_samples, config->gain);
+        break;
+    case CONVERSION_FLTP_TO_S16:
+        Convert_FltpToS16(in0, in1, (int16_t*)outBuff0, nb_samples, config->gain);
+        break;
+    default: {
+        uint8_t* convertedData[2] = { outBuff0, outBuff1 };
+        nb_samples = swr_convert(config->swr_ctx,
+            (uint8_t* const*)convertedData, numSamples,
+            (const uint8_t* const*)frame->data, frame->nb_samples);
+        config->stats.resampled_frames++;
+    }
+    }
+
+    add_convert_stats(config, start_ns, nb_samples);
+    return nb_samples;
+}
+
+int32_t decoder_decode_packet(PAacDecoder config, uint8_t* pCompressedAudio, uint32_t cbInBufferSize) {
+
+    int32_t ret;
+    int64_t start_ns;
+
+    config->packet->size = cbInBufferSize; //input buffer size
+    config->packet->data = pCompressedAudio; // the input buffer
+
+    config->stats.frames_in++;
+    config->stats.bytes_in += cbInBufferSize;
+
+    /* send the packet with the compressed data to the decoder */
+    start_ns = stats_now_ns();
+    ret = avcodec_send_packet(config->context, config->packet);
+    config->stats.send_ns += stats_now_ns() - start_ns;
+    if (ret < 0) {
+        config->stats.errors++;
+        return ret;
+    }
+
+    start_ns = stats_now_ns();
+    ret = avcodec_receive_frame(config->context, config->frame);
+    config->stats.receive_ns += stats_now_ns() - start_ns;
+
+    if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF)
+        return 0;
+    else if (ret < 0) {
+        config->stats.errors++;
+        return ret;
+    }
+
+    config->stats.frames_out++;
+    config->stats.samples_in += config->frame->nb_samples;
+
+    /*Choose the conversion after each successful frame receipt */
+    return update_conversion(config);
+}
+
 int32_t Decoder_ReceiveDecodedFrame(PAacDecoder config, uint8_t* outBuff0, uint8_t* outBuff1, int32_t numSamples) {
     
     if (!config->frame->nb_samples)
         return 0;
 
-    int32_t required_size = swr_get_out_samples(config->swr_ctx, config->frame->nb_samples);
+    int32_t required_size = decoder_get_out_samples(config);
 
     if ((!outBuff0 && !numSamples) || required_size > numSamples)
         return required_size;
-    else {
-        uint8_t* convertedData[2] = { outBuff0 , outBuff1 };
-        int32_t decoded = swr_convert(config->swr_ctx,
-            (uint8_t* const*)convertedData, numSamples,
-            (const uint8_t * const *)config->frame->data, config->frame->nb_samples);
-
-        return decoded;
-    }
+    else
+        return decoder_convert_frame(config, outBuff0, outBuff1, numSamples);
 }
 
 int32_t Decoder_DecodeFlush(PAacDecoder config, uint8_t* outBuff0, uint8_t* outBuff1, uint32_t cbOutBuff)
 {
-    if (!config || !config->context || !config->swr_ctx)
+    if (!config || !config->context || config->conversion == CONVERSION_UNKNOWN)
         return ERR_INVALID_HANDLE;
 
+    //Only swresample buffers samples.
+    if (config->conversion != CONVERSION_SWR)
+        return 0;
+
     int32_t ret;
     uint8_t* convertedData[2] = { outBuff0 , outBuff1 };
+    int64_t start_ns = stats_now_ns();
 
     //Null frame flushes buffer
     ret = swr_convert(config->swr_ctx, convertedData, cbOutBuff, NULL, 0);
+    add_convert_stats(config, start_ns, ret);
     return ret;
 }
 
+int32_t Decoder_GetStats(PAacDecoder config, PCodecStats pStats)
+{
+    if (!config)
+        return ERR_INVALID_HANDLE;
+    if (!pStats)
+        return ERR_BUFF_HANDLE_INVALID;
+
+    *pStats = config->stats;
+    return ERR_SUCCESS;
+}
+
+int32_t Decoder_Reset(PAacDecoder config)
+{
+    if (!config || !config->context)
+        return ERR_INVALID_HANDLE;
+
+    avcodec_flush_buffers(config->context);
+    av_frame_unref(config->frame);
+    av_packet_unref(config->packet);
+    config->frame_pending = 0;
+
+    return Decoder_SetGain(config, 1.0f);
+}
+
+int32_t Decoder_SetGain(PAacDecoder config, float gain)
+{
+    if (!config || !config->context)
+        return ERR_INVALID_HANDLE;
+    //Also rejects NaN.
+    if (!(gain > 0.0f) || isinf(gain))
+        return ERR_GAIN_INVALID;
+
+    config->gain = gain;
+
+    //swr_init on an initialized context drops its buffered samples and filter history.
+    if (config->swr_ctx &&
+        (av_opt_set_double(config->swr_ctx, "rematrix_volume", gain, 0) < 0 || swr_init(config->swr_ctx) < 0))
+        return ERR_SWR_INIT_FAIL;
+
+    return ERR_SUCCESS;
+}
+
 int32_t Decoder_DecodeFrame(PAacDecoder config, uint8_t* pCompressedAudio, uint32_t cbInBufferSize)
 {
     if (!config || !config->context)
         return ERR_INVALID_HANDLE;
 
-    int32_t ret;
+    return decoder_decode_packet(config, pCompressedAudio, cbInBufferSize);
+}
 
-    config->packet->size = cbInBufferSize; //input buffer size
-    config->packet->data = pCompressedAudio; // the input buffer
+int32_t Decoder_DecodeBatch(PAacDecoder config, uint8_t** ppCompressedAudio, uint32_t* pcbInBufferSizes, int32_t nbFrames, uint8_t* outBuff0, uint8_t* outBuff1, int32_t numSamples, int32_t* pFrameResults)
+{
+    if (!config || !config->context)
+        return ERR_INVALID_HANDLE;
 
-    /* send the packet with the compressed data to the decoder */
-    ret = avcodec_send_packet(config->context, config->packet);
-    if (ret < 0)
-        return ret;
+    if (!ppCompressedAudio || !pcbInBufferSizes || !pFrameResults || !outBuff0 || nbFrames < 0 || numSamples < 0)
+        return ERR_BUFF_HANDLE_INVALID;
 
-    ret = avcodec_receive_frame(config->context, config->frame);
+    int32_t i, ret, required_size, decoded;
+    int32_t samples_written = 0;
+    const enum AVSampleFormat out_sample_fmt = config->output_options.out_sample_fmt;
+    const int32_t stride
+        = av_get_bytes_per_sample(out_sample_fmt)
+        * (av_sample_fmt_is_planar(out_sample_fmt) ? 1 : config->output_options.out_channels);
+
+    for (i = 0; i < nbFrames; i++) {
+
+        //Stop before sending a packet whose decoded audio may not fit in the output arena.
+        if (numSamples - samples_written < config->max_frame_samples)
+            break;
+
+        //A frame that didn't fit in the last call's arena was decoded but not yet converted.
+        if (config->frame_pending) {
+            config->frame_pending = 0;
+            ret = 0;
+        }
+        else
+            ret = decoder_decode_packet(config, ppCompressedAudio[i], pcbInBufferSizes[i]);
+
+        if (ret == AVERROR_INVALIDDATA) {
+            //Let the caller decide whether this frame may be skipped
+            pFrameResults[i] = ret;
+            continue;
+        }
+        else if (ret < 0)
+            return ret;
+
+        if (!config->frame->nb_samples) {
+            pFrameResults[i] = 0;
+            continue;
+        }
 
-    if (ret < 0)
-        return ret == AVERROR(EAGAIN) || ret == AVERROR_EOF ? 0 : ret;
+        required_size = decoder_get_out_samples(config);
+        config->max_frame_samples = max(config->max_frame_samples, required_size);
 
-    if (!config->swr_ctx) {
-        /*Initialize the filter after the first successful frame receipt */
-        ret = init_swr(config, &config->output_options, &config->frame->ch_layout, config->frame->sample_rate);
+        //The frame size isn't known until the first frame is decoded. Keep a frame that doesn't
+        //fit and leave its packet unconsumed, so the caller can retry with a bigger arena.
+        if (config->conversion != CONVERSION_SWR && numSamples - samples_written < required_size) {
+            config->frame_pending = 1;
+            break;
+        }
+
+        //Any samples that don't fit remain buffered in swr and are returned with the next frame.
+        decoded = decoder_convert_frame(config,
+            outBuff0 + samples_written * stride,
+            outBuff1 ? outBuff1 + samples_written * stride : NULL,
+            numSamples - samples_written);
+
+        if (decoded < 0)
+            return decoded;
+
+        pFrameResults[i] = decoded;
+        samples_written += decoded;
     }
 
-    return ret;
+    return i;
+}
+
+static int32_t validate_output_options(POutputOptions pOptions) {
+
+    if (pOptions->resample_quality < RESAMPLE_QUALITY_DEFAULT || pOptions->resample_quality > RESAMPLE_QUALITY_HIGH)
+        return ERR_RESAMPLE_QUALITY_UNSUPPORTED;
+
+    return 0;
 }
 
 static int32_t init_frame_packet(PAacDecoder pdec) {
@@ -151,6 +433,11 @@ static int32_t init_decoder_context(PAacDecoder* ppdec, enum AVCodecID id) {
     pdec->swr_ctx = NULL;
     pdec->packet = NULL;
     pdec->frame = NULL;
+    pdec->max_frame_samples = 0;
+    pdec->frame_pending = 0;
+    pdec->conversion = CONVERSION_UNKNOWN;
+    pdec->gain = 1.0f;
+    memset(&pdec->stats, 0, sizeof(CodecStats));
 
     codec = avcodec_find_decoder(id);
 
@@ -216,6 +503,9 @@ PVOID Decoder_OpenAac(PAacDecoderOptions decoder_options)
     }
 
     pdec->output_options = decoder_options->output_options;
+    if ((ret = validate_output_options(&pdec->output_options)) != 0) {
+        goto failed;
+    }
 
     /* Copy ASC to AVCodecConbtext.extradata and open the codec*/
     pdec->context->extradata_size = decoder_options->asc_size;
@@ -258,6 +548,9 @@ PVOID Decoder_OpenWithStreamDetect(POutputOptions output_options, enum AVCodecID
     }
 
     pdec->output_options = *output_options;
+    if ((ret = validate_output_options(&pdec->output_options)) != 0) {
+        goto failed;
+    }
 
     if (avcodec_open2(pdec->context, pdec->context->codec, NULL) != 0) {
         ret = ERR_AAC_CODEC_OPEN_FAIL;
@@ -284,8 +577,3 @@ PVOID Decoder_OpenEC3(POutputOptions output_options) {
 
     return Decoder_OpenWithStreamDetect(output_options, AV_CODEC_ID_EAC3);
 }
-
-void SetLogCallback(LogCallbackType callback) {
-    LogCallback = callback;
-    av_log_set_callback(LogCallback ? AvLogCallback : av_log_default_callback);
-}
@@ -1,12 +1,49 @@
 #include "AAXCleanNative.h"
 
+/* avcodec_send_frame, counting the frame and its duration in the encoder's stats. */
+int32_t encoder_send_frame(PAacEncoder config, AVFrame* frame) {
+
+    int64_t start_ns = stats_now_ns();
+    int32_t ret = avcodec_send_frame(config->context, frame);
+    config->stats.send_ns += stats_now_ns() - start_ns;
+
+    if (ret < 0 && ret != AVERROR_EOF)
+        config->stats.errors++;
+    else if (frame && ret == 0)
+        config->stats.frames_in++;
+    return ret;
+}
+
+/* avcodec_receive_packet, counting the packet and its duration in the encoder's stats. */
+static int32_t receive_packet(PAacEncoder config) {
+
+    int64_t start_ns = stats_now_ns();
+    int32_t ret = avcodec_receive_packet(config->context, config->packet);
+    config->stats.receive_ns += stats_now_ns() - start_ns;
+
+    if (ret == 0) {
+        config->stats.frames_out++;
+        config->stats.samples_out += config->packet->duration;
+        config->stats.bytes_out += config->packet->size;
+    }
+    else if (ret != AVERROR(EAGAIN) && ret != AVERROR_EOF)
+        config->stats.errors++;
+    return ret;
+}
+
+/* Count samples copied into the encoder's frame buffer. */
+static void add_input_stats(PAacEncoder config, int32_t nb_samples) {
+    config->stats.samples_in += nb_samples;
+    config->stats.bytes_in += (int64_t)nb_samples * config->sample_size * config->context->ch_layout.nb_channels;
+}
+
 int32_t AacEncoder_EncodeFlush(PAacEncoder config) {
 
     int32_t ret;
 
     if (config->current_frame_nb_samples) {
         //Send last partial frame
-        ret = avcodec_send_frame(config->context, config->frame);
+        ret = encoder_send_frame(config, config->frame);
 
         if (ret < 0)
             return ret;
@@ -14,7 +51,7 @@ int32_t AacEncoder_EncodeFlush(PAacEncoder config) {
 
     config->current_frame_nb_samples = 0;
     //Flush the encoder
-    ret = avcodec_send_frame(config->context, NULL);
+    ret = encoder_send_frame(config, NULL);
 
     if (ret == 0 || ret == AVERROR_EOF)
         return 0;
@@ -27,7 +64,7 @@ int32_t AacEncoder_ReceiveEncodedFrame(PAacEncoder config, uint8_t* outBuff, int
 
     if (!outBuff && !cbOutBuff) {
         //Called with null, so receive packet and report size;
-        ret = avcodec_receive_packet(config->context, config->packet);
+        ret = receive_packet(config);
         if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF)
             return 0;
         else if (ret < 0)
@@ -70,12 +107,13 @@ int32_t AacEncoder_EncodeFrame(PAacEncoder config, uint8_t* pDecodedAudio0, uint
     }
 
     config->current_frame_nb_samples += to_copy;
+    add_input_stats(config, to_copy);
 
     //Tell the caller how many more samples we need before we can encode a frame.
     if (config->current_frame_nb_samples < AAC_FRAME_SIZE)
         return AAC_FRAME_SIZE - config->current_frame_nb_samples;
 
-    ret = avcodec_send_frame(config->context, config->frame);
+    ret = encoder_send_frame(config, config->frame);
     if (ret < 0)
         return ret;
 
@@ -93,11 +131,106 @@ int32_t AacEncoder_EncodeFrame(PAacEncoder config, uint8_t* pDecodedAudio0, uint
         }
 
         config->current_frame_nb_samples = nb_available_samples;
+        add_input_stats(config, nb_available_samples);
     }
 
     return 0;
 }
 
+int32_t encoder_drain_packets(PAacEncoder config, uint8_t* outBuff, int32_t cbOutBuff, int32_t* pPacketSizes, int32_t maxPackets, int32_t* pBytesWritten, int32_t* pNbPackets) {
+
+    int32_t ret;
+    const int32_t max_packet_size = AAC_MAX_PACKET_SIZE(config->context->ch_layout.nb_channels);
+
+    //Only receive a packet if there's guaranteed room for it.
+    while (*pNbPackets < maxPackets && cbOutBuff - *pBytesWritten >= max_packet_size) {
+
+        ret = receive_packet(config);
+        if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF)
+            return 0;
+        else if (ret < 0)
+            return ret;
+
+        memcpy(
+            outBuff + *pBytesWritten,
+            config->packet->data,
+            config->packet->size);
+
+        pPacketSizes[(*pNbPackets)++] = config->packet->size;
+        *pBytesWritten += config->packet->size;
+    }
+    return 0;
+}
+
+int32_t AacEncoder_EncodeBatch(PAacEncoder config, uint8_t* pDecodedAudio0, uint8_t* pDecodedAudio1, int32_t nbSamples, uint8_t* outBuff, int32_t cbOutBuff, int32_t* pPacketSizes, int32_t maxPackets, int32_t* pNbPackets) {
+
+    if (!config || !config->context)
+        return ERR_INVALID_HANDLE;
+
+    if (!outBuff || !pPacketSizes || !pNbPackets || (nbSamples > 0 && !pDecodedAudio0))
+        return ERR_BUFF_HANDLE_INVALID;
+
+    int32_t i, ret, to_copy;
+    int32_t consumed = 0;
+    int32_t bytes_written = 0;
+    const int32_t max_packet_size = AAC_MAX_PACKET_SIZE(config->context->ch_layout.nb_channels);
+
+    uint8_t* inputBuff[2] = { pDecodedAudio0 , pDecodedAudio1 };
+    const int32_t num_planes = pDecodedAudio1 ? 2 : 1;
+    const int32_t bytes_per_sample = config->sample_size * config->context->ch_layout.nb_channels / num_planes;
+
+    *pNbPackets = 0;
+
+    //Collect packets left over from the previous call or from AacEncoder_EncodeFlush
+    if ((ret = encoder_drain_packets(config, outBuff, cbOutBuff, pPacketSizes, maxPackets, &bytes_written, pNbPackets)) < 0)
+        return ret;
+
+    while (consumed < nbSamples) {
+
+        //Don't complete another frame unless its packet is guaranteed to fit.
+        if (*pNbPackets >= maxPackets || cbOutBuff - bytes_written < max_packet_size)
+            break;
+
+        to_copy = min(nbSamples - consumed, AAC_FRAME_SIZE - config->current_frame_nb_samples);
+
+        for (i = 0; i < num_planes; i++) {
+            memcpy(
+                config->frame->data[i] + config->current_frame_nb_samples * bytes_per_sample,
+                inputBuff[i] + consumed * bytes_per_sample,
+                to_copy * bytes_per_sample);
+        }
+
+        config->current_frame_nb_samples += to_copy;
+        consumed += to_copy;
+        add_input_stats(config, to_copy);
+
+        if (config->current_frame_nb_samples < AAC_FRAME_SIZE)
+            break;
+
+        ret = encoder_send_frame(config, config->frame);
+        if (ret < 0)
+            return ret;
+
+        config->current_frame_nb_samples = 0;
+
+        if ((ret = encoder_drain_packets(config, outBuff, cbOutBuff, pPacketSizes, maxPackets, &bytes_written, pNbPackets)) < 0)
+            return ret;
+    }
+
+    return consumed;
+}
+
+int32_t AacEncoder_GetStats(PAacEncoder config, PCodecStats pStats) {
+
+    if (!config)
+        return ERR_INVALID_HANDLE;
+    if (!pStats)
+        return ERR_BUFF_HANDLE_INVALID;
+
+    *pStats = config->stats;
+    return ERR_SUCCESS;
+}
+
 int32_t AacEncoder_Close(PAacEncoder config) {
 
     if (config) {
@@ -137,6 +270,47 @@ failed:
     return ret;
 }
 
+/* Allocate and open the codec context from the encoder's options. */
+static int32_t open_context(PAacEncoder penc, const AVCodec* codec) {
+
+    PAacEncoderOptions encoder_options = &penc->options;
+
+    /*Initialize the codec context*/
+    penc->context = avcodec_alloc_context3(codec);
+    if (!penc->context)
+        return ERR_ALLOC_FAIL;
+
+    //maximum bitrate is 6144 * channels / 1024.0 * sample_rate
+    //put sample parameters
+    penc->context->bit_rate = encoder_options->bit_rate;
+    penc->context->sample_rate = encoder_options->sample_rate;
+    penc->context->sample_fmt = encoder_options->sample_fmt;
+    penc->context->global_quality = encoder_options->global_quality;
+    penc->context->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+    penc->context->ch_layout = encoder_options->channels == 2 ? (AVChannelLayout)AV_CHANNEL_LAYOUT_STEREO : (AVChannelLayout)AV_CHANNEL_LAYOUT_MONO;
+
+    return avcodec_open2(penc->context, codec, NULL);
+}
+
+int32_t AacEncoder_Reset(PAacEncoder config) {
+
+    if (!config || !config->context)
+        return ERR_INVALID_HANDLE;
+
+    config->current_frame_nb_samples = 0;
+    av_packet_unref(config->packet);
+
+    const AVCodec* codec = config->context->codec;
+    if (codec->capabilities & AV_CODEC_CAP_ENCODER_FLUSH) {
+        avcodec_flush_buffers(config->context);
+        return ERR_SUCCESS;
+    }
+
+    //Encoders that can't flush leave draining mode only by being reopened.
+    avcodec_free_context(&config->context);
+    return open_context(config, codec);
+}
+
 PVOID AacEncoder_Open(PAacEncoderOptions encoder_options) {
 
     PAacEncoder penc = NULL;
@@ -159,6 +333,8 @@ PVOID AacEncoder_Open(PAacEncoderOptions encoder_options) {
     penc->packet = NULL;
     penc->frame = NULL;
     penc->current_frame_nb_samples = 0;
+    penc->options = *encoder_options;
+    memset(&penc->stats, 0, sizeof(CodecStats));
 
     codec = avcodec_find_encoder(AV_CODEC_ID_AAC);
 
@@ -178,23 +354,7 @@ PVOID AacEncoder_Open(PAacEncoderOptions encoder_options) {
         goto failed;
     }
 
-    /*Initialize the codec context*/
-    penc->context = avcodec_alloc_context3(codec);
-    if (!penc->context) {
-        ret = ERR_ALLOC_FAIL;
-        goto failed;
-    }
-
-    //maximum bitrate is 6144 * channels / 1024.0 * sample_rate
-    //put sample parameters
-    penc->context->bit_rate = encoder_options->bit_rate;
-    penc->context->sample_rate = encoder_options->sample_rate;
-    penc->context->sample_fmt = encoder_options->sample_fmt;
-    penc->context->global_quality = encoder_options->global_quality;
-    penc->context->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
-    penc->context->ch_layout = encoder_options->channels == 2 ? (AVChannelLayout)AV_CHANNEL_LAYOUT_STEREO : (AVChannelLayout)AV_CHANNEL_LAYOUT_MONO;
-
-    ret = avcodec_open2(penc->context, codec, NULL);
+    ret = open_context(penc, codec);
     if (ret < 0)
         goto failed;
 
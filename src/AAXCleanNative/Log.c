@@ -0,0 +1,242 @@
+#include "AAXCleanNative.h"
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+/*
+* FFmpeg log messages are formatted once into a stack record on the logging thread and
+* copied into a bounded multi-producer ring (Vyukov's sequence-per-cell queue), which the
+* managed side drains on its own thread. Cell sequences are stored relative to the cell
+* index so that the zero-initialized statics are a valid empty ring.
+*
+* Messages are grouped into classes by format string. A class coalesces consecutive
+* identical messages and is rate limited to LOG_RATE_LIMIT messages per window. The class
+* counters are updated without locks, so concurrent loggers may make the summaries
+* slightly approximate, but never block.
+*/
+#define LOG_RING_SIZE 1024
+#define LOG_RING_MASK (LOG_RING_SIZE - 1)
+#define LOG_CLASS_COUNT 64
+#define LOG_RATE_WINDOW_US 1000000
+
+typedef struct LogCell {
+    atomic_size_t sequence;
+    LogRecord record;
+}LogCell;
+
+typedef struct LogClass {
+    _Atomic(const char*) format;
+    atomic_int level;
+    _Atomic(uint64_t) last_hash;
+    atomic_int repeats;
+    atomic_int suppressed;
+    atomic_int window_count;
+    _Atomic(int64_t) window_start;
+    _Atomic(int64_t) last_summary;
+}LogClass;
+
+static LogCell Ring[LOG_RING_SIZE];
+static atomic_size_t EnqueuePos;
+static atomic_size_t DequeuePos;
+static LogClass Classes[LOG_CLASS_COUNT];
+static _Atomic(int64_t) Dropped;
+
+static void log_enqueue(const LogRecord* record) {
+    size_t pos = atomic_load_explicit(&EnqueuePos, memory_order_relaxed);
+    LogCell* cell;
+
+    for (;;) {
+        cell = &Ring[pos & LOG_RING_MASK];
+        size_t seq = atomic_load_explicit(&cell->sequence, memory_order_acquire) + (pos & LOG_RING_MASK);
+        intptr_t diff = (intptr_t)(seq - pos);
+
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&EnqueuePos, &pos, pos + 1, memory_order_relaxed, memory_order_relaxed))
+                break;
+        }
+        else if (diff < 0) {
+            atomic_fetch_add_explicit(&Dropped, 1, memory_order_relaxed);
+            return;
+        }
+        else
+            pos = atomic_load_explicit(&EnqueuePos, memory_order_relaxed);
+    }
+
+    memcpy(&cell->record, record, offsetof(LogRecord, message) + record->message_size + 1);
+    atomic_store_explicit(&cell->sequence, pos + 1 - (pos & LOG_RING_MASK), memory_order_release);
+}
+
+/* Single consumer. Log_Drain must not run concurrently with itself. */
+static int32_t log_dequeue(PLogRecord record) {
+    size_t pos = atomic_load_explicit(&DequeuePos, memory_order_relaxed);
+    LogCell* cell = &Ring[pos & LOG_RING_MASK];
+    size_t seq = atomic_load_explicit(&cell->sequence, memory_order_acquire) + (pos & LOG_RING_MASK);
+
+    if ((intptr_t)(seq - (pos + 1)) < 0)
+        return 0;
+
+    memcpy(record, &cell->record, sizeof(LogRecord));
+    atomic_store_explicit(&DequeuePos, pos + 1, memory_order_relaxed);
+    atomic_store_explicit(&cell->sequence, pos + LOG_RING_SIZE - (pos & LOG_RING_MASK), memory_order_release);
+    return 1;
+}
+
+static void log_format_summary(PLogRecord record, int32_t level, int32_t count, const char* fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    int32_t size = vsnprintf(record->message, LOG_MESSAGE_SIZE, fmt, args);
+    va_end(args);
+
+    record->level = level;
+    record->repeat_count = count;
+    record->message_size = size < 0 ? 0 : size < LOG_MESSAGE_SIZE ? size : LOG_MESSAGE_SIZE - 1;
+    record->message[record->message_size] = 0;
+}
+
+/* Format a class's pending repeat or suppression summary. Returns 1 if record was written. */
+static int32_t log_take_repeats(LogClass* cls, PLogRecord record) {
+    int32_t repeats = atomic_exchange_explicit(&cls->repeats, 0, memory_order_relaxed);
+    if (repeats <= 0)
+        return 0;
+
+    log_format_summary(record, atomic_load_explicit(&cls->level, memory_order_relaxed), repeats, "Last message repeated %d times\n", repeats);
+    return 1;
+}
+
+static int32_t log_take_suppressed(LogClass* cls, PLogRecord record) {
+    int32_t suppressed = atomic_exchange_explicit(&cls->suppressed, 0, memory_order_relaxed);
+    if (suppressed <= 0)
+        return 0;
+
+    const char* format = atomic_load_explicit(&cls->format, memory_order_relaxed);
+    log_format_summary(record, atomic_load_explicit(&cls->level, memory_order_relaxed), suppressed, "Suppressed %d more messages like: %s", suppressed, format);
+    return 1;
+}
+
+static LogClass* log_find_class(const char* fmt, int32_t level) {
+    size_t start = (size_t)(((uint64_t)(uintptr_t)fmt * 0x9E3779B97F4A7C15ull) >> 32);
+
+    for (int32_t i = 0; i < LOG_CLASS_COUNT; i++) {
+        LogClass* cls = &Classes[(start + i) & (LOG_CLASS_COUNT - 1)];
+        const char* format = atomic_load_explicit(&cls->format, memory_order_acquire);
+
+        if (format == fmt)
+            return cls;
+        if (!format) {
+            if (atomic_compare_exchange_strong(&cls->format, &format, fmt)) {
+                atomic_store_explicit(&cls->level, level, memory_order_relaxed);
+                return cls;
+            }
+            if (format == fmt)
+                return cls;
+        }
+    }
+    return NULL;
+}
+
+static uint64_t log_hash(const char* message, int32_t size) {
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for (int32_t i = 0; i < size; i++)
+        hash = (hash ^ (uint8_t)message[i]) * 0x100000001b3ull;
+    return hash | 1;
+}
+
+static int32_t log_rate_allow(LogClass* cls, int64_t now) {
+    int64_t start = atomic_load_explicit(&cls->window_start, memory_order_relaxed);
+
+    if (now - start >= LOG_RATE_WINDOW_US
+        && atomic_compare_exchange_strong(&cls->window_start, &start, now)) {
+        atomic_store_explicit(&cls->window_count, 0, memory_order_relaxed);
+
+        LogRecord summary;
+        if (log_take_suppressed(cls, &summary))
+            log_enqueue(&summary);
+    }
+    return atomic_fetch_add_explicit(&cls->window_count, 1, memory_order_relaxed) < LOG_RATE_LIMIT;
+}
+
+static void log_callback(void* avcl, int32_t level, const char* fmt, va_list args) {
+
+    if (level > AV_LOG_VERBOSE || !fmt)
+        return;
+
+    LogRecord record;
+    int32_t size = vsnprintf(record.message, LOG_MESSAGE_SIZE, fmt, args);
+    if (size < 0)
+        return;
+
+    record.level = level;
+    record.repeat_count = 1;
+    record.message_size = size < LOG_MESSAGE_SIZE ? size : LOG_MESSAGE_SIZE - 1;
+
+    LogClass* cls = log_find_class(fmt, level);
+    if (!cls) {
+        log_enqueue(&record);
+        return;
+    }
+
+    uint64_t hash = log_hash(record.message, record.message_size);
+    if (atomic_load_explicit(&cls->last_hash, memory_order_relaxed) == hash) {
+        atomic_fetch_add_explicit(&cls->repeats, 1, memory_order_relaxed);
+        return;
+    }
+
+    LogRecord summary;
+    if (log_take_repeats(cls, &summary))
+        log_enqueue(&summary);
+
+    if (!log_rate_allow(cls, av_gettime_relative())) {
+        /* Identical follow-ups of a suppressed message are suppressed too, not coalesced. */
+        atomic_store_explicit(&cls->last_hash, 0, memory_order_relaxed);
+        atomic_fetch_add_explicit(&cls->suppressed, 1, memory_order_relaxed);
+        return;
+    }
+
+    atomic_store_explicit(&cls->last_hash, hash, memory_order_relaxed);
+    log_enqueue(&record);
+}
+
+void Log_SetEnabled(int32_t enabled) {
+    av_log_set_callback(enabled ? log_callback : av_log_default_callback);
+}
+
+int32_t Log_Drain(PLogRecord records, int32_t maxRecords) {
+    if (!records || maxRecords < 0)
+        return ERR_BUFF_TOO_SMALL;
+
+    int32_t count = 0;
+    while (count < maxRecords && log_dequeue(&records[count]))
+        count++;
+
+    if (count == maxRecords)
+        return count;
+
+    /* The ring is empty, so summaries can't overtake the messages they refer to. Each
+    class is summarized at most once per window to keep a sustained flood quiet. */
+    int64_t now = av_gettime_relative();
+    for (int32_t i = 0; i < LOG_CLASS_COUNT && count < maxRecords; i++) {
+        LogClass* cls = &Classes[i];
+        if (!atomic_load_explicit(&cls->format, memory_order_acquire))
+            continue;
+
+        int64_t lastSummary = atomic_load_explicit(&cls->last_summary, memory_order_relaxed);
+        if (now - lastSummary < LOG_RATE_WINDOW_US)
+            continue;
+        atomic_store_explicit(&cls->last_summary, now, memory_order_relaxed);
+
+        if (log_take_repeats(cls, &records[count]))
+            count++;
+        if (count < maxRecords && log_take_suppressed(cls, &records[count]))
+            count++;
+    }
+
+    int64_t dropped = atomic_exchange_explicit(&Dropped, 0, memory_order_relaxed);
+    if (dropped > 0) {
+        if (count < maxRecords)
+            log_format_summary(&records[count++], AV_LOG_WARNING, dropped < INT32_MAX ? (int32_t)dropped : INT32_MAX, "Dropped %lld log messages, the log buffer is full\n", (long long)dropped);
+        else
+            atomic_fetch_add_explicit(&Dropped, dropped, memory_order_relaxed);
+    }
+    return count;
+}
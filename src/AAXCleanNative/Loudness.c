@@ -0,0 +1,351 @@
+#include "AAXCleanNative.h"
+#include <math.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define LOUDNESS_HAVE_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#define TARGET_AVX2
+#else
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#define LOUDNESS_HAVE_NEON 1
+#include <arm_neon.h>
+#endif
+
+//Samples kept from the previous chunk for the true-peak interpolator.
+#define LOUDNESS_HISTORY (LOUDNESS_TP_TAPS - 1)
+//M_PI isn't standard C.
+#define LOUDNESS_PI 3.14159265358979323846
+
+/*
+* ITU-R BS.1770-4 Annex 2 interpolator for 4x oversampling. Phase p of output
+* sample i is the sum of tp_coefs[p][t] * x[i - t].
+*/
+static const float tp_coefs[LOUDNESS_TP_PHASES][LOUDNESS_TP_TAPS] = {
+    { 0.0017089843750f, 0.0109863281250f, -0.0196533203125f, 0.0332031250000f, -0.0594482421875f, 0.1373291015625f, 0.9721679687500f, -0.1022949218750f, 0.0476074218750f, -0.0266113281250f, 0.0148925781250f, -0.0083007812500f },
+    { -0.0291748046875f, 0.0292968750000f, -0.0517578125000f, 0.0891113281250f, -0.1665039062500f, 0.4650878906250f, 0.7797851562500f, -0.2003173828125f, 0.1015625000000f, -0.0582275390625f, 0.0330810546875f, -0.0189208984375f },
+    { -0.0189208984375f, 0.0330810546875f, -0.0582275390625f, 0.1015625000000f, -0.2003173828125f, 0.7797851562500f, 0.4650878906250f, -0.1665039062500f, 0.0891113281250f, -0.0517578125000f, 0.0292968750000f, -0.0291748046875f },
+    { -0.0083007812500f, 0.0148925781250f, -0.0266113281250f, 0.0476074218750f, -0.1022949218750f, 0.9721679687500f, 0.1373291015625f, -0.0594482421875f, 0.0332031250000f, -0.0196533203125f, 0.0109863281250f, 0.0017089843750f },
+};
+
+/*
+* Each kernel returns the largest magnitude of the interpolated samples between
+* p[0] and p[n - 1]. p[-LOUDNESS_HISTORY] through p[-1] must be readable. The
+* vector kernels sum the taps in the same order as the scalar kernel, which
+* finishes the tail.
+*/
+typedef float (*true_peak_fn)(const float* p, int64_t n);
+
+static float true_peak_scalar(const float* p, int64_t n) {
+    float peak = 0.0f;
+    for (int64_t i = 0; i < n; i++) {
+        for (int32_t phase = 0; phase < LOUDNESS_TP_PHASES; phase++) {
+            const float* h = tp_coefs[phase];
+            float acc = h[0] * p[i];
+            for (int32_t t = 1; t < LOUDNESS_TP_TAPS; t++)
+                acc += h[t] * p[i - t];
+            peak = fmaxf(peak, fabsf(acc));
+        }
+    }
+    return peak;
+}
+
+#if defined(LOUDNESS_HAVE_X86)
+TARGET_AVX2 static float true_peak_avx2(const float* p, int64_t n) {
+    const __m256 abs_mask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7FFFFFFF));
+    __m256 peak = _mm256_setzero_ps();
+    int64_t i = 0;
+
+    //Eight consecutive outputs of one phase at a time, so each tap is one broadcast coefficient.
+    for (; i + 8 <= n; i += 8) {
+        for (int32_t phase = 0; phase < LOUDNESS_TP_PHASES; phase++) {
+            const float* h = tp_coefs[phase];
+            __m256 acc = _mm256_mul_ps(_mm256_set1_ps(h[0]), _mm256_loadu_ps(p + i));
+            for (int32_t t = 1; t < LOUDNESS_TP_TAPS; t++)
+                acc = _mm256_add_ps(acc, _mm256_mul_ps(_mm256_set1_ps(h[t]), _mm256_loadu_ps(p + i - t)));
+            peak = _mm256_max_ps(peak, _mm256_and_ps(acc, abs_mask));
+        }
+    }
+
+    __m128 half = _mm_max_ps(_mm256_castps256_ps128(peak), _mm256_extractf128_ps(peak, 1));
+    half = _mm_max_ps(half, _mm_movehl_ps(half, half));
+    half = _mm_max_ss(half, _mm_shuffle_ps(half, half, 1));
+    return fmaxf(_mm_cvtss_f32(half), true_peak_scalar(p + i, n - i));
+}
+#endif
+
+#if defined(LOUDNESS_HAVE_NEON)
+static float true_peak_neon(const float* p, int64_t n) {
+    float32x4_t peak = vdupq_n_f32(0.0f);
+    int64_t i = 0;
+
+    for (; i + 4 <= n; i += 4) {
+        for (int32_t phase = 0; phase < LOUDNESS_TP_PHASES; phase++) {
+            const float* h = tp_coefs[phase];
+            float32x4_t acc = vmulq_n_f32(vld1q_f32(p + i), h[0]);
+            for (int32_t t = 1; t < LOUDNESS_TP_TAPS; t++)
+                acc = vaddq_f32(acc, vmulq_n_f32(vld1q_f32(p + i - t), h[t]));
+            peak = vmaxq_f32(peak, vabsq_f32(acc));
+        }
+    }
+    return fmaxf(vmaxvq_f32(peak), true_peak_scalar(p + i, n - i));
+}
+#endif
+
+/*
+* The interpolator is the only part of the meter worth vectorizing. The K-weighting
+* filters are recursive, so each channel is filtered one sample at a time.
+*/
+static true_peak_fn get_true_peak_kernel(void) {
+    switch (Silence_GetIsa()) {
+#if defined(LOUDNESS_HAVE_X86)
+    case SILENCE_ISA_AVX2:
+    case SILENCE_ISA_AVX512:
+        return true_peak_avx2;
+#endif
+#if defined(LOUDNESS_HAVE_NEON)
+    case SILENCE_ISA_NEON:
+        return true_peak_neon;
+#endif
+    default:
+        return true_peak_scalar;
+    }
+}
+
+/* Biquad coefficients of the K-weighting filters at any sample rate, as derived in libebur128. */
+static void init_k_weighting(PLoudnessMeter meter, double sample_rate) {
+
+    const double shelf_f0 = 1681.974450955533;
+    const double shelf_gain_db = 3.999843853973347;
+    const double shelf_q = 0.7071752369554196;
+
+    double k = tan(LOUDNESS_PI * shelf_f0 / sample_rate);
+    double vh = pow(10.0, shelf_gain_db / 20.0);
+    double vb = pow(vh, 0.4996667741545416);
+    double a0 = 1.0 + k / shelf_q + k * k;
+
+    meter->shelf[0] = (vh + vb * k / shelf_q + k * k) / a0;
+    meter->shelf[1] = 2.0 * (k * k - vh) / a0;
+    meter->shelf[2] = (vh - vb * k / shelf_q + k * k) / a0;
+    meter->shelf[3] = 2.0 * (k * k - 1.0) / a0;
+    meter->shelf[4] = (1.0 - k / shelf_q + k * k) / a0;
+
+    const double highpass_f0 = 38.13547087602444;
+    const double highpass_q = 0.5003270373238773;
+
+    k = tan(LOUDNESS_PI * highpass_f0 / sample_rate);
+    a0 = 1.0 + k / highpass_q + k * k;
+
+    meter->highpass[0] = 1.0;
+    meter->highpass[1] = -2.0;
+    meter->highpass[2] = 1.0;
+    meter->highpass[3] = 2.0 * (k * k - 1.0) / a0;
+    meter->highpass[4] = (1.0 - k / highpass_q + k * k) / a0;
+}
+
+static inline double block_loudness(double power) {
+    return -0.691 + 10.0 * log10(power);
+}
+
+static void add_block(PLoudnessMeter meter, double power) {
+
+    double loudness = block_loudness(power);
+    //Also drops silent blocks, whose loudness is -inf.
+    if (!(loudness > LOUDNESS_ABSOLUTE_GATE))
+        return;
+
+    int32_t bin = (int32_t)((loudness - LOUDNESS_ABSOLUTE_GATE) / LOUDNESS_BIN_WIDTH);
+    bin = min(bin, LOUDNESS_BINS - 1);
+    meter->bin_blocks[bin]++;
+    meter->bin_power[bin] += power;
+}
+
+/* Close the current 100 ms step. Each step from the fourth on completes a 400 ms block. */
+static void end_step(PLoudnessMeter meter) {
+
+    meter->step_power[meter->steps % 4] = meter->step_energy / meter->step_length;
+    meter->steps++;
+    meter->step_energy = 0.0;
+    meter->step_position = 0;
+
+    if (meter->steps >= 4)
+        add_block(meter, (meter->step_power[0] + meter->step_power[1] + meter->step_power[2] + meter->step_power[3]) / 4.0);
+}
+
+/* K-weight the chunk in history, accumulating each step's energy and the sample peak. */
+static void weight_chunk(PLoudnessMeter meter, int32_t n) {
+
+    const double* s = meter->shelf;
+    const double* h = meter->highpass;
+
+    for (int32_t i = 0; i < n;) {
+        int32_t run = min(n - i, meter->step_length - meter->step_position);
+
+        for (int32_t c = 0; c < meter->channels; c++) {
+            const float* x = meter->history[c] + LOUDNESS_HISTORY + i;
+            double* z = meter->filter_state[c];
+            double energy = 0.0;
+            float peak = meter->sample_peak;
+
+            for (int32_t j = 0; j < run; j++) {
+                double in = x[j];
+                double shelved = s[0] * in + z[0];
+                z[0] = s[1] * in - s[3] * shelved + z[1];
+                z[1] = s[2] * in - s[4] * shelved;
+                double weighted = h[0] * shelved + z[2];
+                z[2] = h[1] * shelved - h[3] * weighted + z[3];
+                z[3] = h[2] * shelved - h[4] * weighted;
+                energy += weighted * weighted;
+                peak = fmaxf(peak, fabsf(x[j]));
+            }
+            meter->step_energy += energy;
+            meter->sample_peak = peak;
+        }
+
+        i += run;
+        meter->step_position += run;
+        if (meter->step_position == meter->step_length)
+            end_step(meter);
+    }
+}
+
+/* Copy n samples per channel, starting at sample offset, into history as planar float. */
+static void load_chunk(PLoudnessMeter meter, const uint8_t* pSamples0, const uint8_t* pSamples1, int32_t sampleFormat, int32_t offset, int32_t n) {
+
+    const int32_t channels = meter->channels;
+    float* planes[2] = { meter->history[0] + LOUDNESS_HISTORY, meter->history[1] + LOUDNESS_HISTORY };
+
+    switch (sampleFormat) {
+    case AV_SAMPLE_FMT_S16: {
+        const int16_t* in = (const int16_t*)pSamples0 + (int64_t)offset * channels;
+        for (int32_t c = 0; c < channels; c++)
+            for (int32_t i = 0; i < n; i++)
+                planes[c][i] = in[i * channels + c] * (1.0f / 32768.0f);
+        break;
+    }
+    case AV_SAMPLE_FMT_FLT: {
+        const float* in = (const float*)pSamples0 + (int64_t)offset * channels;
+        for (int32_t c = 0; c < channels; c++)
+            for (int32_t i = 0; i < n; i++)
+                planes[c][i] = in[i * channels + c];
+        break;
+    }
+    default:
+        memcpy(planes[0], (const float*)pSamples0 + offset, sizeof(float) * n);
+        if (channels == 2)
+            memcpy(planes[1], (const float*)pSamples1 + offset, sizeof(float) * n);
+        break;
+    }
+}
+
+PVOID Loudness_Open(int32_t sampleRate, int32_t channels) {
+
+    intptr_t ret = 0;
+    PLoudnessMeter meter = NULL;
+
+    if (channels < 1 || channels > 2) {
+        ret = ERR_SWR_OUTPUT_CHANNELS_UNSUPPORTED;
+        goto failed;
+    }
+    if (sampleRate < 8000 || sampleRate > 192000) {
+        ret = ERR_SAMPLE_RATE_UNSUPPORTED;
+        goto failed;
+    }
+
+    meter = calloc(1, sizeof(LoudnessMeter));
+    if (!meter) {
+        ret = ERR_ALLOC_FAIL;
+        goto failed;
+    }
+
+    meter->channels = channels;
+    meter->step_length = (sampleRate + 5) / 10;
+    init_k_weighting(meter, sampleRate);
+    return meter;
+
+failed:
+    Loudness_Close(meter);
+    return (void*)ret;
+}
+
+int32_t Loudness_Close(PLoudnessMeter meter) {
+    free(meter);
+    return ERR_SUCCESS;
+}
+
+int32_t Loudness_Process(PLoudnessMeter meter, uint8_t* pSamples0, uint8_t* pSamples1, int32_t nbSamples, int32_t sampleFormat) {
+
+    if (!meter)
+        return ERR_INVALID_HANDLE;
+    if (sampleFormat != AV_SAMPLE_FMT_S16 && sampleFormat != AV_SAMPLE_FMT_FLT && sampleFormat != AV_SAMPLE_FMT_FLTP)
+        return ERR_SWR_OUTPUT_FORMAT_UNSUPPORTED;
+    if (nbSamples < 0 || (nbSamples > 0 && (!pSamples0 || (sampleFormat == AV_SAMPLE_FMT_FLTP && meter->channels == 2 && !pSamples1))))
+        return ERR_BUFF_HANDLE_INVALID;
+
+    true_peak_fn true_peak = get_true_peak_kernel();
+
+    for (int32_t offset = 0; offset < nbSamples;) {
+        int32_t n = min(LOUDNESS_CHUNK, nbSamples - offset);
+
+        load_chunk(meter, pSamples0, pSamples1, sampleFormat, offset, n);
+        weight_chunk(meter, n);
+
+        for (int32_t c = 0; c < meter->channels; c++) {
+            float* history = meter->history[c];
+            meter->true_peak = fmaxf(meter->true_peak, true_peak(history + LOUDNESS_HISTORY, n));
+            //The chunk's last samples become the next chunk's history. n may be shorter than the history.
+            memmove(history, history + n, sizeof(float) * LOUDNESS_HISTORY);
+        }
+        offset += n;
+    }
+
+    meter->samples += nbSamples;
+    return ERR_SUCCESS;
+}
+
+int32_t Loudness_GetResult(PLoudnessMeter meter, PLoudnessResult pResult) {
+
+    if (!meter)
+        return ERR_INVALID_HANDLE;
+    if (!pResult)
+        return ERR_BUFF_HANDLE_INVALID;
+
+    int64_t blocks = 0;
+    double power = 0.0;
+    for (int32_t i = 0; i < LOUDNESS_BINS; i++) {
+        blocks += meter->bin_blocks[i];
+        power += meter->bin_power[i];
+    }
+
+    pResult->integrated = -INFINITY;
+    if (blocks > 0) {
+        //Bins are only counted if they lie wholly above the relative gate.
+        double relative_gate = block_loudness(power / blocks) - 10.0;
+        int32_t first = max(0, (int32_t)ceil((relative_gate - LOUDNESS_ABSOLUTE_GATE) / LOUDNESS_BIN_WIDTH));
+        int64_t gated_blocks = 0;
+        double gated_power = 0.0;
+
+        for (int32_t i = first; i < LOUDNESS_BINS; i++) {
+            gated_blocks += meter->bin_blocks[i];
+            gated_power += meter->bin_power[i];
+        }
+        if (gated_blocks > 0)
+            pResult->integrated = block_loudness(gated_power / gated_blocks);
+    }
+
+    //Interpolate past the last samples as though the audio were followed by silence.
+    float true_peak = meter->true_peak;
+    for (int32_t c = 0; c < meter->channels; c++) {
+        float tail[2 * LOUDNESS_HISTORY] = { 0 };
+        memcpy(tail, meter->history[c], sizeof(float) * LOUDNESS_HISTORY);
+        true_peak = fmaxf(true_peak, true_peak_scalar(tail + LOUDNESS_HISTORY, LOUDNESS_HISTORY));
+    }
+
+    pResult->true_peak = fmaxf(true_peak, meter->sample_peak);
+    pResult->sample_peak = meter->sample_peak;
+    pResult->samples = meter->samples;
+    return ERR_SUCCESS;
+}
@@ -0,0 +1,247 @@
+#include "AAXCleanNative.h"
+#include <math.h>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define PEAKS_HAVE_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#define TARGET_AVX2
+#else
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#define PEAKS_HAVE_NEON 1
+#include <arm_neon.h>
+#endif
+
+/*
+* Each kernel folds n samples into a running minimum, maximum and sum of squares.
+* The vector kernels finish the tail with the scalar kernel, so none reads past p[n - 1].
+* Sums of 16-bit squares are exact in 64 bits. Float squares are summed in single
+* precision within a call, which is at most one peak's worth of samples.
+*/
+typedef void (*stats_s16_fn)(const int16_t* p, int64_t n, int16_t* pMin, int16_t* pMax, int64_t* pSumSquares);
+typedef void (*stats_flt_fn)(const float* p, int64_t n, float* pMin, float* pMax, double* pSumSquares);
+
+static void stats_s16_scalar(const int16_t* p, int64_t n, int16_t* pMin, int16_t* pMax, int64_t* pSumSquares) {
+    int16_t lo = *pMin, hi = *pMax;
+    int64_t sum = 0;
+    for (int64_t i = 0; i < n; i++) {
+        lo = min(lo, p[i]);
+        hi = max(hi, p[i]);
+        sum += (int32_t)p[i] * p[i];
+    }
+    *pMin = lo;
+    *pMax = hi;
+    *pSumSquares += sum;
+}
+
+static void stats_flt_scalar(const float* p, int64_t n, float* pMin, float* pMax, double* pSumSquares) {
+    float lo = *pMin, hi = *pMax;
+    double sum = 0.0;
+    for (int64_t i = 0; i < n; i++) {
+        lo = fminf(lo, p[i]);
+        hi = fmaxf(hi, p[i]);
+        sum += (double)p[i] * p[i];
+    }
+    *pMin = lo;
+    *pMax = hi;
+    *pSumSquares += sum;
+}
+
+#if defined(PEAKS_HAVE_X86)
+TARGET_AVX2 static void stats_s16_avx2(const int16_t* p, int64_t n, int16_t* pMin, int16_t* pMax, int64_t* pSumSquares) {
+    __m256i lo = _mm256_set1_epi16(*pMin);
+    __m256i hi = _mm256_set1_epi16(*pMax);
+    __m256i sum = _mm256_setzero_si256();
+    const __m256i zero = _mm256_setzero_si256();
+    int64_t i = 0;
+
+    for (; i + 16 <= n; i += 16) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(p + i));
+        lo = _mm256_min_epi16(lo, v);
+        hi = _mm256_max_epi16(hi, v);
+        //Pairs of squares are at most 2^31, so they are widened as unsigned before summing.
+        __m256i squares = _mm256_madd_epi16(v, v);
+        sum = _mm256_add_epi64(sum, _mm256_unpacklo_epi32(squares, zero));
+        sum = _mm256_add_epi64(sum, _mm256_unpackhi_epi32(squares, zero));
+    }
+
+    __m128i lo128 = _mm_min_epi16(_mm256_castsi256_si128(lo), _mm256_extracti128_si256(lo, 1));
+    __m128i hi128 = _mm_max_epi16(_mm256_castsi256_si128(hi), _mm256_extracti128_si256(hi, 1));
+    //minpos finds the smallest unsigned word, so flip the sign bit to order signed words.
+    const __m128i sign = _mm_set1_epi16((short)0x8000);
+    int16_t lo_s = (int16_t)(_mm_cvtsi128_si32(_mm_minpos_epu16(_mm_xor_si128(lo128, sign))) ^ 0x8000);
+    int16_t hi_s = (int16_t)~(_mm_cvtsi128_si32(_mm_minpos_epu16(_mm_xor_si128(hi128, _mm_set1_epi16(0x7FFF)))) ^ 0x8000);
+
+    int64_t sums[2];
+    _mm_storeu_si128((__m128i*)sums, _mm_add_epi64(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1)));
+    *pSumSquares += sums[0] + sums[1];
+    *pMin = lo_s;
+    *pMax = hi_s;
+    stats_s16_scalar(p + i, n - i, pMin, pMax, pSumSquares);
+}
+
+TARGET_AVX2 static void stats_flt_avx2(const float* p, int64_t n, float* pMin, float* pMax, double* pSumSquares) {
+    __m256 lo = _mm256_set1_ps(*pMin);
+    __m256 hi = _mm256_set1_ps(*pMax);
+    __m256 sum = _mm256_setzero_ps();
+    int64_t i = 0;
+
+    for (; i + 8 <= n; i += 8) {
+        __m256 v = _mm256_loadu_ps(p + i);
+        lo = _mm256_min_ps(lo, v);
+        hi = _mm256_max_ps(hi, v);
+        sum = _mm256_add_ps(sum, _mm256_mul_ps(v, v));
+    }
+
+    __m128 lo128 = _mm_min_ps(_mm256_castps256_ps128(lo), _mm256_extractf128_ps(lo, 1));
+    lo128 = _mm_min_ps(lo128, _mm_movehl_ps(lo128, lo128));
+    lo128 = _mm_min_ss(lo128, _mm_shuffle_ps(lo128, lo128, 1));
+    __m128 hi128 = _mm_max_ps(_mm256_castps256_ps128(hi), _mm256_extractf128_ps(hi, 1));
+    hi128 = _mm_max_ps(hi128, _mm_movehl_ps(hi128, hi128));
+    hi128 = _mm_max_ss(hi128, _mm_shuffle_ps(hi128, hi128, 1));
+    __m128 sum128 = _mm_add_ps(_mm256_castps256_ps128(sum), _mm256_extractf128_ps(sum, 1));
+    sum128 = _mm_add_ps(sum128, _mm_movehl_ps(sum128, sum128));
+    sum128 = _mm_add_ss(sum128, _mm_shuffle_ps(sum128, sum128, 1));
+
+    *pMin = _mm_cvtss_f32(lo128);
+    *pMax = _mm_cvtss_f32(hi128);
+    *pSumSquares += _mm_cvtss_f32(sum128);
+    stats_flt_scalar(p + i, n - i, pMin, pMax, pSumSquares);
+}
+#endif
+
+#if defined(PEAKS_HAVE_NEON)
+static void stats_s16_neon(const int16_t* p, int64_t n, int16_t* pMin, int16_t* pMax, int64_t* pSumSquares) {
+    int16x8_t lo = vdupq_n_s16(*pMin);
+    int16x8_t hi = vdupq_n_s16(*pMax);
+    int64x2_t sum = vdupq_n_s64(0);
+    int64_t i = 0;
+
+    for (; i + 8 <= n; i += 8) {
+        int16x8_t v = vld1q_s16(p + i);
+        lo = vminq_s16(lo, v);
+        hi = vmaxq_s16(hi, v);
+        int32x4_t squares = vmull_s16(vget_low_s16(v), vget_low_s16(v));
+        squares = vreinterpretq_s32_u32(vaddq_u32(vreinterpretq_u32_s32(squares), vreinterpretq_u32_s32(vmull_high_s16(v, v))));
+        sum = vreinterpretq_s64_u64(vpadalq_u32(vreinterpretq_u64_s64(sum), vreinterpretq_u32_s32(squares)));
+    }
+
+    *pMin = vminvq_s16(lo);
+    *pMax = vmaxvq_s16(hi);
+    *pSumSquares += vaddvq_s64(sum);
+    stats_s16_scalar(p + i, n - i, pMin, pMax, pSumSquares);
+}
+
+static void stats_flt_neon(const float* p, int64_t n, float* pMin, float* pMax, double* pSumSquares) {
+    float32x4_t lo = vdupq_n_f32(*pMin);
+    float32x4_t hi = vdupq_n_f32(*pMax);
+    float32x4_t sum = vdupq_n_f32(0.0f);
+    int64_t i = 0;
+
+    for (; i + 4 <= n; i += 4) {
+        float32x4_t v = vld1q_f32(p + i);
+        lo = vminq_f32(lo, v);
+        hi = vmaxq_f32(hi, v);
+        sum = vmlaq_f32(sum, v, v);
+    }
+
+    *pMin = vminvq_f32(lo);
+    *pMax = vmaxvq_f32(hi);
+    *pSumSquares += vaddvq_f32(sum);
+    stats_flt_scalar(p + i, n - i, pMin, pMax, pSumSquares);
+}
+#endif
+
+typedef struct PeakKernels {
+    stats_s16_fn stats_s16;
+    stats_flt_fn stats_flt;
+} PeakKernels;
+
+static const PeakKernels scalar_kernels = { stats_s16_scalar, stats_flt_scalar };
+#if defined(PEAKS_HAVE_X86)
+static const PeakKernels avx2_kernels = { stats_s16_avx2, stats_flt_avx2 };
+#endif
+#if defined(PEAKS_HAVE_NEON)
+static const PeakKernels neon_kernels = { stats_s16_neon, stats_flt_neon };
+#endif
+
+static const PeakKernels* get_peak_kernels(void) {
+    switch (Silence_GetIsa()) {
+#if defined(PEAKS_HAVE_X86)
+    case SILENCE_ISA_AVX2:
+    case SILENCE_ISA_AVX512:
+        return &avx2_kernels;
+#endif
+#if defined(PEAKS_HAVE_NEON)
+    case SILENCE_ISA_NEON:
+        return &neon_kernels;
+#endif
+    default:
+        return &scalar_kernels;
+    }
+}
+
+/* Fold samples [from, from + n) of every channel into the current peak. */
+static void add_samples(const PeakKernels* k, PPeakScanState state, const uint8_t* pSamples0, const uint8_t* pSamples1, int32_t channels, int32_t sampleFormat, int64_t from, int64_t n) {
+
+    if (sampleFormat == AV_SAMPLE_FMT_S16) {
+        int16_t lo = INT16_MAX, hi = INT16_MIN;
+        int64_t sum = 0;
+        k->stats_s16((const int16_t*)pSamples0 + from * channels, n * channels, &lo, &hi, &sum);
+        state->min = fminf(state->min, lo * (1.0f / 32768.0f));
+        state->max = fmaxf(state->max, hi * (1.0f / 32768.0f));
+        state->sum_squares += sum * (1.0 / (32768.0 * 32768.0));
+    }
+    else if (sampleFormat == AV_SAMPLE_FMT_FLT) {
+        k->stats_flt((const float*)pSamples0 + from * channels, n * channels, &state->min, &state->max, &state->sum_squares);
+    }
+    else {
+        k->stats_flt((const float*)pSamples0 + from, n, &state->min, &state->max, &state->sum_squares);
+        if (channels == 2)
+            k->stats_flt((const float*)pSamples1 + from, n, &state->min, &state->max, &state->sum_squares);
+    }
+}
+
+int32_t Peaks_Scan(PPeakScanState state, uint8_t* pSamples0, uint8_t* pSamples1, int32_t nbSamples, int32_t channels, int32_t sampleFormat, int32_t samplesPerPeak, PWavePeak pPeaks, int32_t maxPeaks) {
+
+    if (!state || (!pPeaks && maxPeaks > 0))
+        return ERR_INVALID_HANDLE;
+    if (channels < 1 || channels > 2)
+        return ERR_SWR_OUTPUT_CHANNELS_UNSUPPORTED;
+    if (sampleFormat != AV_SAMPLE_FMT_S16 && sampleFormat != AV_SAMPLE_FMT_FLT && sampleFormat != AV_SAMPLE_FMT_FLTP)
+        return ERR_SWR_OUTPUT_FORMAT_UNSUPPORTED;
+    if (nbSamples > 0 && (!pSamples0 || (sampleFormat == AV_SAMPLE_FMT_FLTP && channels == 2 && !pSamples1)))
+        return ERR_BUFF_HANDLE_INVALID;
+    if (samplesPerPeak < 1 || state->window_position < 0 || state->window_position >= samplesPerPeak)
+        return ERR_PEAK_SIZE_INVALID;
+    if ((state->window_position + nbSamples) / samplesPerPeak > maxPeaks)
+        return ERR_BUFF_TOO_SMALL;
+
+    const PeakKernels* k = get_peak_kernels();
+    int32_t peaks = 0;
+
+    for (int64_t i = 0; i < nbSamples;) {
+        if (state->window_position == 0) {
+            state->min = INFINITY;
+            state->max = -INFINITY;
+            state->sum_squares = 0.0;
+        }
+
+        int64_t run = min(nbSamples - i, samplesPerPeak - state->window_position);
+        add_samples(k, state, pSamples0, pSamples1, channels, sampleFormat, i, run);
+        i += run;
+        state->window_position += run;
+
+        if (state->window_position == samplesPerPeak) {
+            pPeaks[peaks].min = state->min;
+            pPeaks[peaks].max = state->max;
+            pPeaks[peaks].rms = (float)sqrt(state->sum_squares / ((double)samplesPerPeak * channels));
+            peaks++;
+            state->window_position = 0;
+        }
+    }
+
+    return peaks;
+}
@@ -0,0 +1,184 @@
+#include "AAXCleanNative.h"
+#include <math.h>
+#include <string.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#include <emmintrin.h>
+#define CONVERT_SSE2
+#elif defined(__ARM_NEON) || defined(_M_ARM64)
+#include <arm_neon.h>
+#define CONVERT_NEON
+#endif
+
+/*
+* swresample converts float to s16 as av_clip_int16(lrintf(sample * 32768)). The
+* samples are clamped before rounding so that out-of-range floats saturate the same
+* way in the scalar and SIMD paths. A gain is folded into the scale factor, so it
+* adds no work to the S16 conversion.
+*/
+#define S16_SCALE 32768.0f
+#define S16_MIN_F -32768.0f
+#define S16_MAX_F 32767.0f
+
+static inline int16_t flt_to_s16(float sample, float scale) {
+    float scaled = sample * scale;
+    scaled = scaled < S16_MIN_F ? S16_MIN_F : scaled > S16_MAX_F ? S16_MAX_F : scaled;
+    return (int16_t)lrintf(scaled);
+}
+
+#if defined(CONVERT_SSE2)
+
+static inline __m128i flt_to_s32_sse2(const float* p, __m128 scale, __m128 lo, __m128 hi) {
+    __m128 scaled = _mm_mul_ps(_mm_loadu_ps(p), scale);
+    return _mm_cvtps_epi32(_mm_min_ps(_mm_max_ps(scaled, lo), hi));
+}
+
+void Convert_FltpToS16(const float* pSamples0, const float* pSamples1, int16_t* pOutput, int32_t nbSamples, float gain) {
+    const float s16_scale = S16_SCALE * gain;
+    const __m128 scale = _mm_set1_ps(s16_scale);
+    const __m128 lo = _mm_set1_ps(S16_MIN_F);
+    const __m128 hi = _mm_set1_ps(S16_MAX_F);
+    int32_t i = 0;
+
+    if (pSamples1) {
+        for (; i + 8 <= nbSamples; i += 8) {
+            __m128i left = _mm_packs_epi32(flt_to_s32_sse2(pSamples0 + i, scale, lo, hi), flt_to_s32_sse2(pSamples0 + i + 4, scale, lo, hi));
+            __m128i right = _mm_packs_epi32(flt_to_s32_sse2(pSamples1 + i, scale, lo, hi), flt_to_s32_sse2(pSamples1 + i + 4, scale, lo, hi));
+            _mm_storeu_si128((__m128i*)(pOutput + 2 * i), _mm_unpacklo_epi16(left, right));
+            _mm_storeu_si128((__m128i*)(pOutput + 2 * i + 8), _mm_unpackhi_epi16(left, right));
+        }
+        for (; i < nbSamples; i++) {
+            pOutput[2 * i] = flt_to_s16(pSamples0[i], s16_scale);
+            pOutput[2 * i + 1] = flt_to_s16(pSamples1[i], s16_scale);
+        }
+    }
+    else {
+        for (; i + 8 <= nbSamples; i += 8) {
+            __m128i mono = _mm_packs_epi32(flt_to_s32_sse2(pSamples0 + i, scale, lo, hi), flt_to_s32_sse2(pSamples0 + i + 4, scale, lo, hi));
+            _mm_storeu_si128((__m128i*)(pOutput + i), mono);
+        }
+        for (; i < nbSamples; i++)
+            pOutput[i] = flt_to_s16(pSamples0[i], s16_scale);
+    }
+}
+
+void Convert_FltpToFlt(const float* pSamples0, const float* pSamples1, float* pOutput, int32_t nbSamples, float gain) {
+    const __m128 vgain = _mm_set1_ps(gain);
+    int32_t i = 0;
+
+    if (!pSamples1) {
+        if (gain == 1.0f) {
+            memcpy(pOutput, pSamples0, sizeof(float) * nbSamples);
+            return;
+        }
+        for (; i + 4 <= nbSamples; i += 4)
+            _mm_storeu_ps(pOutput + i, _mm_mul_ps(_mm_loadu_ps(pSamples0 + i), vgain));
+        for (; i < nbSamples; i++)
+            pOutput[i] = pSamples0[i] * gain;
+        return;
+    }
+
+    for (; i + 4 <= nbSamples; i += 4) {
+        __m128 left = _mm_mul_ps(_mm_loadu_ps(pSamples0 + i), vgain);
+        __m128 right = _mm_mul_ps(_mm_loadu_ps(pSamples1 + i), vgain);
+        _mm_storeu_ps(pOutput + 2 * i, _mm_unpacklo_ps(left, right));
+        _mm_storeu_ps(pOutput + 2 * i + 4, _mm_unpackhi_ps(left, right));
+    }
+    for (; i < nbSamples; i++) {
+        pOutput[2 * i] = pSamples0[i] * gain;
+        pOutput[2 * i + 1] = pSamples1[i] * gain;
+    }
+}
+
+#elif defined(CONVERT_NEON)
+
+static inline int16x4_t flt_to_s16_neon(const float* p, float scale, float32x4_t lo, float32x4_t hi) {
+    float32x4_t scaled = vmulq_n_f32(vld1q_f32(p), scale);
+    return vqmovn_s32(vcvtnq_s32_f32(vminq_f32(vmaxq_f32(scaled, lo), hi)));
+}
+
+void Convert_FltpToS16(const float* pSamples0, const float* pSamples1, int16_t* pOutput, int32_t nbSamples, float gain) {
+    const float s16_scale = S16_SCALE * gain;
+    const float32x4_t lo = vdupq_n_f32(S16_MIN_F);
+    const float32x4_t hi = vdupq_n_f32(S16_MAX_F);
+    int32_t i = 0;
+
+    if (pSamples1) {
+        for (; i + 8 <= nbSamples; i += 8) {
+            int16x8x2_t stereo;
+            stereo.val[0] = vcombine_s16(flt_to_s16_neon(pSamples0 + i, s16_scale, lo, hi), flt_to_s16_neon(pSamples0 + i + 4, s16_scale, lo, hi));
+            stereo.val[1] = vcombine_s16(flt_to_s16_neon(pSamples1 + i, s16_scale, lo, hi), flt_to_s16_neon(pSamples1 + i + 4, s16_scale, lo, hi));
+            vst2q_s16(pOutput + 2 * i, stereo);
+        }
+        for (; i < nbSamples; i++) {
+            pOutput[2 * i] = flt_to_s16(pSamples0[i], s16_scale);
+            pOutput[2 * i + 1] = flt_to_s16(pSamples1[i], s16_scale);
+        }
+    }
+    else {
+        for (; i + 8 <= nbSamples; i += 8)
+            vst1q_s16(pOutput + i, vcombine_s16(flt_to_s16_neon(pSamples0 + i, s16_scale, lo, hi), flt_to_s16_neon(pSamples0 + i + 4, s16_scale, lo, hi)));
+        for (; i < nbSamples; i++)
+            pOutput[i] = flt_to_s16(pSamples0[i], s16_scale);
+    }
+}
+
+void Convert_FltpToFlt(const float* pSamples0, const float* pSamples1, float* pOutput, int32_t nbSamples, float gain) {
+    int32_t i = 0;
+
+    if (!pSamples1) {
+        if (gain == 1.0f) {
+            memcpy(pOutput, pSamples0, sizeof(float) * nbSamples);
+            return;
+        }
+        for (; i + 4 <= nbSamples; i += 4)
+            vst1q_f32(pOutput + i, vmulq_n_f32(vld1q_f32(pSamples0 + i), gain));
+        for (; i < nbSamples; i++)
+            pOutput[i] = pSamples0[i] * gain;
+        return;
+    }
+
+    for (; i + 4 <= nbSamples; i += 4) {
+        float32x4x2_t stereo = { { vmulq_n_f32(vld1q_f32(pSamples0 + i), gain), vmulq_n_f32(vld1q_f32(pSamples1 + i), gain) } };
+        vst2q_f32(pOutput + 2 * i, stereo);
+    }
+    for (; i < nbSamples; i++) {
+        pOutput[2 * i] = pSamples0[i] * gain;
+        pOutput[2 * i + 1] = pSamples1[i] * gain;
+    }
+}
+
+#else
+
+void Convert_FltpToS16(const float* pSamples0, const float* pSamples1, int16_t* pOutput, int32_t nbSamples, float gain) {
+    const float s16_scale = S16_SCALE * gain;
+    if (pSamples1) {
+        for (int32_t i = 0; i < nbSamples; i++) {
+            pOutput[2 * i] = flt_to_s16(pSamples0[i], s16_scale);
+            pOutput[2 * i + 1] = flt_to_s16(pSamples1[i], s16_scale);
+        }
+    }
+    else {
+        for (int32_t i = 0; i < nbSamples; i++)
+            pOutput[i] = flt_to_s16(pSamples0[i], s16_scale);
+    }
+}
+
+void Convert_FltpToFlt(const float* pSamples0, const float* pSamples1, float* pOutput, int32_t nbSamples, float gain) {
+    if (!pSamples1) {
+        if (gain == 1.0f) {
+            memcpy(pOutput, pSamples0, sizeof(float) * nbSamples);
+            return;
+        }
+        for (int32_t i = 0; i < nbSamples; i++)
+            pOutput[i] = pSamples0[i] * gain;
+        return;
+    }
+
+    for (int32_t i = 0; i < nbSamples; i++) {
+        pOutput[2 * i] = pSamples0[i] * gain;
+        pOutput[2 * i + 1] = pSamples1[i] * gain;
+    }
+}
+
+#endif
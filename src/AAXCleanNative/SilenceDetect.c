@@ -0,0 +1,587 @@
+#include "AAXCleanNative.h"
+#include <math.h>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define SILENCE_HAVE_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define TARGET_AVX2
+#define TARGET_AVX512
+#else
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#define TARGET_AVX512 __attribute__((target("avx512f,avx512bw")))
+#endif
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#define SILENCE_HAVE_NEON 1
+#include <arm_neon.h>
+#endif
+
+/*
+* Each kernel returns the index of the first of n samples whose loudness matches
+* want_loud, or n if there is none. A sample is silent if its magnitude is strictly
+* less than the threshold. Full vectors are compared in bulk and the remaining
+* tail is finished with the scalar kernel, so no kernel reads past p[n - 1].
+*/
+typedef int64_t (*find_s16_fn)(const int16_t* p, int64_t n, int16_t threshold, int32_t want_loud);
+typedef int64_t (*find_flt_fn)(const float* p, int64_t n, float threshold, int32_t want_loud);
+
+/*
+* Band kernels return the index of the first sample whose magnitude is outside
+* [lo, hi), i.e. the first sample that is silent at lo or loud at hi.
+*/
+typedef int64_t (*find_band_s16_fn)(const int16_t* p, int64_t n, int16_t lo, int16_t hi);
+typedef int64_t (*find_band_flt_fn)(const float* p, int64_t n, float lo, float hi);
+
+typedef struct SilenceKernels {
+    int32_t isa;
+    find_s16_fn find_s16;
+    find_flt_fn find_flt;
+    find_band_s16_fn find_band_s16;
+    find_band_flt_fn find_band_flt;
+} SilenceKernels;
+
+/*
+* The magnitudes a search stays within. A missing bound searches with the
+* single threshold kernels instead.
+*/
+typedef struct SilenceBand {
+    int32_t has_lo;
+    int32_t has_hi;
+    int16_t lo_s16;
+    int16_t hi_s16;
+    float lo_flt;
+    float hi_flt;
+} SilenceBand;
+
+static inline int32_t ctz64(uint64_t mask) {
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanForward64(&index, mask);
+    return (int32_t)index;
+#else
+    return __builtin_ctzll(mask);
+#endif
+}
+
+static int64_t find_s16_scalar(const int16_t* p, int64_t n, int16_t threshold, int32_t want_loud) {
+    for (int64_t i = 0; i < n; i++) {
+        // Promote before abs() so that INT16_MIN is loud rather than overflowing.
+        if ((abs((int32_t)p[i]) >= threshold) == want_loud)
+            return i;
+    }
+    return n;
+}
+
+static int64_t find_flt_scalar(const float* p, int64_t n, float threshold, int32_t want_loud) {
+    for (int64_t i = 0; i < n; i++) {
+        // Written so that NaN compares loud, matching the vector kernels.
+        int32_t loud = !(fabsf(p[i]) < threshold);
+        if (loud == want_loud)
+            return i;
+    }
+    return n;
+}
+
+static int64_t find_band_s16_scalar(const int16_t* p, int64_t n, int16_t lo, int16_t hi) {
+    for (int64_t i = 0; i < n; i++) {
+        int32_t a = abs((int32_t)p[i]);
+        if (a < lo || a >= hi)
+            return i;
+    }
+    return n;
+}
+
+static int64_t find_band_flt_scalar(const float* p, int64_t n, float lo, float hi) {
+    for (int64_t i = 0; i < n; i++) {
+        // NaN is loud at every threshold, so it is never inside a band.
+        float a = fabsf(p[i]);
+        if (a < lo || !(a < hi))
+            return i;
+    }
+    return n;
+}
+
+#if defined(SILENCE_HAVE_X86)
+TARGET_AVX2 static int64_t find_s16_avx2(const int16_t* p, int64_t n, int16_t threshold, int32_t want_loud) {
+    const __m256i hi = _mm256_set1_epi16(threshold);
+    const __m256i lo = _mm256_set1_epi16((int16_t)-threshold);
+    // movemask_epi8 yields two bits per 16-bit lane
+    const uint32_t flip = want_loud ? 0xFFFFFFFFu : 0;
+    int64_t i = 0;
+
+    for (; i + 16 <= n; i += 16) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(p + i));
+        __m256i silent = _mm256_and_si256(_mm256_cmpgt_epi16(hi, v), _mm256_cmpgt_epi16(v, lo));
+        uint32_t mask = (uint32_t)_mm256_movemask_epi8(silent) ^ flip;
+        if (mask)
+            return i + (ctz64(mask) >> 1);
+    }
+    return i + find_s16_scalar(p + i, n - i, threshold, want_loud);
+}
+
+TARGET_AVX2 static int64_t find_flt_avx2(const float* p, int64_t n, float threshold, int32_t want_loud) {
+    const __m256 abs_mask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7FFFFFFF));
+    const __m256 thresh = _mm256_set1_ps(threshold);
+    const uint32_t flip = want_loud ? 0xFFu : 0;
+    int64_t i = 0;
+
+    for (; i + 8 <= n; i += 8) {
+        __m256 v = _mm256_and_ps(_mm256_loadu_ps(p + i), abs_mask);
+        uint32_t mask = (uint32_t)_mm256_movemask_ps(_mm256_cmp_ps(v, thresh, _CMP_LT_OQ)) ^ flip;
+        if (mask)
+            return i + ctz64(mask);
+    }
+    return i + find_flt_scalar(p + i, n - i, threshold, want_loud);
+}
+
+TARGET_AVX2 static int64_t find_band_s16_avx2(const int16_t* p, int64_t n, int16_t lo, int16_t hi) {
+    // abs_epi16 leaves INT16_MIN as 0x8000, which is its magnitude when compared unsigned.
+    const __m256i vlo = _mm256_set1_epi16(lo);
+    const __m256i vhi = _mm256_set1_epi16(hi);
+    int64_t i = 0;
+
+    for (; i + 16 <= n; i += 16) {
+        __m256i a = _mm256_abs_epi16(_mm256_loadu_si256((const __m256i*)(p + i)));
+        __m256i ge_lo = _mm256_cmpeq_epi16(_mm256_max_epu16(a, vlo), a);
+        __m256i ge_hi = _mm256_cmpeq_epi16(_mm256_max_epu16(a, vhi), a);
+        uint32_t mask = ~(uint32_t)_mm256_movemask_epi8(_mm256_andnot_si256(ge_hi, ge_lo));
+        if (mask)
+            return i + (ctz64(mask) >> 1);
+    }
+    return i + find_band_s16_scalar(p + i, n - i, lo, hi);
+}
+
+TARGET_AVX2 static int64_t find_band_flt_avx2(const float* p, int64_t n, float lo, float hi) {
+    const __m256 abs_mask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7FFFFFFF));
+    const __m256 vlo = _mm256_set1_ps(lo);
+    const __m256 vhi = _mm256_set1_ps(hi);
+    int64_t i = 0;
+
+    for (; i + 8 <= n; i += 8) {
+        __m256 a = _mm256_and_ps(_mm256_loadu_ps(p + i), abs_mask);
+        __m256 inside = _mm256_and_ps(_mm256_cmp_ps(a, vlo, _CMP_NLT_UQ), _mm256_cmp_ps(a, vhi, _CMP_LT_OQ));
+        uint32_t mask = ~(uint32_t)_mm256_movemask_ps(inside) & 0xFFu;
+        if (mask)
+            return i + ctz64(mask);
+    }
+    return i + find_band_flt_scalar(p + i, n - i, lo, hi);
+}
+
+TARGET_AVX512 static int64_t find_s16_avx512(const int16_t* p, int64_t n, int16_t threshold, int32_t want_loud) {
+    const __m512i hi = _mm512_set1_epi16(threshold);
+    const __m512i lo = _mm512_set1_epi16((int16_t)-threshold);
+    const uint32_t flip = want_loud ? 0xFFFFFFFFu : 0;
+    int64_t i = 0;
+
+    for (; i + 32 <= n; i += 32) {
+        __m512i v = _mm512_loadu_si512((const void*)(p + i));
+        uint32_t silent = (uint32_t)(_mm512_cmpgt_epi16_mask(hi, v) & _mm512_cmpgt_epi16_mask(v, lo));
+        uint32_t mask = silent ^ flip;
+        if (mask)
+            return i + ctz64(mask);
+    }
+    return i + find_s16_scalar(p + i, n - i, threshold, want_loud);
+}
+
+TARGET_AVX512 static int64_t find_flt_avx512(const float* p, int64_t n, float threshold, int32_t want_loud) {
+    const __m512 thresh = _mm512_set1_ps(threshold);
+    const uint32_t flip = want_loud ? 0xFFFFu : 0;
+    int64_t i = 0;
+
+    for (; i + 16 <= n; i += 16) {
+        __m512 v = _mm512_abs_ps(_mm512_loadu_ps(p + i));
+        uint32_t mask = (uint32_t)_mm512_cmp_ps_mask(v, thresh, _CMP_LT_OQ) ^ flip;
+        if (mask)
+            return i + ctz64(mask);
+    }
+    return i + find_flt_scalar(p + i, n - i, threshold, want_loud);
+}
+
+TARGET_AVX512 static int64_t find_band_s16_avx512(const int16_t* p, int64_t n, int16_t lo, int16_t hi) {
+    const __m512i vlo = _mm512_set1_epi16(lo);
+    const __m512i vhi = _mm512_set1_epi16(hi);
+    int64_t i = 0;
+
+    for (; i + 32 <= n; i += 32) {
+        __m512i a = _mm512_abs_epi16(_mm512_loadu_si512((const void*)(p + i)));
+        uint32_t inside = (uint32_t)(_mm512_cmpge_epu16_mask(a, vlo) & _mm512_cmplt_epu16_mask(a, vhi));
+        if (~inside)
+            return i + ctz64(~inside);
+    }
+    return i + find_band_s16_scalar(p + i, n - i, lo, hi);
+}
+
+TARGET_AVX512 static int64_t find_band_flt_avx512(const float* p, int64_t n, float lo, float hi) {
+    const __m512 vlo = _mm512_set1_ps(lo);
+    const __m512 vhi = _mm512_set1_ps(hi);
+    int64_t i = 0;
+
+    for (; i + 16 <= n; i += 16) {
+        __m512 a = _mm512_abs_ps(_mm512_loadu_ps(p + i));
+        uint32_t inside = (uint32_t)(_mm512_cmp_ps_mask(a, vlo, _CMP_NLT_UQ) & _mm512_cmp_ps_mask(a, vhi, _CMP_LT_OQ));
+        uint32_t mask = ~inside & 0xFFFFu;
+        if (mask)
+            return i + ctz64(mask);
+    }
+    return i + find_band_flt_scalar(p + i, n - i, lo, hi);
+}
+
+static int32_t cpu_has_avx2(void) {
+#if defined(_MSC_VER)
+    int32_t info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7) return 0;
+    __cpuid(info, 1);
+    // OSXSAVE and AVX, and the OS saves the YMM state
+    if ((info[2] & (1 << 27)) == 0 || (info[2] & (1 << 28)) == 0 || (_xgetbv(0) & 0x6) != 0x6) return 0;
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#else
+    return __builtin_cpu_supports("avx2");
+#endif
+}
+
+static int32_t cpu_has_avx512bw(void) {
+#if defined(_MSC_VER)
+    int32_t info[4];
+    if (!cpu_has_avx2()) return 0;
+    // The OS must also save the opmask and ZMM state
+    if ((_xgetbv(0) & 0xE6) != 0xE6) return 0;
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 16)) != 0 && (info[1] & (1 << 30)) != 0;
+#else
+    return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw");
+#endif
+}
+#endif
+
+#if defined(SILENCE_HAVE_NEON)
+static int64_t find_s16_neon(const int16_t* p, int64_t n, int16_t threshold, int32_t want_loud) {
+    const int16x8_t hi = vdupq_n_s16(threshold);
+    const int16x8_t lo = vdupq_n_s16((int16_t)-threshold);
+    const uint64_t flip = want_loud ? UINT64_MAX : 0;
+    int64_t i = 0;
+
+    for (; i + 8 <= n; i += 8) {
+        int16x8_t v = vld1q_s16(p + i);
+        uint16x8_t silent = vandq_u16(vcltq_s16(v, hi), vcgtq_s16(v, lo));
+        // Narrow each 16-bit lane to a byte so the mask fits in a 64-bit scalar.
+        uint64_t mask = vget_lane_u64(vreinterpret_u64_u8(vmovn_u16(silent)), 0) ^ flip;
+        if (mask)
+            return i + (ctz64(mask) >> 3);
+    }
+    return i + find_s16_scalar(p + i, n - i, threshold, want_loud);
+}
+
+static int64_t find_flt_neon(const float* p, int64_t n, float threshold, int32_t want_loud) {
+    const float32x4_t thresh = vdupq_n_f32(threshold);
+    const uint64_t flip = want_loud ? UINT64_MAX : 0;
+    int64_t i = 0;
+
+    for (; i + 4 <= n; i += 4) {
+        uint32x4_t silent = vcaltq_f32(vld1q_f32(p + i), thresh);
+        uint64_t mask = vget_lane_u64(vreinterpret_u64_u16(vmovn_u32(silent)), 0) ^ flip;
+        if (mask)
+            return i + (ctz64(mask) >> 4);
+    }
+    return i + find_flt_scalar(p + i, n - i, threshold, want_loud);
+}
+
+static int64_t find_band_s16_neon(const int16_t* p, int64_t n, int16_t lo, int16_t hi) {
+    const uint16x8_t vlo = vdupq_n_u16((uint16_t)lo);
+    const uint16x8_t vhi = vdupq_n_u16((uint16_t)hi);
+    int64_t i = 0;
+
+    for (; i + 8 <= n; i += 8) {
+        uint16x8_t a = vreinterpretq_u16_s16(vabsq_s16(vld1q_s16(p + i)));
+        uint16x8_t inside = vandq_u16(vcgeq_u16(a, vlo), vcltq_u16(a, vhi));
+        uint64_t mask = ~vget_lane_u64(vreinterpret_u64_u8(vmovn_u16(inside)), 0);
+        if (mask)
+            return i + (ctz64(mask) >> 3);
+    }
+    return i + find_band_s16_scalar(p + i, n - i, lo, hi);
+}
+
+static int64_t find_band_flt_neon(const float* p, int64_t n, float lo, float hi) {
+    const float32x4_t vlo = vdupq_n_f32(lo);
+    const float32x4_t vhi = vdupq_n_f32(hi);
+    int64_t i = 0;
+
+    for (; i + 4 <= n; i += 4) {
+        float32x4_t a = vabsq_f32(vld1q_f32(p + i));
+        uint32x4_t inside = vandq_u32(vmvnq_u32(vcltq_f32(a, vlo)), vcltq_f32(a, vhi));
+        uint64_t mask = ~vget_lane_u64(vreinterpret_u64_u16(vmovn_u32(inside)), 0);
+        if (mask)
+            return i + (ctz64(mask) >> 4);
+    }
+    return i + find_band_flt_scalar(p + i, n - i, lo, hi);
+}
+#endif
+
+static const SilenceKernels scalar_kernels = { SILENCE_ISA_SCALAR, find_s16_scalar, find_flt_scalar, find_band_s16_scalar, find_band_flt_scalar };
+#if defined(SILENCE_HAVE_X86)
+static const SilenceKernels avx2_kernels = { SILENCE_ISA_AVX2, find_s16_avx2, find_flt_avx2, find_band_s16_avx2, find_band_flt_avx2 };
+static const SilenceKernels avx512_kernels = { SILENCE_ISA_AVX512, find_s16_avx512, find_flt_avx512, find_band_s16_avx512, find_band_flt_avx512 };
+#endif
+#if defined(SILENCE_HAVE_NEON)
+static const SilenceKernels neon_kernels = { SILENCE_ISA_NEON, find_s16_neon, find_flt_neon, find_band_s16_neon, find_band_flt_neon };
+#endif
+
+// Selected on first use. Racing threads all select the same kernels.
+static const SilenceKernels* volatile active_kernels;
+
+static const SilenceKernels* get_kernels_for_isa(int32_t isa) {
+    switch (isa) {
+    case SILENCE_ISA_SCALAR:
+        return &scalar_kernels;
+#if defined(SILENCE_HAVE_X86)
+    case SILENCE_ISA_AVX2:
+        return cpu_has_avx2() ? &avx2_kernels : NULL;
+    case SILENCE_ISA_AVX512:
+        return cpu_has_avx512bw() ? &avx512_kernels : NULL;
+#endif
+#if defined(SILENCE_HAVE_NEON)
+    case SILENCE_ISA_NEON:
+        return &neon_kernels;
+#endif
+    default:
+        return NULL;
+    }
+}
+
+static const SilenceKernels* get_kernels(void) {
+    const SilenceKernels* kernels = active_kernels;
+    if (kernels)
+        return kernels;
+
+    const int32_t preferred[] = { SILENCE_ISA_AVX512, SILENCE_ISA_AVX2, SILENCE_ISA_NEON };
+    kernels = &scalar_kernels;
+    for (size_t i = 0; i < sizeof(preferred) / sizeof(preferred[0]); i++) {
+        const SilenceKernels* candidate = get_kernels_for_isa(preferred[i]);
+        if (candidate) {
+            kernels = candidate;
+            break;
+        }
+    }
+    active_kernels = kernels;
+    return kernels;
+}
+
+EXPORT int32_t Silence_GetIsa(void) {
+    return get_kernels()->isa;
+}
+
+EXPORT int32_t Silence_SetIsa(int32_t isa) {
+    const SilenceKernels* kernels = get_kernels_for_isa(isa);
+    if (!kernels)
+        return ERR_ISA_UNSUPPORTED;
+    active_kernels = kernels;
+    return isa;
+}
+
+static int64_t find_outside_s16(const SilenceKernels* k, const int16_t* p, int64_t n, const SilenceBand* band) {
+    if (!band->has_lo)
+        return k->find_s16(p, n, band->hi_s16, 1);
+    if (!band->has_hi)
+        return k->find_s16(p, n, band->lo_s16, 0);
+    return k->find_band_s16(p, n, band->lo_s16, band->hi_s16);
+}
+
+static int64_t find_outside_flt(const SilenceKernels* k, const float* p, int64_t n, const SilenceBand* band) {
+    if (!band->has_lo)
+        return k->find_flt(p, n, band->hi_flt, 1);
+    if (!band->has_hi)
+        return k->find_flt(p, n, band->lo_flt, 0);
+    return k->find_band_flt(p, n, band->lo_flt, band->hi_flt);
+}
+
+/*
+* Search interleaved samples for the first sample outside the band, starting
+* at sample `from`. Returns the index of that sample or n.
+*/
+static int64_t find_interleaved(const SilenceKernels* k, const uint8_t* samples, int32_t sample_fmt, int64_t from, int64_t n, const SilenceBand* band) {
+    return sample_fmt == AV_SAMPLE_FMT_S16
+        ? from + find_outside_s16(k, (const int16_t*)samples + from, n - from, band)
+        : from + find_outside_flt(k, (const float*)samples + from, n - from, band);
+}
+
+/*
+* Search two planes of float samples as though they were interleaved, starting
+* at interleaved sample `from`. Planes are searched in blocks so that a match
+* early in one plane doesn't wait on a long scan of the other.
+*/
+static int64_t find_planar(const SilenceKernels* k, const float* left, const float* right, int64_t from, int64_t n, const SilenceBand* band) {
+    const int64_t BLOCK = 256;
+    int64_t nb_pairs = n / 2;
+    int64_t pair = from / 2;
+
+    if (from & 1) {
+        if (find_outside_flt(k, right + pair, 1, band) == 0)
+            return from;
+        pair++;
+    }
+
+    while (pair < nb_pairs) {
+        int64_t block = min(BLOCK, nb_pairs - pair);
+        int64_t in_left = find_outside_flt(k, left + pair, block, band);
+        int64_t in_right = find_outside_flt(k, right + pair, min(block, in_left + 1), band);
+
+        if (in_right < in_left)
+            return 2 * (pair + in_right) + 1;
+        if (in_left < block)
+            return 2 * (pair + in_left);
+        pair += block;
+    }
+    return n;
+}
+
+static int32_t validate_scan_args(uint8_t* pSamples0, uint8_t* pSamples1, int32_t nbSamples, int32_t channels, int32_t sampleFormat) {
+    if (channels < 1 || channels > 2)
+        return ERR_SWR_OUTPUT_CHANNELS_UNSUPPORTED;
+    if (sampleFormat != AV_SAMPLE_FMT_S16 && sampleFormat != AV_SAMPLE_FMT_FLT && sampleFormat != AV_SAMPLE_FMT_FLTP)
+        return ERR_SWR_OUTPUT_FORMAT_UNSUPPORTED;
+    if (nbSamples > 0 && (!pSamples0 || (sampleFormat == AV_SAMPLE_FMT_FLTP && channels == 2 && !pSamples1)))
+        return ERR_BUFF_HANDLE_INVALID;
+    return ERR_SUCCESS;
+}
+
+static int64_t find_outside(const SilenceKernels* k, uint8_t* pSamples0, uint8_t* pSamples1, int32_t planar, int32_t sampleFormat, int64_t from, int64_t n, const SilenceBand* band) {
+    return planar
+        ? find_planar(k, (const float*)pSamples0, (const float*)pSamples1, from, n, band)
+        : find_interleaved(k, pSamples0, sampleFormat == AV_SAMPLE_FMT_FLTP ? AV_SAMPLE_FMT_FLT : sampleFormat, from, n, band);
+}
+
+EXPORT int32_t Silence_Scan(PSilenceScanState state, uint8_t* pSamples0, uint8_t* pSamples1, int32_t nbSamples, int32_t channels, int32_t sampleFormat, double threshold, int64_t minRunLength, int64_t* pRunStarts, int64_t* pRunLengths, int32_t maxRuns) {
+
+    if (!state || !pRunStarts || !pRunLengths)
+        return ERR_INVALID_HANDLE;
+    int32_t ret = validate_scan_args(pSamples0, pSamples1, nbSamples, channels, sampleFormat);
+    if (ret != ERR_SUCCESS)
+        return ret;
+
+    const SilenceKernels* k = get_kernels();
+    const int16_t threshold_s16 = (int16_t)nearbyint(threshold * INT16_MAX);
+    const float threshold_flt = (float)threshold;
+    const int32_t planar = sampleFormat == AV_SAMPLE_FMT_FLTP && channels == 2;
+    const int64_t n = (int64_t)nbSamples * channels;
+    // While silent, search for a loud sample. Otherwise search for a silent one.
+    const SilenceBand find_loud = { 0, 1, 0, threshold_s16, 0, threshold_flt };
+    const SilenceBand find_silent = { 1, 0, threshold_s16, 0, threshold_flt, 0 };
+    int32_t nb_runs = 0;
+    int64_t i = 0;
+
+    while (i < n) {
+        int32_t in_silence = state->run_length > 0;
+        int64_t next = find_outside(k, pSamples0, pSamples1, planar, sampleFormat, i, n, in_silence ? &find_loud : &find_silent);
+
+        if (in_silence) {
+            state->run_length += next - i;
+            if (next < n) {
+                if (state->run_length > minRunLength) {
+                    if (nb_runs == maxRuns)
+                        return ERR_BUFF_TOO_SMALL;
+                    pRunStarts[nb_runs] = state->run_start;
+                    pRunLengths[nb_runs] = state->run_length;
+                    nb_runs++;
+                }
+                state->run_length = 0;
+            }
+        }
+        else if (next < n) {
+            state->run_start = state->position + next;
+            state->run_length = 1;
+            next++;
+        }
+        i = next;
+    }
+
+    state->position += n;
+    return nb_runs;
+}
+
+/*
+* The number of profiles a sample is loud for. Thresholds are ascending, so those
+* profiles are always the first ones.
+*/
+static int32_t loud_profile_count(const uint8_t* pSamples0, const uint8_t* pSamples1, int32_t planar, int32_t sampleFormat, int64_t i, const int16_t* thresholds_s16, const float* thresholds_flt, int32_t nbProfiles) {
+    int32_t count = 0;
+    if (sampleFormat == AV_SAMPLE_FMT_S16) {
+        int32_t a = abs((int32_t)((const int16_t*)pSamples0)[i]);
+        while (count < nbProfiles && a >= thresholds_s16[count])
+            count++;
+    }
+    else {
+        const float* plane = planar && (i & 1) ? (const float*)pSamples1 : (const float*)pSamples0;
+        float a = fabsf(plane[planar ? i / 2 : i]);
+        while (count < nbProfiles && !(a < thresholds_flt[count]))
+            count++;
+    }
+    return count;
+}
+
+EXPORT int32_t Silence_ScanProfiles(PSilenceScanState states, int32_t nbProfiles, const double* thresholds, const int64_t* minRunLengths, uint8_t* pSamples0, uint8_t* pSamples1, int32_t nbSamples, int32_t channels, int32_t sampleFormat, int32_t* pRunProfiles, int64_t* pRunStarts, int64_t* pRunLengths, int32_t maxRuns) {
+
+    if (!states || !thresholds || !minRunLengths || !pRunProfiles || !pRunStarts || !pRunLengths)
+        return ERR_INVALID_HANDLE;
+    if (nbProfiles < 1 || nbProfiles > SILENCE_MAX_PROFILES)
+        return ERR_SILENCE_PROFILES_INVALID;
+    int32_t ret = validate_scan_args(pSamples0, pSamples1, nbSamples, channels, sampleFormat);
+    if (ret != ERR_SUCCESS)
+        return ret;
+
+    int16_t thresholds_s16[SILENCE_MAX_PROFILES];
+    float thresholds_flt[SILENCE_MAX_PROFILES];
+    for (int32_t p = 0; p < nbProfiles; p++) {
+        if (p > 0 && !(thresholds[p] >= thresholds[p - 1]))
+            return ERR_SILENCE_PROFILES_INVALID;
+        thresholds_s16[p] = (int16_t)nearbyint(thresholds[p] * INT16_MAX);
+        thresholds_flt[p] = (float)thresholds[p];
+    }
+
+    const SilenceKernels* k = get_kernels();
+    const int32_t planar = sampleFormat == AV_SAMPLE_FMT_FLTP && channels == 2;
+    const int64_t n = (int64_t)nbSamples * channels;
+    int32_t nb_runs = 0;
+    int64_t i = 0;
+
+    /*
+    * Samples are grouped by how many profiles they are loud for. One search finds
+    * the end of each group across every threshold at once, and only the profiles
+    * whose state changes there are updated.
+    */
+    while (i < n) {
+        int32_t nb_loud = loud_profile_count(pSamples0, pSamples1, planar, sampleFormat, i, thresholds_s16, thresholds_flt, nbProfiles);
+        SilenceBand band = {
+            nb_loud > 0, nb_loud < nbProfiles,
+            nb_loud > 0 ? thresholds_s16[nb_loud - 1] : 0, nb_loud < nbProfiles ? thresholds_s16[nb_loud] : 0,
+            nb_loud > 0 ? thresholds_flt[nb_loud - 1] : 0, nb_loud < nbProfiles ? thresholds_flt[nb_loud] : 0
+        };
+        int64_t next = i + 1 < n ? find_outside(k, pSamples0, pSamples1, planar, sampleFormat, i + 1, n, &band) : n;
+
+        for (int32_t p = 0; p < nbProfiles; p++) {
+            PSilenceScanState state = states + p;
+            if (p >= nb_loud) {
+                if (state->run_length == 0)
+                    state->run_start = state->position + i;
+                state->run_length += next - i;
+            }
+            else if (state->run_length > 0) {
+                if (state->run_length > minRunLengths[p]) {
+                    if (nb_runs == maxRuns)
+                        return ERR_BUFF_TOO_SMALL;
+                    pRunProfiles[nb_runs] = p;
+                    pRunStarts[nb_runs] = state->run_start;
+                    pRunLengths[nb_runs] = state->run_length;
+                    nb_runs++;
+                }
+                state->run_length = 0;
+            }
+        }
+        i = next;
+    }
+
+    for (int32_t p = 0; p < nbProfiles; p++)
+        states[p].position += n;
+    return nb_runs;
+}
@@ -0,0 +1,321 @@
+#include "AAXCleanNative.h"
+
+//Staging holds this many encoder frames before it has to be compacted or grown.
+#define TRANSCODE_STAGING_FRAMES 8
+
+/* Bytes per sample index in plane 0 of the staging buffer. */
+static int32_t staging_stride(PTranscoder config) {
+    AVFrame* staging = config->staging;
+    return av_get_bytes_per_sample(staging->format)
+        * (av_sample_fmt_is_planar(staging->format) ? 1 : staging->ch_layout.nb_channels);
+}
+
+static uint8_t* staging_plane(PTranscoder config, int32_t plane, int32_t position) {
+    AVFrame* staging = config->staging;
+    if (plane == 1 && (!av_sample_fmt_is_planar(staging->format) || staging->ch_layout.nb_channels < 2))
+        return NULL;
+    return staging->data[plane] + (size_t)position * staging_stride(config);
+}
+
+static int32_t alloc_staging(PTranscoder config, int32_t capacity) {
+
+    int32_t ret;
+    AVFrame* staging = av_frame_alloc();
+    if (!staging)
+        return ERR_ALLOC_FAIL;
+
+    staging->format = config->encoder->context->sample_fmt;
+    staging->sample_rate = config->encoder->context->sample_rate;
+    staging->nb_samples = capacity;
+
+    if ((ret = av_channel_layout_copy(&staging->ch_layout, &config->encoder->context->ch_layout)) < 0 ||
+        (ret = av_frame_get_buffer(staging, 0)) < 0) {
+        av_frame_free(&staging);
+        return ret;
+    }
+
+    //Carry over samples not yet sent to the encoder.
+    if (config->staging) {
+        int32_t staged = config->write_pos - config->read_pos;
+        int32_t num_planes = staging_plane(config, 1, 0) ? 2 : 1;
+        int32_t stride = staging_stride(config);
+        for (int32_t i = 0; i < num_planes; i++)
+            memcpy(staging->data[i], staging_plane(config, i, config->read_pos), (size_t)staged * stride);
+
+        av_frame_free(&config->staging);
+        config->write_pos = staged;
+        config->read_pos = 0;
+    }
+
+    config->staging = staging;
+    config->capacity = capacity;
+    return 0;
+}
+
+/*
+* Make room for nb_samples after write_pos. Staged samples are moved to the front of
+* the buffer, which copies less than one encoder frame, or the buffer is grown.
+*/
+static int32_t reserve_staging(PTranscoder config, int32_t nb_samples) {
+
+    if (config->capacity - config->write_pos >= nb_samples)
+        return 0;
+
+    int32_t staged = config->write_pos - config->read_pos;
+    if (config->capacity - staged < nb_samples)
+        return alloc_staging(config, staged + nb_samples + AAC_FRAME_SIZE);
+
+    int32_t num_planes = staging_plane(config, 1, 0) ? 2 : 1;
+    for (int32_t i = 0; i < num_planes; i++)
+        memmove(staging_plane(config, i, 0), staging_plane(config, i, config->read_pos), (size_t)staged * staging_stride(config));
+
+    config->read_pos = 0;
+    config->write_pos = staged;
+    return 0;
+}
+
+/* Send nb_samples from read_pos to the encoder without copying them. */
+static int32_t send_staged(PTranscoder config, int32_t nb_samples) {
+
+    int32_t ret;
+    AVFrame* view = config->view;
+
+    av_frame_unref(view);
+    if ((ret = av_frame_ref(view, config->staging)) < 0)
+        return ret;
+
+    view->nb_samples = nb_samples;
+    view->data[0] = staging_plane(config, 0, config->read_pos);
+    if (staging_plane(config, 1, 0))
+        view->data[1] = staging_plane(config, 1, config->read_pos);
+
+    ret = encoder_send_frame(config->encoder, view);
+    av_frame_unref(view);
+    return ret;
+}
+
+/*
+* Encode staged frames while a packet is guaranteed to fit in the output buffer. When
+* flushing, the last partial frame is sent too, followed by the end of stream.
+*/
+static int32_t encode_staged(PTranscoder config, uint8_t* outBuff, int32_t cbOutBuff, int32_t* pPacketSizes, int32_t maxPackets, int32_t* pBytesWritten, int32_t* pNbPackets) {
+
+    int32_t ret, nb_samples;
+    PAacEncoder encoder = config->encoder;
+    const int32_t max_packet_size = AAC_MAX_PACKET_SIZE(encoder->context->ch_layout.nb_channels);
+
+    if ((ret = encoder_drain_packets(encoder, outBuff, cbOutBuff, pPacketSizes, maxPackets, pBytesWritten, pNbPackets)) < 0)
+        return ret;
+
+    while (config->write_pos - config->read_pos >= AAC_FRAME_SIZE ||
+        (config->flushing && config->write_pos > config->read_pos)) {
+
+        if (*pNbPackets >= maxPackets || cbOutBuff - *pBytesWritten < max_packet_size)
+            return 0;
+
+        nb_samples = min(AAC_FRAME_SIZE, config->write_pos - config->read_pos);
+        ret = send_staged(config, nb_samples);
+
+        //The encoder is holding a packet that didn't fit. Try again next call.
+        if (ret == AVERROR(EAGAIN))
+            return 0;
+        else if (ret < 0)
+            return ret;
+
+        encoder->stats.samples_in += nb_samples;
+        encoder->stats.bytes_in += (int64_t)nb_samples * encoder->sample_size * encoder->context->ch_layout.nb_channels;
+        config->read_pos += nb_samples;
+
+        if ((ret = encoder_drain_packets(encoder, outBuff, cbOutBuff, pPacketSizes, maxPackets, pBytesWritten, pNbPackets)) < 0)
+            return ret;
+    }
+
+    if (config->flushing && !config->eof_sent) {
+        ret = encoder_send_frame(encoder, NULL);
+        if (ret == AVERROR(EAGAIN))
+            return 0;
+        else if (ret < 0 && ret != AVERROR_EOF)
+            return ret;
+
+        config->eof_sent = 1;
+        return encoder_drain_packets(encoder, outBuff, cbOutBuff, pPacketSizes, maxPackets, pBytesWritten, pNbPackets);
+    }
+    return 0;
+}
+
+int32_t Transcoder_TranscodeBatch(PTranscoder config, uint8_t** ppCompressedAudio, uint32_t* pcbInBufferSizes, int32_t nbFrames, uint8_t* outBuff, int32_t cbOutBuff, int32_t* pPacketSizes, int32_t maxPackets, int32_t* pNbPackets) {
+
+    if (!config || !config->decoder || !config->encoder)
+        return ERR_INVALID_HANDLE;
+
+    if (!outBuff || !pPacketSizes || !pNbPackets || nbFrames < 0 || (nbFrames > 0 && (!ppCompressedAudio || !pcbInBufferSizes)))
+        return ERR_BUFF_HANDLE_INVALID;
+
+    int32_t i, ret, decoded;
+    int32_t bytes_written = 0;
+    PAacDecoder decoder = config->decoder;
+
+    *pNbPackets = 0;
+
+    //Encode audio left over from the previous call first.
+    if ((ret = encode_staged(config, outBuff, cbOutBuff, pPacketSizes, maxPackets, &bytes_written, pNbPackets)) < 0)
+        return ret;
+
+    for (i = 0; i < nbFrames && !config->flushing; i++) {
+
+        //Stop decoding while a full frame is waiting for room in the output buffer.
+        if (config->write_pos - config->read_pos >= AAC_FRAME_SIZE)
+            break;
+
+        if ((ret = decoder_decode_packet(decoder, ppCompressedAudio[i], pcbInBufferSizes[i])) < 0)
+            return ret;
+
+        if (!decoder->frame->nb_samples)
+            continue;
+
+        if ((ret = reserve_staging(config, decoder_get_out_samples(decoder))) < 0)
+            return ret;
+
+        decoded = decoder_convert_frame(decoder,
+            staging_plane(config, 0, config->write_pos),
+            staging_plane(config, 1, config->write_pos),
+            config->capacity - config->write_pos);
+
+        if (decoded < 0)
+            return decoded;
+
+        config->write_pos += decoded;
+
+        if ((ret = encode_staged(config, outBuff, cbOutBuff, pPacketSizes, maxPackets, &bytes_written, pNbPackets)) < 0)
+            return ret;
+    }
+
+    return i;
+}
+
+int32_t Transcoder_Flush(PTranscoder config) {
+
+    if (!config || !config->decoder || !config->encoder)
+        return ERR_INVALID_HANDLE;
+
+    if (config->flushing)
+        return ERR_SUCCESS;
+
+    PAacDecoder decoder = config->decoder;
+
+    //Only swresample buffers samples.
+    if (decoder->conversion == CONVERSION_SWR) {
+        int32_t ret = reserve_staging(config, swr_get_out_samples(decoder->swr_ctx, 0));
+        if (ret < 0)
+            return ret;
+
+        ret = Decoder_DecodeFlush(decoder,
+            staging_plane(config, 0, config->write_pos),
+            staging_plane(config, 1, config->write_pos),
+            config->capacity - config->write_pos);
+
+        if (ret < 0)
+            return ret;
+
+        config->write_pos += ret;
+    }
+
+    config->flushing = 1;
+    return ERR_SUCCESS;
+}
+
+int32_t Transcoder_GetExtraData(PTranscoder config, uint8_t* ascBuffer, int32_t* pSize) {
+
+    if (!config || !config->encoder)
+        return ERR_INVALID_HANDLE;
+
+    return AacEncoder_GetExtraData(config->encoder, ascBuffer, pSize);
+}
+
+int32_t Transcoder_GetStats(PTranscoder config, PCodecStats pDecodeStats, PCodecStats pEncodeStats) {
+
+    if (!config || !config->decoder || !config->encoder)
+        return ERR_INVALID_HANDLE;
+    if (!pDecodeStats || !pEncodeStats)
+        return ERR_BUFF_HANDLE_INVALID;
+
+    *pDecodeStats = config->decoder->stats;
+    *pEncodeStats = config->encoder->stats;
+    return ERR_SUCCESS;
+}
+
+int32_t Transcoder_SetGain(PTranscoder config, float gain) {
+
+    if (!config || !config->decoder || !config->encoder)
+        return ERR_INVALID_HANDLE;
+
+    return Decoder_SetGain(config->decoder, gain);
+}
+
+int32_t Transcoder_Close(PTranscoder config) {
+
+    if (config) {
+        if (config->decoder)
+            Decoder_Close(config->decoder);
+        if (config->encoder)
+            AacEncoder_Close(config->encoder);
+        if (config->staging)
+            av_frame_free(&config->staging);
+        if (config->view)
+            av_frame_free(&config->view);
+        free(config);
+    }
+    return ERR_SUCCESS;
+}
+
+PVOID Transcoder_Open(PAacDecoderOptions decoder_options, PAacEncoderOptions encoder_options) {
+
+    intptr_t ret = 0;
+    PTranscoder ptrans = NULL;
+
+    if (!decoder_options || !encoder_options) {
+        ret = ERR_BUFF_HANDLE_INVALID;
+        goto failed;
+    }
+
+    ptrans = calloc(1, sizeof(Transcoder));
+    if (!ptrans) {
+        ret = ERR_ALLOC_FAIL;
+        goto failed;
+    }
+
+    //The decoder outputs exactly what the encoder reads.
+    AacDecoderOptions transcode_options = *decoder_options;
+    transcode_options.output_options.out_sample_rate = encoder_options->sample_rate;
+    transcode_options.output_options.out_sample_fmt = encoder_options->sample_fmt;
+    transcode_options.output_options.out_channels = encoder_options->channels;
+
+    ptrans->decoder = Decoder_OpenAac(&transcode_options);
+    if ((intptr_t)ptrans->decoder < 0) {
+        ret = (intptr_t)ptrans->decoder;
+        ptrans->decoder = NULL;
+        goto failed;
+    }
+
+    ptrans->encoder = AacEncoder_Open(encoder_options);
+    if ((intptr_t)ptrans->encoder < 0) {
+        ret = (intptr_t)ptrans->encoder;
+        ptrans->encoder = NULL;
+        goto failed;
+    }
+
+    ptrans->view = av_frame_alloc();
+    if (!ptrans->view) {
+        ret = ERR_ALLOC_FAIL;
+        goto failed;
+    }
+
+    if ((ret = alloc_staging(ptrans, TRANSCODE_STAGING_FRAMES * AAC_FRAME_SIZE)) < 0)
+        goto failed;
+
+    return ptrans;
+
+failed:
+    Transcoder_Close(ptrans);
+    return (void*)ret;
+}
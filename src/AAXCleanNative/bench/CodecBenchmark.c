@@ -0,0 +1,165 @@
+#include "AAXCleanNative.h"
+#include <math.h>
+#include <stdio.h>
+#include <time.h>
+
+/*
+* Measures AacEncoder_EncodeFrame and Decoder_DecodeFrame/Decoder_ReceiveDecodedFrame
+* throughput on two minutes of synthetic 44.1 kHz stereo audio, and the decoder's
+* cost for each output format the resampler produces. The audio is encoded once and
+* the packets are decoded repeatedly, so no input files are needed.
+*
+* Results are written to stdout as CSV, one row per measurement:
+* benchmark,codec,output,msamples_per_sec,realtime_factor
+*/
+
+#define SAMPLE_RATE 44100
+#define CHANNELS 2
+#define NB_SAMPLES (SAMPLE_RATE * 60 * 2)
+#define NB_FRAMES (NB_SAMPLES / AAC_FRAME_SIZE)
+#define ITERATIONS 3
+#define BIT_RATE 64000
+#define TWO_PI 6.283185307179586
+
+typedef struct OutputCase {
+    const char* name;
+    OutputOptions options;
+} OutputCase;
+
+static const OutputCase output_cases[] = {
+    { "fltp_44100_stereo", { SAMPLE_RATE, AV_SAMPLE_FMT_FLTP, 2 } },
+    { "flt_44100_stereo", { SAMPLE_RATE, AV_SAMPLE_FMT_FLT, 2 } },
+    { "s16_44100_stereo", { SAMPLE_RATE, AV_SAMPLE_FMT_S16, 2 } },
+    { "s16_44100_mono", { SAMPLE_RATE, AV_SAMPLE_FMT_S16, 1 } },
+    { "s16_22050_stereo", { 22050, AV_SAMPLE_FMT_S16, 2 } },
+    { "s16_22050_mono", { 22050, AV_SAMPLE_FMT_S16, 1 } },
+};
+
+static double now_seconds(void) {
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void print_result(const char* benchmark, const char* codec, const char* output, int64_t nb_samples, double seconds) {
+    double audio_seconds = (double)nb_samples / SAMPLE_RATE;
+    printf("%s,%s,%s,%.2f,%.1f\n", benchmark, codec, output, nb_samples / seconds / 1e6, audio_seconds / seconds);
+}
+
+/* Speech-like audio: a few harmonics with a syllable-rate envelope and some
+* noise, with one second of near-silence every six seconds. */
+static void generate_audio(int16_t* s16) {
+    uint32_t seed = 12345;
+    for (int64_t i = 0; i < NB_SAMPLES; i++) {
+        double t = (double)i / SAMPLE_RATE;
+        double envelope = (int64_t)t % 6 == 5 ? 0.001 : 0.3 * (0.6 + 0.4 * sin(TWO_PI * 4 * t));
+        double tone = sin(TWO_PI * 180 * t) + 0.5 * sin(TWO_PI * 360 * t) + 0.25 * sin(TWO_PI * 1100 * t);
+
+        for (int32_t c = 0; c < CHANNELS; c++) {
+            seed = seed * 1664525 + 1013904223;
+            double noise = ((int32_t)(seed >> 16) - 32768) / 32768.0 * 0.1;
+            s16[i * CHANNELS + c] = (int16_t)(envelope * (tone + noise) / 1.85 * INT16_MAX);
+        }
+    }
+}
+
+/* Encode the audio, keeping the packets of the last iteration. Returns the number
+* of packets, or a negative error code. */
+static int32_t run_encode(int16_t* s16, uint8_t* packets, int32_t* packet_sizes, uint8_t* asc, int32_t* asc_size) {
+    int32_t nb_packets = 0;
+    double start = now_seconds();
+
+    for (int32_t it = 0; it < ITERATIONS; it++) {
+        AacEncoderOptions options = { BIT_RATE, 0, SAMPLE_RATE, CHANNELS, AV_SAMPLE_FMT_S16 };
+        PAacEncoder encoder = AacEncoder_Open(&options);
+        if ((intptr_t)encoder <= 0)
+            return (int32_t)(intptr_t)encoder;
+
+        nb_packets = 0;
+        uint8_t* out = packets;
+        for (int32_t f = 0; f <= NB_FRAMES; f++) {
+            if (f < NB_FRAMES)
+                AacEncoder_EncodeFrame(encoder, (uint8_t*)(s16 + (int64_t)f * AAC_FRAME_SIZE * CHANNELS), NULL, AAC_FRAME_SIZE);
+            else
+                AacEncoder_EncodeFlush(encoder);
+
+            int32_t size;
+            while (nb_packets < NB_FRAMES + 8 && (size = AacEncoder_ReceiveEncodedFrame(encoder, NULL, 0)) > 0) {
+                AacEncoder_ReceiveEncodedFrame(encoder, out, size);
+                packet_sizes[nb_packets++] = size;
+                out += size;
+            }
+        }
+
+        AacEncoder_GetExtraData(encoder, asc, asc_size);
+        AacEncoder_Close(encoder);
+    }
+
+    print_result("encode", "aac_lc", "s16_44100_stereo", (int64_t)NB_FRAMES * AAC_FRAME_SIZE * ITERATIONS, now_seconds() - start);
+    return nb_packets;
+}
+
+static int32_t run_decode(const OutputCase* output, uint8_t* packets, int32_t* packet_sizes, int32_t nb_packets, uint8_t* asc, int32_t asc_size) {
+    //Room for one frame of the largest output format, planar or interleaved.
+    static float out0[AAC_FRAME_SIZE * 2 * CHANNELS];
+    static float out1[AAC_FRAME_SIZE * 2];
+    int64_t nb_decoded = 0;
+    double start = now_seconds();
+
+    for (int32_t it = 0; it < ITERATIONS; it++) {
+        AacDecoderOptions options = { output->options, asc_size, asc };
+        PAacDecoder decoder = Decoder_OpenAac(&options);
+        if ((intptr_t)decoder <= 0)
+            return (int32_t)(intptr_t)decoder;
+
+        uint8_t* in = packets;
+        for (int32_t p = 0; p < nb_packets; p++) {
+            int32_t ret = Decoder_DecodeFrame(decoder, in, packet_sizes[p]);
+            in += packet_sizes[p];
+            if (ret < 0) {
+                Decoder_Close(decoder);
+                return ret;
+            }
+
+            ret = Decoder_ReceiveDecodedFrame(decoder, (uint8_t*)out0, (uint8_t*)out1, AAC_FRAME_SIZE * 2);
+            if (ret > 0)
+                nb_decoded += ret;
+        }
+        Decoder_Close(decoder);
+    }
+
+    //Rates are in input samples so that every output format is comparable.
+    double seconds = now_seconds() - start;
+    print_result("decode", "aac_lc", output->name, (int64_t)nb_packets * AAC_FRAME_SIZE * ITERATIONS, seconds);
+    return nb_decoded > 0 ? 0 : ERR_AAC_DECODE_FAIL;
+}
+
+int main(void) {
+    int16_t* s16 = malloc(sizeof(int16_t) * NB_SAMPLES * CHANNELS);
+    uint8_t* packets = malloc((size_t)AAC_MAX_PACKET_SIZE(CHANNELS) * (NB_FRAMES + 8));
+    int32_t* packet_sizes = malloc(sizeof(int32_t) * (NB_FRAMES + 8));
+    uint8_t asc[64];
+    int32_t asc_size = sizeof(asc);
+    if (!s16 || !packets || !packet_sizes)
+        return 1;
+
+    generate_audio(s16);
+
+    printf("benchmark,codec,output,msamples_per_sec,realtime_factor\n");
+    int32_t nb_packets = run_encode(s16, packets, packet_sizes, asc, &asc_size);
+    if (nb_packets <= 0) {
+        fprintf(stderr, "Failed to encode audio: %d\n", nb_packets);
+        return 1;
+    }
+
+    for (size_t i = 0; i < sizeof(output_cases) / sizeof(output_cases[0]); i++) {
+        int32_t ret = run_decode(&output_cases[i], packets, packet_sizes, nb_packets, asc, asc_size);
+        if (ret < 0)
+            fprintf(stderr, "Failed to decode to %s: %d\n", output_cases[i].name, ret);
+    }
+
+    free(s16);
+    free(packets);
+    free(packet_sizes);
+    return 0;
+}
@@ -0,0 +1,94 @@
+#include "AAXCleanNative.h"
+#include <stdio.h>
+#include <time.h>
+
+/*
+* Measures Silence_Scan throughput for each instruction set supported by this
+* CPU, and Silence_ScanProfiles with four profiles, on ten minutes of synthetic
+* 44.1 kHz stereo audio that alternates between five seconds of noise and one
+* second of near-silence.
+*/
+
+#define SAMPLE_RATE 44100
+#define CHANNELS 2
+#define NB_SAMPLES (SAMPLE_RATE * 60 * 10)
+#define FRAME_SIZE 1024
+#define ITERATIONS 10
+#define NB_PROFILES 4
+
+static const char* isa_names[] = { "scalar", "avx2", "avx512", "neon" };
+
+static double now_seconds(void) {
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static double run_scan(int32_t sample_fmt, uint8_t* plane0, uint8_t* plane1, int32_t bytes_per_frame) {
+    int64_t run_starts[FRAME_SIZE * CHANNELS];
+    int64_t run_lengths[FRAME_SIZE * CHANNELS];
+    double start = now_seconds();
+
+    for (int32_t it = 0; it < ITERATIONS; it++) {
+        SilenceScanState state = { 0 };
+        for (int32_t s = 0; s + FRAME_SIZE <= NB_SAMPLES; s += FRAME_SIZE) {
+            int64_t offset = (int64_t)s / FRAME_SIZE * bytes_per_frame;
+            Silence_Scan(&state, plane0 + offset, plane1 ? plane1 + offset : NULL, FRAME_SIZE, CHANNELS, sample_fmt, 0.001, SAMPLE_RATE / 2, run_starts, run_lengths, FRAME_SIZE * CHANNELS);
+        }
+    }
+    return (double)NB_SAMPLES * CHANNELS * ITERATIONS / (now_seconds() - start) / 1e6;
+}
+
+static double run_scan_profiles(int16_t* s16) {
+    static int32_t run_profiles[FRAME_SIZE * CHANNELS * NB_PROFILES];
+    static int64_t run_starts[FRAME_SIZE * CHANNELS * NB_PROFILES];
+    static int64_t run_lengths[FRAME_SIZE * CHANNELS * NB_PROFILES];
+    const double thresholds[NB_PROFILES] = { 0.0005, 0.001, 0.01, 0.03 };
+    const int64_t min_run_lengths[NB_PROFILES] = { SAMPLE_RATE, SAMPLE_RATE / 2, SAMPLE_RATE / 2, SAMPLE_RATE / 4 };
+    double start = now_seconds();
+
+    for (int32_t it = 0; it < ITERATIONS; it++) {
+        SilenceScanState states[NB_PROFILES] = { 0 };
+        for (int32_t s = 0; s + FRAME_SIZE <= NB_SAMPLES; s += FRAME_SIZE) {
+            Silence_ScanProfiles(states, NB_PROFILES, thresholds, min_run_lengths, (uint8_t*)(s16 + (int64_t)s * CHANNELS), NULL, FRAME_SIZE, CHANNELS, AV_SAMPLE_FMT_S16, run_profiles, run_starts, run_lengths, FRAME_SIZE * CHANNELS * NB_PROFILES);
+        }
+    }
+    return (double)NB_SAMPLES * CHANNELS * ITERATIONS / (now_seconds() - start) / 1e6;
+}
+
+int main(void) {
+    int16_t* s16 = malloc(sizeof(int16_t) * NB_SAMPLES * CHANNELS);
+    float* flt = malloc(sizeof(float) * NB_SAMPLES * CHANNELS);
+    float* fltp0 = malloc(sizeof(float) * NB_SAMPLES);
+    float* fltp1 = malloc(sizeof(float) * NB_SAMPLES);
+    if (!s16 || !flt || !fltp0 || !fltp1)
+        return 1;
+
+    uint32_t seed = 12345;
+    for (int64_t i = 0; i < (int64_t)NB_SAMPLES * CHANNELS; i++) {
+        seed = seed * 1664525 + 1013904223;
+        int32_t quiet = (i / CHANNELS / SAMPLE_RATE) % 6 == 5;
+        float sample = ((int32_t)(seed >> 16) - 32768) / 32768.0f * (quiet ? 0.0005f : 0.5f);
+        s16[i] = (int16_t)(sample * INT16_MAX);
+        flt[i] = sample;
+        (i % CHANNELS ? fltp1 : fltp0)[i / CHANNELS] = sample;
+    }
+
+    printf("%-8s %12s %12s %12s %12s\n", "isa", "s16 MS/s", "flt MS/s", "fltp MS/s", "s16x4 MS/s");
+    for (int32_t isa = SILENCE_ISA_SCALAR; isa <= SILENCE_ISA_NEON; isa++) {
+        if (Silence_SetIsa(isa) != isa)
+            continue;
+
+        double s16_rate = run_scan(AV_SAMPLE_FMT_S16, (uint8_t*)s16, NULL, FRAME_SIZE * CHANNELS * sizeof(int16_t));
+        double flt_rate = run_scan(AV_SAMPLE_FMT_FLT, (uint8_t*)flt, NULL, FRAME_SIZE * CHANNELS * sizeof(float));
+        double fltp_rate = run_scan(AV_SAMPLE_FMT_FLTP, (uint8_t*)fltp0, (uint8_t*)fltp1, FRAME_SIZE * sizeof(float));
+        double profiles_rate = run_scan_profiles(s16);
+        printf("%-8s %12.1f %12.1f %12.1f %12.1f\n", isa_names[isa], s16_rate, flt_rate, fltp_rate, profiles_rate);
+    }
+
+    free(s16);
+    free(flt);
+    free(fltp0);
+    free(fltp1);
+    return 0;
+}
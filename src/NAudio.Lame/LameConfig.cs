@@ -113,6 +113,9 @@ namespace NAudio.Lame
 
 		/// <summary>Use free format.</summary>
 		public bool? UseFreeFormat { get; set; }
+
+		/// <summary>Disable the bit reservoir so that every frame can be decoded independently of its neighbours.</summary>
+		public bool? DisableReservoir { get; set; }
 		#endregion
 
 		#region Frame Parameters
@@ -134,6 +137,9 @@ namespace NAudio.Lame
 		public ID3TagData? ID3 { get; set; }
 		#endregion
 
+		/// <summary>Create a shallow copy of this configuration.</summary>
+		public LameConfig Clone() => (LameConfig)MemberwiseClone();
+
 		#region DLL initialisation
 		/// <summary>Create <see cref="LibMp3Lame"/> and configure it.</summary>
 		/// <returns></returns>
@@ -193,6 +199,7 @@ namespace NAudio.Lame
 			if (Mode != null) result.Mode = (LameDLLWrap.MPEGMode)Mode.Value;
 			if (ForceMS != null) result.ForceMS = ForceMS.Value;
 			if (UseFreeFormat != null) result.UseFreeFormat = UseFreeFormat.Value;
+			if (DisableReservoir != null) result.DisableReservoir = DisableReservoir.Value;
 
 			// Frame Parameters
 			if (Copyright != null) result.Copyright = Copyright.Value;
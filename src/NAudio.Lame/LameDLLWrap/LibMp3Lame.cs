@@ -410,6 +410,22 @@ namespace LameDLLWrap
 			return rc;
 		}
 
+		/// <summary>Write planar 32-bit floating point PCM samples to encoder without copying them</summary>
+		/// <param name="left">Left channel samples, scaled to +/- 1.0.</param>
+		/// <param name="right">Right channel samples, scaled to +/- 1.0.  Pass the left channel again for mono.</param>
+		/// <param name="output">Buffer to write encoded data to</param>
+		/// <param name="outputSize">Size of buffer.</param>
+		/// <returns>Number of bytes of encoded data written to output buffer.</returns>
+		public unsafe int Write(ReadOnlySpan<float> left, ReadOnlySpan<float> right, byte[] output, int outputSize)
+		{
+			fixed (float* pLeft = left)
+			fixed (float* pRight = right)
+			fixed (byte* pOutput = output)
+			{
+				return NativeMethods.lame_encode_buffer_ieee_float(context, pLeft, pRight, left.Length, pOutput, outputSize);
+			}
+		}
+
 		/// <summary>Flush encoder output</summary>
 		/// <param name="output">Buffer to write encoded data to</param>
 		/// <param name="outputSize">Size of buffer.</param>
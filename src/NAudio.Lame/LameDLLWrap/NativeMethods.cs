@@ -896,6 +896,15 @@ namespace LameDLLWrap
 				int mp3buf_size
 			);
 
+		[DllImport(libname, CallingConvention = CallingConvention.Cdecl)]
+		internal static extern unsafe int lame_encode_buffer_ieee_float(IntPtr context,
+				float* pcm_l,
+				float* pcm_r,
+				int nSamples,
+				byte* mp3buf,
+				int mp3buf_size
+			);
+
 		// int CDECL lame_encode_buffer_interleaved_ieee_float(
 		//		lame_t          gfp,
 		//		const float     pcm[],             /* PCM data for left and right channel, interleaved */
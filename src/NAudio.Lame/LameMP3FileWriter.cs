@@ -284,6 +284,49 @@ namespace NAudio.Lame
 			}
 		}
 
+		/// <summary>Send planar samples straight to the encoder, bypassing the input buffer</summary>
+		/// <param name="left">Left channel samples, or the only channel for mono input</param>
+		/// <param name="right">Right channel samples.  Ignored for mono input.</param>
+		/// <remarks>Requires a 32-bit IeeeFloat input format with samples scaled to +/- 1.0.</remarks>
+		public void WritePlanar(ReadOnlySpan<float> left, ReadOnlySpan<float> right)
+		{
+			if (_inputFormat.Encoding != WaveFormatEncoding.IeeeFloat)
+				throw new InvalidOperationException($"Planar samples require an {WaveFormatEncoding.IeeeFloat} input format.");
+			if (_inputFormat.Channels == 1)
+				right = left;
+			else if (right.Length != left.Length)
+				throw new ArgumentException("Both channels must have the same number of samples.", nameof(right));
+
+			lock (lockObj)
+			{
+				if (_outStream == null || _lame == null)
+					throw new InvalidOperationException("Output stream closed.");
+
+				// keep samples from Write in order
+				if (inPosition > 0)
+					Encode();
+
+				// output buffer is sized for one second of input
+				while (!left.IsEmpty)
+				{
+					int nSamples = Math.Min(left.Length, _inputFormat.SampleRate);
+					int rc = _lame.Write(left[..nSamples], right[..nSamples], _outBuffer, _outBuffer.Length);
+
+					if (rc > 0)
+					{
+						_outStream.Write(_outBuffer, 0, rc);
+						_outputByteCount += rc;
+					}
+
+					_inputByteCount += nSamples * _inputFormat.BlockAlign;
+					left = left[nSamples..];
+					right = right[nSamples..];
+				}
+			}
+
+			RaiseProgress(false);
+		}
+
 		private readonly object lockObj = new();
 		private bool isFlushed = false;
 
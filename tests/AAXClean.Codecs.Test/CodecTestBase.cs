@@ -1,9 +1,17 @@
+using AAXClean.Codecs.FrameFilters.Audio;
+using AAXClean.Codecs.Interop;
 using Microsoft.VisualStudio.TestTools.UnitTesting;
+using Mpeg4Lib;
 using System;
+using System.Buffers.Binary;
 using System.Collections.Generic;
+using System.Diagnostics;
+using System.Diagnostics.Metrics;
 using System.IO;
 using System.Linq;
 using System.Security.Cryptography;
+using System.Text;
+using System.Threading;
 using System.Threading.Tasks;
 
 namespace AAXClean.Codecs.Test
@@ -69,6 +77,235 @@ namespace AAXClean.Codecs.Test
 			}
 		}
 
+		[TestMethod]
+		public async Task _0_SilenceDetectionFast()
+		{
+			try
+			{
+				List<SilenceEntry> silences = await Aax.DetectSilenceFastAsync(SilenceThreshold, SilenceDuration);
+
+				//Decoded regions restart the decoder, so boundaries may move by up to a frame.
+				TimeSpan tolerance = TimeSpan.FromSeconds(1024d / (int)Aax.SampleRate);
+				Assert.AreEqual(SilenceTimes.Count, silences.Count);
+
+				for (int i = 0; i < silences.Count; i++)
+				{
+					Assert.IsTrue((SilenceTimes[i].start - silences[i].SilenceStart).Duration() <= tolerance, $"Silence {i} start");
+					Assert.IsTrue((SilenceTimes[i].end - silences[i].SilenceEnd).Duration() <= tolerance, $"Silence {i} end");
+				}
+			}
+			catch (Exception ex)
+			{
+				Assert.Fail($"Fast silence detection failed: {ex.Message}");
+			}
+			finally
+			{
+				Aax.InputStream.Close();
+			}
+		}
+
+		[TestMethod]
+		public async Task _0_SilenceDetectionProfiles()
+		{
+			try
+			{
+				//The stricter profile's silences must each lie inside one of the looser profile's.
+				var profiles = new (double, TimeSpan)[] { (SilenceThreshold - 10, SilenceDuration * 2), (SilenceThreshold, SilenceDuration) };
+				List<SilenceEntry>[] results = await Aax.DetectSilenceAsync(profiles);
+
+				Assert.AreEqual(2, results.Length);
+				Assert.AreEqual(SilenceTimes.Count, results[1].Count);
+				for (int i = 0; i < results[1].Count; i++)
+				{
+					Assert.AreEqual(SilenceTimes[i].start, results[1][i].SilenceStart);
+					Assert.AreEqual(SilenceTimes[i].end, results[1][i].SilenceEnd);
+				}
+
+				foreach (var strict in results[0])
+					Assert.IsTrue(results[1].Any(s => s.SilenceStart <= strict.SilenceStart && s.SilenceEnd >= strict.SilenceEnd), $"{strict} not inside a looser silence");
+			}
+			catch (Exception ex)
+			{
+				Assert.Fail($"Multi-profile silence detection failed: {ex.Message}");
+			}
+			finally
+			{
+				Aax.InputStream.Close();
+			}
+		}
+
+		[TestMethod]
+		public async Task _0_SilenceDetectionCached()
+		{
+			string cacheDir = Path.Combine(Path.GetTempPath(), Path.GetRandomFileName());
+			try
+			{
+				//The first pass decodes everything and builds the envelope. The second decodes only around the silences.
+				DecodeCache cache = new(cacheDir, 64 * 1024 * 1024, cachePcm: false);
+				for (int pass = 0; pass < 2; pass++)
+				{
+					AaxFile aax = new(File.Open(AaxFile, FileMode.Open, FileAccess.Read, FileShare.Read));
+					aax.SetDecryptionKey(new byte[16], new byte[16]);
+					try
+					{
+						List<SilenceEntry> silences = await aax.DetectSilenceAsync(SilenceThreshold, SilenceDuration, decodeCache: cache);
+
+						Assert.AreEqual(1, Directory.GetFiles(cacheDir).Length);
+						Assert.AreEqual(SilenceTimes.Count, silences.Count);
+						for (int i = 0; i < silences.Count; i++)
+						{
+							Assert.AreEqual(SilenceTimes[i].start, silences[i].SilenceStart);
+							Assert.AreEqual(SilenceTimes[i].end, silences[i].SilenceEnd);
+						}
+					}
+					finally
+					{
+						aax.InputStream.Close();
+					}
+				}
+			}
+			catch (Exception ex)
+			{
+				Assert.Fail($"Cached silence detection failed: {ex.Message}");
+			}
+			finally
+			{
+				Directory.Delete(cacheDir, true);
+			}
+		}
+
+		[TestMethod]
+		public void _0_DecodeCacheCommitConflict()
+		{
+			string cacheDir = Path.Combine(Path.GetTempPath(), Path.GetRandomFileName());
+			try
+			{
+				DecodeCache cache = new(cacheDir, 64 * 1024 * 1024);
+				string tempPath = Path.Combine(cacheDir, "entry.tmp");
+				string path = Path.Combine(cacheDir, "entry" + DecodeCache.EXTENSION);
+				File.WriteAllBytes(tempPath, new byte[16]);
+
+				//A directory can't be replaced by a file, the way a mapped entry can't be replaced on Windows.
+				Directory.CreateDirectory(path);
+				cache.Commit(tempPath, path);
+
+				Assert.IsFalse(File.Exists(tempPath), "The entry that couldn't be committed should be discarded.");
+				Assert.IsTrue(Directory.Exists(path), "The existing entry should be kept.");
+			}
+			finally
+			{
+				Directory.Delete(cacheDir, true);
+			}
+		}
+
+		[TestMethod]
+		public async Task _0_SilenceDetectionPooledDecoder()
+		{
+			//The second pass rents the decoder the first pass returned to the pool, after it was reset.
+			for (int pass = 0; pass < 2; pass++)
+			{
+				AaxFile aax = new(File.Open(AaxFile, FileMode.Open, FileAccess.Read, FileShare.Read));
+				aax.SetDecryptionKey(new byte[16], new byte[16]);
+				try
+				{
+					List<SilenceEntry> silences = await aax.DetectSilenceAsync(SilenceThreshold, SilenceDuration);
+
+					Assert.AreEqual(SilenceTimes.Count, silences.Count, $"Pass {pass}");
+					for (int i = 0; i < silences.Count; i++)
+					{
+						Assert.AreEqual(SilenceTimes[i].start, silences[i].SilenceStart, $"Pass {pass}");
+						Assert.AreEqual(SilenceTimes[i].end, silences[i].SilenceEnd, $"Pass {pass}");
+					}
+				}
+				finally
+				{
+					aax.InputStream.Close();
+				}
+			}
+		}
+
+		[TestMethod]
+		public unsafe void _0_SilenceScanIsaParity()
+		{
+			const double threshold = 0.01;
+			const long minRunLength = 3;
+			//Lengths that leave a remainder after every kernel's vector width.
+			int[] lengths = [1, 7, 15, 33, 257, 1021, 4099];
+			var random = new Random(6);
+			var originalIsa = NativeSilence.Isa;
+
+			List<long> scan(byte[] plane0, byte[]? plane1, int length, int channels, WaveFormatEncoding encoding)
+			{
+				var state = new NativeSilence.SilenceScanState();
+				int maxRuns = (int)(length * channels / (minRunLength + 1) + 1);
+				var runStarts = new long[maxRuns];
+				var runLengths = new long[maxRuns];
+				int nbRuns;
+				fixed (byte* p0 = plane0)
+				fixed (byte* p1 = plane1)
+				fixed (long* pStarts = runStarts)
+				fixed (long* pLengths = runLengths)
+					nbRuns = NativeSilence.Scan(ref state, p0, p1, length, channels, (NAudio.Wave.WaveFormatEncoding)encoding, threshold, minRunLength, pStarts, pLengths, maxRuns);
+
+				//Compare the run still open at the end too.
+				var result = new List<long> { state.position, state.run_start, state.run_length };
+				for (int i = 0; i < nbRuns; i++)
+				{
+					result.Add(runStarts[i]);
+					result.Add(runLengths[i]);
+				}
+				return result;
+			}
+
+			try
+			{
+				foreach (var encoding in new[] { WaveFormatEncoding.Pcm, WaveFormatEncoding.Float, WaveFormatEncoding.FloatPlanar })
+				foreach (int channels in new[] { 1, 2 })
+				foreach (int length in lengths)
+				{
+					//Runs of quiet and loud samples of random lengths, with values just either side of the threshold.
+					bool planar = encoding is WaveFormatEncoding.FloatPlanar && channels == 2;
+					int bytesPerSample = encoding is WaveFormatEncoding.Pcm ? sizeof(short) : sizeof(float);
+					var samples = new double[length * channels];
+					for (int i = 0; i < samples.Length;)
+					{
+						bool quiet = random.Next(2) == 0;
+						for (int end = Math.Min(samples.Length, i + random.Next(1, 40)); i < end; i++)
+						{
+							double magnitude = quiet ? random.NextDouble() * threshold * 0.99 : threshold * 1.01 + random.NextDouble() * (1 - threshold * 1.01);
+							samples[i] = random.Next(2) == 0 ? magnitude : -magnitude;
+						}
+					}
+
+					byte[] plane0 = new byte[(planar ? length : samples.Length) * bytesPerSample];
+					byte[]? plane1 = planar ? new byte[length * bytesPerSample] : null;
+					for (int i = 0; i < samples.Length; i++)
+					{
+						var (plane, index) = planar ? (i % 2 == 0 ? plane0 : plane1!, i / 2) : (plane0, i);
+						if (encoding is WaveFormatEncoding.Pcm)
+							BitConverter.TryWriteBytes(plane.AsSpan(index * bytesPerSample), (short)(samples[i] * short.MaxValue));
+						else
+							BitConverter.TryWriteBytes(plane.AsSpan(index * bytesPerSample), (float)samples[i]);
+					}
+
+					NativeSilence.Isa = SilenceIsa.Scalar;
+					var expected = scan(plane0, plane1, length, channels, encoding);
+
+					foreach (var isa in Enum.GetValues<SilenceIsa>())
+					{
+						try { NativeSilence.Isa = isa; }
+						catch (PlatformNotSupportedException) { continue; }
+
+						CollectionAssert.AreEqual(expected, scan(plane0, plane1, length, channels, encoding), $"{isa} {encoding} {channels} channel {length} samples");
+					}
+				}
+			}
+			finally
+			{
+				NativeSilence.Isa = originalIsa;
+			}
+		}
+
 		[TestMethod]
 		public async Task _1_ConvertMp3Single()
 		{
@@ -96,6 +333,112 @@ namespace AAXClean.Codecs.Test
 			}
 		}
 
+		[TestMethod]
+		public async Task _1_ConvertMp3Parallel()
+		{
+			try
+			{
+				FileStream tempfile = TestFiles.NewTempFile();
+				await Aax.ConvertToMp3Async(tempfile, new NAudio.Lame.LameConfig { Preset = NAudio.Lame.LAMEPreset.STANDARD_FAST, Mode = NAudio.Lame.MPEGMode.Mono }, degreeOfParallelism: 4);
+
+				byte[] mp3 = File.ReadAllBytes(tempfile.Name);
+				int position = 10 + ((mp3[6] & 0x7f) << 21 | (mp3[7] & 0x7f) << 14 | (mp3[8] & 0x7f) << 7 | mp3[9] & 0x7f);
+
+				//The stitched stream carries one Xing/LAME tag describing the whole encode.
+				int sampleRate = new[] { 44100, 48000, 32000 }[(mp3[position + 2] >> 2) & 3] >> (((mp3[position + 1] >> 3) & 3) == 3 ? 0 : 1);
+				int samplesPerFrame = sampleRate >= 32000 ? 1152 : 576;
+				int xing = position + 4 + (((mp3[position + 1] >> 3) & 3) == 3 ? 17 : 9);
+				Assert.AreEqual("Xing", Encoding.ASCII.GetString(mp3, xing, 4));
+
+				int frames = mp3[xing + 8] << 24 | mp3[xing + 9] << 16 | mp3[xing + 10] << 8 | mp3[xing + 11];
+				int lame = xing + 8 + 4 + 4 + 100 + 4;
+				int delay = mp3[lame + 21] << 4 | mp3[lame + 22] >> 4;
+				int padding = (mp3[lame + 22] & 0xf) << 8 | mp3[lame + 23];
+				Assert.AreEqual(576, delay);
+
+				double gaplessSeconds = ((double)frames * samplesPerFrame - delay - padding) / sampleRate;
+				Assert.AreEqual(Aax.Duration.TotalSeconds, gaplessSeconds, 2d * samplesPerFrame / sampleRate);
+
+				//The totals were rewritten after stitching, so they must describe the frames actually written.
+				int[] bitrates = ((mp3[position + 1] >> 3) & 3) == 3
+					? [0, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320]
+					: [0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160];
+				int frameLength(int frame) => samplesPerFrame / 8 * 1000 * bitrates[mp3[frame + 2] >> 4] / sampleRate + ((mp3[frame + 2] >> 1) & 1);
+
+				int end = mp3.Length >= 128 && Encoding.ASCII.GetString(mp3, mp3.Length - 128, 3) == "TAG" ? mp3.Length - 128 : mp3.Length;
+				int tagLength = frameLength(position);
+				int audioFrames = 0;
+				for (int frame = position + tagLength; frame < end; frame += frameLength(frame))
+				{
+					Assert.AreEqual(0xff, mp3[frame], $"Lost frame sync at byte {frame}.");
+					audioFrames++;
+				}
+
+				uint streamBytes = (uint)(end - position);
+				Assert.AreEqual(audioFrames, frames);
+				Assert.AreEqual(streamBytes, BinaryPrimitives.ReadUInt32BigEndian(mp3.AsSpan(xing + 12)));
+				Assert.AreEqual(streamBytes, BinaryPrimitives.ReadUInt32BigEndian(mp3.AsSpan(lame + 28)));
+			}
+			finally
+			{
+				TestFiles.CloseAllFiles();
+				Aax.InputStream.Close();
+			}
+		}
+
+		[TestMethod]
+		public void _1_Mp3PlanarFeedMatchesInterleaved()
+		{
+			const int sampleRate = 44100;
+			const int sampleCount = 3 * sampleRate + 123;
+			const int writeSize = 1000;
+
+			foreach (int channels in new[] { 1, 2 })
+			{
+				var random = new Random(5);
+				float[] left = new float[sampleCount];
+				float[] right = new float[sampleCount];
+				for (int i = 0; i < sampleCount; i++)
+				{
+					left[i] = 0.5f * MathF.Sin(2 * MathF.PI * 440 * i / sampleRate) + 0.01f * (random.NextSingle() - 0.5f);
+					right[i] = 0.5f * MathF.Sin(2 * MathF.PI * 660 * i / sampleRate) + 0.01f * (random.NextSingle() - 0.5f);
+				}
+
+				float[] interleaved = channels == 1 ? left : Enumerable.Range(0, 2 * sampleCount).Select(i => i % 2 == 0 ? left[i / 2] : right[i / 2]).ToArray();
+				byte[] interleavedBytes = new byte[interleaved.Length * sizeof(float)];
+				Buffer.BlockCopy(interleaved, 0, interleavedBytes, 0, interleavedBytes.Length);
+
+				var waveFormat = NAudio.Wave.WaveFormat.CreateIeeeFloatWaveFormat(sampleRate, channels);
+				byte[] encode(Action<NAudio.Lame.LameMP3FileWriter> write)
+				{
+					var output = new MemoryStream();
+					var lameConfig = new NAudio.Lame.LameConfig { Preset = NAudio.Lame.LAMEPreset.STANDARD_FAST, Mode = channels == 2 ? NAudio.Lame.MPEGMode.JointStereo : NAudio.Lame.MPEGMode.Mono };
+					using (var writer = new NAudio.Lame.LameMP3FileWriter(output, waveFormat, lameConfig))
+					{
+						write(writer);
+						writer.Flush();
+					}
+					return output.ToArray();
+				}
+
+				var expected = encode(writer =>
+				{
+					for (int start = 0; start < sampleCount; start += writeSize)
+						writer.Write(interleavedBytes, start * waveFormat.BlockAlign, Math.Min(writeSize, sampleCount - start) * waveFormat.BlockAlign);
+				});
+				var actual = encode(writer =>
+				{
+					for (int start = 0; start < sampleCount; start += writeSize)
+					{
+						int count = Math.Min(writeSize, sampleCount - start);
+						writer.WritePlanar(left.AsSpan(start, count), right.AsSpan(start, count));
+					}
+				});
+
+				CollectionAssert.AreEqual(expected, actual, $"Planar and interleaved {channels} channel MP3s differ.");
+			}
+		}
+
 		[TestMethod]
 		public async Task _2_ConvertMp3SingleIndirect()
 		{
@@ -162,19 +505,156 @@ namespace AAXClean.Codecs.Test
 			}
 		}
 		[TestMethod]
-		public async Task _5_ConvertMp4ReencodeMultiple()
+		public unsafe void _4_AacEncodeBatchPacketTable()
+		{
+			const int maxPackets = 3;
+			const int totalSamples = 20 * 1024 + 300;
+			var waveFormat = new WaveFormat(SampleRate.Hz_44100, WaveFormatEncoding.Pcm, stereo: true);
+			int blockAlign = waveFormat.BlockAlign;
+
+			//Noise, so that packet sizes vary.
+			byte[] pcm = new byte[totalSamples * blockAlign];
+			new Random(4).NextBytes(pcm);
+
+			//Reference packets from the one-packet-at-a-time API.
+			List<byte[]> expected = new();
+			using (var encoder = new NativeAacEncode(waveFormat, 64000, 0))
+			fixed (byte* pPcm = pcm)
+			{
+				void receive()
+				{
+					int size;
+					while ((size = encoder.ReceiveEncodedFrame(null, 0)) > 0)
+					{
+						byte[] packet = new byte[size];
+						fixed (byte* pPacket = packet)
+							Assert.AreEqual(0, encoder.ReceiveEncodedFrame(pPacket, size));
+						expected.Add(packet);
+					}
+					Assert.AreEqual(0, size);
+				}
+
+				for (int sent = 0; sent < totalSamples; sent += 1024)
+				{
+					int ret = encoder.EncodeFrame(pPcm + sent * blockAlign, null, Math.Min(1024, totalSamples - sent));
+					Assert.IsTrue(ret >= 0);
+					if (ret == 0)
+						receive();
+				}
+				Assert.AreEqual(0, encoder.EncodeFlush());
+				receive();
+			}
+
+			//The batch API with a table too small for all of a request's packets.
+			List<byte[]> actual = new();
+			byte[] packets = new byte[maxPackets * 768 * waveFormat.Channels + 100];
+			int[] packetSizes = new int[maxPackets];
+			using (var encoder = new NativeAacEncode(waveFormat, 64000, 0))
+			fixed (byte* pPcm = pcm)
+			fixed (byte* pPackets = packets)
+			fixed (int* pPacketSizes = packetSizes)
+			{
+				int nbPackets;
+				void collect(int count)
+				{
+					Assert.IsLessThan(maxPackets + 1, count);
+					int offset = 0;
+					for (int i = 0; i < count; i++)
+					{
+						Assert.IsGreaterThan(0, packetSizes[i]);
+						actual.Add(packets.AsSpan(offset, packetSizes[i]).ToArray());
+						offset += packetSizes[i];
+					}
+					Assert.IsLessThan(packets.Length + 1, offset);
+				}
+
+				int consumed = 0;
+				while (consumed < totalSamples)
+				{
+					//Requests that straddle frame boundaries.
+					int ret = encoder.EncodeBatch(pPcm + consumed * blockAlign, null, Math.Min(5000, totalSamples - consumed), pPackets, packets.Length, pPacketSizes, maxPackets, &nbPackets);
+					Assert.IsTrue(ret >= 0);
+					Assert.IsTrue(ret > 0 || nbPackets > 0, "EncodeBatch made no progress.");
+					collect(nbPackets);
+					consumed += ret;
+				}
+
+				Assert.AreEqual(0, encoder.EncodeFlush());
+				do
+				{
+					Assert.AreEqual(0, encoder.EncodeBatch(null, null, 0, pPackets, packets.Length, pPacketSizes, maxPackets, &nbPackets));
+					collect(nbPackets);
+				} while (nbPackets > 0);
+			}
+
+			Assert.AreEqual(expected.Count, actual.Count);
+			for (int i = 0; i < expected.Count; i++)
+				CollectionAssert.AreEqual(expected[i], actual[i], $"Packet {i} differs.");
+		}
+
+		[TestMethod]
+		public async Task _4_ConvertMp4ReencodeSingleParallel()
 		{
 			try
 			{
-				List<string> tempFiles = new();
-				void NewSplit(INewSplitCallback callback)
+				FileStream tempfile = TestFiles.NewTempFile();
+				var options = new AacEncodingOptions
 				{
-					callback.OutputFile = TestFiles.NewTempFile();
-					tempFiles.Add(((FileStream)callback.OutputFile).Name);
+					BitRate = 30000,
+					Stereo = false,
+					SampleRate = SampleRate.Hz_16000
+				};
+				var chapters = Aax.GetChaptersFromMetadata();
+				await Aax.ConvertToMp4aAsync(tempfile, options, chapters, degreeOfParallelism: 4);
+				tempfile.Close();
+				AssertMatchesSourceDuration(tempfile.Name, (int)SampleRate.Hz_16000);
+
+				var encoded = new Mp4File(tempfile.Name);
+				var encodedChapters = encoded.GetChaptersFromMetadata().ToList();
+				Assert.HasCount(chapters.Count, encodedChapters);
+				foreach (var (expected, actual) in chapters.Zip(encodedChapters))
+					Assert.IsLessThan(1024d / (int)SampleRate.Hz_16000, Math.Abs((actual.StartOffset - expected.StartOffset).TotalSeconds), $"Chapter at {expected.StartOffset} moved to {actual.StartOffset}.");
+
+				//Each 30 s segment is encoded on its own. Find how far the encode lags the source,
+				//then check that it lags by the same amount after every seam. A frame dropped or
+				//repeated at a seam would put the audio after it a whole frame out of step.
+				const int frameSamples = 1024;
+				const int segmentSamples = 16000 * 30 / frameSamples * frameSamples;
+				const int window = 4 * frameSamples;
+				const int maxLag = 4 * frameSamples;
+				long totalSamples = (long)(Aax.Duration.TotalSeconds * 16000);
+				long[] starts = [5 * 16000, .. Enumerable.Range(1, (int)((totalSamples - window - frameSamples) / segmentSamples)).Select(i => (long)i * segmentSamples + frameSamples / 4)];
+
+				var sourceWindows = await ReadWindowsAsync(Aax, starts, 0, window);
+				var encodedWindows = await ReadWindowsAsync(encoded, starts, maxLag, window);
+				encoded.InputStream.Close();
+
+				double error(int index, int lag)
+				{
+					double sum = 0;
+					for (int i = 0; i < window; i++)
+					{
+						double difference = sourceWindows[index][i] - encodedWindows[index][maxLag + lag + i];
+						sum += difference * difference;
+					}
+					return sum;
 				}
 
-				await Aax.ConvertToMultiMp4aAsync(Aax.GetChaptersFromMetadata(), NewSplit, new AacEncodingOptions { BitRate = 30000, EncoderQuality = 0.6, Stereo = false, SampleRate = SampleRate.Hz_16000 });
-				Assert.HasCount(ChapterCount, tempFiles);
+				int encoderLag = Enumerable.Range(-maxLag, 2 * maxLag + 1).MinBy(lag => error(0, lag));
+				for (int i = 1; i < starts.Length; i++)
+				{
+					//Silence looks the same at any lag.
+					if (sourceWindows[i].Sum(x => (double)x * x) < window * 1e-5)
+						continue;
+
+					double aligned = error(i, encoderLag);
+					foreach (int slip in new[] { -2, -1, 1, 2 })
+					{
+						int lag = encoderLag + slip * frameSamples;
+						if (Math.Abs(lag) <= maxLag)
+							Assert.IsLessThan(error(i, lag), aligned, $"Audio after the seam at sample {starts[i]} is {slip} frames out of step.");
+					}
+				}
 			}
 			finally
 			{
@@ -182,60 +662,1000 @@ namespace AAXClean.Codecs.Test
 				Aax.InputStream.Close();
 			}
 		}
+		/// <summary>
+		/// Decode a file to 16 kHz mono and keep the audio from <paramref name="margin"/> samples before each
+		/// of <paramref name="starts"/>, which must be in order, to <paramref name="margin"/> samples after <paramref name="length"/>.
+		/// </summary>
+		private static async Task<float[][]> ReadWindowsAsync(Mp4File file, long[] starts, int margin, int length)
+		{
+			var windows = starts.Select(_ => new float[length + 2 * margin]).ToArray();
+			long position = 0;
+			int next = 0;
+			await foreach (var block in file.ReadPcmAsync<float>(SampleRate.Hz_16000, stereo: false))
+			{
+				var samples = block.Span;
+				while (next < starts.Length && starts[next] + length + margin <= position)
+					next++;
+
+				for (int i = next; i < starts.Length && starts[i] - margin < position + samples.Length; i++)
+				{
+					long first = Math.Max(starts[i] - margin, position);
+					long last = Math.Min(starts[i] + length + margin, position + samples.Length);
+					if (first < last)
+						samples.Slice((int)(first - position), (int)(last - first)).CopyTo(windows[i].AsSpan((int)(first - starts[i] + margin)));
+				}
+				position += samples.Length;
+			}
+			return windows;
+		}
+
+		/// <summary> Run a conversion, counting the frames decoded and how many of them were resampled. </summary>
+		private static async Task<(long decoded, long resampled)> CountDecodedFramesAsync(Func<Task> convert)
+		{
+			long decoded = 0, resampled = 0;
+			using MeterListener listener = new();
+			listener.InstrumentPublished = (instrument, l) =>
+			{
+				//Codec totals are only published while the frame counter is listened to.
+				if (instrument.Meter.Name == CodecMetrics.MeterName && instrument.Name is "aaxclean.codec.frames" or "aaxclean.codec.resampled")
+					l.EnableMeasurementEvents(instrument);
+			};
+			listener.SetMeasurementEventCallback<long>((instrument, value, tags, _) =>
+			{
+				string key = instrument.Name;
+				foreach (var tag in tags)
+					key += $";{tag.Value}";
+				if (key == "aaxclean.codec.resampled;decode")
+					Interlocked.Add(ref resampled, value);
+				else if (key == "aaxclean.codec.frames;decode;out")
+					Interlocked.Add(ref decoded, value);
+			});
+			listener.Start();
+
+			await convert();
+			return (Interlocked.Read(ref decoded), Interlocked.Read(ref resampled));
+		}
+
+		/// <summary> Assert that an encoded file is as long as the source, give or take the encoder's priming and final frames. </summary>
+		private void AssertMatchesSourceDuration(string file, int sampleRate)
+		{
+			var encoded = new Mp4File(file);
+			var duration = encoded.Duration;
+			encoded.InputStream.Close();
+			Assert.IsLessThan(2 * 1024d / sampleRate, Math.Abs((duration - Aax.Duration).TotalSeconds), $"Encoded duration {duration} differs from source duration {Aax.Duration}.");
+		}
+
 		[TestMethod]
-		public async Task _6_TestCancelSingleMp3()
+		public async Task _4_ConvertMp4ReencodeSingleFastResample()
 		{
-			var aaxFile = Aax;
 			try
 			{
 				FileStream tempfile = TestFiles.NewTempFile();
+				var options = new AacEncodingOptions
+				{
+					BitRate = 30000,
+					Stereo = false,
+					SampleRate = SampleRate.Hz_16000,
+					ResampleQuality = ResampleQuality.Fast
+				};
+				var (decoded, resampled) = await CountDecodedFramesAsync(async () => await Aax.ConvertToMp4aAsync(tempfile, options));
+				tempfile.Close();
+				Assert.IsGreaterThan(0, decoded);
+				Assert.AreEqual(decoded, resampled, "Every frame must be resampled to reach 16 kHz.");
 
-				var convertTask = aaxFile.ConvertToMp3Async(tempfile);
-				convertTask.Start();
+				//A shorter filter changes the resampler's delay, not the number of samples it produces.
+				AssertMatchesSourceDuration(tempfile.Name, (int)SampleRate.Hz_16000);
 
-				await Task.Delay(100);
-				await convertTask.CancelAsync();
-				await convertTask;
-				Assert.IsTrue(convertTask.IsCanceled);
+				//The preset must reach the resampler, so the same clip at default quality comes out differently.
+				async Task<float[]> encodeClip(ResampleQuality quality)
+				{
+					FileStream clipFile = TestFiles.NewTempFile();
+					var clipChapters = new ChapterInfo();
+					clipChapters.AddChapter("Clip", TimeSpan.FromMinutes(1));
+					await Aax.ConvertToMp4aAsync(clipFile, new AacEncodingOptions { BitRate = 30000, Stereo = false, SampleRate = SampleRate.Hz_16000, ResampleQuality = quality }, clipChapters);
+					clipFile.Close();
 
-				TestFiles.CloseAllFiles();
-				Aax.InputStream.Close();
+					var clip = new Mp4File(clipFile.Name);
+					List<float> samples = new();
+					await foreach (var block in clip.ReadPcmAsync<float>())
+						samples.AddRange(block.Span);
+					clip.InputStream.Close();
+					return samples.ToArray();
+				}
+				float[] fastClip = await encodeClip(ResampleQuality.Fast);
+				float[] defaultClip = await encodeClip(ResampleQuality.Default);
+				Assert.IsGreaterThan(0, fastClip.Length);
+				Assert.IsFalse(fastClip.AsSpan().SequenceEqual(defaultClip), "Fast and default resampling produced the same audio.");
 			}
 			finally
 			{
 				TestFiles.CloseAllFiles();
-				aaxFile.InputStream.Close();
+				Aax.InputStream.Close();
 			}
 		}
-
 		[TestMethod]
-		public async Task _7_TestCancelMultiMp3()
+		public async Task _4_ConvertMp4ReencodeSingleNativeRate()
 		{
-			var aaxFile = Aax;
 			try
 			{
 				FileStream tempfile = TestFiles.NewTempFile();
-
-				void NewSplit(INewSplitCallback callback)
+				var options = new AacEncodingOptions
 				{
-					callback.OutputFile = TestFiles.NewTempFile();
-				}
-
-				var convertTask = aaxFile.ConvertToMultiMp3Async(Aax.GetChaptersFromMetadata(), NewSplit);
-				convertTask.Start();
-				await Task.Delay(100);
-				await convertTask.CancelAsync();
-
-				await convertTask;
-				Assert.IsTrue(convertTask.IsCanceled);
+					BitRate = 64000,
+					Stereo = true,
+					SampleRate = Aax.SampleRate
+				};
+				var (decoded, resampled) = await CountDecodedFramesAsync(async () => await Aax.ConvertToMp4aAsync(tempfile, options));
+				tempfile.Close();
 
+				//Without resampling, the transcoder stages every decoded frame for the encoder unchanged.
+				Assert.IsGreaterThan(0, decoded);
+				Assert.AreEqual(0L, resampled, "Frames already at the output rate and layout went through the resampler.");
+				AssertMatchesSourceDuration(tempfile.Name, (int)Aax.SampleRate);
+			}
+			finally
+			{
 				TestFiles.CloseAllFiles();
 				Aax.InputStream.Close();
 			}
+		}
+		[TestMethod]
+		public async Task _4_ConvertMp4StreamCopy()
+		{
+			try
+			{
+				FileStream tempfile = TestFiles.NewTempFile();
+				await Aax.ConvertToMp4aAsync(tempfile, new AacEncodingOptions { Stereo = true, AllowStreamCopy = true });
+
+				//Copied frames keep the source's timing exactly.
+				var copied = new Mp4File(tempfile.Name);
+				Assert.AreEqual(Aax.Duration, copied.Duration);
+				copied.InputStream.Close();
+			}
 			finally
 			{
 				TestFiles.CloseAllFiles();
-				aaxFile.InputStream.Close();
+				Aax.InputStream.Close();
+			}
+		}
+		[TestMethod]
+		public async Task _4_DecodeOnceMultipleOutputs()
+		{
+			try
+			{
+				FileStream mp3file = TestFiles.NewTempFile();
+				FileStream mp4file = TestFiles.NewTempFile();
+				var outputs = new DecodeOnceOutputs
+				{
+					Mp3Output = mp3file,
+					LameConfig = new NAudio.Lame.LameConfig { Preset = NAudio.Lame.LAMEPreset.STANDARD_FAST, Mode = NAudio.Lame.MPEGMode.Mono },
+					Mp4aOutput = mp4file,
+					AacOptions = new AacEncodingOptions { BitRate = 64000, Stereo = true, SampleRate = Aax.SampleRate },
+					SilenceProfiles = [(SilenceThreshold, SilenceDuration)]
+				};
+				List<SilenceEntry>[]? results = await Aax.DecodeOnceAsync(outputs);
+
+				//At the source's own format, the shared decode finds the same silences as a separate pass.
+				Assert.IsNotNull(results);
+				Assert.AreEqual(SilenceTimes.Count, results[0].Count);
+				for (int i = 0; i < results[0].Count; i++)
+				{
+					Assert.AreEqual(SilenceTimes[i].start, results[0][i].SilenceStart);
+					Assert.AreEqual(SilenceTimes[i].end, results[0][i].SilenceEnd);
+				}
+
+				Assert.IsGreaterThan(0, new FileInfo(mp3file.Name).Length);
+				AssertMatchesSourceDuration(mp4file.Name, (int)Aax.SampleRate);
+			}
+			finally
+			{
+				TestFiles.CloseAllFiles();
+				Aax.InputStream.Close();
+			}
+		}
+		[TestMethod]
+		public async Task _4_ConvertMp4NormalizeLoudness()
+		{
+			try
+			{
+				LoudnessInfo? source = await Aax.MeasureLoudnessAsync(stereo: false);
+				Assert.IsNotNull(source);
+				Assert.IsTrue(double.IsFinite(source.IntegratedLoudness));
+				Assert.IsTrue(source.TruePeak >= source.SamplePeak);
+
+				double gain = source.GetNormalizationGain(-20);
+				Assert.IsTrue(source.TruePeak + gain <= -1 + 1e-9);
+
+				FileStream tempfile = TestFiles.NewTempFile();
+				var options = new AacEncodingOptions
+				{
+					BitRate = 64000,
+					Stereo = false,
+					SampleRate = Aax.SampleRate,
+					GainDecibels = gain
+				};
+				await Aax.ConvertToMp4aAsync(tempfile, options);
+
+				//Encoding changes the level by a small fraction of a dB.
+				var encoded = new Mp4File(tempfile.Name);
+				LoudnessInfo? normalized = await encoded.MeasureLoudnessAsync();
+				encoded.InputStream.Close();
+
+				Assert.IsNotNull(normalized);
+				Assert.AreEqual(source.IntegratedLoudness + gain, normalized.IntegratedLoudness, 0.5);
+			}
+			finally
+			{
+				TestFiles.CloseAllFiles();
+				Aax.InputStream.Close();
+			}
+		}
+		[TestMethod]
+		public async Task _4_GenerateWaveform()
+		{
+			try
+			{
+				FileStream tempfile = TestFiles.NewTempFile();
+				string path = tempfile.Name;
+				await Aax.GenerateWaveformAsync(tempfile, samplesPerPeak: 256, levelCount: 4, levelScale: 4);
+
+				using var peaks = WaveformPeaks.Open(path);
+				Assert.AreEqual((int)Aax.SampleRate, peaks.SampleRate);
+				Assert.AreEqual(4, peaks.Levels.Count);
+				Assert.AreEqual(Aax.Duration.TotalSeconds, peaks.Duration.TotalSeconds, 0.1);
+
+				for (int i = 1; i < peaks.Levels.Count; i++)
+				{
+					var finer = peaks.Levels[i - 1];
+					var coarser = peaks.Levels[i];
+					Assert.AreEqual(finer.SamplesPerPeak * 4, coarser.SamplesPerPeak);
+					Assert.AreEqual((finer.PeakCount + 3) / 4, coarser.PeakCount);
+				}
+
+				//A coarse peak spans exactly the finer peaks it was built from.
+				var start = 600.1 * peaks.Levels[2].PeakDuration;
+				var end = 600.9 * peaks.Levels[2].PeakDuration;
+				var fine = peaks.GetPeaks(1, start, end);
+				var coarse = peaks.GetPeaks(2, start, end);
+				Assert.AreEqual(4, fine.Length);
+				Assert.AreEqual(1, coarse.Length);
+				Assert.AreEqual(fine.Min(p => p.Min), coarse[0].Min);
+				Assert.AreEqual(fine.Max(p => p.Max), coarse[0].Max);
+				Assert.IsTrue(coarse[0].Rms <= Math.Max(-coarse[0].Min, coarse[0].Max));
+
+				var overview = peaks.GetPeaks(TimeSpan.Zero, TimeSpan.MaxValue, 2000);
+				Assert.IsTrue(overview.Length <= 2000 || overview.Length == peaks.Levels[^1].PeakCount);
+			}
+			finally
+			{
+				TestFiles.CloseAllFiles();
+				Aax.InputStream.Close();
+			}
+		}
+		[TestMethod]
+		public async Task _4_ReadPcmStream()
+		{
+			try
+			{
+				long samples = 0;
+				await foreach (var block in Aax.ReadPcmAsync<float>(SampleRate.Hz_16000, stereo: false))
+				{
+					Assert.IsTrue(block.Length > 0);
+					samples += block.Length;
+				}
+				Assert.AreEqual(Aax.Duration.TotalSeconds * 16000, samples, 2 * 1024);
+
+				//Stopping early cancels decoding and recycles every lent block.
+				int blocks = 0;
+				await foreach (var block in Aax.ReadPlanarPcmAsync(stereo: true))
+				{
+					Assert.AreEqual(block.SampleCount, block.Channel0.Length);
+					Assert.AreEqual(block.SampleCount, block.Channel1.Length);
+					if (++blocks == 10) break;
+				}
+				Assert.AreEqual(10, blocks);
+				Assert.AreEqual(0, PcmMemory.BytesInUse);
+			}
+			finally
+			{
+				Aax.InputStream.Close();
+			}
+		}
+		[TestMethod]
+		public async Task _5_BatchProcess()
+		{
+			var splitSource = new AaxFile(File.Open(AaxFile, FileMode.Open, FileAccess.Read, FileShare.Read));
+			try
+			{
+				splitSource.SetDecryptionKey(new byte[16], new byte[16]);
+
+				List<SilenceEntry> silences = null;
+				int splitFiles = 0;
+				void NewSplit(NewMP3SplitCallback callback)
+				{
+					callback.OutputFile = TestFiles.NewTempFile();
+					splitFiles++;
+				}
+
+				var jobs = new[]
+				{
+					BatchJob.DetectSilence(Aax, SilenceThreshold, SilenceDuration, s => silences = s),
+					BatchJob.ConvertToMultiMp3(splitSource, splitSource.GetChaptersFromMetadata(), NewSplit, new NAudio.Lame.LameConfig { Preset = NAudio.Lame.LAMEPreset.STANDARD_FAST, Mode = NAudio.Lame.MPEGMode.Mono })
+				};
+				jobs[0].Name = "silence";
+				jobs[1].Name = "split";
+
+				List<BatchJobResult> completed = new();
+				var batch = await new BatchProcessor(maxCores: 4).RunAsync(jobs, completed.Add);
+
+				Assert.AreEqual(0, batch.FailedCount, string.Join(", ", batch.Jobs.Select(j => j.Error?.Message)));
+				CollectionAssert.AreEquivalent(jobs, batch.Jobs.Select(j => j.Job).ToArray());
+				CollectionAssert.AreEqual(completed, batch.Jobs.ToArray());
+				Assert.IsTrue(batch.Jobs.All(j => j.Cores >= 1 && j.RealtimeFactor > 0));
+				Assert.IsTrue(batch.Jobs.Sum(j => j.Cores) <= 4);
+				Assert.AreEqual(jobs[0].AudioDuration + jobs[1].AudioDuration, batch.AudioDuration);
+				Assert.IsTrue(batch.RealtimeFactor > 0);
+
+				Assert.IsNotNull(silences);
+				Assert.AreEqual(SilenceTimes.Count, silences.Count);
+				Assert.AreEqual(ChapterCount, splitFiles);
+			}
+			finally
+			{
+				TestFiles.CloseAllFiles();
+				splitSource.InputStream.Close();
+				Aax.InputStream.Close();
+			}
+		}
+		[TestMethod]
+		public async Task _5_ConvertMp4ReencodeMultiple()
+		{
+			try
+			{
+				List<string> tempFiles = new();
+				void NewSplit(INewSplitCallback callback)
+				{
+					callback.OutputFile = TestFiles.NewTempFile();
+					tempFiles.Add(((FileStream)callback.OutputFile).Name);
+				}
+
+				await Aax.ConvertToMultiMp4aAsync(Aax.GetChaptersFromMetadata(), NewSplit, new AacEncodingOptions { BitRate = 30000, EncoderQuality = 0.6, Stereo = false, SampleRate = SampleRate.Hz_16000 });
+				Assert.HasCount(ChapterCount, tempFiles);
+			}
+			finally
+			{
+				TestFiles.CloseAllFiles();
+				Aax.InputStream.Close();
+			}
+		}
+		[TestMethod]
+		public async Task _5_ConvertMp4ReencodeMultipleFinalBatch()
+		{
+			try
+			{
+				//The decoder still has a batch of frames queued when the input ends, so the last
+				//chapter boundary falls inside the audio it emits at the end.
+				var lastChapter = TimeSpan.FromSeconds(0.5);
+				var chapters = new ChapterInfo(Aax.Duration - TimeSpan.FromSeconds(5));
+				chapters.AddChapter("First", TimeSpan.FromSeconds(5) - lastChapter);
+				chapters.AddChapter("Last", lastChapter);
+
+				List<string> tempFiles = new();
+				void NewSplit(INewSplitCallback callback)
+				{
+					callback.OutputFile = TestFiles.NewTempFile();
+					tempFiles.Add(((FileStream)callback.OutputFile).Name);
+				}
+
+				var options = new AacEncodingOptions { BitRate = 30000, EncoderQuality = 0.6, Stereo = false, SampleRate = SampleRate.Hz_16000 };
+				await Aax.ConvertToMultiMp4aAsync(chapters, NewSplit, options);
+				Assert.HasCount(2, tempFiles);
+				TestFiles.CloseAllFiles();
+
+				//Allow for the source frame the boundary falls in and the encoder's own frames.
+				double tolerance = 3 * 1024d / (int)SampleRate.Hz_16000;
+				var expected = chapters.ToList();
+				for (int i = 0; i < tempFiles.Count; i++)
+				{
+					var chapterFile = new Mp4File(tempFiles[i]);
+					var duration = chapterFile.Duration;
+					chapterFile.InputStream.Close();
+					Assert.IsLessThan(tolerance, Math.Abs((duration - expected[i].Duration).TotalSeconds), $"Chapter {i} lasts {duration} instead of {expected[i].Duration}.");
+				}
+			}
+			finally
+			{
+				TestFiles.CloseAllFiles();
+				Aax.InputStream.Close();
+			}
+		}
+		[TestMethod]
+		public async Task _5_ConvertMp4ReencodeMultipleParallel()
+		{
+			try
+			{
+				var chapters = Aax.GetChaptersFromMetadata();
+				List<string> tempFiles = new();
+				List<TimeSpan> callbackStarts = new();
+				void NewSplit(NewAacSplitCallback callback)
+				{
+					callback.OutputFile = TestFiles.NewTempFile();
+					tempFiles.Add(((FileStream)callback.OutputFile).Name);
+					callbackStarts.Add(callback.Chapter.StartOffset);
+				}
+
+				await Aax.ConvertToMultiMp4aAsync(chapters, NewSplit, new AacEncodingOptions { BitRate = 30000, EncoderQuality = 0.6, Stereo = false, SampleRate = SampleRate.Hz_16000 }, degreeOfParallelism: 4);
+				Assert.HasCount(ChapterCount, tempFiles);
+				CollectionAssert.AreEqual(chapters.Select(c => c.StartOffset).ToList(), callbackStarts);
+			}
+			finally
+			{
+				TestFiles.CloseAllFiles();
+				Aax.InputStream.Close();
+			}
+		}
+		[TestMethod]
+		public async Task _5_ConvertMp4StreamCopyMultiple()
+		{
+			try
+			{
+				List<string> tempFiles = new();
+				void NewSplit(NewAacSplitCallback callback)
+				{
+					callback.OutputFile = TestFiles.NewTempFile();
+					tempFiles.Add(((FileStream)callback.OutputFile).Name);
+				}
+
+				await Aax.ConvertToMultiMp4aAsync(Aax.GetChaptersFromMetadata(), NewSplit, new AacEncodingOptions { Stereo = true, AllowStreamCopy = true });
+				Assert.HasCount(ChapterCount, tempFiles);
+
+				//Chapters are split on frame boundaries, and the edit list hides the splice encoder's priming,
+				//so neither a chapter's length nor its start may be off by more than a frame.
+				TestFiles.CloseAllFiles();
+				double oneFrame = 1024d / (int)Aax.SampleRate + 0.001;
+				var chapters = Aax.GetChaptersFromMetadata().ToList();
+				double start = 0;
+				for (int i = 0; i < chapters.Count; i++)
+				{
+					double duration = GetPresentationSeconds(tempFiles[i]);
+					Assert.IsLessThan(oneFrame, Math.Abs(duration - chapters[i].Duration.TotalSeconds), $"Chapter {i} lasts {duration}s instead of {chapters[i].Duration.TotalSeconds}s.");
+					Assert.IsLessThan(oneFrame, Math.Abs(start - chapters[i].StartOffset.TotalSeconds), $"Chapter {i} starts at {start}s instead of {chapters[i].StartOffset.TotalSeconds}s.");
+					start += duration;
+				}
+			}
+			finally
+			{
+				TestFiles.CloseAllFiles();
+				Aax.InputStream.Close();
+			}
+		}
+
+		/// <summary>
+		/// Length of a file's audio as a player presents it: its edit's duration if the audio track
+		/// has an edit list, or else the length of its media.
+		/// </summary>
+		private static double GetPresentationSeconds(string file)
+		{
+			byte[] data = File.ReadAllBytes(file);
+			uint be32(int offset) => BinaryPrimitives.ReadUInt32BigEndian(data.AsSpan(offset));
+			ulong be64(int offset) => BinaryPrimitives.ReadUInt64BigEndian(data.AsSpan(offset));
+			//Timescale and duration of a full box, at their offsets for its version.
+			(double timescale, double duration) times(int box, int v0, int v1)
+				=> data[box + 8] == 1 ? (be32(box + v1), be64(box + v1 + 4)) : (be32(box + v0), be32(box + v0 + 4));
+			IEnumerable<int> children(int start, int end)
+			{
+				for (int box = start; box + 8 <= end && be32(box) >= 8; box += (int)be32(box))
+					yield return box;
+			}
+			int child(int parent, string type)
+				=> children(parent + 8, parent + (int)be32(parent)).FirstOrDefault(b => Encoding.ASCII.GetString(data, b + 4, 4) == type, -1);
+
+			int moov = children(0, data.Length).Single(b => Encoding.ASCII.GetString(data, b + 4, 4) == "moov");
+			var movieTimescale = times(child(moov, "mvhd"), 20, 28).timescale;
+			foreach (int trak in children(moov + 8, moov + (int)be32(moov)))
+			{
+				int mdia = child(trak, "mdia");
+				if (mdia < 0 || Encoding.ASCII.GetString(data, child(mdia, "hdlr") + 16, 4) != "soun")
+					continue;
+
+				int edts = child(trak, "edts");
+				if (edts < 0)
+				{
+					var media = times(child(mdia, "mdhd"), 20, 28);
+					return media.duration / media.timescale;
+				}
+				int elst = child(edts, "elst");
+				Assert.AreEqual(1u, be32(elst + 12), "Expected a single edit.");
+				return (data[elst + 8] == 1 ? be64(elst + 16) : be32(elst + 16)) / movieTimescale;
+			}
+			throw new InvalidDataException($"{file} has no audio track.");
+		}
+		[TestMethod]
+		public async Task _5_ExtractClips()
+		{
+			try
+			{
+				var clips = new (TimeSpan start, TimeSpan end)[]
+				{
+					(TimeSpan.FromSeconds(10.3), TimeSpan.FromSeconds(14.3)),
+					(TimeSpan.FromSeconds(2.1), TimeSpan.FromSeconds(4.1)),
+				};
+				var files = new string[clips.Length];
+				Stream createOutput(int index)
+				{
+					var file = TestFiles.NewTempFile();
+					files[index] = file.Name;
+					return file;
+				}
+
+				await Aax.ExtractClipsAsync(clips, createOutput, new NAudio.Lame.LameConfig { BitRate = 64, Mode = NAudio.Lame.MPEGMode.Mono }, degreeOfParallelism: 2);
+
+				//At a constant bitrate, the longer clip is larger by two seconds of audio, give or take a few MP3 frames.
+				long sizeDifference = new FileInfo(files[0]).Length - new FileInfo(files[1]).Length;
+				Assert.AreEqual(2 * 64000 / 8d, sizeDifference, 1000d);
+			}
+			finally
+			{
+				TestFiles.CloseAllFiles();
+				Aax.InputStream.Close();
+			}
+		}
+		[TestMethod]
+		public async Task _6_TestCancelSingleMp3()
+		{
+			var aaxFile = Aax;
+			try
+			{
+				FileStream tempfile = TestFiles.NewTempFile();
+
+				var convertTask = aaxFile.ConvertToMp3Async(tempfile);
+				convertTask.Start();
+
+				await Task.Delay(100);
+				await convertTask.CancelAsync();
+				await convertTask;
+				Assert.IsTrue(convertTask.IsCanceled);
+
+				TestFiles.CloseAllFiles();
+				Aax.InputStream.Close();
+			}
+			finally
+			{
+				TestFiles.CloseAllFiles();
+				aaxFile.InputStream.Close();
+			}
+		}
+
+		[TestMethod]
+		public async Task _7_TestCancelMultiMp3()
+		{
+			var aaxFile = Aax;
+			try
+			{
+				FileStream tempfile = TestFiles.NewTempFile();
+
+				void NewSplit(INewSplitCallback callback)
+				{
+					callback.OutputFile = TestFiles.NewTempFile();
+				}
+
+				var convertTask = aaxFile.ConvertToMultiMp3Async(Aax.GetChaptersFromMetadata(), NewSplit);
+				convertTask.Start();
+				await Task.Delay(100);
+				await convertTask.CancelAsync();
+
+				await convertTask;
+				Assert.IsTrue(convertTask.IsCanceled);
+
+				TestFiles.CloseAllFiles();
+				Aax.InputStream.Close();
+			}
+			finally
+			{
+				TestFiles.CloseAllFiles();
+				aaxFile.InputStream.Close();
+			}
+		}
+
+		[TestMethod]
+		public async Task _7_ChapterEncoderFailure()
+		{
+			const int frameCount = 8;
+			var pool = new PcmBufferPool(4096);
+			var rented = Enumerable.Range(0, frameCount).Select(_ => pool.Rent()).ToList();
+			var encoder = new FailingChapterEncoder(failAtFrame: 2);
+
+			using (var encoderPool = new ChapterEncoderPool(2))
+			{
+				var job = encoderPool.StartChapter(() => encoder);
+				foreach (var buffer in rented)
+				{
+					var entry = new WaveEntry { FrameData = buffer.Data, Buffer = buffer };
+					try { job.Add(entry); }
+					catch (AggregateException) { entry.Release(); }
+				}
+				job.Complete();
+				await Assert.ThrowsExactlyAsync<AggregateException>(encoderPool.WhenAllAsync);
+			}
+
+			Assert.IsTrue(encoder.Aborted, "A failed chapter must be aborted.");
+			Assert.IsFalse(encoder.Closed, "A failed chapter must not be finalized.");
+
+			//Every frame, including the one that failed to encode, was returned to the pool.
+			var rentedAgain = Enumerable.Range(0, frameCount).Select(_ => pool.Rent()).ToList();
+			Assert.AreEqual(frameCount, rentedAgain.Count(rented.Contains));
+		}
+
+		private sealed class FailingChapterEncoder : IChapterEncoder
+		{
+			public bool Closed { get; private set; }
+			public bool Aborted { get; private set; }
+			private readonly int FailAtFrame;
+			private int FramesWritten;
+
+			public FailingChapterEncoder(int failAtFrame) => FailAtFrame = failAtFrame;
+
+			public void Write(WaveEntry audioFrame)
+			{
+				try
+				{
+					if (FramesWritten++ == FailAtFrame)
+						throw new InvalidOperationException("Encoder failure");
+				}
+				finally
+				{
+					audioFrame.Release();
+				}
+			}
+
+			public void Close() => Closed = true;
+			public void Abort() => Aborted = true;
+		}
+
+		[TestMethod]
+		public async Task _8_DecodeSteadyStateAllocations()
+		{
+			try
+			{
+				//The first run fills the decoder and buffer pools, so only the second is measured.
+				await Aax.DetectSilenceAsync(SilenceThreshold, SilenceDuration);
+
+				long allocatedBefore = GC.GetTotalAllocatedBytes(precise: true);
+				await Aax.DetectSilenceAsync(SilenceThreshold, SilenceDuration);
+				long allocated = GC.GetTotalAllocatedBytes(precise: true) - allocatedBefore;
+
+				double frameCount = Aax.Duration.TotalSeconds * (int)Aax.SampleRate / 1024;
+				double decodedBytesPerFrame = 1024 * sizeof(short) * Aax.AudioChannels;
+				double compressedBytesPerFrame = new FileInfo(AaxFile).Length / frameCount;
+				double allocatedPerFrame = allocated / frameCount;
+
+				//Decoded audio is rented from a warm pool, so the only per-frame allocations
+				//are a few bookkeeping objects and at most the compressed input.
+				const int bookkeepingBytesPerFrame = 256;
+				Assert.IsTrue(
+					allocatedPerFrame < compressedBytesPerFrame + bookkeepingBytesPerFrame,
+					$"Allocated {allocatedPerFrame:F0} bytes per frame while decoding {decodedBytesPerFrame} bytes per frame.");
+			}
+			finally
+			{
+				Aax.InputStream.Close();
+			}
+		}
+
+		[TestMethod]
+		public void _8_PcmBufferPoolRetention()
+		{
+			var pool = new PcmBufferPool(1024 * 1024);
+			var rented = Enumerable.Range(0, pool.MaxRetained + 4).Select(_ => pool.Rent()).ToList();
+			foreach (var buffer in rented)
+				buffer.Release();
+
+			//Buffers returned beyond the cap are dropped rather than kept for reuse.
+			var rentedAgain = Enumerable.Range(0, rented.Count).Select(_ => pool.Rent()).ToList();
+			Assert.AreEqual(pool.MaxRetained, rentedAgain.Count(rented.Contains));
+		}
+
+		[TestMethod]
+		public async Task _9_CodecMetrics()
+		{
+			Dictionary<string, double> totals = new();
+			using MeterListener listener = new();
+			listener.InstrumentPublished = (instrument, l) =>
+			{
+				if (instrument.Meter.Name == CodecMetrics.MeterName)
+					l.EnableMeasurementEvents(instrument);
+			};
+			void record(Instrument instrument, double value, ReadOnlySpan<KeyValuePair<string, object>> tags)
+			{
+				string key = instrument.Name;
+				foreach (var tag in tags)
+					key += $";{tag.Value}";
+				lock (totals)
+					totals[key] = totals.GetValueOrDefault(key) + value;
+			}
+			listener.SetMeasurementEventCallback<long>((i, v, t, _) => record(i, v, t));
+			listener.SetMeasurementEventCallback<double>((i, v, t, _) => record(i, v, t));
+			listener.Start();
+
+			try
+			{
+				await Aax.DetectSilenceAsync(SilenceThreshold, SilenceDuration);
+
+				double frameCount = Aax.Duration.TotalSeconds * (int)Aax.SampleRate / 1024;
+				Assert.AreEqual(frameCount, totals.GetValueOrDefault("aaxclean.codec.frames;decode;in"), 2d);
+				Assert.IsTrue(totals.GetValueOrDefault("aaxclean.codec.samples;decode;out") > 0);
+				Assert.IsTrue(totals.GetValueOrDefault("aaxclean.codec.time;decode;receive") > 0);
+				Assert.IsTrue(totals.GetValueOrDefault("aaxclean.filter.time;AacToWave") > 0);
+				Assert.IsTrue(totals.GetValueOrDefault("aaxclean.filter.time;SilenceDetectFilter") > 0);
+				Assert.AreEqual(0, totals.GetValueOrDefault("aaxclean.filter.queue_depth;AacToWave"));
+			}
+			finally
+			{
+				Aax.InputStream.Close();
+			}
+		}
+
+		[TestMethod]
+		public void _9_CoalescingWriteStream()
+		{
+			var random = new Random(3);
+			using var destination = new MemoryStream();
+			var expected = new MemoryStream();
+
+			//Start unaligned so the first block is shorter than BLOCK_SIZE.
+			byte[] header = new byte[1000];
+			random.NextBytes(header);
+			destination.Write(header);
+			expected.Write(header);
+
+			using (var stream = new CoalescingWriteStream(destination, default, leaveOpen: true))
+			{
+				void write(int count)
+				{
+					byte[] data = new byte[count];
+					random.NextBytes(data);
+					stream.Write(data);
+					expected.Write(data);
+				}
+
+				//Small writes spanning several swaps of the two blocks.
+				while (expected.Length < 3 * CoalescingWriteStream.BLOCK_SIZE + 12345)
+					write(random.Next(1, 5000));
+
+				//Reading the length writes everything buffered.
+				Assert.AreEqual(expected.Length, stream.Length);
+				Assert.AreEqual(expected.Length, destination.Length);
+
+				//Patch the header the way the Mp4aWriter and LAME tag writers do, then carry on at the end.
+				byte[] patch = [1, 2, 3, 4];
+				stream.Position = 10;
+				stream.Write(patch);
+				expected.Position = 10;
+				expected.Write(patch);
+				Assert.AreEqual(14, stream.Position);
+
+				stream.Seek(0, SeekOrigin.End);
+				expected.Seek(0, SeekOrigin.End);
+				write(CoalescingWriteStream.BLOCK_SIZE + 7);
+				write(100);
+			}
+
+			CollectionAssert.AreEqual(expected.ToArray(), destination.ToArray());
+		}
+
+		[TestMethod]
+		public void _9_CoalescingWriteStreamIoWait()
+		{
+			double ioWait = 0;
+			using MeterListener listener = new();
+			listener.InstrumentPublished = (instrument, l) =>
+			{
+				if (instrument.Meter.Name == CodecMetrics.MeterName && instrument.Name == "aaxclean.filter.io_wait")
+					l.EnableMeasurementEvents(instrument);
+			};
+			listener.SetMeasurementEventCallback<double>((_, v, _, _) => ioWait += v);
+			listener.Start();
+
+			var writeDelay = TimeSpan.FromMilliseconds(100);
+			using var destination = new SlowWriteStream(writeDelay);
+			using (var stream = new CoalescingWriteStream(destination, CodecMetrics.FilterTag("test"), leaveOpen: true))
+			{
+				//The third block can only be submitted once the first has been written.
+				stream.Write(new byte[3 * CoalescingWriteStream.BLOCK_SIZE]);
+				Assert.IsGreaterThan(writeDelay.TotalSeconds / 2, ioWait);
+			}
+			Assert.AreEqual(3L * CoalescingWriteStream.BLOCK_SIZE, destination.Length);
+		}
+
+		[TestMethod]
+		public void _9_Mp3FilterDisposeClosesOutput()
+		{
+			var output = new SlowWriteStream(TimeSpan.FromMilliseconds(100));
+			var waveFormat = new WaveFormat(SampleRate.Hz_22050, WaveFormatEncoding.Pcm, stereo: false);
+			var filter = new WaveToMp3Filter(output, waveFormat, new NAudio.Lame.LameConfig { Preset = NAudio.Lame.LAMEPreset.STANDARD_FAST });
+
+			//Disposing without flushing, as a cancelled conversion does, still waits for and closes the output.
+			filter.Dispose();
+			Assert.IsFalse(output.CanWrite);
+		}
+
+		private sealed class SlowWriteStream : MemoryStream
+		{
+			private readonly TimeSpan WriteDelay;
+			public SlowWriteStream(TimeSpan writeDelay) => WriteDelay = writeDelay;
+
+			public override async ValueTask WriteAsync(ReadOnlyMemory<byte> buffer, CancellationToken cancellationToken = default)
+			{
+				await Task.Delay(WriteDelay, cancellationToken);
+				Write(buffer.Span);
+			}
+		}
+
+		[TestMethod]
+		public async Task _9_PcmMemoryLimit()
+		{
+			long pipelineLimit = PcmMemory.PipelineLimit;
+			try
+			{
+				//Far below one decode batch, so the decoder waits on the silence detector throughout.
+				PcmMemory.PipelineLimit = 16 * 1024;
+				List<SilenceEntry>[]? results = await Aax.DetectSilenceAsync([(SilenceThreshold, SilenceDuration)]);
+
+				Assert.AreEqual(SilenceTimes.Count, results!.Single().Count);
+				for (int i = 0; i < SilenceTimes.Count; i++)
+				{
+					Assert.AreEqual(SilenceTimes[i].start, results[0][i].SilenceStart);
+					Assert.AreEqual(SilenceTimes[i].end, results[0][i].SilenceEnd);
+				}
+				Assert.AreEqual(0L, PcmMemory.BytesInUse);
+			}
+			finally
+			{
+				PcmMemory.PipelineLimit = pipelineLimit;
+				Aax.InputStream.Close();
+			}
+		}
+
+		[TestMethod]
+		public async Task _9_NativeLogging()
+		{
+			List<(LogLevel level, string message)> messages = new();
+			void logged(LogLevel level, string message)
+			{
+				lock (messages)
+					messages.Add((level, message));
+			}
+
+			NativeLogging.MessageLogged += logged;
+			try
+			{
+				await Aax.DetectSilenceAsync(SilenceThreshold, SilenceDuration);
+				NativeLogging.Flush();
+
+				lock (messages)
+					Assert.IsFalse(messages.Any(m => m.level <= LogLevel.Error), string.Join("", messages.Select(m => m.message)));
+			}
+			finally
+			{
+				NativeLogging.MessageLogged -= logged;
+				Aax.InputStream.Close();
+			}
+		}
+
+		[TestMethod]
+		public unsafe void _9_NativeLoggingFlood()
+		{
+			//Native LOG_CLASS_COUNT and LOG_RATE_LIMIT.
+			const int logClasses = 64;
+			const int rateLimit = 20;
+			const int floodPackets = 20000;
+
+			List<(LogLevel level, string message)> messages = new();
+			void logged(LogLevel level, string message)
+			{
+				lock (messages)
+					messages.Add((level, message));
+			}
+
+			bool hasSummaries()
+			{
+				lock (messages)
+					return messages.Any(m => m.message.StartsWith("Last message repeated"))
+						&& messages.Any(m => m.message.StartsWith("Suppressed") || m.message.StartsWith("Dropped"));
+			}
+
+			NativeLogging.MessageLogged += logged;
+			try
+			{
+				var waveFormat = FfmpegAacDecoder.GetNativeWaveFormat(Aax.AudioSampleEntry, WaveFormatEncoding.Pcm);
+				using var decoder = new NativeAacDecode(Aax.AudioSampleEntry.Esds!, waveFormat, ResampleQuality.Default);
+				var random = new Random(1);
+				byte[] packet = new byte[256];
+				var stopwatch = Stopwatch.StartNew();
+
+				fixed (byte* pPacket = packet)
+				{
+					//Sending the same corrupt packet over and over logs identical messages, which are coalesced.
+					for (int i = 0; i < 20; i++)
+					{
+						random.NextBytes(packet);
+						for (int repeat = 0; repeat < 50; repeat++)
+							decoder.DecodeFrame(pPacket, packet.Length);
+					}
+
+					//Different corrupt packets log messages that differ only in their details, which are rate limited.
+					for (int i = 0; i < floodPackets; i++)
+					{
+						random.NextBytes(packet);
+						decoder.DecodeFrame(pPacket, packet.Length);
+					}
+				}
+				var floodTime = stopwatch.Elapsed;
+
+				//A class is summarized at most once a second, so its last summary may lag the flood.
+				NativeLogging.Flush();
+				while (!hasSummaries() && stopwatch.Elapsed < floodTime + TimeSpan.FromSeconds(3))
+				{
+					Thread.Sleep(100);
+					NativeLogging.Flush();
+				}
+
+				Assert.IsTrue(hasSummaries(), "Expected repeat and suppression summaries after a flood of corrupt packets.");
+
+				//Each class passes at most rateLimit messages per one second window, plus its two summaries.
+				int windows = (int)Math.Ceiling(stopwatch.Elapsed.TotalSeconds) + 1;
+				lock (messages)
+					Assert.IsLessThan(logClasses * (rateLimit + 2) * windows + 1, messages.Count, $"{messages.Count} messages logged for {floodPackets} corrupt packets.");
+			}
+			finally
+			{
+				NativeLogging.MessageLogged -= logged;
+				Aax.InputStream.Close();
+			}
+		}
+
+		[TestMethod]
+		public unsafe void _9_NativeLoggingHandlerThrows()
+		{
+			int calls = 0;
+			void logged(LogLevel level, string message)
+			{
+				Interlocked.Increment(ref calls);
+				throw new InvalidOperationException("Handler failure");
+			}
+
+			NativeLogging.MessageLogged += logged;
+			try
+			{
+				var waveFormat = FfmpegAacDecoder.GetNativeWaveFormat(Aax.AudioSampleEntry, WaveFormatEncoding.Pcm);
+				using var decoder = new NativeAacDecode(Aax.AudioSampleEntry.Esds!, waveFormat, ResampleQuality.Default);
+				var random = new Random(2);
+				byte[] packet = new byte[256];
+
+				bool logUntilHandled(int handledCalls)
+				{
+					var stopwatch = Stopwatch.StartNew();
+					fixed (byte* pPacket = packet)
+					{
+						while (Volatile.Read(ref calls) <= handledCalls && stopwatch.Elapsed < TimeSpan.FromSeconds(5))
+						{
+							random.NextBytes(packet);
+							decoder.DecodeFrame(pPacket, packet.Length);
+							Thread.Sleep(10);
+						}
+					}
+					return Volatile.Read(ref calls) > handledCalls;
+				}
+
+				//The background drain must survive a throwing handler and keep raising later messages.
+				Assert.IsTrue(logUntilHandled(0), "Background drain never raised a message.");
+				int firstCalls = Volatile.Read(ref calls);
+				Assert.IsTrue(logUntilHandled(firstCalls), "Background drain stopped after a handler threw.");
+			}
+			finally
+			{
+				NativeLogging.MessageLogged -= logged;
+				Aax.InputStream.Close();
 			}
 		}
 	}